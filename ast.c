@@ -1,6 +1,7 @@
 /* ast.c */
 
 #include "ast.h"
+#include "closure.h"
 #include "lib/mem.h"
 #include <stdbool.h>
 #include <math.h>
@@ -9,21 +10,17 @@
 #include <stdint.h>
 #include <stdio.h>
 
-JumpBuffer *jump_buffer = {0};
 
-Function *function_table = NULL;
-ReturnValue current_return_value;
-Arena arena;
+_Thread_local BrainrotVM *brainrot;
 
-TypeModifiers current_modifiers = {false, false, false, false, false};
-extern VarType current_var_type;
-
-Scope *current_scope;
+/* Case labels for the specialized int operations, which every type query
+ * and evaluator handles */
+#define INT_INT_CASE(NODE, OP) case NODE:
 
 // Symbol table functions
-bool set_variable(const char *name, void *value, VarType type, TypeModifiers mods)
+bool set_variable(ASTNode *target, void *value, VarType type, TypeModifiers mods)
 {
-    Variable *var = get_variable(name);
+    Variable *var = lookup_variable(target);
     if (var != NULL)
     {
 
@@ -57,14 +54,14 @@ bool set_variable(const char *name, void *value, VarType type, TypeModifiers mod
     return false; // Symbol table is full
 }
 
-bool set_int_variable(const char *name, int value, TypeModifiers mods)
+bool set_int_variable(ASTNode *target, int value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_INT, mods);
+    return set_variable(target, &value, VAR_INT, mods);
 }
 
-bool set_char_variable(const char *name, int value, TypeModifiers mods)
+bool set_char_variable(ASTNode *target, int value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_CHAR, mods);
+    return set_variable(target, &value, VAR_CHAR, mods);
 }
 
 bool set_array_variable(char *name, int length, TypeModifiers mods, VarType type)
@@ -123,44 +120,43 @@ bool set_array_variable(char *name, int length, TypeModifiers mods, VarType type
     return false; // no space
 }
 
-bool set_short_variable(const char *name, short value, TypeModifiers mods)
+bool set_short_variable(ASTNode *target, short value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_SHORT, mods);
+    return set_variable(target, &value, VAR_SHORT, mods);
 }
 
-bool set_float_variable(const char *name, float value, TypeModifiers mods)
+bool set_float_variable(ASTNode *target, float value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_FLOAT, mods);
+    return set_variable(target, &value, VAR_FLOAT, mods);
 }
 
-bool set_double_variable(const char *name, double value, TypeModifiers mods)
+bool set_double_variable(ASTNode *target, double value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_DOUBLE, mods);
+    return set_variable(target, &value, VAR_DOUBLE, mods);
 }
 
-bool set_bool_variable(const char *name, bool value, TypeModifiers mods)
+bool set_bool_variable(ASTNode *target, bool value, TypeModifiers mods)
 {
-    return set_variable(name, &value, VAR_BOOL, mods);
+    return set_variable(target, &value, VAR_BOOL, mods);
 }
 
 void reset_modifiers(void)
 {
-    current_modifiers.is_volatile = false;
-    current_modifiers.is_signed = false;
-    current_modifiers.is_unsigned = false;
-    current_modifiers.is_const = false;
+    brainrot->current_modifiers.is_volatile = false;
+    brainrot->current_modifiers.is_signed = false;
+    brainrot->current_modifiers.is_unsigned = false;
+    brainrot->current_modifiers.is_const = false;
 }
 
 TypeModifiers get_current_modifiers(void)
 {
-    TypeModifiers mods = current_modifiers;
+    TypeModifiers mods = brainrot->current_modifiers;
     reset_modifiers(); // Reset for next declaration
     return mods;
 }
 
 /* Include the symbol table functions */
-extern void yyerror(const char *s);
-extern void cleanup(void);
+extern void report_error(const char *s);
 extern void ragequit(int exit_code);
 extern void chill(unsigned int seconds);
 extern void yapping(const char *format, ...);
@@ -172,8 +168,7 @@ extern int slorp_int(int val);
 extern short slorp_short(short val);
 extern float slorp_float(float var);
 extern double slorp_double(double var);
-extern TypeModifiers get_variable_modifiers(const char *name);
-extern int yylineno;
+extern TypeModifiers get_variable_modifiers(ASTNode *node);
 
 /* Function implementations */
 
@@ -185,57 +180,183 @@ bool check_and_mark_identifier(ASTNode *node, const char *contextErrorMessage)
         node->is_valid_symbol = false;
 
         // Do the table lookup
-        Variable *var = get_variable(node->data.name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
             node->is_valid_symbol = true;
 
         if (!node->is_valid_symbol)
         {
-            yylineno = yylineno - 2;
-            yyerror(contextErrorMessage);
+            brainrot->line -= 2;
+            report_error(contextErrorMessage);
         }
     }
 
     return node->is_valid_symbol;
 }
 
-void execute_switch_statement(ASTNode *node)
+/* A bruh ends the switch; grind and bussin belong to an enclosing
+ * loop or function and are passed on. */
+static ControlFlow leave_switch(ControlFlow flow)
+{
+    return flow == FLOW_BREAK ? FLOW_NORMAL : flow;
+}
+
+typedef struct
+{
+    int value;
+    int position;
+    CaseNode *entry;
+} CaseKey;
+
+/* By value, then by position, so the first of equal cases comes first */
+static int compare_case_keys(const void *a, const void *b)
+{
+    const CaseKey *left = a, *right = b;
+    if (left->value != right->value)
+        return left->value < right->value ? -1 : 1;
+    return left->position - right->position;
+}
+
+/* The dispatch table of a switch, or NULL if it should test its cases in
+ * order. */
+CaseTable *build_case_table(ASTNode *node)
+{
+    int count = 0;
+    CaseNode *miss = NULL;
+    for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+    {
+        if (!entry->value)
+        {
+            miss = entry;
+            break;
+        }
+        if (entry->value->type != NODE_INT && entry->value->type != NODE_CHAR)
+            return NULL;
+        count++;
+    }
+    if (count < SWITCH_TABLE_MIN_CASES)
+        return NULL;
+
+    CaseKey *keys = malloc(count * sizeof(CaseKey));
+    if (!keys)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    int n = 0;
+    for (CaseNode *entry = node->data.switch_stmt.cases; entry != miss; entry = entry->next)
+    {
+        keys[n] = (CaseKey){entry->value->data.ivalue, n, entry};
+        n++;
+    }
+    qsort(keys, count, sizeof(CaseKey), compare_case_keys);
+    // A value's first case is the one a match starts at
+    n = 0;
+    for (int k = 0; k < count; k++)
+    {
+        if (n == 0 || keys[n - 1].value != keys[k].value)
+            keys[n++] = keys[k];
+    }
+
+    CaseTable *table = ARENA_ALLOC(CaseTable);
+    table->miss = miss;
+    table->low = keys[0].value;
+    long span = (long)keys[n - 1].value - keys[0].value + 1;
+    if (span <= (long)SWITCH_DENSE_FACTOR * n)
+    {
+        table->keys = NULL;
+        table->count = (int)span;
+        table->entries = ARENA_ALLOC_ARRAY(CaseNode *, span);
+        memset(table->entries, 0, span * sizeof(CaseNode *));
+        for (int k = 0; k < n; k++)
+            table->entries[keys[k].value - table->low] = keys[k].entry;
+    }
+    else
+    {
+        table->count = n;
+        table->keys = ARENA_ALLOC_ARRAY(int, n);
+        table->entries = ARENA_ALLOC_ARRAY(CaseNode *, n);
+        for (int k = 0; k < n; k++)
+        {
+            table->keys[k] = keys[k].value;
+            table->entries[k] = keys[k].entry;
+        }
+    }
+    free(keys);
+    return table;
+}
+
+/* The table slot of a value, or -1 if no case has it */
+int case_table_slot(const CaseTable *table, int value)
+{
+    if (!table->keys)
+    {
+        unsigned offset = (unsigned)value - (unsigned)table->low;
+        return offset < (unsigned)table->count && table->entries[offset] ? (int)offset : -1;
+    }
+    int low = 0, high = table->count - 1;
+    while (low <= high)
+    {
+        int middle = low + (high - low) / 2;
+        if (table->keys[middle] == value)
+            return middle;
+        if (table->keys[middle] < value)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return -1;
+}
+
+/* Runs the cases from `entry` on, falling through, up to and including
+ * `based`. */
+static ControlFlow run_cases(CaseNode *entry)
+{
+    for (; entry; entry = entry->next)
+    {
+        ControlFlow flow = execute_statements(entry->statements);
+        if (flow != FLOW_NORMAL)
+            return leave_switch(flow);
+        if (!entry->value)
+            break;
+    }
+    return FLOW_NORMAL;
+}
+
+ControlFlow execute_switch_statement(ASTNode *node)
 {
     int switch_value = evaluate_expression(node->data.switch_stmt.expression);
+    const CaseTable *table = node->data.switch_stmt.table;
+    if (table)
+    {
+        int slot = case_table_slot(table, switch_value);
+        return run_cases(slot >= 0 ? table->entries[slot] : table->miss);
+    }
+
     CaseNode *current_case = node->data.switch_stmt.cases;
     int matched = 0;
 
-    PUSH_JUMP_BUFFER();
-    if (setjmp(CURRENT_JUMP_BUFFER()) == 0)
+    while (current_case)
     {
-        while (current_case)
+        if (current_case->value)
         {
-            if (current_case->value)
+            int case_value = evaluate_expression(current_case->value);
+            if (case_value == switch_value || matched)
             {
-                int case_value = evaluate_expression(current_case->value);
-                if (case_value == switch_value || matched)
-                {
-                    matched = 1;
-                    execute_statements(current_case->statements);
-                }
+                matched = 1;
+                ControlFlow flow = execute_statements(current_case->statements);
+                if (flow != FLOW_NORMAL)
+                    return leave_switch(flow);
             }
-            else
-            {
-                // Default case
-                if (matched || !matched)
-                {
-                    execute_statements(current_case->statements);
-                    break;
-                }
-            }
-            current_case = current_case->next;
         }
+        else
+        {
+            // Default case
+            return leave_switch(execute_statements(current_case->statements));
+        }
+        current_case = current_case->next;
     }
-    else
-    {
-        // Break encountered; do nothing
-    }
-    POP_JUMP_BUFFER();
+    return FLOW_NORMAL;
 }
 
 static ASTNode *create_node(NodeType type, VarType var_type, TypeModifiers modifiers)
@@ -243,51 +364,47 @@ static ASTNode *create_node(NodeType type, VarType var_type, TypeModifiers modif
     ASTNode *node = ARENA_ALLOC(ASTNode);
     if (!node)
     {
-        yyerror("Error: Memory allocation failed for ASTNode.\n");
-        exit(EXIT_FAILURE);
+        report_error("Error: Memory allocation failed for ASTNode.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     node->type = type;
     node->var_type = var_type;
     node->modifiers = modifiers;
+    node->type_info = (TypeInfo){0};
+    node->slot = -1;
     node->already_checked = false;
     node->is_valid_symbol = false;
+    node->deoptimized = false;
     return node;
 }
 
 ASTNode *create_int_node(int value)
 {
-    ASTNode *node = create_node(NODE_INT, VAR_INT, current_modifiers);
+    ASTNode *node = create_node(NODE_INT, VAR_INT, brainrot->current_modifiers);
     SET_DATA_INT(node, value);
     return node;
 }
 
 ASTNode *create_array_declaration_node(char *name, int length, VarType var_type)
 {
-    ASTNode *node = ARENA_ALLOC(ASTNode);
-    if (!node)
-        return NULL;
-
-    node->type = NODE_ARRAY_ACCESS;
-    node->var_type = var_type;
+    /* The modifiers went to the variable when the grammar declared it */
+    ASTNode *node = create_node(NODE_ARRAY_ACCESS, var_type, (TypeModifiers){0});
     node->is_array = true;
+    node->in_bounds = false;
     node->array_length = length;
     node->data.array.name = ARENA_STRDUP(name);
+    node->data.array.index = NULL; /* a declaration, not an access */
     return node;
 }
 
 ASTNode *create_array_access_node(char *name, ASTNode *index)
 {
-    ASTNode *node = ARENA_ALLOC(ASTNode);
-    if (!node)
-    {
-        yyerror("Memory allocation failed");
-        exit(EXIT_FAILURE);
-    }
-
-    node->type = NODE_ARRAY_ACCESS;
+    ASTNode *node = create_node(NODE_ARRAY_ACCESS, NONE, (TypeModifiers){0});
     node->data.array.name = ARENA_STRDUP(name);
     node->data.array.index = index;
     node->is_array = true;
+    node->in_bounds = false;
+    node->array_length = 0;
 
     // Look up and set the array's type from the symbol table
     Variable *var = get_variable(name);
@@ -303,120 +420,142 @@ ASTNode *create_array_access_node(char *name, ASTNode *index)
 
 ASTNode *create_short_node(short value)
 {
-    ASTNode *node = create_node(NODE_SHORT, VAR_SHORT, current_modifiers);
+    ASTNode *node = create_node(NODE_SHORT, VAR_SHORT, brainrot->current_modifiers);
     SET_DATA_SHORT(node, value);
     return node;
 }
 
 ASTNode *create_float_node(float value)
 {
-    ASTNode *node = create_node(NODE_FLOAT, VAR_FLOAT, current_modifiers);
+    ASTNode *node = create_node(NODE_FLOAT, VAR_FLOAT, brainrot->current_modifiers);
     SET_DATA_FLOAT(node, value);
     return node;
 }
 
 ASTNode *create_char_node(char value)
 {
-    ASTNode *node = create_node(NODE_CHAR, VAR_CHAR, current_modifiers);
+    ASTNode *node = create_node(NODE_CHAR, VAR_CHAR, brainrot->current_modifiers);
     SET_DATA_INT(node, value); // Store char as integer
     return node;
 }
 
 ASTNode *create_boolean_node(bool value)
 {
-    ASTNode *node = create_node(NODE_BOOLEAN, VAR_BOOL, current_modifiers);
+    ASTNode *node = create_node(NODE_BOOLEAN, VAR_BOOL, brainrot->current_modifiers);
     SET_DATA_BOOL(node, value);
     return node;
 }
 
 ASTNode *create_identifier_node(char *name)
 {
-    ASTNode *node = create_node(NODE_IDENTIFIER, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_IDENTIFIER, NONE, brainrot->current_modifiers);
     SET_DATA_NAME(node, name);
     return node;
 }
 
 ASTNode *create_assignment_node(char *name, ASTNode *expr)
 {
-    ASTNode *node = create_node(NODE_ASSIGNMENT, current_var_type, get_current_modifiers());
+    ASTNode *node = create_node(NODE_ASSIGNMENT, brainrot->current_var_type, get_current_modifiers());
     SET_DATA_OP(node, create_identifier_node(name), expr, OP_ASSIGN);
     return node;
 }
 
 ASTNode *create_declaration_node(char *name, ASTNode *expr)
 {
-    ASTNode *node = create_node(NODE_DECLARATION, current_var_type, get_current_modifiers());
+    ASTNode *node = create_node(NODE_DECLARATION, brainrot->current_var_type, get_current_modifiers());
     SET_DATA_OP(node, create_identifier_node(name), expr, OP_ASSIGN);
     return node;
 }
 
 ASTNode *create_operation_node(OperatorType op, ASTNode *left, ASTNode *right)
 {
-    ASTNode *node = create_node(NODE_OPERATION, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_OPERATION, NONE, brainrot->current_modifiers);
     SET_DATA_OP(node, left, right, op);
     return node;
 }
 
 ASTNode *create_unary_operation_node(OperatorType op, ASTNode *operand)
 {
-    ASTNode *node = create_node(NODE_UNARY_OPERATION, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_UNARY_OPERATION, NONE, brainrot->current_modifiers);
     SET_DATA_UNARY_OP(node, operand, op);
     return node;
 }
 
 ASTNode *create_for_statement_node(ASTNode *init, ASTNode *cond, ASTNode *incr, ASTNode *body)
 {
-    ASTNode *node = create_node(NODE_FOR_STATEMENT, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_FOR_STATEMENT, NONE, brainrot->current_modifiers);
     SET_DATA_FOR(node, init, cond, incr, body);
     return node;
 }
 
 ASTNode *create_while_statement_node(ASTNode *cond, ASTNode *body)
 {
-    ASTNode *node = create_node(NODE_WHILE_STATEMENT, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_WHILE_STATEMENT, NONE, brainrot->current_modifiers);
     SET_DATA_WHILE(node, cond, body);
     return node;
 }
 
 ASTNode *create_do_while_statement_node(ASTNode *cond, ASTNode *body)
 {
-    ASTNode *node = create_node(NODE_DO_WHILE_STATEMENT, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_DO_WHILE_STATEMENT, NONE, brainrot->current_modifiers);
     SET_DATA_WHILE(node, cond, body);
     return node;
 }
 
+static Builtin builtin_for(const char *name)
+{
+    static const struct
+    {
+        const char *name;
+        Builtin builtin;
+    } builtins[] = {
+        {"yapping", BUILTIN_YAPPING},
+        {"yappin", BUILTIN_YAPPIN},
+        {"baka", BUILTIN_BAKA},
+        {"ragequit", BUILTIN_RAGEQUIT},
+        {"chill", BUILTIN_CHILL},
+        {"slorp", BUILTIN_SLORP},
+    };
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+    {
+        if (strcmp(builtins[i].name, name) == 0)
+            return builtins[i].builtin;
+    }
+    return BUILTIN_NONE;
+}
+
 ASTNode *create_function_call_node(char *func_name, ArgumentList *args)
 {
-    ASTNode *node = create_node(NODE_FUNC_CALL, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_FUNC_CALL, NONE, brainrot->current_modifiers);
     SET_DATA_FUNC_CALL(node, func_name, args);
+    node->data.func_call.builtin = builtin_for(func_name);
+    node->data.func_call.function = NULL;
     return node;
 }
 
 ASTNode *create_double_node(double value)
 {
-    ASTNode *node = create_node(NODE_DOUBLE, VAR_DOUBLE, current_modifiers);
+    ASTNode *node = create_node(NODE_DOUBLE, VAR_DOUBLE, brainrot->current_modifiers);
     SET_DATA_DOUBLE(node, value);
     return node;
 }
 
 ASTNode *create_sizeof_node(ASTNode *expr)
 {
-    ASTNode *node = create_node(NODE_SIZEOF, NONE, current_modifiers);
+    ASTNode *node = create_node(NODE_SIZEOF, NONE, brainrot->current_modifiers);
     SET_SIZEOF(node, expr);
     return node;
 }
 
-// @param promotion: 0 for no promotion, 1 for promotion to double 2 for promotion to float
+// @param promotion: 0 for conversion to int, truncating like a C cast, 1 for promotion to double 2 for promotion to float
 void *handle_identifier(ASTNode *node, const char *contextErrorMessage, int promote)
 {
     if (!check_and_mark_identifier(node, contextErrorMessage))
-        exit(1);
+        brainrot_exit(1);
 
-    char *name = node->data.name;
-    Variable *var = get_variable(name);
+    Variable *var = lookup_variable(node);
     if (var != NULL)
     {
-        static Value promoted_value;
         if (promote == 1)
         {
 
@@ -425,18 +564,20 @@ void *handle_identifier(ASTNode *node, const char *contextErrorMessage, int prom
             case VAR_DOUBLE:
                 return &var->value.dvalue;
             case VAR_FLOAT:
-                promoted_value.dvalue = (double)var->value.fvalue;
-                return &promoted_value;
+                brainrot->promoted_value.dvalue = (double)var->value.fvalue;
+                return &brainrot->promoted_value.dvalue;
             case VAR_INT:
             case VAR_CHAR:
+                brainrot->promoted_value.dvalue = (double)var->value.ivalue;
+                return &brainrot->promoted_value.dvalue;
             case VAR_SHORT:
-                promoted_value.dvalue = (double)var->value.svalue;
-                return &promoted_value;
+                brainrot->promoted_value.dvalue = (double)var->value.svalue;
+                return &brainrot->promoted_value.dvalue;
             case VAR_BOOL:
-                promoted_value.dvalue = (double)var->value.ivalue;
-                return &promoted_value;
+                brainrot->promoted_value.dvalue = (double)var->value.bvalue;
+                return &brainrot->promoted_value.dvalue;
             default:
-                yyerror("Unsupported variable type");
+                report_error("Unsupported variable type");
                 return NULL;
             }
         }
@@ -445,20 +586,22 @@ void *handle_identifier(ASTNode *node, const char *contextErrorMessage, int prom
             switch (var->var_type)
             {
             case VAR_DOUBLE:
-                promoted_value.fvalue = (float)var->value.dvalue;
-                return &promoted_value.fvalue;
+                brainrot->promoted_value.fvalue = (float)var->value.dvalue;
+                return &brainrot->promoted_value.fvalue;
             case VAR_FLOAT:
                 return &var->value.fvalue;
             case VAR_INT:
             case VAR_CHAR:
+                brainrot->promoted_value.fvalue = (float)var->value.ivalue;
+                return &brainrot->promoted_value.fvalue;
             case VAR_SHORT:
-                promoted_value.fvalue = (float)var->value.svalue;
-                return &promoted_value.svalue;
+                brainrot->promoted_value.fvalue = (float)var->value.svalue;
+                return &brainrot->promoted_value.fvalue;
             case VAR_BOOL:
-                promoted_value.fvalue = (float)var->value.ivalue;
-                return &promoted_value.fvalue;
+                brainrot->promoted_value.fvalue = (float)var->value.bvalue;
+                return &brainrot->promoted_value.fvalue;
             default:
-                yyerror("Unsupported variable type");
+                report_error("Unsupported variable type");
                 return NULL;
             }
         }
@@ -467,22 +610,27 @@ void *handle_identifier(ASTNode *node, const char *contextErrorMessage, int prom
             switch (var->var_type)
             {
             case VAR_DOUBLE:
-                return &var->value.dvalue;
+                brainrot->promoted_value.ivalue = (int)var->value.dvalue;
+                return &brainrot->promoted_value.ivalue;
             case VAR_FLOAT:
-                return &var->value.fvalue;
+                brainrot->promoted_value.ivalue = (int)var->value.fvalue;
+                return &brainrot->promoted_value.ivalue;
             case VAR_INT:
             case VAR_CHAR:
+                return &var->value.ivalue;
             case VAR_SHORT:
-                return &var->value.svalue;
+                brainrot->promoted_value.ivalue = var->value.svalue;
+                return &brainrot->promoted_value.ivalue;
             case VAR_BOOL:
-                return &var->value.ivalue;
+                brainrot->promoted_value.ivalue = var->value.bvalue;
+                return &brainrot->promoted_value.ivalue;
             default:
-                yyerror("Unsupported variable type");
+                report_error("Unsupported variable type");
                 return NULL;
             }
         }
     }
-    yyerror("Undefined variable");
+    report_error("Undefined variable");
     return NULL;
 }
 
@@ -490,9 +638,11 @@ int get_expression_type(ASTNode *node)
 {
     if (!node)
     {
-        yyerror("Null node in get_expression_type");
+        report_error("Null node in get_expression_type");
         return NONE; // Return an unknown type if the node is null
     }
+    if (node->type_info.resolved)
+        return node->var_type;
 
     switch (node->type)
     {
@@ -511,8 +661,7 @@ int get_expression_type(ASTNode *node)
     case NODE_ARRAY_ACCESS:
     {
         // First, get the array's base type from symbol table
-        const char *array_name = node->data.array.name;
-        Variable *var = get_variable(array_name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             // Found the array, now handle the index expression
@@ -522,28 +671,28 @@ int get_expression_type(ASTNode *node)
             int index_type = get_expression_type(index_expr);
             if (index_type != VAR_INT && index_type != VAR_SHORT)
             {
-                yyerror("Array index must be an integer type");
+                report_error("Array index must be an integer type");
                 return NONE;
             }
 
             // Return the array's element type
             return var->var_type;
         }
-        yyerror("Undefined array in expression");
+        report_error("Undefined array in expression");
         return NONE;
     }
     case NODE_IDENTIFIER:
     {
         // Look up the variable type in the symbol table
-        const char *array_name = node->data.name;
-        Variable *var = get_variable(array_name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             return var->var_type;
         }
-        yyerror("Undefined variable in get_expression_type");
+        report_error("Undefined variable in get_expression_type");
         return NONE;
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
     case NODE_OPERATION:
     {
         // For binary operations, evaluate both operands to determine the highest type
@@ -568,517 +717,361 @@ int get_expression_type(ASTNode *node)
     }
     case NODE_FUNC_CALL:
     {
-        // Look up the function in the symbol table
-        const char *func_name = node->data.func_call.function_name;
-        Function *func = get_function(func_name);
+        // Bound to its function by link_program()
+        Function *func = node->data.func_call.function;
         if (func != NULL)
         {
             return func->return_type;
         }
-        yyerror("Undefined function in get_expression_type");
+        report_error("Undefined function in get_expression_type");
         return NONE;
     }
     default:
-        yyerror("Unknown node type in get_expression_type");
+        report_error("Unknown node type in get_expression_type");
         return NONE;
     }
 }
 
-void *handle_binary_operation(ASTNode *node)
-{
-    if (!node || node->type != NODE_OPERATION)
-    {
-        yyerror("Invalid binary operation node");
-        return NULL;
-    }
-
-    // Evaluate left and right operands.
-    void *left_value = NULL;
-    void *right_value = NULL;
+/*
+ * Operator kernels. Operands are promoted to one of the types below and
+ * every type gets its own kernel, generated from these lists, so operator
+ * evaluation works on plain values and never touches the heap.
+ */
 
-    // Determine the actual types of the operands.
-    int left_type = get_expression_type(node->data.op.left);
-    int right_type = get_expression_type(node->data.op.right);
+/* X(C type, Value member, VarType, variable setter) */
+#define OPERAND_TYPES(X)                                 \
+    X(int, ivalue, VAR_INT, set_int_variable)            \
+    X(short, svalue, VAR_SHORT, set_short_variable)      \
+    X(float, fvalue, VAR_FLOAT, set_float_variable)      \
+    X(double, dvalue, VAR_DOUBLE, set_double_variable)
 
-    // Promote types if necessary (short -> int -> float -> double).
-    int promoted_type = VAR_SHORT;
-    if (left_type == VAR_DOUBLE || right_type == VAR_DOUBLE)
-        promoted_type = VAR_DOUBLE;
-    else if (left_type == VAR_FLOAT || right_type == VAR_FLOAT)
-        promoted_type = VAR_FLOAT;
-    else if (left_type == VAR_INT || right_type == VAR_INT)
-        promoted_type = VAR_INT;
+/* X(operator, C operator) for operators that mean the same for every type */
+#define COMMON_BINARY_OPS(X) \
+    X(OP_PLUS, +)            \
+    X(OP_MINUS, -)           \
+    X(OP_TIMES, *)           \
+    X(OP_LT, <)              \
+    X(OP_GT, >)              \
+    X(OP_LE, <=)             \
+    X(OP_GE, >=)             \
+    X(OP_EQ, ==)             \
+    X(OP_NE, !=)
 
-    // Allocate and evaluate operands based on promoted type.
-    switch (promoted_type)
+static int int_divide(int left, int right)
+{
+    if (right == 0)
     {
-    case VAR_INT:
-        left_value = SAFE_MALLOC(int);
-        right_value = SAFE_MALLOC(int);
-        *(int *)left_value = evaluate_expression_int(node->data.op.left);
-        *(int *)right_value = evaluate_expression_int(node->data.op.right);
-        break;
-
-    case VAR_FLOAT:
-        left_value = SAFE_MALLOC(float);
-        right_value = SAFE_MALLOC(float);
-        *(float *)left_value = (left_type == VAR_INT)
-                                   ? (float)evaluate_expression_int(node->data.op.left)
-                                   : evaluate_expression_float(node->data.op.left);
-        *(float *)right_value = (right_type == VAR_INT)
-                                    ? (float)evaluate_expression_int(node->data.op.right)
-                                    : evaluate_expression_float(node->data.op.right);
-        break;
-
-    case VAR_DOUBLE:
-        left_value = SAFE_MALLOC(double);
-        right_value = SAFE_MALLOC(double);
-        *(double *)left_value = (left_type == VAR_INT)
-                                    ? (double)evaluate_expression_int(node->data.op.left)
-                                : (left_type == VAR_FLOAT)
-                                    ? (double)evaluate_expression_float(node->data.op.left)
-                                    : evaluate_expression_double(node->data.op.left);
-        *(double *)right_value = (right_type == VAR_INT)
-                                     ? (double)evaluate_expression_int(node->data.op.right)
-                                 : (right_type == VAR_FLOAT)
-                                     ? (double)evaluate_expression_float(node->data.op.right)
-                                     : evaluate_expression_double(node->data.op.right);
-        break;
-    case VAR_SHORT:
-        left_value = SAFE_MALLOC(short);
-        right_value = SAFE_MALLOC(short);
-        *(short *)left_value = evaluate_expression_short(node->data.op.left);
-        *(short *)right_value = evaluate_expression_short(node->data.op.right);
-        break;
-
-    default:
-        yyerror("Unsupported type promotion");
-        return NULL;
+        report_error("Division by zero");
+        return 0;
     }
+    return left / right;
+}
 
-    
-    // Perform the operation and allocate the result.
-    void *result;
-    if (promoted_type == VAR_DOUBLE)
+static short short_divide(short left, short right)
+{
+    if (right == 0)
     {
-        result = SAFE_MALLOC(double);
+        report_error("Division by zero");
+        return 0;
     }
-    else if (promoted_type == VAR_FLOAT)
+    return left / right;
+}
+
+static float float_divide(float left, float right)
+{
+    if (fabsf(right) < __FLT_MIN__)
     {
-        result = SAFE_MALLOC(float);
+        if (fabsf(left) < __FLT_MIN__)
+            return 0.0f / 0.0f; // NaN
+        return left > 0 ? __FLT_MAX__ : -__FLT_MAX__;
     }
-    else if (promoted_type == VAR_SHORT)
+    return left / right;
+}
+
+static double double_divide(double left, double right)
+{
+    if (fabs(right) < __DBL_MIN__)
     {
-        result = SAFE_MALLOC(short);
+        if (fabs(left) < __DBL_MIN__)
+            return 0.0 / 0.0; // NaN
+        return left > 0 ? __DBL_MAX__ : -__DBL_MAX__;
     }
-    else
+    return left / right;
+}
+
+static int int_modulo(int left, int right, bool is_unsigned)
+{
+    if (right == 0)
     {
-        result = SAFE_MALLOC(int);
+        report_error("Modulo by zero");
+        return 0;
     }
+    if (is_unsigned)
+        return (int)((unsigned int)left % (unsigned int)right);
+    return left % right;
+}
 
-    switch (node->data.op.op)
+static short short_modulo(short left, short right, bool is_unsigned)
+{
+    (void)is_unsigned;
+    if (right == 0)
     {
-    case OP_PLUS:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value + *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value + *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value + *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value + *(short *)right_value;
-        break;
+        report_error("Modulo by zero");
+        return 0;
+    }
+    return left % right;
+}
 
-    case OP_MINUS:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value - *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value - *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value - *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value - *(short *)right_value;
+static float float_modulo(float left, float right, bool is_unsigned)
+{
+    (void)is_unsigned;
+    return fmod(left, right);
+}
 
-        break;
+static double double_modulo(double left, double right, bool is_unsigned)
+{
+    (void)is_unsigned;
+    return fmod(left, right);
+}
 
-    case OP_TIMES:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value * *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value * *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value * *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value * *(short *)right_value;
-        break;
+#define COMMON_BINARY_CASE(OP, SYMBOL) \
+    case OP:                           \
+        return left SYMBOL right;
 
-    case OP_DIVIDE:
-        if (promoted_type == VAR_INT)
-        {
-            if (*(int *)right_value == 0)
-            {
-                yyerror("Division by zero");
-                *(int *)result = 0; // Define a fallback behavior for int division by zero
-            }
-            else
-            {
-                *(int *)result = *(int *)left_value / *(int *)right_value;
-            }
-        }
-        else if (promoted_type == VAR_FLOAT)
-        {
-            float right = *(float *)right_value;
-            float left = *(float *)left_value;
+#define DEFINE_BINARY_KERNEL(CT, FIELD, TAG, SETTER)                       \
+    CT CT##_binary(OperatorType op, CT left, CT right, bool is_unsigned)   \
+    {                                                                      \
+        switch (op)                                                        \
+        {                                                                  \
+            COMMON_BINARY_OPS(COMMON_BINARY_CASE)                          \
+        case OP_DIVIDE:                                                    \
+            return CT##_divide(left, right);                               \
+        case OP_MOD:                                                       \
+            return CT##_modulo(left, right, is_unsigned);                  \
+        default:                                                           \
+            report_error("Unsupported binary operator");                   \
+            return 0;                                                      \
+        }                                                                  \
+    }
 
-            if (fabsf(right) < __FLT_MIN__)
-            {
-                if (fabsf(left) < __FLT_MIN__)
-                {
-                    *(float *)result = 0.0f / 0.0f; // NaN
-                }
-                else
-                {
-                    *(float *)result = left > 0 ? __FLT_MAX__ : -__FLT_MAX__;
-                }
-            }
-            else
-            {
-                *(float *)result = left / right;
-            }
-        }
-        else if (promoted_type == VAR_DOUBLE)
-        {
-            double right = *(double *)right_value;
-            double left = *(double *)left_value;
+OPERAND_TYPES(DEFINE_BINARY_KERNEL)
 
-            if (fabs(right) < __DBL_MIN__)
-            {
-                if (fabs(left) < __DBL_MIN__)
-                {
-                    *(double *)result = 0.0 / 0.0; // NaN
-                }
-                else
-                {
-                    *(double *)result = left > 0 ? __DBL_MAX__ : -__DBL_MAX__;
-                }
-            }
-            else
-            {
-                *(double *)result = left / right;
-            }
-        }
-        else if (promoted_type == VAR_SHORT)
-        {
-            if (*(short *)right_value == 0)
-            {
-                yyerror("Division by zero");
-                *(short *)result = 0; // Define a fallback behavior for short division by zero
-            }
-            else
-            {
-                *(short *)result = *(short *)left_value / *(short *)right_value;
-            }
-        }
-        break;
-    case OP_MOD:
-        if (promoted_type == VAR_INT)
-        {
-            int left = *(int *)left_value;
-            int right = *(int *)right_value;
+#undef DEFINE_BINARY_KERNEL
+#undef COMMON_BINARY_CASE
 
-            if (right == 0)
-            {
-                yyerror("Modulo by zero");
-                *(int *)result = 0; // Define fallback for modulo by zero
-            }
-            else if (node->modifiers.is_unsigned)
-            {
-                // Explicitly handle unsigned modulo
-                unsigned int ul = (unsigned int)left;
-                unsigned int ur = (unsigned int)right;
-                *(int *)result = (int)(ul % ur);
-            }
-            else
-            {
-                *(int *)result = left % right;
-            }
-        }
-        else if (promoted_type == VAR_FLOAT)
-        {
-            *(float *)result = fmod(*(float *)left_value, *(float *)right_value);
-        }
-        else if (promoted_type == VAR_DOUBLE)
-        {
-            *(double *)result = fmod(*(double *)left_value, *(double *)right_value);
-        }
-        else if (promoted_type == VAR_SHORT)
-        {
-            *(short *)result = *(short *)left_value % *(short *)right_value;
-        }
-        break;
-    case OP_LT:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value < *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value < *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value < *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value < *(short *)right_value;
-        break;
+/* ++ and -- store back into the operand, which names a variable. */
+#define DEFINE_UNARY_KERNEL(CT, FIELD, TAG, SETTER)                              \
+    static CT CT##_unary(ASTNode *node, CT value)                                \
+    {                                                                            \
+        ASTNode *target = node->data.unary.operand;                              \
+        switch (node->data.unary.op)                                             \
+        {                                                                        \
+        case OP_NEG:                                                             \
+            return -value;                                                       \
+        case OP_PRE_INC:                                                         \
+            SETTER(target, value + 1, get_variable_modifiers(target));           \
+            return value + 1;                                                    \
+        case OP_PRE_DEC:                                                         \
+            SETTER(target, value - 1, get_variable_modifiers(target));           \
+            return value - 1;                                                    \
+        case OP_POST_INC:                                                        \
+            SETTER(target, value + 1, get_variable_modifiers(target));           \
+            return value;                                                        \
+        case OP_POST_DEC:                                                        \
+            SETTER(target, value - 1, get_variable_modifiers(target));           \
+            return value;                                                        \
+        default:                                                                 \
+            report_error("Unknown unary operator");                              \
+            return 0;                                                            \
+        }                                                                        \
+    }
 
-    case OP_GT:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value > *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value > *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value > *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value > *(short *)right_value;
-        break;
+OPERAND_TYPES(DEFINE_UNARY_KERNEL)
 
-    case OP_LE:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value <= *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value <= *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value <= *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value <= *(short *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value <= *(short *)right_value;
-        break;
+#undef DEFINE_UNARY_KERNEL
 
-    case OP_GE:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value >= *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value >= *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value >= *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value >= *(short *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value >= *(short *)right_value;
-        break;
+/*
+ * Quickening. The first time the tree-walker runs a node it works out the
+ * operand types as usual, then rewrites the node in place into a form
+ * specialized for them, which later runs skip straight to. A specialized
+ * node whose type_info is resolved keeps its types for good; any other
+ * re-checks them first and, if they changed, goes back to the generic
+ * node for good and is run as that.
+ */
 
-    case OP_EQ:
+#define INT_INT_ENTRY(NODE, OP) [OP] = NODE,
 
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value == *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value == *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value == *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value == *(short *)right_value;
-        break;
+/* Specialization of each operator for two int operands; NODE_INT for none */
+static const NodeType int_int_nodes[OP_ASSIGN + 1] = {INT_INT_OPERATIONS(INT_INT_ENTRY)};
 
-    case OP_NE:
-        if (promoted_type == VAR_INT)
-            *(int *)result = *(int *)left_value != *(int *)right_value;
-        else if (promoted_type == VAR_FLOAT)
-            *(float *)result = *(float *)left_value != *(float *)right_value;
-        else if (promoted_type == VAR_DOUBLE)
-            *(double *)result = *(double *)left_value != *(double *)right_value;
-        else if (promoted_type == VAR_SHORT)
-            *(short *)result = *(short *)left_value != *(short *)right_value;
-        break;
+#undef INT_INT_ENTRY
 
+static bool is_int_int(const ASTNode *node)
+{
+    return node->type >= NODE_ADD_INT_INT && node->type <= NODE_NE_INT_INT;
+}
+
+static void quicken(ASTNode *node, NodeType specialized)
+{
+    if (!brainrot->quicken_enabled || node->deoptimized || specialized == NODE_INT)
+        return;
+    node->type = specialized;
+    brainrot->quicken_stats.specialized++;
+}
+
+static void deoptimize(ASTNode *node, NodeType generic)
+{
+    node->type = generic;
+    node->deoptimized = true;
+    brainrot->quicken_stats.deoptimized++;
+}
+
+/* An operand of a specialized int operation, read without the evaluator's
+ * dispatch when it is a literal or a declared variable. */
+static inline int int_operand(ASTNode *node)
+{
+    if (node->type == NODE_INT)
+        return node->data.ivalue;
+    if (node->type == NODE_IDENTIFIER && brainrot->current_frame && node->slot >= 0 &&
+        brainrot->current_frame->slots[node->slot].name)
+        return brainrot->current_frame->slots[node->slot].value.ivalue;
+    return evaluate_expression_int(node);
+}
+
+/* Runs a specialized int operation. Returns false, with the node made
+ * generic again, when an operand is no longer an int. */
+static bool run_int_int(ASTNode *node, int *result)
+{
+    if (!node->type_info.resolved && (get_expression_type(node->data.op.left) != VAR_INT ||
+                                      get_expression_type(node->data.op.right) != VAR_INT))
+    {
+        deoptimize(node, NODE_OPERATION);
+        return false;
+    }
+    int left = int_operand(node->data.op.left);
+    int right = int_operand(node->data.op.right);
+    switch (node->type)
+    {
+    case NODE_ADD_INT_INT:
+        *result = left + right;
+        break;
+    case NODE_SUB_INT_INT:
+        *result = left - right;
+        break;
+    case NODE_MUL_INT_INT:
+        *result = left * right;
+        break;
+    case NODE_DIV_INT_INT:
+        *result = int_divide(left, right);
+        break;
+    case NODE_MOD_INT_INT:
+        *result = int_modulo(left, right, node->modifiers.is_unsigned);
+        break;
+    case NODE_LT_INT_INT:
+        *result = left < right;
+        break;
+    case NODE_GT_INT_INT:
+        *result = left > right;
+        break;
+    case NODE_LE_INT_INT:
+        *result = left <= right;
+        break;
+    case NODE_GE_INT_INT:
+        *result = left >= right;
+        break;
+    case NODE_EQ_INT_INT:
+        *result = left == right;
+        break;
     default:
-        yyerror("Unsupported binary operator");
-        SAFE_FREE(result);
-        result = NULL;
+        *result = left != right;
+        break;
+    }
+    return true;
+}
+
+/* Whether a scalar assignment specialized for an int value still takes
+ * the int path of execute_statement(); makes it generic again if not. */
+static bool assign_int_holds(ASTNode *node)
+{
+    ASTNode *value = node->data.op.right;
+    if (value->type_info.resolved || (!is_float_expression(value) && !is_double_expression(value)))
+        return true;
+    deoptimize(node, NODE_ASSIGNMENT);
+    return false;
+}
+
+Value handle_binary_operation(ASTNode *node)
+{
+    Value result = {.type = VAR_INT, .ivalue = 0};
+    if (!node || node->type != NODE_OPERATION)
+    {
+        report_error("Invalid binary operation node");
+        return result;
     }
 
-    SAFE_FREE(left_value);
-    SAFE_FREE(right_value);
+    ASTNode *left = node->data.op.left;
+    ASTNode *right = node->data.op.right;
 
+    // Determine the actual types of the operands.
+    int left_type = get_expression_type(left);
+    int right_type = get_expression_type(right);
+
+    // Promote types if necessary (short -> int -> float -> double). Short
+    // operands are promoted to int, as in C.
+    OperatorType op = node->data.op.op;
+    bool is_unsigned = node->modifiers.is_unsigned;
+    if (left_type == VAR_DOUBLE || right_type == VAR_DOUBLE)
+    {
+        double l = (left_type == VAR_INT)     ? (double)evaluate_expression_int(left)
+                   : (left_type == VAR_FLOAT) ? (double)evaluate_expression_float(left)
+                                              : evaluate_expression_double(left);
+        double r = (right_type == VAR_INT)     ? (double)evaluate_expression_int(right)
+                   : (right_type == VAR_FLOAT) ? (double)evaluate_expression_float(right)
+                                               : evaluate_expression_double(right);
+        result.type = VAR_DOUBLE;
+        result.dvalue = double_binary(op, l, r, is_unsigned);
+    }
+    else if (left_type == VAR_FLOAT || right_type == VAR_FLOAT)
+    {
+        float l = (left_type == VAR_INT) ? (float)evaluate_expression_int(left)
+                                         : evaluate_expression_float(left);
+        float r = (right_type == VAR_INT) ? (float)evaluate_expression_int(right)
+                                          : evaluate_expression_float(right);
+        result.type = VAR_FLOAT;
+        result.fvalue = float_binary(op, l, r, is_unsigned);
+    }
+    else
+    {
+        if (left_type == VAR_INT && right_type == VAR_INT)
+            quicken(node, int_int_nodes[op]);
+        int l = evaluate_expression_int(left);
+        int r = evaluate_expression_int(right);
+        result.ivalue = int_binary(op, l, r, is_unsigned);
+    }
     return result;
 }
 
-void *handle_unary_expression(ASTNode *node, void *operand_value, int operand_type)
+Value handle_unary_expression(ASTNode *node, Value operand)
 {
-    switch (node->data.unary.op)
+    switch (operand.type)
     {
-    case OP_NEG:
-        if (operand_type == VAR_INT)
-        {
-            int *result = SAFE_MALLOC(int);
-            *result = -(*(int *)operand_value);
-            return result;
-        }
-        else if (operand_type == VAR_SHORT)
-        {
-            short *result = SAFE_MALLOC(short);
-            *result = !(*(short *)operand_value);
-            return result;
-        }
-        else if (operand_type == VAR_FLOAT)
-        {
-            float *result = SAFE_MALLOC(float);
-            *result = -(*(float *)operand_value);
-            return result;
-        }
-        else if (operand_type == VAR_DOUBLE)
-        {
-            double *result = SAFE_MALLOC(double);
-            *result = -(*(double *)operand_value);
-            return result;
-        }
-        else if (operand_type == VAR_BOOL)
-        {
-            bool *result = SAFE_MALLOC(bool);
-            *result = !(*(bool *)operand_value);
-            return result;
-        }
-        else
-        {
-            yyerror("Invalid type for unary negation");
-            return NULL;
-        }
-
-    case OP_PRE_INC:
-        if (operand_type == VAR_INT)
-        {
-            int *result = SAFE_MALLOC(int);
-            *result = *(int *)operand_value + 1;
-            set_int_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_SHORT)
-        {
-            short *result = SAFE_MALLOC(short);
-            *result = *(short *)operand_value + 1;
-            set_short_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_FLOAT)
-        {
-            float *result = SAFE_MALLOC(float);
-            *result = *(float *)operand_value + 1;
-            set_float_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_DOUBLE)
-        {
-            double *result = SAFE_MALLOC(double);
-            *result = *(double *)operand_value + 1;
-            set_double_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else
-        {
-            yyerror("Invalid type for pre-increment");
-            return NULL;
-        }
-    case OP_PRE_DEC:
-        if (operand_type == VAR_INT)
-        {
-            int *result = SAFE_MALLOC(int);
-            *result = *(int *)operand_value - 1;
-            set_int_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_SHORT)
-        {
-            short *result = SAFE_MALLOC(short);
-            *result = *(short *)operand_value - 1;
-            set_short_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_FLOAT)
-        {
-            float *result = SAFE_MALLOC(float);
-            *result = *(float *)operand_value - 1;
-            set_float_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_DOUBLE)
-        {
-            double *result = SAFE_MALLOC(double);
-            *result = *(double *)operand_value - 1;
-            set_double_variable(node->data.unary.operand->data.name, *result, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else
-        {
-            yyerror("Invalid type for pre-decrement");
-            return NULL;
-        }
-    case OP_POST_INC:
-        if (operand_type == VAR_INT)
-        {
-            int *result = SAFE_MALLOC(int);
-            *result = *(int *)operand_value;
-            set_int_variable(node->data.unary.operand->data.name, *result + 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_SHORT)
-        {
-            short *result = SAFE_MALLOC(short);
-            *result = *(short *)operand_value;
-            set_short_variable(node->data.unary.operand->data.name, *result + 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_FLOAT)
-        {
-            float *result = SAFE_MALLOC(float);
-            *result = *(float *)operand_value;
-            set_float_variable(node->data.unary.operand->data.name, *result + 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_DOUBLE)
-        {
-            double *result = SAFE_MALLOC(double);
-            *result = *(double *)operand_value;
-            set_double_variable(node->data.unary.operand->data.name, *result + 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else
-        {
-            yyerror("Invalid type for post-increment");
-            return NULL;
-        }
-    case OP_POST_DEC:
-        if (operand_type == VAR_INT)
-        {
-            int *result = SAFE_MALLOC(int);
-            *result = *(int *)operand_value;
-            set_int_variable(node->data.unary.operand->data.name, *result - 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_SHORT)
-        {
-            short *result = SAFE_MALLOC(short);
-            *result = *(short *)operand_value;
-            set_short_variable(node->data.unary.operand->data.name, *result - 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_FLOAT)
-        {
-            float *result = SAFE_MALLOC(float);
-            *result = *(float *)operand_value;
-            set_float_variable(node->data.unary.operand->data.name, *result - 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else if (operand_type == VAR_DOUBLE)
-        {
-            double *result = SAFE_MALLOC(double);
-            *result = *(double *)operand_value;
-            set_double_variable(node->data.unary.operand->data.name, *result - 1, get_variable_modifiers(node->data.unary.operand->data.name));
-            return result;
-        }
-        else
+#define UNARY_CASE(CT, FIELD, TAG, SETTER)               \
+    case TAG:                                            \
+        operand.FIELD = CT##_unary(node, operand.FIELD); \
+        return operand;
+        OPERAND_TYPES(UNARY_CASE)
+#undef UNARY_CASE
+    case VAR_BOOL:
+        if (node->data.unary.op == OP_NEG)
         {
-            yyerror("Invalid type for post-decrement");
-            return NULL;
+            operand.bvalue = !operand.bvalue;
+            return operand;
         }
+        report_error("Invalid type for increment or decrement");
+        return operand;
     default:
-        yyerror("Unknown unary operator");
-        return NULL;
+        report_error("Invalid type for unary operation");
+        return operand;
     }
 }
 
@@ -1091,19 +1084,18 @@ float evaluate_expression_float(ASTNode *node)
     {
     case NODE_ARRAY_ACCESS:
     {
-        const char *array_name = node->data.array.name;
         int idx = evaluate_expression_int(node->data.array.index);
-        Variable *var = get_variable(array_name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return 0.0f;
             }
-            if (idx < 0 || idx >= var->array_length)
+            if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return 0.0f;
             }
 
@@ -1123,11 +1115,11 @@ float evaluate_expression_float(ASTNode *node)
             case VAR_CHAR:
                 return (float)((char *)var->value.array_data)[idx];
             default:
-                yyerror("Unsupported array type");
+                report_error("Unsupported array type");
                 return 0.0f;
             }
         }
-        yyerror("Undefined array variable!");
+        report_error("Undefined array variable!");
         return 0.0f;
     }
     case NODE_FLOAT:
@@ -1140,26 +1132,22 @@ float evaluate_expression_float(ASTNode *node)
     {
         return *(float *)handle_identifier(node, "Undefined variable", 2);
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
+    {
+        int result;
+        if (run_int_int(node, &result))
+            return (float)result;
+        return evaluate_expression_float(node);
+    }
     case NODE_OPERATION:
     {
-        int result_type = get_expression_type(node);
-        void *result = handle_binary_operation(node);
-        float result_float = 0.0f;
-        result_float = (result_type == VAR_INT)
-                           ? (float)(*(int *)result)
-                       : (result_type == VAR_FLOAT)
-                           ? *(float *)result
-                           : (float)(*(double *)result);
-        SAFE_FREE(result);
-        return result_float;
+        Value result = handle_binary_operation(node);
+        return VALUE_AS(float, result);
     }
     case NODE_UNARY_OPERATION:
     {
-        float operand = evaluate_expression_float(node->data.unary.operand);
-        float *result = (float *)handle_unary_expression(node, &operand, VAR_FLOAT);
-        float return_val = *result;
-        SAFE_FREE(result);
-        return return_val;
+        Value operand = {.type = VAR_FLOAT, .fvalue = evaluate_expression_float(node->data.unary.operand)};
+        return handle_unary_expression(node, operand).fvalue;
     }
     case NODE_SIZEOF:
     {
@@ -1167,17 +1155,11 @@ float evaluate_expression_float(ASTNode *node)
     }
     case NODE_FUNC_CALL:
     {
-        float *res = (float *)handle_function_call(node);
-        if (res != NULL)
-        {
-            float result = *res;
-            SAFE_FREE(res);
-            return result;
-        }
-        return 0.0f;
+        Value result = handle_function_call(node);
+        return VALUE_AS(float, result);
     }
     default:
-        yyerror("Invalid float expression");
+        report_error("Invalid float expression");
         return 0.0f;
     }
 }
@@ -1191,20 +1173,19 @@ double evaluate_expression_double(ASTNode *node)
     {
     case NODE_ARRAY_ACCESS:
     {
-        const char *array_name = node->data.array.name;
         int idx = evaluate_expression_int(node->data.array.index);
 
-        Variable *var = get_variable(array_name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return 0.0L;
             }
-            if (idx < 0 || idx >= var->array_length)
+            if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return 0.0L;
             }
 
@@ -1224,11 +1205,11 @@ double evaluate_expression_double(ASTNode *node)
             case VAR_CHAR:
                 return (double)((char *)var->value.array_data)[idx];
             default:
-                yyerror("Unsupported array type");
+                report_error("Unsupported array type");
                 return 0.0L;
             }
         }
-        yyerror("Undefined array variable!");
+        report_error("Undefined array variable!");
         return 0.0L;
     }
     case NODE_DOUBLE:
@@ -1241,26 +1222,22 @@ double evaluate_expression_double(ASTNode *node)
     {
         return *(double *)handle_identifier(node, "Undefined variable", 1);
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
+    {
+        int result;
+        if (run_int_int(node, &result))
+            return (double)result;
+        return evaluate_expression_double(node);
+    }
     case NODE_OPERATION:
     {
-        int result_type = get_expression_type(node);
-        void *result = handle_binary_operation(node);
-        double result_double = 0.0L;
-        result_double = (result_type == VAR_INT)
-                            ? (double)(*(int *)result)
-                        : (result_type == VAR_FLOAT)
-                            ? (double)(*(float *)result)
-                            : *(double *)result;
-        SAFE_FREE(result);
-        return result_double;
+        Value result = handle_binary_operation(node);
+        return VALUE_AS(double, result);
     }
     case NODE_UNARY_OPERATION:
     {
-        double operand = evaluate_expression_double(node->data.unary.operand);
-        double *result = (double *)handle_unary_expression(node, &operand, VAR_DOUBLE);
-        double return_val = *result;
-        SAFE_FREE(result);
-        return return_val;
+        Value operand = {.type = VAR_DOUBLE, .dvalue = evaluate_expression_double(node->data.unary.operand)};
+        return handle_unary_expression(node, operand).dvalue;
     }
     case NODE_SIZEOF:
     {
@@ -1268,23 +1245,17 @@ double evaluate_expression_double(ASTNode *node)
     }
     case NODE_FUNC_CALL:
     {
-        double *res = (double *)handle_function_call(node);
-        if (res != NULL)
-        {
-            double result = *res;
-            SAFE_FREE(res);
-            return result;
-        }
-        return 0.0L;
+        Value result = handle_function_call(node);
+        return VALUE_AS(double, result);
     }
     default:
-        yyerror("Invalid double expression");
+        report_error("Invalid double expression");
         return 0.0L;
     }
 }
-size_t get_type_size(char *name)
+size_t get_type_size(ASTNode *node)
 {
-    Variable *var = get_variable(name);
+    Variable *var = lookup_variable(node);
     if (var != NULL)
     {
         if (var->var_type == VAR_FLOAT)
@@ -1345,10 +1316,10 @@ size_t get_type_size(char *name)
         }
         else
         {
-            yyerror("Undefined variable in sizeof");
+            report_error("Undefined variable in sizeof");
         }
     }
-    yyerror("Undefined variable in sizeof");
+    report_error("Undefined variable in sizeof");
     return 0;
 }
 
@@ -1358,7 +1329,7 @@ size_t handle_sizeof(ASTNode *node)
     VarType type = get_expression_type(node->data.sizeof_stmt.expr);
     if (expr->type == NODE_IDENTIFIER)
     {
-        return get_type_size(expr->data.name);
+        return get_type_size(expr);
     }
     switch (type)
     {
@@ -1375,10 +1346,10 @@ size_t handle_sizeof(ASTNode *node)
     case VAR_CHAR:
         return sizeof(char);
     default:
-        yyerror("Invalid type in sizeof");
+        report_error("Invalid type in sizeof");
         return 0;
     }
-    yyerror("Invalid type in sizeof");
+    report_error("Invalid type in sizeof");
     return 0;
 }
 
@@ -1398,10 +1369,10 @@ short evaluate_expression_short(ASTNode *node)
     case NODE_SHORT:
         return node->data.svalue;
     case NODE_FLOAT:
-        yyerror("Cannot use float in integer context");
+        report_error("Cannot use float in integer context");
         return (short)node->data.fvalue;
     case NODE_DOUBLE:
-        yyerror("Cannot use double in integer context");
+        report_error("Cannot use double in integer context");
         return (short)node->data.dvalue;
     case NODE_SIZEOF:
     {
@@ -1409,7 +1380,14 @@ short evaluate_expression_short(ASTNode *node)
     }
     case NODE_IDENTIFIER:
     {
-        return *(short *)handle_identifier(node, "Undefined variable", 0);
+        return (short)*(int *)handle_identifier(node, "Undefined variable", 0);
+    }
+    INT_INT_OPERATIONS(INT_INT_CASE)
+    {
+        int result;
+        if (run_int_int(node, &result))
+            return (short)result;
+        return evaluate_expression_short(node);
     }
     case NODE_OPERATION:
     {
@@ -1431,44 +1409,30 @@ short evaluate_expression_short(ASTNode *node)
         }
 
         // Regular integer operations
-        int result_type = get_expression_type(node);
-        void *result = handle_binary_operation(node);
-        short result_short = 0;
-        result_short = (result_type == VAR_SHORT)
-                           ? *(short *)result
-                       : (result_type == VAR_FLOAT)
-                           ? (short)(*(float *)result)
-                       : (result_type == VAR_DOUBLE)
-                           ? (short)(*(double *)result)
-                           : (short)(*(int *)result);
-        SAFE_FREE(result);
-        return result_short;
+        Value result = handle_binary_operation(node);
+        return VALUE_AS(short, result);
     }
     case NODE_UNARY_OPERATION:
     {
-        short operand = evaluate_expression_short(node->data.unary.operand);
-        short *result = (short *)handle_unary_expression(node, &operand, VAR_SHORT);
-        short return_val = *result;
-        SAFE_FREE(result);
-        return return_val;
+        Value operand = {.type = VAR_SHORT, .svalue = evaluate_expression_short(node->data.unary.operand)};
+        return handle_unary_expression(node, operand).svalue;
     }
     case NODE_ARRAY_ACCESS:
     {
         // find the symbol
-        char *name = node->data.array.name;
-        Variable *var = get_variable(name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return 0;
             }
             // Evaluate index
             int idx = evaluate_expression_int(node->data.array.index);
-            if (idx < 0 || idx >= var->array_length)
+            if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return 0;
             }
             switch (node->var_type)
@@ -1486,25 +1450,19 @@ short evaluate_expression_short(ASTNode *node)
             case VAR_CHAR:
                 return (short)((char *)var->value.array_data)[idx];
             default:
-                yyerror("Undefined array type!");
+                report_error("Undefined array type!");
             }
         }
-        yyerror("Undefined array variable!");
+        report_error("Undefined array variable!");
         return 0;
     }
     case NODE_FUNC_CALL:
     {
-        short *res = (short *)handle_function_call(node);
-        if (res != NULL)
-        {
-            short return_val = *res;
-            SAFE_FREE(res);
-            return return_val;
-        }
-        return 0;
+        Value result = handle_function_call(node);
+        return VALUE_AS(short, result);
     }
     default:
-        yyerror("Invalid short expression");
+        report_error("Invalid short expression");
         return 0;
     }
 }
@@ -1525,10 +1483,10 @@ int evaluate_expression_int(ASTNode *node)
     case NODE_SHORT:
         return node->data.svalue;
     case NODE_FLOAT:
-        yyerror("Cannot use float in integer context");
+        report_error("Cannot use float in integer context");
         return (int)node->data.fvalue;
     case NODE_DOUBLE:
-        yyerror("Cannot use double in integer context");
+        report_error("Cannot use double in integer context");
         return (int)node->data.dvalue;
     case NODE_SIZEOF:
     {
@@ -1538,6 +1496,13 @@ int evaluate_expression_int(ASTNode *node)
     {
         return *(int *)handle_identifier(node, "Undefined variable", 0);
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
+    {
+        int result;
+        if (run_int_int(node, &result))
+            return result;
+        return evaluate_expression_int(node);
+    }
     case NODE_OPERATION:
     {
         // Special handling for logical operations
@@ -1558,42 +1523,30 @@ int evaluate_expression_int(ASTNode *node)
         }
 
         // Regular integer operations
-        int result_type = get_expression_type(node);
-        void *result = handle_binary_operation(node);
-        int result_int = 0;
-        result_int = (result_type == VAR_INT)
-                         ? *(int *)result
-                     : (result_type == VAR_FLOAT)
-                         ? (int)(*(float *)result)
-                         : (int)(*(double *)result);
-        SAFE_FREE(result);
-        return result_int;
+        Value result = handle_binary_operation(node);
+        return VALUE_AS(int, result);
     }
     case NODE_UNARY_OPERATION:
     {
-        int operand = evaluate_expression_int(node->data.unary.operand);
-        int *result = (int *)handle_unary_expression(node, &operand, VAR_INT);
-        int return_val = *result;
-        SAFE_FREE(result);
-        return return_val;
+        Value operand = {.type = VAR_INT, .ivalue = evaluate_expression_int(node->data.unary.operand)};
+        return handle_unary_expression(node, operand).ivalue;
     }
     case NODE_ARRAY_ACCESS:
     {
         // find the symbol
-        char *name = node->data.array.name;
-        Variable *var = get_variable(name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return 0;
             }
             // Evaluate index
             int idx = evaluate_expression_int(node->data.array.index);
-            if (idx < 0 || idx >= var->array_length)
+            if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return 0;
             }
             switch (node->var_type)
@@ -1611,68 +1564,32 @@ int evaluate_expression_int(ASTNode *node)
             case VAR_CHAR:
                 return (int)((char *)var->value.array_data)[idx];
             default:
-                yyerror("Undefined array type!");
+                report_error("Undefined array type!");
             }
         }
-        yyerror("Undefined array variable!");
+        report_error("Undefined array variable!");
         return 0;
     }
     case NODE_FUNC_CALL:
     {
-        int *res = (int *)handle_function_call(node);
-        if (res != NULL)
-        {
-            int return_val = *res;
-            SAFE_FREE(res);
-            return return_val;
-        }
-        return 0;
+        Value result = handle_function_call(node);
+        return VALUE_AS(int, result);
     }
     default:
-        yyerror("Invalid integer expression");
+        report_error("Invalid integer expression");
         return 0;
     }
 }
 
-void *handle_function_call(ASTNode *node)
+Value handle_function_call(ASTNode *node)
 {
-    execute_function_call(
-        node->data.func_call.function_name,
-        node->data.func_call.arguments);
-    void *return_value = NULL;
-    if (current_return_value.has_value)
+    Function *func = node->data.func_call.function;
+    if (!func)
     {
-        switch (current_return_value.type)
-        {
-        case VAR_INT:
-            return_value = SAFE_MALLOC(int);
-            *(int *)return_value = current_return_value.value.ivalue;
-            break;
-        case VAR_FLOAT:
-            return_value = SAFE_MALLOC(float);
-            *(float *)return_value = current_return_value.value.fvalue;
-            break;
-        case VAR_DOUBLE:
-            return_value = SAFE_MALLOC(double);
-            *(double *)return_value = current_return_value.value.dvalue;
-            break;
-        case VAR_BOOL:
-            return_value = SAFE_MALLOC(bool);
-            *(bool *)return_value = current_return_value.value.bvalue;
-            break;
-        case VAR_CHAR:
-            return_value = SAFE_MALLOC(char);
-            *(char *)return_value = current_return_value.value.ivalue;
-            break;
-        case VAR_SHORT:
-            return_value = SAFE_MALLOC(short);
-            *(short *)return_value = current_return_value.value.svalue;
-            break;
-        case NONE:
-            return NULL;
-        }
+        report_error("Undefined function");
+        return (Value){.type = VAR_INT, .ivalue = 0};
     }
-    return return_value;
+    return call_function(func, node->data.func_call.arguments);
 }
 
 bool evaluate_expression_bool(ASTNode *node)
@@ -1696,7 +1613,14 @@ bool evaluate_expression_bool(ASTNode *node)
         return (bool)node->data.dvalue;
     case NODE_IDENTIFIER:
     {
-        return *(bool *)handle_identifier(node, "Undefined variable", 0);
+        return *(double *)handle_identifier(node, "Undefined variable", 1) != 0;
+    }
+    INT_INT_OPERATIONS(INT_INT_CASE)
+    {
+        int result;
+        if (run_int_int(node, &result))
+            return (bool)result;
+        return evaluate_expression_bool(node);
     }
     case NODE_OPERATION:
     {
@@ -1718,42 +1642,30 @@ bool evaluate_expression_bool(ASTNode *node)
         }
 
         // Regular integer operations
-        int result_type = get_expression_type(node);
-        void *result = handle_binary_operation(node);
-        bool result_bool = 0;
-        result_bool = (result_type == VAR_INT)
-                          ? (bool)(*(int *)result)
-                      : (result_type == VAR_FLOAT)
-                          ? (bool)(*(float *)result)
-                          : (bool)(*(double *)result);
-        SAFE_FREE(result);
-        return result_bool;
+        Value result = handle_binary_operation(node);
+        return VALUE_AS(bool, result);
     }
     case NODE_UNARY_OPERATION:
     {
-        bool operand = evaluate_expression_bool(node->data.unary.operand);
-        bool *result = (bool *)handle_unary_expression(node, &operand, VAR_BOOL);
-        bool return_val = *result;
-        SAFE_FREE(result);
-        return return_val;
+        Value operand = {.type = VAR_BOOL, .bvalue = evaluate_expression_bool(node->data.unary.operand)};
+        return handle_unary_expression(node, operand).bvalue;
     }
     case NODE_ARRAY_ACCESS:
     {
         // find the symbol
-        char *name = node->data.array.name;
-        Variable *var = get_variable(name);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return 0;
             }
             // Evaluate index
             int idx = evaluate_expression_int(node->data.array.index);
-            if (idx < 0 || idx >= var->array_length)
+            if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return 0;
             }
             switch (node->var_type)
@@ -1771,25 +1683,19 @@ bool evaluate_expression_bool(ASTNode *node)
             case VAR_CHAR:
                 return (bool)((char *)var->value.array_data)[idx];
             default:
-                yyerror("Undefined array type!");
+                report_error("Undefined array type!");
             }
         }
-        yyerror("Undefined array variable!");
+        report_error("Undefined array variable!");
         return 0;
     }
     case NODE_FUNC_CALL:
     {
-        bool *res = (bool *)handle_function_call(node);
-        if (res != NULL)
-        {
-            bool return_val = *res;
-            SAFE_FREE(res);
-            return return_val;
-        }
-        return 0;
+        Value result = handle_function_call(node);
+        return VALUE_AS(bool, result);
     }
     default:
-        yyerror("Invalid boolean expression");
+        report_error("Invalid boolean expression");
         return 0;
     }
 }
@@ -1841,7 +1747,7 @@ ASTNode *create_statement_list(ASTNode *statement, ASTNode *existing_list)
         ASTNode *node = ARENA_ALLOC(ASTNode);
         if (!node)
         {
-            yyerror("Memory allocation failed");
+            report_error("Memory allocation failed");
             return NULL;
         }
         node->type = NODE_STATEMENT_LIST;
@@ -1849,7 +1755,7 @@ ASTNode *create_statement_list(ASTNode *statement, ASTNode *existing_list)
         if (!node->data.statements)
         {
             SAFE_FREE(node);
-            yyerror("Memory allocation failed");
+            report_error("Memory allocation failed");
             return NULL;
         }
         node->data.statements->statement = statement;
@@ -1868,7 +1774,7 @@ ASTNode *create_statement_list(ASTNode *statement, ASTNode *existing_list)
         StatementList *new_item = ARENA_ALLOC(StatementList);
         if (!new_item)
         {
-            yyerror("Memory allocation failed");
+            report_error("Memory allocation failed");
             return existing_list;
         }
         new_item->statement = statement;
@@ -1878,9 +1784,9 @@ ASTNode *create_statement_list(ASTNode *statement, ASTNode *existing_list)
     }
 }
 
-bool is_const_variable(const char *name)
+bool is_const_variable(ASTNode *node)
 {
-    Variable *var = get_variable(name);
+    Variable *var = lookup_variable(node);
     if (var != NULL)
     {
         return var->modifiers.is_const;
@@ -1888,15 +1794,13 @@ bool is_const_variable(const char *name)
     return false;
 }
 
-void check_const_assignment(const char *name)
+void check_const_assignment(ASTNode *node)
 {
-    if (is_const_variable(name))
+    if (is_const_variable(node))
     {
-        yylineno = yylineno - 2;
-        yyerror("Cannot modify const variable");
-        // TODO: make proper cleanup when error occurs
-        cleanup();
-        exit(EXIT_FAILURE);
+        brainrot->line -= 2;
+        report_error("Cannot modify const variable");
+        brainrot_exit(EXIT_FAILURE);
     }
 }
 
@@ -1904,6 +1808,8 @@ bool is_short_expression(ASTNode *node)
 {
     if (!node)
         return false;
+    if (node->type_info.resolved)
+        return node->type_info.has_short;
 
     switch (node->type)
     {
@@ -1918,52 +1824,50 @@ bool is_short_expression(ASTNode *node)
     case NODE_IDENTIFIER:
     {
         if (!check_and_mark_identifier(node, "Undefined variable in type check"))
-            exit(1);
-        Variable *var = get_variable(node->data.name);
+            brainrot_exit(1);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             return var->var_type == VAR_SHORT;
         }
-        yyerror("Undefined variable in type check");
+        report_error("Undefined variable in type check");
         return false;
     }
-    case NODE_OPERATION:
-    {
-        // If either operand is short, result is short
-        return is_short_expression(node->data.op.left) ||
-               is_short_expression(node->data.op.right);
-    }
     case NODE_FUNC_CALL:
     {
-        return get_function_return_type(node->data.func_call.function_name) == VAR_SHORT;
+        return get_function_return_type(node) == VAR_SHORT;
     }
     default:
+        // Including binary operations, which promote short operands to int
         return false;
     }
 }
 
+static Function **function_bucket(const char *name)
+{
+    return &brainrot->function_buckets[fnv1a_hash(name, strlen(name)) % FUNCTION_BUCKETS];
+}
+
 Function *get_function(const char *name)
 {
-    Function *func = function_table;
-    while (func != NULL)
+    for (Function *func = *function_bucket(name); func != NULL; func = func->bucket_next)
     {
         if (strcmp(func->name, name) == 0)
         {
             return func;
         }
-        func = func->next;
     }
     return NULL;
 }
 
-VarType get_function_return_type(const char *name)
+VarType get_function_return_type(ASTNode *call)
 {
-    Function *func = get_function(name);
+    Function *func = call->data.func_call.function;
     if (func != NULL)
     {
         return func->return_type;
     }
-    yyerror("Undefined function in type check");
+    report_error("Undefined function in type check");
     return NONE;
 }
 
@@ -1971,6 +1875,8 @@ bool is_float_expression(ASTNode *node)
 {
     if (!node)
         return false;
+    if (node->type_info.resolved)
+        return node->type_info.has_float;
 
     switch (node->type)
     {
@@ -1983,15 +1889,16 @@ bool is_float_expression(ASTNode *node)
     case NODE_IDENTIFIER:
     {
         if (!check_and_mark_identifier(node, "Undefined variable in type check"))
-            exit(1);
-        Variable *var = get_variable(node->data.name);
+            brainrot_exit(1);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             return var->var_type == VAR_FLOAT;
         }
-        yyerror("Undefined variable in type check");
+        report_error("Undefined variable in type check");
         return false;
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
     case NODE_OPERATION:
     {
         // If either operand is float, result is float
@@ -2000,7 +1907,7 @@ bool is_float_expression(ASTNode *node)
     }
     case NODE_FUNC_CALL:
     {
-        return get_function_return_type(node->data.func_call.function_name) == VAR_FLOAT;
+        return get_function_return_type(node) == VAR_FLOAT;
     }
     default:
         return false;
@@ -2011,6 +1918,8 @@ bool is_double_expression(ASTNode *node)
 {
     if (!node)
         return false;
+    if (node->type_info.resolved)
+        return node->type_info.has_double;
 
     switch (node->type)
     {
@@ -2023,15 +1932,16 @@ bool is_double_expression(ASTNode *node)
     case NODE_IDENTIFIER:
     {
         if (!check_and_mark_identifier(node, "Undefined variable in type check"))
-            exit(1);
-        Variable *var = get_variable(node->data.name);
+            brainrot_exit(1);
+        Variable *var = lookup_variable(node);
         if (var != NULL)
         {
             return var->var_type == VAR_DOUBLE;
         }
-        yyerror("Undefined variable in type check");
+        report_error("Undefined variable in type check");
         return false;
     }
+    INT_INT_OPERATIONS(INT_INT_CASE)
     case NODE_OPERATION:
     {
         // If either operand is double, result is double
@@ -2040,7 +1950,7 @@ bool is_double_expression(ASTNode *node)
     }
     case NODE_FUNC_CALL:
     {
-        return get_function_return_type(node->data.func_call.function_name) == VAR_DOUBLE;
+        return get_function_return_type(node) == VAR_DOUBLE;
     }
     default:
         return false;
@@ -2049,6 +1959,10 @@ bool is_double_expression(ASTNode *node)
 
 int evaluate_expression(ASTNode *node)
 {
+    // A specialized operation statically typed as a plain int needs none of the checks below
+    if (is_int_int(node) && node->type_info.resolved && !node->type_info.has_short &&
+        !node->type_info.has_float && !node->type_info.has_double)
+        return evaluate_expression_int(node);
     if (is_short_expression(node))
     {
         return (short)evaluate_expression_short(node);
@@ -2068,12 +1982,12 @@ void execute_assignment(ASTNode *node)
 {
     if (node->type != NODE_ASSIGNMENT)
     {
-        yyerror("Expected assignment node");
+        report_error("Expected assignment node");
         return;
     }
 
-    char *name = node->data.op.left->data.name;
-    check_const_assignment(name);
+    ASTNode *target = node->data.op.left;
+    check_const_assignment(target);
 
     ASTNode *value_node = node->data.op.right;
     TypeModifiers mods = node->modifiers;
@@ -2081,21 +1995,20 @@ void execute_assignment(ASTNode *node)
     if (node->data.op.left->type == NODE_ARRAY_ACCESS)
     {
         // Evaluate the right side with proper type handling
-        const char *array_name = node->data.op.left->data.array.name;
         int idx = evaluate_expression_int(node->data.op.left->data.array.index);
 
         // Find array in symbol table
-        Variable *var = get_variable(array_name);
+        Variable *var = lookup_variable(node->data.op.left);
         if (var != NULL)
         {
             if (!var->is_array)
             {
-                yyerror("Not an array!");
+                report_error("Not an array!");
                 return;
             }
-            if (idx < 0 || idx >= var->array_length)
+            if (!target->in_bounds && (idx < 0 || idx >= var->array_length))
             {
-                yyerror("Array index out of bounds!");
+                report_error("Array index out of bounds!");
                 return;
             }
 
@@ -2115,12 +2028,12 @@ void execute_assignment(ASTNode *node)
                 ((short *)var->value.array_data)[idx] = evaluate_expression_short(node->data.op.right);
                 break;
             default:
-                yyerror("Unsupported array type");
+                report_error("Unsupported array type");
                 return;
             }
             return;
         }
-        yyerror("Undefined array variable");
+        report_error("Undefined array variable");
         return;
     }
 
@@ -2133,12 +2046,12 @@ void execute_assignment(ASTNode *node)
             // Check for overflow
             if (value > INT_MAX || value < INT_MIN)
             {
-                yyerror("Float to int conversion overflow");
+                report_error("Float to int conversion overflow");
                 value = INT_MAX;
             }
-            if (!set_int_variable(name, (int)value, mods))
+            if (!set_int_variable(target, (int)value, mods))
             {
-                yyerror("Failed to set integer variable");
+                report_error("Failed to set integer variable");
             }
             return;
         }
@@ -2147,76 +2060,71 @@ void execute_assignment(ASTNode *node)
     if (is_float_expression(value_node))
     {
         float value = evaluate_expression_float(value_node);
-        if (!set_float_variable(name, value, mods))
+        if (!set_float_variable(target, value, mods))
         {
-            yyerror("Failed to set float variable");
+            report_error("Failed to set float variable");
         }
     }
     else if (is_double_expression(value_node))
     {
         double value = evaluate_expression_double(value_node);
-        if (!set_double_variable(name, value, mods))
+        if (!set_double_variable(target, value, mods))
         {
-            yyerror("Failed to set double variable");
+            report_error("Failed to set double variable");
         }
     }
     else if (is_short_expression(value_node))
     {
         short value = evaluate_expression_short(value_node);
-        if (!set_short_variable(name, value, mods))
+        if (!set_short_variable(target, value, mods))
         {
-            yyerror("Failed to set short variable");
+            report_error("Failed to set short variable");
         }
     }
     else
     {
         int value = evaluate_expression_int(value_node);
-        if (!set_int_variable(name, value, mods))
+        if (!set_int_variable(target, value, mods))
         {
-            yyerror("Failed to set integer variable");
+            report_error("Failed to set integer variable");
         }
     }
 }
 
-void execute_statement(ASTNode *node)
+ControlFlow execute_statement(ASTNode *node)
 {
     if (!node)
-        return;
+        return FLOW_NORMAL;
     switch (node->type)
     {
     case NODE_DECLARATION:
-    {
-        char *name = node->data.op.left->data.name;
-        Variable *var = variable_new(name);
-        add_variable_to_scope(name, var);
-        SAFE_FREE(var);
-    }
+        // Each execution of a declaration starts a fresh variable in its slot
+        brainrot->current_frame->slots[node->slot] = (Variable){.name = node->data.op.left->data.name};
         __attribute__((fallthrough));
     case NODE_ASSIGNMENT:
     {
-        char *name = node->data.op.left->data.name;
-        check_const_assignment(name);
+        ASTNode *target = node->data.op.left;
+        check_const_assignment(target);
 
         // Handle array assignment
-        if (node->data.op.left->type == NODE_ARRAY_ACCESS)
+        if (target->type == NODE_ARRAY_ACCESS)
         {
-            ASTNode *array_node = node->data.op.left;
-            const char *array_name = array_node->data.array.name;
+            ASTNode *array_node = target;
             int idx = evaluate_expression_int(array_node->data.array.index);
 
             // Find array in symbol table
-            Variable *var = get_variable(array_name);
+            Variable *var = lookup_variable(array_node);
             if (var != NULL)
             {
                 if (!var->is_array)
                 {
-                    yyerror("Not an array!");
-                    return;
+                    report_error("Not an array!");
+                    return FLOW_NORMAL;
                 }
-                if (idx < 0 || idx >= var->array_length)
+                if (!array_node->in_bounds && (idx < 0 || idx >= var->array_length))
                 {
-                    yyerror("Array index out of bounds!");
-                    return;
+                    report_error("Array index out of bounds!");
+                    return FLOW_NORMAL;
                 }
 
                 switch (var->var_type)
@@ -2240,13 +2148,13 @@ void execute_statement(ASTNode *node)
                     ((char *)var->value.array_data)[idx] = evaluate_expression_int(node->data.op.right);
                     break;
                 default:
-                    yyerror("Unsupported array type");
-                    return;
+                    report_error("Unsupported array type");
+                    return FLOW_NORMAL;
                 }
-                return;
+                return FLOW_NORMAL;
             }
-            yyerror("Undefined array variable");
-            return;
+            report_error("Undefined array variable");
+            return FLOW_NORMAL;
         }
 
         ASTNode *value_node = node->data.op.right;
@@ -2255,48 +2163,63 @@ void execute_statement(ASTNode *node)
         if (value_node->type == NODE_CHAR)
         {
             // Handle character assignments directly
-            if (!set_char_variable(name, value_node->data.ivalue, mods))
+            if (!set_char_variable(target, value_node->data.ivalue, mods))
             {
-                yyerror("Failed to set character variable");
+                report_error("Failed to set character variable");
             }
         }
         else if (value_node->type == NODE_BOOLEAN)
         {
-            if (!set_bool_variable(name, value_node->data.bvalue, mods))
+            if (!set_bool_variable(target, value_node->data.bvalue, mods))
             {
-                yyerror("Failed to set boolean variable");
+                report_error("Failed to set boolean variable");
             }
         }
         else if (value_node->type == NODE_SHORT)
         {
-            if (!set_short_variable(name, value_node->data.svalue, mods))
+            if (!set_short_variable(target, value_node->data.svalue, mods))
             {
-                yyerror("Failed to set short variable");
+                report_error("Failed to set short variable");
             }
         }
         else if (node->var_type == VAR_FLOAT || is_float_expression(value_node))
         {
             float value = evaluate_expression_float(value_node);
-            if (!set_float_variable(name, value, mods))
+            if (!set_float_variable(target, value, mods))
             {
-                yyerror("Failed to set float variable");
+                report_error("Failed to set float variable");
             }
         }
         else if (node->var_type == VAR_DOUBLE || is_double_expression(value_node))
         {
             double value = evaluate_expression_double(value_node);
-            if (!set_double_variable(name, value, mods))
+            if (!set_double_variable(target, value, mods))
             {
-                yyerror("Failed to set double variable");
+                report_error("Failed to set double variable");
             }
         }
         else
         {
             int value = evaluate_expression_int(value_node);
-            if (!set_int_variable(name, value, mods))
+            if (!set_int_variable(target, value, mods))
             {
-                yyerror("Failed to set integer variable");
+                report_error("Failed to set integer variable");
             }
+            if (node->type == NODE_ASSIGNMENT)
+                quicken(node, NODE_ASSIGN_INT);
+        }
+        break;
+    }
+    case NODE_ASSIGN_INT:
+    {
+        if (!assign_int_holds(node))
+            return execute_statement(node);
+        ASTNode *target = node->data.op.left;
+        check_const_assignment(target);
+        int value = evaluate_expression_int(node->data.op.right);
+        if (!set_int_variable(target, value, node->modifiers))
+        {
+            report_error("Failed to set integer variable");
         }
         break;
     }
@@ -2305,7 +2228,7 @@ void execute_statement(ASTNode *node)
         {
             if (!(node->data.array.name))
             {
-                yyerror("Failed to create array");
+                report_error("Failed to create array");
             }
         }
         break;
@@ -2320,47 +2243,37 @@ void execute_statement(ASTNode *node)
         evaluate_expression(node);
         break;
     case NODE_FUNC_CALL:
-        // TODO: clearn up built-in functions
-        if (strcmp(node->data.func_call.function_name, "yapping") == 0)
+        switch (node->data.func_call.builtin)
         {
+        case BUILTIN_YAPPING:
             execute_yapping_call(node->data.func_call.arguments);
-        }
-        else if (strcmp(node->data.func_call.function_name, "yappin") == 0)
-        {
-            execute_yappin_call(node->data.func_call.arguments);
-        }
-        else if (strcmp(node->data.func_call.function_name, "baka") == 0)
-        {
+            break;
+        case BUILTIN_YAPPIN:
+            execute_yappin_call(node->data.func_call.arguments);
+            break;
+        case BUILTIN_BAKA:
             execute_baka_call(node->data.func_call.arguments);
-        }
-        else if (strcmp(node->data.func_call.function_name, "ragequit") == 0)
-        {
+            break;
+        case BUILTIN_RAGEQUIT:
             execute_ragequit_call(node->data.func_call.arguments);
-        }
-        else if (strcmp(node->data.func_call.function_name, "chill") == 0)
-        {
+            break;
+        case BUILTIN_CHILL:
             execute_chill_call(node->data.func_call.arguments);
-        }
-        else if (strcmp(node->data.func_call.function_name, "slorp") == 0)
-        {
+            break;
+        case BUILTIN_SLORP:
             execute_slorp_call(node->data.func_call.arguments);
-        }
-        else
-        {
-            execute_function_call(
-                node->data.func_call.function_name,
-                node->data.func_call.arguments);
+            break;
+        case BUILTIN_NONE:
+            handle_function_call(node);
+            break;
         }
         break;
     case NODE_FOR_STATEMENT:
-        execute_for_statement(node);
-        break;
+        return execute_for_statement(node);
     case NODE_WHILE_STATEMENT:
-        execute_while_statement(node);
-        break;
+        return execute_while_statement(node);
     case NODE_DO_WHILE_STATEMENT:
-        execute_do_while_statement(node);
-        break;
+        return execute_do_while_statement(node);
     case NODE_PRINT_STATEMENT:
     {
         ASTNode *expr = node->data.op.left;
@@ -2390,138 +2303,204 @@ void execute_statement(ASTNode *node)
         break;
     }
     case NODE_STATEMENT_LIST:
-        execute_statements(node);
-        break;
+        return execute_statements(node);
     case NODE_IF_STATEMENT:
-        enter_scope();
         if (evaluate_expression(node->data.if_stmt.condition))
         {
-            execute_statement(node->data.if_stmt.then_branch);
+            return execute_statement(node->data.if_stmt.then_branch);
         }
         else if (node->data.if_stmt.else_branch)
         {
-            execute_statement(node->data.if_stmt.else_branch);
+            return execute_statement(node->data.if_stmt.else_branch);
         }
-        exit_scope();
         break;
     case NODE_SWITCH_STATEMENT:
-        execute_switch_statement(node);
-        break;
+        return execute_switch_statement(node);
     case NODE_BREAK_STATEMENT:
         // Signal to break out of the current loop/switch
-        bruh();
-        break;
+        return FLOW_BREAK;
+    case NODE_CONTINUE_STATEMENT:
+        // Signal to start the next iteration of the current loop
+        return FLOW_CONTINUE;
     case NODE_FUNCTION_DEF:
-    {
-        Function *func = create_function(
-            node->data.function_def.name,
-            node->data.function_def.return_type,
-            node->data.function_def.parameters,
-            node->data.function_def.body);
-        if (!func)
-        {
-            yyerror("Failed to create function");
-            exit(1);
-        }
+        // The parser already entered the function in the function table
+        node->data.function_def.function->frame_size = node->data.function_def.frame_size;
         break;
-    }
     case NODE_RETURN:
     {
         handle_return_statement(node->data.op.left);
-        break;
+        return FLOW_RETURN;
     }
     default:
-        yyerror("Unknown statement type");
+        report_error("Unknown statement type");
         break;
     }
+    return FLOW_NORMAL;
 }
 
-void execute_statements(ASTNode *node)
+ControlFlow execute_statements(ASTNode *node)
 {
     if (!node)
-        return;
+        return FLOW_NORMAL;
     if (node->type != NODE_STATEMENT_LIST)
     {
-        execute_statement(node);
-        return;
+        return execute_statement(node);
     }
     StatementList *current = node->data.statements;
     while (current)
     {
-        execute_statement(current->statement);
+        ControlFlow flow = execute_statement(current->statement);
+        if (flow != FLOW_NORMAL)
+            return flow;
         current = current->next;
     }
+    return FLOW_NORMAL;
 }
 
-void execute_for_statement(ASTNode *node)
+/*
+ * Loop bodies report how they completed: a bruh leaves the loop, a grind
+ * moves on to the next iteration and a bussin leaves the loop and is
+ * passed on to the function call.
+ */
+static ControlFlow run_for_loop(ASTNode *node)
 {
-    PUSH_JUMP_BUFFER();
-    if (setjmp(CURRENT_JUMP_BUFFER()) == 0)
+    while (1)
     {
-        // Execute initialization once
-        enter_scope();
-        if (node->data.for_stmt.init)
+        // Evaluate condition
+        if (node->data.for_stmt.cond)
         {
-            execute_statement(node->data.for_stmt.init);
+            int cond_result = evaluate_expression(node->data.for_stmt.cond);
+            if (!cond_result)
+            {
+                break;
+            }
         }
 
-        while (1)
+        // Execute body
+        ControlFlow flow = execute_statement(node->data.for_stmt.body);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+
+        // Execute increment
+        if (node->data.for_stmt.incr)
         {
-            // Evaluate condition
-            enter_scope();
-            if (node->data.for_stmt.cond)
-            {
-                int cond_result = evaluate_expression(node->data.for_stmt.cond);
-                if (!cond_result)
-                {
-                    break;
-                }
-            }
+            execute_statement(node->data.for_stmt.incr);
+        }
+    }
+    return FLOW_NORMAL;
+}
 
-            // Execute body
-            if (node->data.for_stmt.body)
-            {
-                execute_statement(node->data.for_stmt.body);
-            }
+static inline bool counter_in_range(OperatorType op, int counter, int bound)
+{
+    switch (op)
+    {
+    case OP_LT:
+        return counter < bound;
+    case OP_LE:
+        return counter <= bound;
+    case OP_GT:
+        return counter > bound;
+    case OP_GE:
+        return counter >= bound;
+    default:
+        return counter != bound;
+    }
+}
 
-            // Execute increment
-            if (node->data.for_stmt.incr)
-            {
-                execute_statement(node->data.for_stmt.incr);
-            }
-            exit_scope();
+/*
+ * A loop resolve_program() marked as counted keeps its counter in a C
+ * local: the bound is read once, the condition and step never go through
+ * the evaluators, and the counter's slot is only written before a body
+ * that reads it and when the loop ends.
+ */
+static ControlFlow run_counted_loop(ASTNode *node)
+{
+    ASTNode *cond = node->data.for_stmt.cond;
+    ASTNode *incr = node->data.for_stmt.incr;
+    Variable *counter = &brainrot->current_frame->slots[cond->data.op.left->slot];
+    // A deadass counter has to fail in its step, as written
+    if (!counter->name || counter->var_type != VAR_INT || counter->modifiers.is_const)
+        return run_for_loop(node);
+
+    OperatorType op = cond->data.op.op;
+    int bound = int_operand(cond->data.op.right);
+    unsigned step = (unsigned)node->data.for_stmt.step;
+    bool reads_counter = node->data.for_stmt.reads_counter;
+    int value = counter->value.ivalue;
+    bool stepped = false;
+    ControlFlow flow = FLOW_NORMAL;
+    long long last = op == OP_LT ? (long long)bound - 1 : bound;
+    if (node->data.for_stmt.idiom && step == 1 && value <= last && last < INT_MAX)
+    {
+        // The whole range at once; the loop below then finds it done
+        if (run_loop_idiom(node->data.for_stmt.idiom, value, (int)last, node->data.for_stmt.parallel))
+        {
+            value = (int)last + 1;
+            stepped = true;
         }
-        exit_scope();
     }
-    POP_JUMP_BUFFER();
+    else if (node->data.for_stmt.vector && step == 1 && value <= last && last < INT_MAX)
+    {
+        // Whole blocks of iterations; the loop below runs the rest
+        int done = run_vector_kernel(node->data.for_stmt.vector, value, (int)last, node->data.for_stmt.parallel);
+        value += done;
+        stepped = done > 0;
+    }
+    while (counter_in_range(op, value, bound))
+    {
+        if (reads_counter)
+            counter->value.ivalue = value;
+        flow = execute_statement(node->data.for_stmt.body);
+        if (flow == FLOW_BREAK || flow == FLOW_RETURN)
+            break;
+        value = (int)((unsigned)value + step);
+        stepped = true;
+    }
+    counter->value.ivalue = value;
+    // i = i + c stores the assignment's modifiers, as ++ and -- do not
+    if (stepped && incr->type == NODE_ASSIGNMENT)
+        counter->modifiers = incr->modifiers;
+    return flow == FLOW_RETURN ? flow : FLOW_NORMAL;
 }
 
-void execute_while_statement(ASTNode *node)
+ControlFlow execute_for_statement(ASTNode *node)
 {
-    PUSH_JUMP_BUFFER();
-    enter_scope();
-    while (evaluate_expression(node->data.while_stmt.cond) && setjmp(CURRENT_JUMP_BUFFER()) == 0)
+    // Execute initialization once
+    if (node->data.for_stmt.init)
     {
-        enter_scope();
-        execute_statement(node->data.while_stmt.body);
-        exit_scope();
+        execute_statement(node->data.for_stmt.init);
     }
-    exit_scope();
-    POP_JUMP_BUFFER();
+    if (node->data.for_stmt.counted && brainrot->current_frame)
+        return run_counted_loop(node);
+    return run_for_loop(node);
 }
 
-void execute_do_while_statement(ASTNode *node)
+ControlFlow execute_while_statement(ASTNode *node)
+{
+    while (evaluate_expression(node->data.while_stmt.cond))
+    {
+        ControlFlow flow = execute_statement(node->data.while_stmt.body);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+    }
+    return FLOW_NORMAL;
+}
+
+ControlFlow execute_do_while_statement(ASTNode *node)
 {
-    PUSH_JUMP_BUFFER();
-    enter_scope();
     do
     {
-        enter_scope();
-        execute_statement(node->data.while_stmt.body);
-        exit_scope();
-    } while (evaluate_expression(node->data.while_stmt.cond) && setjmp(CURRENT_JUMP_BUFFER()) == 0);
-    exit_scope();
-    POP_JUMP_BUFFER();
+        ControlFlow flow = execute_statement(node->data.while_stmt.body);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+    } while (evaluate_expression(node->data.while_stmt.cond));
+    return FLOW_NORMAL;
 }
 
 ASTNode *create_if_statement_node(ASTNode *condition, ASTNode *then_branch, ASTNode *else_branch)
@@ -2538,6 +2517,8 @@ ASTNode *create_string_literal_node(char *string)
 {
     ASTNode *node = ARENA_ALLOC(ASTNode);
     node->type = NODE_STRING_LITERAL;
+    node->type_info = (TypeInfo){0};
+    node->slot = -1;
     node->data.name = ARENA_STRDUP(string);
     return node;
 }
@@ -2548,6 +2529,7 @@ ASTNode *create_switch_statement_node(ASTNode *expression, CaseNode *cases)
     node->type = NODE_SWITCH_STATEMENT;
     node->data.switch_stmt.expression = expression;
     node->data.switch_stmt.cases = cases;
+    node->data.switch_stmt.table = NULL;
     return node;
 }
 
@@ -2584,18 +2566,26 @@ ASTNode *create_break_node()
     return node;
 }
 
+ASTNode *create_continue_node()
+{
+    ASTNode *node = ARENA_ALLOC(ASTNode);
+    node->type = NODE_CONTINUE_STATEMENT;
+    node->data.break_stmt = NULL;
+    return node;
+}
+
 void execute_yapping_call(ArgumentList *args)
 {
     if (!args)
     {
-        yyerror("No arguments provided for yapping function call");
-        exit(EXIT_FAILURE);
+        report_error("No arguments provided for yapping function call");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     ASTNode *formatNode = args->expr;
     if (formatNode->type != NODE_STRING_LITERAL)
     {
-        yyerror("First argument to yapping must be a string literal");
+        report_error("First argument to yapping must be a string literal");
         return;
     }
 
@@ -2621,8 +2611,8 @@ void execute_yapping_call(ArgumentList *args)
 
             if (*format == '\0')
             {
-                yyerror("Invalid format specifier");
-                exit(EXIT_FAILURE);
+                report_error("Invalid format specifier");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             // Copy the format specifier into a temporary buffer
@@ -2635,8 +2625,8 @@ void execute_yapping_call(ArgumentList *args)
             ASTNode *expr = cur->expr;
             if (!expr)
             {
-                yyerror("Invalid argument in yapping call");
-                exit(EXIT_FAILURE);
+                report_error("Invalid argument in yapping call");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             if (*format == 'b')
@@ -2650,7 +2640,7 @@ void execute_yapping_call(ArgumentList *args)
                 // Integer or unsigned integer
                 bool is_unsigned = expr->modifiers.is_unsigned ||
                                    (expr->type == NODE_IDENTIFIER &&
-                                    get_variable_modifiers(expr->data.name).is_unsigned);
+                                    get_variable_modifiers(expr).is_unsigned);
 
                 if (is_unsigned)
                 {
@@ -2685,20 +2675,19 @@ void execute_yapping_call(ArgumentList *args)
                 if (expr->type == NODE_ARRAY_ACCESS)
                 {
                     // Special handling for array access
-                    const char *array_name = expr->data.array.name;
                     int idx = evaluate_expression_int(expr->data.array.index);
 
-                    Variable *var = get_variable(array_name);
+                    Variable *var = lookup_variable(expr);
                     if (var != NULL)
                     {
                         if (!var->is_array)
                         {
-                            yyerror("Not an array!");
+                            report_error("Not an array!");
                             return;
                         }
-                        if (idx < 0 || idx >= var->array_length)
+                        if (!expr->in_bounds && (idx < 0 || idx >= var->array_length))
                         {
-                            yyerror("Array index out of bounds!");
+                            report_error("Array index out of bounds!");
                             return;
                         }
                         if (var->var_type == VAR_FLOAT)
@@ -2730,8 +2719,8 @@ void execute_yapping_call(ArgumentList *args)
                 }
                 else
                 {
-                    yyerror("Invalid argument type for floating-point format specifier");
-                    exit(EXIT_FAILURE);
+                    report_error("Invalid argument type for floating-point format specifier");
+                    brainrot_exit(EXIT_FAILURE);
                 }
             }
             else if (*format == 'c')
@@ -2743,20 +2732,20 @@ void execute_yapping_call(ArgumentList *args)
             else if (*format == 's')
             {
                 // String
-                const Variable *var = get_variable(expr->data.name);
+                const Variable *var = lookup_variable(expr);
                 if (var != NULL)
                 {
                     if (!var->is_array)
                     {
-                        yyerror("Invalid argument type for %s");
-                        exit(EXIT_FAILURE);
+                        report_error("Invalid argument type for %s");
+                        brainrot_exit(EXIT_FAILURE);
                     }
                     buffer_offset += snprintf(buffer + buffer_offset, sizeof(buffer) - buffer_offset, specifier, var->value.array_data);
                 }
                 else if (expr->type != NODE_STRING_LITERAL)
                 {
-                    yyerror("Invalid argument type for %s");
-                    exit(EXIT_FAILURE);
+                    report_error("Invalid argument type for %s");
+                    brainrot_exit(EXIT_FAILURE);
                 }
                 else
                 {
@@ -2765,8 +2754,8 @@ void execute_yapping_call(ArgumentList *args)
             }
             else
             {
-                yyerror("Unsupported format specifier");
-                exit(EXIT_FAILURE);
+                report_error("Unsupported format specifier");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             cur = cur->next; // Move to the next argument
@@ -2781,8 +2770,8 @@ void execute_yapping_call(ArgumentList *args)
         // Check for buffer overflow
         if (buffer_offset >= (int)sizeof(buffer))
         {
-            yyerror("Buffer overflow in yapping call");
-            exit(EXIT_FAILURE);
+            report_error("Buffer overflow in yapping call");
+            brainrot_exit(EXIT_FAILURE);
         }
     }
 
@@ -2796,15 +2785,15 @@ void execute_yappin_call(ArgumentList *args)
 {
     if (!args)
     {
-        yyerror("No arguments provided for yappin function call");
-        exit(EXIT_FAILURE);
+        report_error("No arguments provided for yappin function call");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     ASTNode *formatNode = args->expr;
     if (formatNode->type != NODE_STRING_LITERAL)
     {
-        yyerror("First argument to yappin must be a string literal");
-        exit(EXIT_FAILURE);
+        report_error("First argument to yappin must be a string literal");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     const char *format = formatNode->data.name; // The format string
@@ -2829,8 +2818,8 @@ void execute_yappin_call(ArgumentList *args)
 
             if (*format == '\0')
             {
-                yyerror("Invalid format specifier");
-                exit(EXIT_FAILURE);
+                report_error("Invalid format specifier");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             // Copy the format specifier into a temporary buffer
@@ -2843,8 +2832,8 @@ void execute_yappin_call(ArgumentList *args)
             ASTNode *expr = cur->expr;
             if (!expr)
             {
-                yyerror("Invalid argument in yappin call");
-                exit(EXIT_FAILURE);
+                report_error("Invalid argument in yappin call");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             if (*format == 'b')
@@ -2881,8 +2870,8 @@ void execute_yappin_call(ArgumentList *args)
                 }
                 else
                 {
-                    yyerror("Invalid argument type for floating-point format specifier");
-                    exit(EXIT_FAILURE);
+                    report_error("Invalid argument type for floating-point format specifier");
+                    brainrot_exit(EXIT_FAILURE);
                 }
             }
             else if (*format == 'c')
@@ -2893,20 +2882,20 @@ void execute_yappin_call(ArgumentList *args)
             }
             else if (*format == 's')
             {
-                const Variable *var = get_variable(expr->data.name);
+                const Variable *var = lookup_variable(expr);
                 if (var != NULL)
                 {
                     if (!var->is_array)
                     {
-                        yyerror("Invalid argument type for %s");
-                        exit(EXIT_FAILURE);
+                        report_error("Invalid argument type for %s");
+                        brainrot_exit(EXIT_FAILURE);
                     }
                     buffer_offset += snprintf(buffer + buffer_offset, sizeof(buffer) - buffer_offset, specifier, var->value.array_data);
                 }
                 else if (expr->type != NODE_STRING_LITERAL)
                 {
-                    yyerror("Invalid argument type for %s");
-                    exit(EXIT_FAILURE);
+                    report_error("Invalid argument type for %s");
+                    brainrot_exit(EXIT_FAILURE);
                 }
                 else
                 {
@@ -2915,8 +2904,8 @@ void execute_yappin_call(ArgumentList *args)
             }
             else
             {
-                yyerror("Unsupported format specifier");
-                exit(EXIT_FAILURE);
+                report_error("Unsupported format specifier");
+                brainrot_exit(EXIT_FAILURE);
             }
 
             cur = cur->next; // Move to the next argument
@@ -2931,8 +2920,8 @@ void execute_yappin_call(ArgumentList *args)
         // Check for buffer overflow
         if (buffer_offset >= (int)sizeof(buffer))
         {
-            yyerror("Buffer overflow in yappin call");
-            exit(EXIT_FAILURE);
+            report_error("Buffer overflow in yappin call");
+            brainrot_exit(EXIT_FAILURE);
         }
     }
 
@@ -2953,7 +2942,7 @@ void execute_baka_call(ArgumentList *args)
     ASTNode *formatNode = args->expr;
     if (formatNode->type != NODE_STRING_LITERAL)
     {
-        yyerror("First argument to yapping must be a string literal");
+        report_error("First argument to yapping must be a string literal");
         return;
     }
 
@@ -2964,15 +2953,15 @@ void execute_ragequit_call(ArgumentList *args)
 {
     if (!args)
     {
-        yyerror("No arguments provided for ragequit function call");
-        exit(EXIT_FAILURE);
+        report_error("No arguments provided for ragequit function call");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     ASTNode *formatNode = args->expr;
     if (formatNode->type != NODE_INT)
     {
-        yyerror("First argument to ragequit must be a integer");
-        exit(EXIT_FAILURE);
+        report_error("First argument to ragequit must be a integer");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     ragequit(formatNode->data.ivalue);
@@ -2982,15 +2971,15 @@ void execute_chill_call(ArgumentList *args)
 {
     if (!args)
     {
-        yyerror("No arguments provided for chill function call");
-        exit(EXIT_FAILURE);
+        report_error("No arguments provided for chill function call");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     ASTNode *formatNode = args->expr;
     if (formatNode->type != NODE_INT && !formatNode->modifiers.is_unsigned)
     {
-        yyerror("First argument to chill must be a unsigned integer");
-        exit(EXIT_FAILURE);
+        report_error("First argument to chill must be a unsigned integer");
+        brainrot_exit(EXIT_FAILURE);
     }
 
     chill(formatNode->data.ivalue);
@@ -3000,15 +2989,15 @@ void execute_slorp_call(ArgumentList *args)
 {
     if (!args || args->expr->type != NODE_IDENTIFIER)
     {
-        yyerror("slurp requires a variable identifier");
+        report_error("slurp requires a variable identifier");
         return;
     }
 
-    char *name = args->expr->data.name;
-    Variable *var = get_variable(name);
+    ASTNode *target = args->expr;
+    Variable *var = lookup_variable(target);
     if (!var)
     {
-        yyerror("Undefined variable");
+        report_error("Undefined variable");
         return;
     }
 
@@ -3018,28 +3007,28 @@ void execute_slorp_call(ArgumentList *args)
     {
         int val = 0;
         val = slorp_int(val);
-        set_int_variable(name, val, var->modifiers);
+        set_int_variable(target, val, var->modifiers);
         break;
     }
     case VAR_FLOAT:
     {
         float val = 0.0f;
         val = slorp_float(val);
-        set_float_variable(name, val, var->modifiers);
+        set_float_variable(target, val, var->modifiers);
         break;
     }
     case VAR_DOUBLE:
     {
         double val = 0.0;
         val = slorp_double(val);
-        set_double_variable(name, val, var->modifiers);
+        set_double_variable(target, val, var->modifiers);
         break;
     }
     case VAR_SHORT:
     {
         short val = 0;
         val = slorp_short(val);
-        set_short_variable(name, val, var->modifiers);
+        set_short_variable(target, val, var->modifiers);
         break;
     }
     case VAR_CHAR:
@@ -3054,19 +3043,14 @@ void execute_slorp_call(ArgumentList *args)
         }
         char val = 0;
         val = slorp_char(val);
-        set_int_variable(name, val, var->modifiers);
+        set_int_variable(target, val, var->modifiers);
         break;
     }
     default:
-        yyerror("Unsupported type for slorp");
+        report_error("Unsupported type for slorp");
     }
 }
 
-void bruh()
-{
-    LONGJMP();
-}
-
 ASTNode *create_default_node(VarType var_type)
 {
     switch (var_type)
@@ -3084,8 +3068,8 @@ ASTNode *create_default_node(VarType var_type)
     case VAR_BOOL:
         return create_boolean_node(0);
     default:
-        yyerror("Unsupported type for default node");
-        exit(1);
+        report_error("Unsupported type for default node");
+        brainrot_exit(1);
     }
 }
 
@@ -3093,25 +3077,24 @@ void *evaluate_array_access(ASTNode *node)
 {
     if (!node || node->type != NODE_ARRAY_ACCESS)
     {
-        yyerror("Invalid array access node");
+        report_error("Invalid array access node");
         return NULL;
     }
 
-    const char *array_name = node->data.array.name;
     int idx = evaluate_expression_int(node->data.array.index);
 
-    Variable *var = get_variable(array_name);
+    Variable *var = lookup_variable(node);
 
     if (var != NULL)
     {
         if (!var->is_array)
         {
-            yyerror("Not an array!");
+            report_error("Not an array!");
             return NULL;
         }
-        if (idx < 0 || idx >= var->array_length)
+        if (!node->in_bounds && (idx < 0 || idx >= var->array_length))
         {
-            yyerror("Array index out of bounds!");
+            report_error("Array index out of bounds!");
             return NULL;
         }
 
@@ -3138,11 +3121,11 @@ void *evaluate_array_access(ASTNode *node)
             ((char *)var->value.array_data)[idx] = evaluate_expression_int(node->data.op.right);
             break;
         default:
-            yyerror("Unsupported array type");
+            report_error("Unsupported array type");
         }
         return result;
     }
-    yyerror("Undefined array variable");
+    report_error("Undefined array variable");
     return NULL;
 }
 
@@ -3151,8 +3134,8 @@ ExpressionList *create_expression_list(ASTNode *expr)
     ExpressionList *list = SAFE_MALLOC(ExpressionList);
     if (!list)
     {
-        yyerror("Failed to allocate memory for expression list");
-        exit(1);
+        report_error("Failed to allocate memory for expression list");
+        brainrot_exit(1);
     }
     list->expr = expr;
     list->next = list;
@@ -3165,8 +3148,8 @@ ExpressionList *append_expression_list(ExpressionList *list, ASTNode *expr)
     ExpressionList *new_node = SAFE_MALLOC(ExpressionList);
     if (!new_node)
     {
-        yyerror("Failed to allocate memory for expression list");
-        exit(1);
+        report_error("Failed to allocate memory for expression list");
+        brainrot_exit(1);
     }
     new_node->expr = expr;
 
@@ -3219,13 +3202,13 @@ void populate_array_variable(char *name, ExpressionList *list)
     {
         if (!var->is_array)
         {
-            yyerror("Not an array!");
+            report_error("Not an array!");
             return;
         }
         if (var->array_length < (int)count_expression_list(list))
         {
-            yyerror("Too many elements in array initialization");
-            exit(1);
+            report_error("Too many elements in array initialization");
+            brainrot_exit(1);
         }
 
         size_t array_length = var->array_length;
@@ -3255,7 +3238,7 @@ void populate_array_variable(char *name, ExpressionList *list)
                 ((bool *)var->value.array_data)[index] = evaluate_expression_bool(current->expr);
                 break;
             default:
-                yyerror("Unsupported array type");
+                report_error("Unsupported array type");
                 return;
             }
             current = current->next;
@@ -3265,7 +3248,7 @@ void populate_array_variable(char *name, ExpressionList *list)
 
         return;
     }
-    yyerror("Undefined array variable");
+    report_error("Undefined array variable");
 }
 
 void free_statement_list(StatementList *list)
@@ -3285,7 +3268,45 @@ void free_statement_list(StatementList *list)
 
 void free_ast()
 {
-    arena_free(&arena);
+    arena_free(&brainrot->arena);
+}
+
+BrainrotVM *brainrot_create(void)
+{
+    BrainrotVM *vm = SAFE_CALLOC(1, BrainrotVM);
+    if (!vm)
+    {
+        fprintf(stderr, "Error: Failed to allocate memory for the interpreter\n");
+        exit(1);
+    }
+    vm->current_var_type = NONE;
+    vm->quicken_enabled = true;
+    vm->out = stdout;
+    vm->err = stderr;
+    brainrot = vm;
+    vm->current_scope = create_scope(NULL);
+    return vm;
+}
+
+void brainrot_destroy(BrainrotVM *vm)
+{
+    // The free functions work on the current context
+    BrainrotVM *current = brainrot == vm ? NULL : brainrot;
+    brainrot = vm;
+    free_ast();
+    free_function_table();
+    free_frame_stack();
+    free_scope(vm->current_scope);
+    SAFE_FREE(vm);
+    brainrot = current;
+}
+
+void brainrot_exit(int status)
+{
+    if (!brainrot || !brainrot->quit)
+        exit(status);
+    brainrot->exit_status = status;
+    longjmp(*brainrot->quit, 1);
 }
 
 Scope *create_scope(Scope *parent)
@@ -3293,9 +3314,9 @@ Scope *create_scope(Scope *parent)
     Scope *scope = SAFE_MALLOC(Scope);
     if (!scope)
     {
-        yyerror("Failed to allocate memory for scope");
+        report_error("Failed to allocate memory for scope");
         SAFE_FREE(scope);
-        exit(1);
+        brainrot_exit(1);
     }
     scope->variables = hm_new();
     scope->parent = parent;
@@ -3304,7 +3325,7 @@ Scope *create_scope(Scope *parent)
 
 Variable *get_variable(const char *name)
 {
-    Scope *scope = current_scope;
+    Scope *scope = brainrot->current_scope;
     while (scope)
     {
         Variable *var = hm_get(scope->variables, name, strlen(name));
@@ -3321,17 +3342,20 @@ Variable *get_variable(const char *name)
     return NULL;
 }
 
-void exit_scope()
+/*
+ * Returns the variable an identifier or array access names in the running
+ * function, or NULL if it is not declared there. Before execution starts
+ * there is no frame and only the global arrays exist, so those are looked
+ * up by name.
+ */
+Variable *lookup_variable(ASTNode *node)
 {
-    if (!current_scope)
-    {
-        yyerror("No scope to exit");
-        exit(1);
-    }
-    Scope *parent = current_scope->parent;
-    hm_free(current_scope->variables);
-    SAFE_FREE(current_scope);
-    current_scope = parent;
+    if (!brainrot->current_frame)
+        return get_variable(node->data.name);
+    if (node->slot < 0)
+        return NULL;
+    Variable *var = &brainrot->current_frame->slots[node->slot];
+    return var->name ? var : NULL;
 }
 
 void free_scope(Scope *scope)
@@ -3342,17 +3366,114 @@ void free_scope(Scope *scope)
     free_scope(scope->parent);
     SAFE_FREE(scope);
 }
-void enter_scope()
+
+/*
+ * Frame slots live on a stack of fixed-size chunks. A chunk never moves, so
+ * pointers into a frame stay valid while callees push frames above it, and
+ * popped chunks are kept for the next call that needs them.
+ */
+#define SLOT_CHUNK_SIZE 4096
+
+typedef struct SlotChunk
+{
+    struct SlotChunk *prev;
+    struct SlotChunk *next;
+    int used;
+    int capacity;
+    Variable slots[];
+} SlotChunk;
+
+static SlotChunk *new_slot_chunk(SlotChunk *prev, int capacity)
+{
+    SlotChunk *chunk = safe_malloc(sizeof(SlotChunk) + (size_t)capacity * sizeof(Variable));
+    if (!chunk)
+    {
+        report_error("Failed to allocate memory for frame");
+        brainrot_exit(1);
+    }
+    chunk->prev = prev;
+    chunk->next = NULL;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void push_frame(Frame *frame, int slot_count, VarType return_type)
+{
+    frame->slot_count = slot_count;
+    frame->slots = NULL;
+    frame->return_value = (Value){.type = return_type == VAR_CHAR ? VAR_INT : return_type, .dvalue = 0};
+    if (!slot_count)
+        return;
+
+    if (!brainrot->slot_chunk)
+        brainrot->slot_chunk = new_slot_chunk(NULL, SLOT_CHUNK_SIZE);
+    if (brainrot->slot_chunk->used + slot_count > brainrot->slot_chunk->capacity)
+    {
+        SlotChunk *next = brainrot->slot_chunk->next;
+        if (next && next->capacity < slot_count)
+        {
+            SAFE_FREE(next);
+            next = NULL;
+        }
+        if (!next)
+        {
+            next = new_slot_chunk(brainrot->slot_chunk, slot_count > SLOT_CHUNK_SIZE ? slot_count : SLOT_CHUNK_SIZE);
+            brainrot->slot_chunk->next = next;
+        }
+        brainrot->slot_chunk = next;
+    }
+    frame->slots = &brainrot->slot_chunk->slots[brainrot->slot_chunk->used];
+    brainrot->slot_chunk->used += slot_count;
+    memset(frame->slots, 0, (size_t)slot_count * sizeof(Variable));
+}
+
+/* Frames never own array storage: arrays belong to the global scope. */
+void pop_frame(Frame *frame)
+{
+    if (!frame->slot_count)
+        return;
+    brainrot->slot_chunk->used -= frame->slot_count;
+    if (!brainrot->slot_chunk->used && brainrot->slot_chunk->prev)
+        brainrot->slot_chunk = brainrot->slot_chunk->prev;
+}
+
+void free_frame_stack(void)
+{
+    while (brainrot->slot_chunk && brainrot->slot_chunk->prev)
+        brainrot->slot_chunk = brainrot->slot_chunk->prev;
+    while (brainrot->slot_chunk)
+    {
+        SlotChunk *next = brainrot->slot_chunk->next;
+        SAFE_FREE(brainrot->slot_chunk);
+        brainrot->slot_chunk = next;
+    }
+}
+
+void execute_program(ASTNode *root, int frame_size, const struct Closure *compiled)
 {
-    current_scope = create_scope(current_scope);
+    Frame main_frame;
+    Frame *frame = &main_frame;
+    push_frame(frame, frame_size, VAR_INT);
+    bind_global_arrays(frame);
+    brainrot->current_frame = frame;
+    ControlFlow flow = compiled ? execute_closure(compiled) : execute_statement(root);
+    if (flow == FLOW_BREAK || flow == FLOW_CONTINUE)
+    {
+        report_error(flow == FLOW_BREAK ? "bruh outside of a loop or switch" : "grind outside of a loop");
+        brainrot_exit(1);
+    }
+    brainrot->current_frame = NULL;
+    pop_frame(frame);
 }
+
 Variable *variable_new(char *name)
 {
     Variable *var = SAFE_MALLOC(Variable);
     if (!var)
     {
-        yyerror("Failed to allocate memory for variable");
-        exit(1);
+        report_error("Failed to allocate memory for variable");
+        brainrot_exit(1);
     }
     var->name = name;
     var->is_array = false;
@@ -3361,20 +3482,20 @@ Variable *variable_new(char *name)
 
 void add_variable_to_scope(const char *name, Variable *var)
 {
-    if (!current_scope)
+    if (!brainrot->current_scope)
     {
-        yyerror("No scope to add variable to");
-        exit(1);
+        report_error("No scope to add variable to");
+        brainrot_exit(1);
     }
-    Variable *existing = hm_get(current_scope->variables, name, strlen(name));
+    Variable *existing = hm_get(brainrot->current_scope->variables, name, strlen(name));
     if (existing)
     {
-        yyerror("Variable already exists in current scope");
+        report_error("Variable already exists in current scope");
         SAFE_FREE(var);
-        exit(1);
+        brainrot_exit(1);
     }
 
-    hm_put(current_scope->variables, name, strlen(name), var, sizeof(Variable));
+    hm_put(brainrot->current_scope->variables, name, strlen(name), var, sizeof(Variable));
 }
 
 ASTNode *create_return_node(ASTNode *expr)
@@ -3382,7 +3503,7 @@ ASTNode *create_return_node(ASTNode *expr)
     ASTNode *node = ARENA_ALLOC(ASTNode);
     if (!node)
     {
-        yyerror("Memory allocation failed");
+        report_error("Memory allocation failed");
         return NULL;
     }
     node->type = NODE_RETURN;
@@ -3395,7 +3516,7 @@ Function *create_function(char *name, VarType return_type, Parameter *params, AS
     Function *func = SAFE_MALLOC(Function);
     if (!func)
     {
-        yyerror("Failed to allocate memory for function");
+        report_error("Failed to allocate memory for function");
         return NULL;
     }
 
@@ -3403,80 +3524,122 @@ Function *create_function(char *name, VarType return_type, Parameter *params, AS
     func->return_type = return_type;
     func->parameters = params;
     func->body = body;
-    func->next = function_table;
-    function_table = func;
+
+    // The parser builds the parameter list back to front
+    func->param_count = 0;
+    for (Parameter *param = params; param; param = param->next)
+        func->param_count++;
+    func->params = ARENA_ALLOC_ARRAY(Parameter *, func->param_count);
+    int index = func->param_count;
+    for (Parameter *param = params; param; param = param->next)
+        func->params[--index] = param;
+    func->frame_size = 0;
+    func->closure = NULL;
+    func->next = brainrot->function_table;
+    brainrot->function_table = func;
+    Function **bucket = function_bucket(name);
+    func->bucket_next = *bucket;
+    *bucket = func;
 
     return func;
 }
 
-void execute_function_call(const char *name, ArgumentList *args)
+/* Reads an argument as the type of the parameter it is passed to. */
+static void bind_argument(Variable *var, Parameter *param, ASTNode *expr)
 {
-    // Find function in function table
-    Function *func = function_table;
-    while (func)
+    var->name = param->name;
+    var->modifiers = param->modifiers;
+    switch (param->type)
     {
-        if (strcmp(func->name, name) == 0)
-        {
-            // Create new scope for function
-            enter_function_scope(func, args);
-            current_return_value.type = func->return_type;
+    case VAR_INT:
+    case VAR_CHAR:
+        var->var_type = VAR_INT;
+        var->value.ivalue = evaluate_expression_int(expr);
+        break;
+    case VAR_FLOAT:
+        var->var_type = VAR_FLOAT;
+        var->value.fvalue = evaluate_expression_float(expr);
+        break;
+    case VAR_DOUBLE:
+        var->var_type = VAR_DOUBLE;
+        var->value.dvalue = evaluate_expression_double(expr);
+        break;
+    case VAR_BOOL:
+        var->var_type = VAR_BOOL;
+        var->value.bvalue = evaluate_expression_bool(expr);
+        break;
+    case VAR_SHORT:
+        var->var_type = VAR_SHORT;
+        var->value.svalue = evaluate_expression_short(expr);
+        break;
+    case NONE:
+        break;
+    }
+}
 
+/*
+ * Calls a user function. The callee's frame is pushed first and the
+ * arguments, evaluated in the caller's frame, go straight into the
+ * parameter slots. The result comes back by value, typed as the function
+ * returns; a function that falls off its end returns zero.
+ */
+Value call_function(Function *func, ArgumentList *args)
+{
+    Frame *caller = brainrot->current_frame;
+    Frame frame;
+    push_frame(&frame, func->frame_size, func->return_type);
 
-            // Set up return handling
-            current_return_value.has_value = false;
-            PUSH_JUMP_BUFFER();
-            if (setjmp(CURRENT_JUMP_BUFFER()) == 0)
-            {
-                execute_statement(func->body);
-            }
+    // Parameters take the first slots, in declaration order
+    ArgumentList *arg = args;
+    int arg_count = 0;
+    for (; arg && arg_count < func->param_count; arg = arg->next, arg_count++)
+        bind_argument(&frame.slots[arg_count], func->params[arg_count], arg->expr);
 
-            POP_JUMP_BUFFER();
-            return;
-        }
-        func = func->next;
+    if (arg || arg_count != func->param_count)
+    {
+        report_error("Mismatched number of arguments and parameters");
+        pop_frame(&frame);
+        return frame.return_value;
     }
 
-    yyerror("Undefined function");
+    // A bussin ends the body early and leaves its value in the frame
+    brainrot->current_frame = &frame;
+    if (func->closure)
+        execute_closure(func->closure);
+    else
+        execute_statement(func->body);
+    brainrot->current_frame = caller;
+    pop_frame(&frame);
+    return frame.return_value;
 }
 
 void handle_return_statement(ASTNode *expr)
 {
-    current_return_value.has_value = true;
+    Value *result = &brainrot->current_frame->return_value;
     if (expr)
     {
-        switch (current_return_value.type)
+        switch (result->type)
         {
         case VAR_INT:
-            current_return_value.value.ivalue = evaluate_expression_int(expr);
+            result->ivalue = evaluate_expression_int(expr);
             break;
         case VAR_FLOAT:
-            current_return_value.value.fvalue = evaluate_expression_float(expr);
+            result->fvalue = evaluate_expression_float(expr);
             break;
         case VAR_DOUBLE:
-            current_return_value.value.dvalue = evaluate_expression_double(expr);
+            result->dvalue = evaluate_expression_double(expr);
             break;
         case VAR_BOOL:
-            current_return_value.value.bvalue = evaluate_expression_bool(expr);
+            result->bvalue = evaluate_expression_bool(expr);
             break;
         case VAR_SHORT:
-            current_return_value.value.svalue = evaluate_expression_short(expr);
+            result->svalue = evaluate_expression_short(expr);
             break;
         default:
-            yyerror("Unsupported return type");
-            exit(1);
+            report_error("Unsupported return type");
+            brainrot_exit(1);
         }
     }
-    // Clean up all scopes until we reach the function scope
-    while (current_scope && !current_scope->is_function_scope)
-    {
-        exit_scope();
-    }
-
-    // skibidi main function do not have jump buffer
-    if (jump_buffer){
-        exit_scope(); // exit current function scope
-        LONGJMP();
-    }
 }
 
 Parameter *create_parameter(char *name, VarType type, Parameter *next, TypeModifiers mods)
@@ -3484,7 +3647,7 @@ Parameter *create_parameter(char *name, VarType type, Parameter *next, TypeModif
     Parameter *param = ARENA_ALLOC(Parameter);
     if (!param)
     {
-        yyerror("Failed to allocate memory for parameter");
+        report_error("Failed to allocate memory for parameter");
         return NULL;
     }
 
@@ -3501,7 +3664,7 @@ ASTNode *create_function_def_node(char *name, VarType return_type, Parameter *pa
     ASTNode *node = ARENA_ALLOC(ASTNode);
     if (!node)
     {
-        yyerror("Failed to allocate memory for function definition node");
+        report_error("Failed to allocate memory for function definition node");
         return NULL;
     }
 
@@ -3512,7 +3675,7 @@ ASTNode *create_function_def_node(char *name, VarType return_type, Parameter *pa
     node->data.function_def.body = body;
 
     // Add function to global function table
-    create_function(name, return_type, params, body);
+    node->data.function_def.function = create_function(name, return_type, params, body);
 
     return node;
 }
@@ -3520,7 +3683,7 @@ ASTNode *create_function_def_node(char *name, VarType return_type, Parameter *pa
 
 void free_function_table(void)
 {
-    Function *f = function_table;
+    Function *f = brainrot->function_table;
     while (f)
     {
         Function *next = f->next;
@@ -3535,107 +3698,143 @@ void free_function_table(void)
         SAFE_FREE(f);
         f = next;
     }
-    function_table = NULL;
+    brainrot->function_table = NULL;
+    memset(brainrot->function_buckets, 0, sizeof(brainrot->function_buckets));
 }
 
-void reverse_parameter_list(Parameter **head)
+/* Unlinks a function from the table and its hash chain and frees it; its
+ * body stays with the AST. */
+void remove_function(Function *func)
 {
-    Parameter *prev = NULL, *current = *head, *next = NULL;
-    while (current)
+    for (Function **link = &brainrot->function_table; *link; link = &(*link)->next)
     {
-        next = current->next;
-        current->next = prev;
-        prev = current;
-        current = next;
+        if (*link == func)
+        {
+            *link = func->next;
+            break;
+        }
     }
-    *head = prev;
-}
-
-void enter_function_scope(Function *func, ArgumentList *args)
-{
-    ArgumentList *curr_arg = args;
-    Value arg_values[MAX_ARGUMENTS];
-    int arg_count = 0;
-
-    // Reverse the parameter list
-    reverse_parameter_list(&func->parameters);
-    Parameter *curr_param = func->parameters;
-
-    // Evaluate argument values before creating the scope
-    while (curr_arg && curr_param)
+    for (Function **link = function_bucket(func->name); *link; link = &(*link)->bucket_next)
     {
-        switch (curr_param->type)
+        if (*link == func)
         {
-        case VAR_INT:
-        case VAR_CHAR:
-            arg_values[arg_count].ivalue = evaluate_expression_int(curr_arg->expr);
-            break;
-        case VAR_FLOAT:
-            arg_values[arg_count].fvalue = evaluate_expression_float(curr_arg->expr);
-            break;
-        case VAR_DOUBLE:
-            arg_values[arg_count].dvalue = evaluate_expression_double(curr_arg->expr);
-            break;
-        case VAR_BOOL:
-            arg_values[arg_count].bvalue = evaluate_expression_bool(curr_arg->expr);
-            break;
-        case VAR_SHORT:
-            arg_values[arg_count].svalue = evaluate_expression_short(curr_arg->expr);
-            break;
-        case NONE:
+            *link = func->bucket_next;
             break;
         }
-
-        curr_arg = curr_arg->next;
-        curr_param = curr_param->next;
-        arg_count++;
     }
+    SAFE_FREE(func->name);
+    SAFE_FREE(func);
+}
 
-    if (curr_arg || curr_param)
-    {
-        yyerror("Mismatched number of arguments and parameters");
-        return;
-    }
+static void link_calls(ASTNode *node);
 
-    // Create function scope after evaluating arguments
-    Scope *scope = create_scope(current_scope);
-    current_scope = scope;
-    current_scope->is_function_scope = true;
+static void link_arguments(ArgumentList *args)
+{
+    for (; args; args = args->next)
+        link_calls(args->expr);
+}
 
-    curr_param = func->parameters; // Reset parameter list after reversing
+/* Output and input inside a schizo flex loop would depend on the order its
+ * iterations run in */
+static void reject_in_parallel_loop(const char *name)
+{
+    if (!brainrot->parallel_loops)
+        return;
+    fprintf(brainrot->err, "Error: '%s' inside a schizo flex loop\n", name);
+    brainrot_exit(1);
+}
 
-    // Assign evaluated values to function parameters
-    for (int i = 0; i < arg_count; i++)
+/* Binds every user-function call below `node` to its Function. */
+static void link_calls(ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
     {
-        Variable *var = variable_new(curr_param->name);
-        var->var_type = curr_param->type;
-        TypeModifiers mods = curr_param->modifiers;
-        add_variable_to_scope(curr_param->name, var);
-        SAFE_FREE(var);
-
-        switch (curr_param->type)
-        {
-        case VAR_INT:
-        case VAR_CHAR:
-            set_int_variable(curr_param->name, arg_values[i].ivalue, mods);
-            break;
-        case VAR_FLOAT:
-            set_float_variable(curr_param->name, arg_values[i].fvalue, mods);
-            break;
-        case VAR_DOUBLE:
-            set_double_variable(curr_param->name, arg_values[i].dvalue, mods);
-            break;
-        case VAR_BOOL:
-            set_bool_variable(curr_param->name, arg_values[i].bvalue, mods);
-            break;
-        case VAR_SHORT:
-            set_short_variable(curr_param->name, arg_values[i].svalue, mods);
-            break;
-        case NONE:
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            link_calls(entry->statement);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+    case NODE_OPERATION:
+        link_calls(node->data.op.left);
+        link_calls(node->data.op.right);
+        break;
+    case NODE_PRINT_STATEMENT:
+        reject_in_parallel_loop("yapping");
+        link_calls(node->data.op.left);
+        break;
+    case NODE_ERROR_STATEMENT:
+        reject_in_parallel_loop("baka");
+        __attribute__((fallthrough));
+    case NODE_RETURN:
+        link_calls(node->data.op.left);
+        break;
+    case NODE_UNARY_OPERATION:
+        link_calls(node->data.unary.operand);
+        break;
+    case NODE_ARRAY_ACCESS:
+        link_calls(node->data.array.index);
+        break;
+    case NODE_SIZEOF:
+        link_calls(node->data.sizeof_stmt.expr);
+        break;
+    case NODE_FUNC_CALL:
+        link_arguments(node->data.func_call.arguments);
+        if (node->data.func_call.builtin == BUILTIN_YAPPING || node->data.func_call.builtin == BUILTIN_YAPPIN ||
+            node->data.func_call.builtin == BUILTIN_BAKA || node->data.func_call.builtin == BUILTIN_SLORP)
+            reject_in_parallel_loop(node->data.func_call.function_name);
+        if (node->data.func_call.builtin != BUILTIN_NONE)
             break;
+        node->data.func_call.function = get_function(node->data.func_call.function_name);
+        if (!node->data.func_call.function)
+        {
+            fprintf(brainrot->err, "Error: Undefined function '%s'\n", node->data.func_call.function_name);
+            brainrot_exit(1);
+        }
+        break;
+    case NODE_FOR_STATEMENT:
+        link_calls(node->data.for_stmt.init);
+        link_calls(node->data.for_stmt.cond);
+        link_calls(node->data.for_stmt.incr);
+        brainrot->parallel_loops += node->data.for_stmt.parallel == LOOP_SCHIZO;
+        link_calls(node->data.for_stmt.body);
+        brainrot->parallel_loops -= node->data.for_stmt.parallel == LOOP_SCHIZO;
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        link_calls(node->data.while_stmt.cond);
+        link_calls(node->data.while_stmt.body);
+        break;
+    case NODE_IF_STATEMENT:
+        link_calls(node->data.if_stmt.condition);
+        link_calls(node->data.if_stmt.then_branch);
+        link_calls(node->data.if_stmt.else_branch);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        link_calls(node->data.switch_stmt.expression);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            link_calls(entry->value);
+            link_calls(entry->statements);
         }
-        curr_param = curr_param->next;
+        break;
+    case NODE_FUNCTION_DEF:
+        link_calls(node->data.function_def.body);
+        break;
+    default:
+        break;
     }
-    reverse_parameter_list(&func->parameters);
+}
+
+/*
+ * Runs once after parsing: binds each call site to the function it calls,
+ * so calls no longer search for their callee by name and a call to an
+ * undefined function is reported before the program starts.
+ */
+void link_program(ASTNode *root)
+{
+    link_calls(root);
 }
 
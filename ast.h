@@ -6,11 +6,11 @@
 #include "lib/hm.h"
 #include "lib/arena.h"
 #include "lib/mem.h"
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
-#include <setjmp.h>
 
 #define MAX_VARS 100
 #define MAX_ARGUMENTS 100
@@ -31,11 +31,24 @@ typedef struct
     bool is_const;
 } TypeModifiers;
 
-typedef struct JumpBuffer
+/* Static type facts about an expression, filled in by resolve_types() */
+typedef struct
+{
+    bool resolved; /* var_type and the flags below hold for every evaluation */
+    bool has_short;
+    bool has_float;
+    bool has_double;
+} TypeInfo;
+
+/* How a statement completed. Anything but FLOW_NORMAL unwinds the
+ * enclosing statements until a loop, switch or function call consumes it. */
+typedef enum
 {
-    jmp_buf data;
-    struct JumpBuffer *next;
-} JumpBuffer;
+    FLOW_NORMAL,
+    FLOW_BREAK,
+    FLOW_CONTINUE,
+    FLOW_RETURN,
+} ControlFlow;
 
 typedef struct ExpressionList
 {
@@ -68,23 +81,26 @@ typedef struct Function
     char *name;
     VarType return_type;
     Parameter *parameters;
+    Parameter **params; /* parameters in declaration order */
+    int param_count;
     ASTNode *body;
+    int frame_size; /* slots resolve_program() assigned to parameters and locals */
+    const struct Closure *closure; /* compiled body, run in place of body when set */
     struct Function *next;
+    struct Function *bucket_next; /* chain in the function hash table */
 } Function;
 
-typedef struct
+/* Built-in functions a call site can name; BUILTIN_NONE calls a user function. */
+typedef enum
 {
-    bool has_value;
-    union
-    {
-        int ivalue;
-        float fvalue;
-        double dvalue;
-        bool bvalue;
-        short svalue;
-    } value;
-    VarType type;
-} ReturnValue;
+    BUILTIN_NONE,
+    BUILTIN_YAPPING,
+    BUILTIN_YAPPIN,
+    BUILTIN_BAKA,
+    BUILTIN_RAGEQUIT,
+    BUILTIN_CHILL,
+    BUILTIN_SLORP,
+} Builtin;
 
 /* Symbol table structure */
 typedef struct
@@ -105,7 +121,7 @@ typedef struct
     int array_length;
 } Variable;
 
-typedef union
+typedef struct
 {
     VarType type;
     union
@@ -118,6 +134,25 @@ typedef union
     };
 } Value;
 
+/* Converts a value to the type a caller evaluates it as. */
+#define VALUE_AS(CT, v)                        \
+    ((v).type == VAR_DOUBLE  ? (CT)(v).dvalue  \
+     : (v).type == VAR_FLOAT ? (CT)(v).fvalue  \
+     : (v).type == VAR_SHORT ? (CT)(v).svalue  \
+     : (v).type == VAR_BOOL  ? (CT)(v).bvalue  \
+                             : (CT)(v).ivalue)
+
+/* Variables of one function activation. Identifiers index `slots` directly
+ * with the slot resolve_program() gave them; a slot whose name is NULL has
+ * not been declared yet in this activation. The slots live on the frame
+ * stack; the Frame itself lives on the C stack of the call. */
+typedef struct Frame
+{
+    Variable *slots;
+    int slot_count;
+    Value return_value; /* typed as the function returns; set by bussin */
+} Frame;
+
 /* Operator types */
 typedef enum
 {
@@ -142,6 +177,22 @@ typedef enum
     OP_ASSIGN,
 } OperatorType;
 
+/* X(specialized node, operator): binary operations the tree-walker rewrites
+ * in place once it has seen both operands evaluate as int. The list is
+ * kept contiguous in NodeType, first to last. */
+#define INT_INT_OPERATIONS(X)      \
+    X(NODE_ADD_INT_INT, OP_PLUS)   \
+    X(NODE_SUB_INT_INT, OP_MINUS)  \
+    X(NODE_MUL_INT_INT, OP_TIMES)  \
+    X(NODE_DIV_INT_INT, OP_DIVIDE) \
+    X(NODE_MOD_INT_INT, OP_MOD)    \
+    X(NODE_LT_INT_INT, OP_LT)      \
+    X(NODE_GT_INT_INT, OP_GT)      \
+    X(NODE_LE_INT_INT, OP_LE)      \
+    X(NODE_GE_INT_INT, OP_GE)      \
+    X(NODE_EQ_INT_INT, OP_EQ)      \
+    X(NODE_NE_INT_INT, OP_NE)
+
 /* AST node types */
 typedef enum
 {
@@ -168,11 +219,18 @@ typedef enum
     NODE_CASE,
     NODE_DEFAULT_CASE,
     NODE_BREAK_STATEMENT,
+    NODE_CONTINUE_STATEMENT,
     NODE_SIZEOF,
     NODE_ARRAY_ACCESS,
     NODE_FUNC_CALL,
     NODE_FUNCTION_DEF,
     NODE_RETURN,
+    /* Specialized forms execute_statement() and the evaluators rewrite a
+     * node into after running it once, and undo when its types change */
+#define QUICKENED_NODE(NODE, OP) NODE,
+    INT_INT_OPERATIONS(QUICKENED_NODE)
+#undef QUICKENED_NODE
+    NODE_ASSIGN_INT, /* scalar assignment of an int value */
 } NodeType;
 
 /* Rest of the structure definitions */
@@ -196,6 +254,94 @@ struct CaseNode
     struct CaseNode *next;
 };
 
+/* Switches with at least SWITCH_TABLE_MIN_CASES cases before `based`, all
+ * with literal values, dispatch through a table instead of testing every
+ * case. The table is indexed by value when the values span at most
+ * SWITCH_DENSE_FACTOR slots per case, and binary searched otherwise. */
+#define SWITCH_TABLE_MIN_CASES 4
+#define SWITCH_DENSE_FACTOR 3
+
+/* Where execution of a switch starts for each value, built by
+ * resolve_program() or the bytecode compiler */
+typedef struct
+{
+    int low;            /* dense: the value entries[0] is for */
+    int *keys;          /* sparse: the case values, ascending; NULL when dense */
+    CaseNode **entries; /* NULL in a dense table's gaps */
+    int count;
+    CaseNode *miss; /* `based`, or NULL, for a value no case has */
+} CaseTable;
+
+/* Counter values a thread takes at a time when a schizo flex loop runs a
+ * kernel on the thread pool. Chunks do not depend on how many threads
+ * there are, so neither does the order a reduction combines them in. */
+#define PARALLEL_CHUNK 8192
+
+/* Whether a flex loop's kernel may run on the thread pool */
+typedef enum
+{
+    LOOP_SEQUENTIAL,  /* one iteration after another */
+    LOOP_INDEPENDENT, /* proved by the parallelize pass; results stay exact */
+    LOOP_SCHIZO,      /* schizo flex: gigachad sums may also be regrouped */
+} LoopParallelism;
+
+/* A flex loop body the idiom pass recognized, run over the whole range of
+ * the counter at once by run_loop_idiom(). Indices are the counter plus a
+ * literal offset. */
+typedef enum
+{
+    IDIOM_COPY, /* a[i + d] = b[i + s] */
+    IDIOM_FILL, /* a[i + d] = literal */
+    IDIOM_MAP,  /* a[i + d] = b[i + s] op c[i + t], op one of + - * */
+    IDIOM_SUM,  /* x = x + b[i + s] */
+    IDIOM_MIN,  /* edgy (b[i + s] < x) x = b[i + s] */
+    IDIOM_MAX,  /* edgy (b[i + s] > x) x = b[i + s] */
+} IdiomKind;
+
+typedef struct
+{
+    IdiomKind kind;
+    OperatorType op;   /* a map's operator */
+    ASTNode *store;    /* the assignment the body makes */
+    ASTNode *test;     /* the comparison of a minimum or maximum */
+    ASTNode *target;   /* array access or variable assigned */
+    ASTNode *left;     /* first array access read; NULL for a fill */
+    ASTNode *right;    /* a map's second array access */
+    int offsets[3];    /* of target, left and right */
+} LoopIdiom;
+
+/* A flex loop body `a[i + d] = expression` the vectorize pass compiled, run
+ * by run_vector_kernel() VECTOR_LANES iterations at a time. The expression
+ * is made of +, -, *, / and unary - over elements at the counter plus a
+ * literal offset, the counter itself, int and double literals, and
+ * variables the loop does not assign. */
+#define VECTOR_LANES 8
+#define VECTOR_MAX_STEPS 32
+
+typedef enum
+{
+    VECTOR_LOAD,    /* b[i + s] */
+    VECTOR_COUNTER, /* i */
+    VECTOR_SCALAR,  /* a literal or a variable, the same in every lane */
+    VECTOR_NEGATE,  /* -x */
+    VECTOR_BINARY,  /* x op y */
+} VectorStepKind;
+
+typedef struct
+{
+    VectorStepKind kind;
+    ASTNode *node; /* the access, identifier, literal or operation */
+    int offset;    /* a load's offset from the counter */
+} VectorStep;
+
+typedef struct
+{
+    ASTNode *target;   /* the array access stored to */
+    int offset;        /* its offset from the counter */
+    VectorStep *steps; /* the expression in postfix order */
+    int count;
+} VectorKernel;
+
 struct ArgumentList
 {
     struct ASTNode *expr;
@@ -208,9 +354,13 @@ struct ASTNode
     NodeType type;
     TypeModifiers modifiers;
     VarType var_type;
+    TypeInfo type_info;
+    int slot; /* frame slot of the variable this node names, -1 if none */
     bool already_checked;
     bool is_valid_symbol;
+    bool deoptimized; /* went back to its generic form; never specialized again */
     bool is_array;
+    bool in_bounds; /* array access resolve_program() proved in range */
     int array_length;
     union
     {
@@ -242,6 +392,12 @@ struct ASTNode
             ASTNode *cond;
             ASTNode *incr;
             ASTNode *body;
+            int step;                 /* counted loops: added to the counter per iteration */
+            bool counted;             /* set by resolve_program(); see execute_for_statement() */
+            LoopParallelism parallel; /* schizo flex, or set by the parallelize pass */
+            bool reads_counter;       /* the body reads the counter variable */
+            LoopIdiom *idiom;         /* what the body does, if the idiom pass recognized it */
+            VectorKernel *vector;     /* the body compiled by the vectorize pass */
         } for_stmt;
         struct
         {
@@ -252,6 +408,8 @@ struct ASTNode
         {
             char *function_name;
             ArgumentList *arguments;
+            Builtin builtin;           /* set by the parser */
+            struct Function *function; /* set by link_program() */
         } func_call;
         StatementList *statements;
         IfStatementNode if_stmt;
@@ -259,6 +417,7 @@ struct ASTNode
         {
             ASTNode *expression;
             CaseNode *cases;
+            CaseTable *table; /* NULL: test the cases in order */
         } switch_stmt;
         struct
         {
@@ -270,6 +429,8 @@ struct ASTNode
             VarType return_type;
             Parameter *parameters;
             ASTNode *body;
+            int frame_size;
+            struct Function *function; /* set by link_program() */
         } function_def;
         ASTNode *break_stmt;
     } data;
@@ -282,31 +443,90 @@ typedef struct Scope
     bool is_function_scope;
 } Scope;
 
-/* Global variable declarations */
-extern TypeModifiers current_modifiers;
-extern Scope *current_scope;
-extern Function *function_table;
-extern ReturnValue current_return_value;
-extern JumpBuffer *jump_buffer;
+/* Counts of nodes rewritten into a specialized form, and of those that
+ * went back to the generic one */
+typedef struct
+{
+    long specialized;
+    long deoptimized;
+} QuickenStats;
+
+/* Array accesses resolve_program() saw, and those it proved in bounds */
+typedef struct
+{
+    int accesses;
+    int unchecked;
+} BoundsStats;
+
+/* Functions are also chained by name hash, newest first, so a later
+ * definition shadows an earlier one. */
+#define FUNCTION_BUCKETS 64
+
+/*
+ * Everything one program owns while it is parsed and run: the parser's
+ * state, the AST and its arena, the symbol tables and the tree-walker's
+ * frames. Every thread has its own current context, `brainrot`, which the
+ * interpreter reads its state from; brainrot_create() makes a new one
+ * current, so programs on different threads, or one after another on the
+ * same thread, share nothing.
+ */
+typedef struct BrainrotVM
+{
+    Arena arena;                     /* AST nodes and what the passes attach to them */
+    ASTNode *root;                   /* the program yyparse() built */
+    int line;                        /* the scanner's line as of the last token; errors report it */
+    VarType current_var_type;        /* the last type keyword the scanner saw */
+    TypeModifiers current_modifiers; /* of the declaration being parsed */
+    Scope *current_scope;
+    Frame *current_frame;
+    Function *function_table;
+    Function *function_buckets[FUNCTION_BUCKETS];
+    struct SlotChunk *slot_chunk; /* top of the frame slot stack */
+    Value promoted_value;         /* what handle_identifier() converted a variable to */
+    int parallel_loops;           /* schizo flex loops around the node link_calls() is at */
+    FILE *remarks;                /* where opt_remark() collects the running pass's lines */
+    FILE *out;                    /* where yapping() and yappin() print; stdout by default */
+    FILE *err;                    /* where baka() and error messages print; stderr by default */
+    jmp_buf *quit;                /* where brainrot_exit() ends the program; NULL ends the process */
+    int exit_status;              /* what the program passed to brainrot_exit() */
+    bool quicken_enabled;
+    bool relaxed_fp;              /* gigachad sums may be regrouped to run on threads */
+    bool bytecode;                /* meant for the bytecode VM or its translation to C */
+    bool translated;              /* translated to C, which runs every loop in order */
+    QuickenStats quicken_stats;
+    BoundsStats bounds_stats;
+} BrainrotVM;
+
+extern _Thread_local BrainrotVM *brainrot;
+
+/* A new context, made current on the calling thread */
+BrainrotVM *brainrot_create(void);
+/* Frees the context and everything it owns; the thread has none current
+ * afterwards if it was */
+void brainrot_destroy(BrainrotVM *vm);
+/* Ends the running program with the given status: through the current
+ * context's quit point when it has one, otherwise by exiting the process */
+_Noreturn void brainrot_exit(int status);
 /* Function prototypes */
-bool set_int_variable(const char *name, int value, TypeModifiers mods);
+bool set_int_variable(ASTNode *target, int value, TypeModifiers mods);
 bool set_array_variable(char *name, int length, TypeModifiers mods, VarType type);
-bool set_short_variable(const char *name, short value, TypeModifiers mods);
-bool set_float_variable(const char *name, float value, TypeModifiers mods);
-bool set_double_variable(const char *name, double value, TypeModifiers mods);
-TypeModifiers get_variable_modifiers(const char *name);
+bool set_short_variable(ASTNode *target, short value, TypeModifiers mods);
+bool set_float_variable(ASTNode *target, float value, TypeModifiers mods);
+bool set_double_variable(ASTNode *target, double value, TypeModifiers mods);
+TypeModifiers get_variable_modifiers(ASTNode *node);
 void reset_modifiers(void);
 TypeModifiers get_current_modifiers(void);
 Variable *get_variable(const char *name);
+Variable *lookup_variable(ASTNode *node);
 Scope *create_scope(Scope *parent);
-void enter_function_scope(Function *func, ArgumentList *args);
-void exit_scope();
-void enter_scope();
+void push_frame(Frame *frame, int slot_count, VarType return_type);
+void pop_frame(Frame *frame);
+void free_frame_stack(void);
 void free_scope(Scope *scope);
 void add_variable_to_scope(const char *name, Variable *var);
 Variable *variable_new(char *name);
 Function *get_function(const char *name);
-VarType get_function_return_type(const char *name);
+VarType get_function_return_type(ASTNode *call);
 
 /* Node creation functions */
 ASTNode *create_int_node(int value);
@@ -338,6 +558,7 @@ CaseNode *create_case_node(ASTNode *value, ASTNode *statements);
 CaseNode *create_default_case_node(ASTNode *statements);
 CaseNode *append_case_list(CaseNode *list, CaseNode *case_node);
 ASTNode *create_break_node(void);
+ASTNode *create_continue_node(void);
 ASTNode *create_default_node(VarType var_type);
 ASTNode *create_return_node(ASTNode *expr);
 ExpressionList *create_expression_list(ASTNode *expr);
@@ -354,16 +575,22 @@ int evaluate_expression_int(ASTNode *node);
 short evaluate_expression_short(ASTNode *node);
 bool evaluate_expression_bool(ASTNode *node);
 int evaluate_expression(ASTNode *node);
+int get_expression_type(ASTNode *node);
 bool is_double_expression(ASTNode *node);
 bool is_float_expression(ASTNode *node);
-bool is_const_variable(const char *name);
-void check_const_assignment(const char *name);
-void execute_statement(ASTNode *node);
-void execute_statements(ASTNode *node);
+bool is_const_variable(ASTNode *node);
+void check_const_assignment(ASTNode *node);
+void execute_program(ASTNode *root, int frame_size, const struct Closure *compiled);
+ControlFlow execute_statement(ASTNode *node);
+ControlFlow execute_statements(ASTNode *node);
 void execute_assignment(ASTNode *node);
-void execute_for_statement(ASTNode *node);
-void execute_while_statement(ASTNode *node);
-void execute_do_while_statement(ASTNode *node);
+ControlFlow execute_for_statement(ASTNode *node);
+ControlFlow execute_while_statement(ASTNode *node);
+ControlFlow execute_do_while_statement(ASTNode *node);
+CaseTable *build_case_table(ASTNode *node);
+int case_table_slot(const CaseTable *table, int value);
+bool run_loop_idiom(const LoopIdiom *idiom, int first, int last, LoopParallelism parallel);
+int run_vector_kernel(const VectorKernel *kernel, int first, int last, LoopParallelism parallel);
 void execute_if_statement(ASTNode *node);
 void execute_yapping_call(ArgumentList *args);
 void execute_yappin_call(ArgumentList *args);
@@ -373,27 +600,35 @@ void execute_chill_call(ArgumentList *args);
 void execute_slorp_call(ArgumentList *args);
 void reset_modifiers(void);
 bool check_and_mark_identifier(ASTNode *node, const char *contextErrorMessage);
-void bruh();
 size_t count_expression_list(ExpressionList *list);
 size_t handle_sizeof(ASTNode *node);
-size_t get_type_size(char *name);
-void *handle_function_call(ASTNode *node);
+size_t get_type_size(ASTNode *node);
+Value handle_function_call(ASTNode *node);
+
+/* Static analysis */
+int resolve_program(ASTNode *root);
+void bind_global_arrays(Frame *frame);
 
 /* User-defined functions */
 Function *create_function(char *name, VarType return_type, Parameter *params, ASTNode *body);
 Parameter *create_parameter(char *name, VarType type, Parameter *next, TypeModifiers mods);
-void execute_function_call(const char *name, ArgumentList *args);
+Value call_function(Function *func, ArgumentList *args);
+void link_program(ASTNode *root);
 ASTNode *create_function_def_node(char *name, VarType return_type, Parameter *params, ASTNode *body);
 void handle_return_statement(ASTNode *expr);
-void *handle_binary_operation(ASTNode *node);
+Value handle_binary_operation(ASTNode *node);
 void free_function_table(void);
+void remove_function(Function *func);
 
-extern TypeModifiers current_modifiers;
+/* Operator kernels, shared with the closure engine */
+int int_binary(OperatorType op, int left, int right, bool is_unsigned);
+short short_binary(OperatorType op, short left, short right, bool is_unsigned);
+float float_binary(OperatorType op, float left, float right, bool is_unsigned);
+double double_binary(OperatorType op, double left, double right, bool is_unsigned);
 
-extern Arena arena;
-
-#define ARENA_ALLOC(type) arena_alloc(&arena, sizeof(type))
-#define ARENA_STRDUP(str) arena_strdup(&arena, str)
+#define ARENA_ALLOC(type) arena_alloc(&brainrot->arena, sizeof(type))
+#define ARENA_ALLOC_ARRAY(type, n) arena_alloc(&brainrot->arena, sizeof(type) * (n))
+#define ARENA_STRDUP(str) arena_strdup(&brainrot->arena, str)
 
 /* Macros for assigning specific fields to a node */
 #define SET_DATA_INT(node, value) ((node)->data.ivalue = (value))
@@ -418,13 +653,17 @@ extern Arena arena;
         (node)->data.unary.op = (opr);    \
     } while (0)
 
-#define SET_DATA_FOR(node, i, c, inc, b)    \
-    do                                      \
-    {                                       \
-        (node)->data.for_stmt.init = (i);   \
-        (node)->data.for_stmt.cond = (c);   \
-        (node)->data.for_stmt.incr = (inc); \
-        (node)->data.for_stmt.body = (b);   \
+#define SET_DATA_FOR(node, i, c, inc, b)                  \
+    do                                                    \
+    {                                                     \
+        (node)->data.for_stmt.init = (i);                 \
+        (node)->data.for_stmt.cond = (c);                 \
+        (node)->data.for_stmt.incr = (inc);               \
+        (node)->data.for_stmt.body = (b);                 \
+        (node)->data.for_stmt.counted = false;            \
+        (node)->data.for_stmt.parallel = LOOP_SEQUENTIAL; \
+        (node)->data.for_stmt.idiom = NULL;               \
+        (node)->data.for_stmt.vector = NULL;              \
     } while (0)
 
 #define SET_DATA_WHILE(node, c, b)          \
@@ -441,46 +680,4 @@ extern Arena arena;
         (node)->data.func_call.arguments = (args);                     \
     } while (0)
 
-/* Macros for handling jump buffer */
-#define PUSH_JUMP_BUFFER()                        \
-    do                                            \
-    {                                             \
-        JumpBuffer *jb = SAFE_MALLOC(JumpBuffer); \
-        jb->next = jump_buffer;                   \
-        jump_buffer = jb;                         \
-    } while (0)
-
-#define POP_JUMP_BUFFER()                \
-    do                                   \
-    {                                    \
-        JumpBuffer *jb = jump_buffer;    \
-        jump_buffer = jump_buffer->next; \
-        SAFE_FREE(jb);                   \
-    } while (0)
-
-#define LONGJMP()                                \
-    do                                           \
-    {                                            \
-        if (jump_buffer != NULL)                 \
-        {                                        \
-            longjmp(jump_buffer->data, 1);       \
-        }                                        \
-        else                                     \
-        {                                        \
-            yyerror("No jump buffer available"); \
-            exit(1);                             \
-        }                                        \
-    } while (0)
-
-#define CURRENT_JUMP_BUFFER() (jump_buffer->data)
-
-#define CLEAN_JUMP_BUFFER() \
-    do                      \
-    {                       \
-        while (jump_buffer) \
-        {                    \
-            POP_JUMP_BUFFER(); \
-        }                    \
-    } while (0)
-
 #endif /* AST_H */
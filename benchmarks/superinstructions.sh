@@ -0,0 +1,59 @@
+#!/bin/bash
+# Per-shape speedups of the bytecode superinstructions.
+#
+# Runs every benchmark with no superinstructions, with each shape on its own
+# and with all of them, on the interpreter (--no-jit) and with the JIT, and
+# prints the best of N runs in milliseconds with the speedup over no fusion.
+#
+# Usage: benchmarks/superinstructions.sh [runs]    (from the repository root)
+
+runs=${1:-5}
+shapes=(increment compare modulo accumulate)
+
+best_time() {
+    local best=""
+    for ((r = 0; r < runs; r++)); do
+        local start end elapsed
+        start=$(date +%s%N)
+        ./brainrot "$@" >/dev/null || exit 1
+        end=$(date +%s%N)
+        elapsed=$(((end - start) / 1000000))
+        if [[ -z $best || $elapsed -lt $best ]]; then
+            best=$elapsed
+        fi
+    done
+    echo "$best"
+}
+
+# The other shapes, comma-separated, to switch off all but $1
+all_but() {
+    local others=()
+    for shape in "${shapes[@]}"; do
+        [[ $shape != "$1" ]] && others+=("$shape")
+    done
+    local IFS=,
+    echo "${others[*]}"
+}
+
+printf "%-24s %-7s %8s" "benchmark" "engine" "none"
+for shape in "${shapes[@]}" all; do
+    printf " %17s" "$shape"
+done
+printf "\n"
+
+for program in benchmarks/*.brainrot; do
+    for engine in --no-jit --engine=vm; do
+        name=$([[ $engine == --no-jit ]] && echo interp || echo jit)
+        none=$(best_time "$engine" --no-superinstructions "$program")
+        printf "%-24s %-7s %6dms" "$(basename "$program")" "$name" "$none"
+        for shape in "${shapes[@]}" all; do
+            if [[ $shape == all ]]; then
+                t=$(best_time "$engine" "$program")
+            else
+                t=$(best_time "$engine" "--no-superinstructions=$(all_but "$shape")" "$program")
+            fi
+            printf " %6dms (%4.2fx)" "$t" "$(awk "BEGIN { print $none / $t }")"
+        done
+        printf "\n"
+    done
+done
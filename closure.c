@@ -0,0 +1,1075 @@
+/* closure.c */
+
+#include "closure.h"
+#include <string.h>
+
+/*
+ * Closure compiler for the tree-walking engine.
+ *
+ * An expression is compiled for the context the tree-walker would evaluate
+ * it in (evaluate_expression_int/short/float/double/bool), and a closure
+ * computes exactly what that evaluator returns. Specialised closures are
+ * only emitted where resolve_program() proved the types involved; every
+ * other node gets a closure that hands the node back to the evaluator or to
+ * execute_statement(). Runtime errors take the same path: a fast closure
+ * that finds something unexpected defers to the tree-walker before it has
+ * evaluated anything, so diagnostics come from one place.
+ */
+
+extern void report_error(const char *s);
+
+typedef enum
+{
+    CLOSURE_CODE,
+    CLOSURE_CONSTANT, /* value in k */
+    CLOSURE_SLOT,     /* reads the variable in slot */
+} ClosureKind;
+
+struct Closure
+{
+    union
+    {
+        int (*as_int)(const Closure *self);
+        short (*as_short)(const Closure *self);
+        float (*as_float)(const Closure *self);
+        double (*as_double)(const Closure *self);
+        bool (*as_bool)(const Closure *self);
+        ControlFlow (*exec)(const Closure *self);
+    } run;
+    ClosureKind kind;
+    ASTNode *node; /* the node this closure was compiled from */
+    const Closure *a, *b, *c, *d;
+    const Closure *next; /* next statement of a list */
+    int slot;
+    Value k;
+    Function *function;
+    const Closure **args;
+};
+
+/* X(C type, Value member, run member, VarType, tree-walker evaluator) */
+#define CLOSURE_TYPES(X, ...)                                                      \
+    X(int, ivalue, as_int, VAR_INT, evaluate_expression_int, __VA_ARGS__)          \
+    X(short, svalue, as_short, VAR_SHORT, evaluate_expression_short, __VA_ARGS__)  \
+    X(float, fvalue, as_float, VAR_FLOAT, evaluate_expression_float, __VA_ARGS__)  \
+    X(double, dvalue, as_double, VAR_DOUBLE, evaluate_expression_double, __VA_ARGS__)
+
+/* The arithmetic types plus bool, which only appears as a context. Spelled
+ * out rather than built on CLOSURE_TYPES so an X can expand CLOSURE_TYPES. */
+#define CLOSURE_RESULT_TYPES(X, ...)                                               \
+    X(int, ivalue, as_int, VAR_INT, evaluate_expression_int, __VA_ARGS__)          \
+    X(short, svalue, as_short, VAR_SHORT, evaluate_expression_short, __VA_ARGS__)  \
+    X(float, fvalue, as_float, VAR_FLOAT, evaluate_expression_float, __VA_ARGS__)  \
+    X(double, dvalue, as_double, VAR_DOUBLE, evaluate_expression_double, __VA_ARGS__) \
+    X(bool, bvalue, as_bool, VAR_BOOL, evaluate_expression_bool, __VA_ARGS__)
+
+/* X(name, operator, C operator) for operators with dedicated closures */
+#define CLOSURE_BINARY_OPS(X, ...)  \
+    X(add, OP_PLUS, +, __VA_ARGS__)  \
+    X(sub, OP_MINUS, -, __VA_ARGS__) \
+    X(mul, OP_TIMES, *, __VA_ARGS__) \
+    X(lt, OP_LT, <, __VA_ARGS__)     \
+    X(gt, OP_GT, >, __VA_ARGS__)     \
+    X(le, OP_LE, <=, __VA_ARGS__)    \
+    X(ge, OP_GE, >=, __VA_ARGS__)    \
+    X(eq, OP_EQ, ==, __VA_ARGS__)    \
+    X(ne, OP_NE, !=, __VA_ARGS__)
+
+#define SLOTS (brainrot->current_frame->slots)
+#define RUN(closure, RUNNER) ((closure)->run.RUNNER(closure))
+
+/* Leaves: fallbacks, constants, variables, calls */
+
+static Value invoke(const Closure *c);
+
+#define DEFINE_LEAVES(CT, FIELD, RUNNER, TAG, EVAL, _)   \
+    static CT CT##_fallback(const Closure *c)            \
+    {                                                    \
+        return EVAL(c->node);                            \
+    }                                                    \
+    static CT CT##_constant(const Closure *c)            \
+    {                                                    \
+        return c->k.FIELD;                               \
+    }                                                    \
+    static CT CT##_slot(const Closure *c)                \
+    {                                                    \
+        return SLOTS[c->slot].value.FIELD;               \
+    }                                                    \
+    static CT CT##_call(const Closure *c)                \
+    {                                                    \
+        Value result = invoke(c);                        \
+        return VALUE_AS(CT, result);                     \
+    }
+
+CLOSURE_RESULT_TYPES(DEFINE_LEAVES, 0)
+
+#undef DEFINE_LEAVES
+
+/* Conversions between contexts: X_from_Y returns a Y closure's value as X */
+
+#define DEFINE_CONVERSION(ST, SFIELD, SRUNNER, STAG, SEVAL, CT)   \
+    static CT CT##_from_##ST(const Closure *c)                   \
+    {                                                            \
+        return (CT)RUN(c->a, SRUNNER);                           \
+    }
+
+#define DEFINE_CONVERSIONS(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    CLOSURE_TYPES(DEFINE_CONVERSION, CT)
+
+CLOSURE_RESULT_TYPES(DEFINE_CONVERSIONS, 0)
+
+#undef DEFINE_CONVERSIONS
+#undef DEFINE_CONVERSION
+
+/*
+ * Binary operators. Each operator gets a closure for two arbitrary operands
+ * and two for the common loop shapes (variable against constant, variable
+ * against variable) that read their operands directly. Division and modulo
+ * go through the tree-walker's kernels for their zero checks.
+ */
+
+#define DEFINE_BINARY(NAME, OP, SYMBOL, CT, FIELD, RUNNER)                    \
+    static CT NAME##_##CT(const Closure *c)                                   \
+    {                                                                         \
+        CT left = RUN(c->a, RUNNER);                                          \
+        CT right = RUN(c->b, RUNNER);                                         \
+        return left SYMBOL right;                                             \
+    }                                                                         \
+    static CT NAME##_##CT##_slot_const(const Closure *c)                      \
+    {                                                                         \
+        return SLOTS[c->a->slot].value.FIELD SYMBOL c->b->k.FIELD;            \
+    }                                                                         \
+    static CT NAME##_##CT##_slot_slot(const Closure *c)                       \
+    {                                                                         \
+        return SLOTS[c->a->slot].value.FIELD SYMBOL SLOTS[c->b->slot].value.FIELD; \
+    }
+
+#define DEFINE_TYPE_OPERATORS(CT, FIELD, RUNNER, TAG, EVAL, _)                   \
+    CLOSURE_BINARY_OPS(DEFINE_BINARY, CT, FIELD, RUNNER)                         \
+    static CT CT##_kernel(const Closure *c)                                      \
+    {                                                                            \
+        CT left = RUN(c->a, RUNNER);                                             \
+        CT right = RUN(c->b, RUNNER);                                            \
+        return CT##_binary(c->node->data.op.op, left, right,                     \
+                           c->node->modifiers.is_unsigned);                      \
+    }                                                                            \
+    static CT neg_##CT(const Closure *c)                                         \
+    {                                                                            \
+        return -RUN(c->a, RUNNER);                                               \
+    }                                                                            \
+    static CT pre_inc_##CT(const Closure *c)                                     \
+    {                                                                            \
+        return ++SLOTS[c->slot].value.FIELD;                                     \
+    }                                                                            \
+    static CT pre_dec_##CT(const Closure *c)                                     \
+    {                                                                            \
+        return --SLOTS[c->slot].value.FIELD;                                     \
+    }                                                                            \
+    static CT post_inc_##CT(const Closure *c)                                    \
+    {                                                                            \
+        return SLOTS[c->slot].value.FIELD++;                                     \
+    }                                                                            \
+    static CT post_dec_##CT(const Closure *c)                                    \
+    {                                                                            \
+        return SLOTS[c->slot].value.FIELD--;                                     \
+    }                                                                            \
+    static bool select_##CT##_binary(Closure *c, OperatorType op)                \
+    {                                                                            \
+        bool slot_const = c->a->kind == CLOSURE_SLOT && c->b->kind == CLOSURE_CONSTANT; \
+        bool slot_slot = c->a->kind == CLOSURE_SLOT && c->b->kind == CLOSURE_SLOT; \
+        switch (op)                                                              \
+        {                                                                        \
+            CLOSURE_BINARY_OPS(SELECT_BINARY_CASE, CT, RUNNER)                   \
+        default:                                                                 \
+            c->run.RUNNER = CT##_kernel;                                         \
+            return true;                                                         \
+        }                                                                        \
+    }
+
+#define SELECT_BINARY_CASE(NAME, OP, SYMBOL, CT, RUNNER)                   \
+    case OP:                                                               \
+        c->run.RUNNER = slot_const  ? NAME##_##CT##_slot_const             \
+                        : slot_slot ? NAME##_##CT##_slot_slot              \
+                                    : NAME##_##CT;                         \
+        return true;
+
+CLOSURE_TYPES(DEFINE_TYPE_OPERATORS, 0)
+
+#undef SELECT_BINARY_CASE
+#undef DEFINE_TYPE_OPERATORS
+#undef DEFINE_BINARY
+
+/* Logical operators evaluate both sides, like the tree-walker. */
+#define DEFINE_LOGICAL(CT, RUNNER)                \
+    static CT and_##CT(const Closure *c)          \
+    {                                             \
+        CT left = RUN(c->a, RUNNER);              \
+        CT right = RUN(c->b, RUNNER);             \
+        return left && right;                     \
+    }                                             \
+    static CT or_##CT(const Closure *c)           \
+    {                                             \
+        CT left = RUN(c->a, RUNNER);              \
+        CT right = RUN(c->b, RUNNER);             \
+        return left || right;                     \
+    }
+
+DEFINE_LOGICAL(int, as_int)
+DEFINE_LOGICAL(short, as_short)
+DEFINE_LOGICAL(bool, as_bool)
+
+#undef DEFINE_LOGICAL
+
+static bool not_bool(const Closure *c)
+{
+    return !RUN(c->a, as_bool);
+}
+
+/*
+ * Array elements. Only global arrays resolve to a slot, so the variable is
+ * always an array; anything else is left to the tree-walker to report.
+ */
+#define DEFINE_ELEMENT_ACCESS(CT, FIELD, RUNNER, TAG, EVAL, _)                   \
+    static CT load_##CT(const Closure *c)                                        \
+    {                                                                            \
+        Variable *var = &SLOTS[c->slot];                                         \
+        if (!var->name || !var->is_array)                                        \
+            return EVAL(c->node);                                                \
+        int idx = RUN(c->a, as_int);                                             \
+        if (idx < 0 || idx >= var->array_length)                                 \
+        {                                                                        \
+            report_error("Array index out of bounds!");                               \
+            return 0;                                                            \
+        }                                                                        \
+        return ((CT *)var->value.array_data)[idx];                               \
+    }                                                                            \
+    static ControlFlow store_##CT(const Closure *c)                              \
+    {                                                                            \
+        Variable *var = &SLOTS[c->slot];                                         \
+        if (!var->name || !var->is_array)                                        \
+            return execute_statement(c->node);                                   \
+        if (var->modifiers.is_const)                                             \
+            check_const_assignment(c->node->data.op.left);                       \
+        int idx = RUN(c->a, as_int);                                             \
+        if (idx < 0 || idx >= var->array_length)                                 \
+        {                                                                        \
+            report_error("Array index out of bounds!");                               \
+            return FLOW_NORMAL;                                                  \
+        }                                                                        \
+        ((CT *)var->value.array_data)[idx] = RUN(c->b, RUNNER);                  \
+        return FLOW_NORMAL;                                                      \
+    }
+
+CLOSURE_RESULT_TYPES(DEFINE_ELEMENT_ACCESS, 0)
+
+#undef DEFINE_ELEMENT_ACCESS
+
+/* Accesses resolve_program() proved in bounds: the slot holds a global
+ * array, and the index is in range. */
+#define DEFINE_UNCHECKED_ACCESS(CT, FIELD, RUNNER, TAG, EVAL, _)                \
+    static CT load_unchecked_##CT(const Closure *c)                              \
+    {                                                                            \
+        return ((CT *)SLOTS[c->slot].value.array_data)[RUN(c->a, as_int)];       \
+    }                                                                            \
+    static ControlFlow store_unchecked_##CT(const Closure *c)                    \
+    {                                                                            \
+        Variable *var = &SLOTS[c->slot];                                         \
+        if (var->modifiers.is_const)                                             \
+            check_const_assignment(c->node->data.op.left);                       \
+        int idx = RUN(c->a, as_int);                                             \
+        ((CT *)var->value.array_data)[idx] = RUN(c->b, RUNNER);                  \
+        return FLOW_NORMAL;                                                      \
+    }
+
+CLOSURE_RESULT_TYPES(DEFINE_UNCHECKED_ACCESS, 0)
+
+#undef DEFINE_UNCHECKED_ACCESS
+
+static int load_char(const Closure *c)
+{
+    Variable *var = &SLOTS[c->slot];
+    if (!var->name || !var->is_array)
+        return evaluate_expression_int(c->node);
+    int idx = RUN(c->a, as_int);
+    if (idx < 0 || idx >= var->array_length)
+    {
+        report_error("Array index out of bounds!");
+        return 0;
+    }
+    return ((char *)var->value.array_data)[idx];
+}
+
+static ControlFlow store_char(const Closure *c)
+{
+    Variable *var = &SLOTS[c->slot];
+    if (!var->name || !var->is_array)
+        return execute_statement(c->node);
+    if (var->modifiers.is_const)
+        check_const_assignment(c->node->data.op.left);
+    int idx = RUN(c->a, as_int);
+    if (idx < 0 || idx >= var->array_length)
+    {
+        report_error("Array index out of bounds!");
+        return FLOW_NORMAL;
+    }
+    ((char *)var->value.array_data)[idx] = RUN(c->b, as_int);
+    return FLOW_NORMAL;
+}
+
+/*
+ * Scalar assignment and declaration. A variable that is not declared in
+ * this activation is left to the tree-walker, which reports it.
+ */
+#define DEFINE_ASSIGNMENT(CT, FIELD, RUNNER, TAG, EVAL, _)                 \
+    static ControlFlow assign_##CT(const Closure *c)                       \
+    {                                                                      \
+        Variable *var = &SLOTS[c->slot];                                   \
+        if (!var->name)                                                    \
+            return execute_statement(c->node);                             \
+        if (var->modifiers.is_const)                                       \
+            check_const_assignment(c->node->data.op.left);                 \
+        CT value = RUN(c->a, RUNNER);                                      \
+        var->modifiers = c->node->modifiers;                               \
+        var->var_type = TAG;                                               \
+        var->value.FIELD = value;                                          \
+        return FLOW_NORMAL;                                                \
+    }                                                                      \
+    static ControlFlow declare_##CT(const Closure *c)                      \
+    {                                                                      \
+        SLOTS[c->node->slot] = (Variable){.name = c->node->data.op.left->data.name}; \
+        return assign_##CT(c);                                             \
+    }
+
+CLOSURE_TYPES(DEFINE_ASSIGNMENT, 0)
+
+#undef DEFINE_ASSIGNMENT
+
+#define DEFINE_RETURN(CT, FIELD, RUNNER, TAG, EVAL, _)         \
+    static ControlFlow return_##CT(const Closure *c)           \
+    {                                                          \
+        brainrot->current_frame->return_value.FIELD = RUN(c->a, RUNNER); \
+        return FLOW_RETURN;                                    \
+    }
+
+CLOSURE_RESULT_TYPES(DEFINE_RETURN, 0)
+
+#undef DEFINE_RETURN
+
+/* Statements */
+
+static ControlFlow run_fallback(const Closure *c)
+{
+    return execute_statement(c->node);
+}
+
+static ControlFlow run_list(const Closure *c)
+{
+    for (const Closure *statement = c->a; statement; statement = statement->next)
+    {
+        ControlFlow flow = RUN(statement, exec);
+        if (flow != FLOW_NORMAL)
+            return flow;
+    }
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_expression(const Closure *c)
+{
+    RUN(c->a, as_int);
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_call(const Closure *c)
+{
+    invoke(c);
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_if(const Closure *c)
+{
+    if (RUN(c->a, as_int))
+        return RUN(c->b, exec);
+    if (c->c)
+        return RUN(c->c, exec);
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_for(const Closure *c)
+{
+    if (c->a)
+        RUN(c->a, exec);
+    while (!c->b || RUN(c->b, as_int))
+    {
+        ControlFlow flow = RUN(c->d, exec);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+        if (c->c)
+            RUN(c->c, exec);
+    }
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_while(const Closure *c)
+{
+    while (RUN(c->a, as_int))
+    {
+        ControlFlow flow = RUN(c->b, exec);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+    }
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_do_while(const Closure *c)
+{
+    do
+    {
+        ControlFlow flow = RUN(c->b, exec);
+        if (flow == FLOW_BREAK)
+            break;
+        if (flow == FLOW_RETURN)
+            return flow;
+    } while (RUN(c->a, as_int));
+    return FLOW_NORMAL;
+}
+
+static ControlFlow run_break(const Closure *c)
+{
+    (void)c;
+    return FLOW_BREAK;
+}
+
+static ControlFlow run_continue(const Closure *c)
+{
+    (void)c;
+    return FLOW_CONTINUE;
+}
+
+static ControlFlow run_return(const Closure *c)
+{
+    (void)c;
+    return FLOW_RETURN;
+}
+
+ControlFlow execute_closure(const Closure *closure)
+{
+    return RUN(closure, exec);
+}
+
+/*
+ * User function calls, as call_function() makes them: the callee's frame is
+ * pushed, the arguments are evaluated in the caller's frame straight into
+ * the parameter slots, and the body runs compiled.
+ */
+static Value invoke(const Closure *c)
+{
+    Function *func = c->function;
+    Frame *caller = brainrot->current_frame;
+    Frame frame;
+    push_frame(&frame, func->frame_size, func->return_type);
+
+    for (int i = 0; i < func->param_count; i++)
+    {
+        Variable *var = &frame.slots[i];
+        const Closure *arg = c->args[i];
+        var->name = func->params[i]->name;
+        var->modifiers = func->params[i]->modifiers;
+        switch (func->params[i]->type)
+        {
+        case VAR_INT:
+        case VAR_CHAR:
+            var->var_type = VAR_INT;
+            var->value.ivalue = RUN(arg, as_int);
+            break;
+        case VAR_FLOAT:
+            var->var_type = VAR_FLOAT;
+            var->value.fvalue = RUN(arg, as_float);
+            break;
+        case VAR_DOUBLE:
+            var->var_type = VAR_DOUBLE;
+            var->value.dvalue = RUN(arg, as_double);
+            break;
+        case VAR_BOOL:
+            var->var_type = VAR_BOOL;
+            var->value.bvalue = RUN(arg, as_bool);
+            break;
+        case VAR_SHORT:
+            var->var_type = VAR_SHORT;
+            var->value.svalue = RUN(arg, as_short);
+            break;
+        case NONE:
+            break;
+        }
+    }
+
+    brainrot->current_frame = &frame;
+    if (func->closure)
+        execute_closure(func->closure);
+    else
+        execute_statement(func->body);
+    brainrot->current_frame = caller;
+    pop_frame(&frame);
+    return frame.return_value;
+}
+
+/* Compilation */
+
+static Closure *new_closure(ASTNode *node, ClosureKind kind)
+{
+    Closure *c = ARENA_ALLOC(Closure);
+    memset(c, 0, sizeof(*c));
+    c->kind = kind;
+    c->node = node;
+    return c;
+}
+
+static Closure *compile_expression(ASTNode *node, VarType context);
+static Closure *compile_statement(ASTNode *node, VarType return_type);
+
+static Closure *fallback_expression(ASTNode *node, VarType context)
+{
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    switch (context)
+    {
+#define FALLBACK_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                          \
+        c->run.RUNNER = CT##_fallback;                 \
+        break;
+        CLOSURE_RESULT_TYPES(FALLBACK_CASE, 0)
+#undef FALLBACK_CASE
+    default:
+        break;
+    }
+    return c;
+}
+
+static Closure *constant(ASTNode *node, VarType context, Value value)
+{
+    Closure *c = new_closure(node, CLOSURE_CONSTANT);
+    c->k.type = context;
+    switch (context)
+    {
+#define CONSTANT_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                          \
+        c->k.FIELD = VALUE_AS(CT, value);              \
+        c->run.RUNNER = CT##_constant;                 \
+        break;
+        CLOSURE_RESULT_TYPES(CONSTANT_CASE, 0)
+#undef CONSTANT_CASE
+    default:
+        break;
+    }
+    return c;
+}
+
+/* Returns a closure of type `to` for a closure of arithmetic type `from`. */
+static Closure *convert(Closure *value, VarType from, VarType to)
+{
+    if (from == to)
+        return value;
+    if (value->kind == CLOSURE_CONSTANT)
+        return constant(value->node, to, value->k);
+
+    Closure *c = new_closure(value->node, CLOSURE_CODE);
+    c->a = value;
+    switch (to)
+    {
+#define FROM_CASE(ST, SFIELD, SRUNNER, STAG, SEVAL, CT, RUNNER) \
+    case STAG:                                                  \
+        c->run.RUNNER = CT##_from_##ST;                         \
+        break;
+#define TO_CASE(CT, FIELD, RUNNER, TAG, EVAL, _)           \
+    case TAG:                                              \
+        switch (from)                                      \
+        {                                                  \
+            CLOSURE_TYPES(FROM_CASE, CT, RUNNER)           \
+        default:                                           \
+            break;                                         \
+        }                                                  \
+        break;
+        CLOSURE_RESULT_TYPES(TO_CASE, 0)
+#undef TO_CASE
+#undef FROM_CASE
+    default:
+        break;
+    }
+    return c;
+}
+
+static bool is_context_type(VarType type)
+{
+    return type == VAR_INT || type == VAR_SHORT || type == VAR_FLOAT ||
+           type == VAR_DOUBLE || type == VAR_BOOL;
+}
+
+/* Literals a context reads without a diagnostic, as that context's value. */
+static bool literal_value(ASTNode *node, VarType context, Value *value)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        *value = (Value){.type = VAR_INT, .ivalue = node->data.ivalue};
+        return true;
+    case NODE_SHORT:
+        *value = (Value){.type = VAR_SHORT, .svalue = node->data.svalue};
+        return context != VAR_FLOAT && context != VAR_DOUBLE;
+    case NODE_BOOLEAN:
+        *value = (Value){.type = VAR_BOOL, .bvalue = node->data.bvalue};
+        return context != VAR_FLOAT && context != VAR_DOUBLE;
+    case NODE_FLOAT:
+        *value = (Value){.type = VAR_FLOAT, .fvalue = node->data.fvalue};
+        return context != VAR_INT && context != VAR_SHORT;
+    case NODE_DOUBLE:
+        *value = (Value){.type = VAR_DOUBLE, .dvalue = node->data.dvalue};
+        return context != VAR_INT && context != VAR_SHORT;
+    default:
+        return false;
+    }
+}
+
+/* The slot of an identifier the resolver typed as `type` for its lifetime. */
+static bool typed_slot(ASTNode *node, VarType type)
+{
+    return node->type == NODE_IDENTIFIER && node->type_info.resolved &&
+           node->slot >= 0 && node->var_type == type;
+}
+
+/* The context handle_binary_operation() evaluates an operand of `type` in
+ * when the operation is promoted to `promoted`. */
+static VarType operand_context(VarType type, VarType promoted)
+{
+    switch (promoted)
+    {
+    case VAR_DOUBLE:
+        return type == VAR_INT || type == VAR_FLOAT ? type : VAR_DOUBLE;
+    case VAR_FLOAT:
+        return type == VAR_INT ? VAR_INT : VAR_FLOAT;
+    default:
+        return promoted;
+    }
+}
+
+static Closure *compile_operand(ASTNode *node, VarType promoted)
+{
+    VarType context = operand_context(node->var_type, promoted);
+    return convert(compile_expression(node, context), context, promoted);
+}
+
+static Closure *compile_binary(ASTNode *node, VarType context)
+{
+    ASTNode *left = node->data.op.left;
+    ASTNode *right = node->data.op.right;
+    OperatorType op = node->data.op.op;
+
+    if ((op == OP_AND || op == OP_OR) &&
+        (context == VAR_INT || context == VAR_SHORT || context == VAR_BOOL))
+    {
+        Closure *c = new_closure(node, CLOSURE_CODE);
+        c->a = compile_expression(left, context);
+        c->b = compile_expression(right, context);
+        if (context == VAR_INT)
+            c->run.as_int = op == OP_AND ? and_int : or_int;
+        else if (context == VAR_SHORT)
+            c->run.as_short = op == OP_AND ? and_short : or_short;
+        else
+            c->run.as_bool = op == OP_AND ? and_bool : or_bool;
+        return c;
+    }
+
+    // Operand types decide the promotion, so both must be static
+    if (!left->type_info.resolved || !right->type_info.resolved)
+        return fallback_expression(node, context);
+
+    VarType l = left->var_type, r = right->var_type;
+    VarType promoted = l == VAR_DOUBLE || r == VAR_DOUBLE ? VAR_DOUBLE
+                       : l == VAR_FLOAT || r == VAR_FLOAT ? VAR_FLOAT
+                                                          : VAR_INT;
+
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    c->a = compile_operand(left, promoted);
+    c->b = compile_operand(right, promoted);
+    switch (promoted)
+    {
+#define SELECT_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                        \
+        select_##CT##_binary(c, op);                 \
+        break;
+        CLOSURE_TYPES(SELECT_CASE, 0)
+#undef SELECT_CASE
+    default:
+        break;
+    }
+    return convert(c, promoted, context);
+}
+
+static Closure *compile_unary(ASTNode *node, VarType context)
+{
+    ASTNode *operand = node->data.unary.operand;
+    OperatorType op = node->data.unary.op;
+    Closure *c = new_closure(node, CLOSURE_CODE);
+
+    if (op == OP_NEG)
+    {
+        c->a = compile_expression(operand, context);
+        switch (context)
+        {
+#define NEG_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                     \
+        c->run.RUNNER = neg_##CT;                 \
+        return c;
+            CLOSURE_TYPES(NEG_CASE, 0)
+#undef NEG_CASE
+        case VAR_BOOL:
+            c->run.as_bool = not_bool;
+            return c;
+        default:
+            return fallback_expression(node, context);
+        }
+    }
+
+    // ++ and -- on a variable that always holds the context's type
+    if (!typed_slot(operand, context) ||
+        (op != OP_PRE_INC && op != OP_PRE_DEC && op != OP_POST_INC && op != OP_POST_DEC))
+        return fallback_expression(node, context);
+    c->slot = operand->slot;
+    switch (context)
+    {
+#define STEP_CASE(CT, FIELD, RUNNER, TAG, EVAL, _)          \
+    case TAG:                                               \
+        c->run.RUNNER = op == OP_PRE_INC    ? pre_inc_##CT  \
+                        : op == OP_PRE_DEC  ? pre_dec_##CT  \
+                        : op == OP_POST_INC ? post_inc_##CT \
+                                            : post_dec_##CT; \
+        return c;
+        CLOSURE_TYPES(STEP_CASE, 0)
+#undef STEP_CASE
+    default:
+        return fallback_expression(node, context);
+    }
+}
+
+static Closure *compile_element(ASTNode *node, VarType context)
+{
+    VarType element = node->var_type;
+    if (!node->type_info.resolved || node->slot < 0 ||
+        !(element == context || (element == VAR_CHAR && context == VAR_INT)))
+        return fallback_expression(node, context);
+
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    c->slot = node->slot;
+    c->a = compile_expression(node->data.array.index, VAR_INT);
+    switch (element)
+    {
+#define LOAD_CASE(CT, FIELD, RUNNER, TAG, EVAL, _)                   \
+    case TAG:                                                        \
+        c->run.RUNNER = node->in_bounds ? load_unchecked_##CT : load_##CT; \
+        return c;
+        CLOSURE_RESULT_TYPES(LOAD_CASE, 0)
+#undef LOAD_CASE
+    case VAR_CHAR:
+        c->run.as_int = load_char;
+        return c;
+    default:
+        return fallback_expression(node, context);
+    }
+}
+
+/* The context a parameter or return value of `type` is evaluated in. */
+static VarType value_context(VarType type)
+{
+    return type == VAR_CHAR ? VAR_INT : type;
+}
+
+/* A call closure for a user function, or NULL if the call has to go
+ * through the tree-walker (an argument count mismatch, an untyped
+ * parameter). */
+static Closure *compile_call(ASTNode *node)
+{
+    Function *func = node->data.func_call.function;
+    if (!func || node->data.func_call.builtin != BUILTIN_NONE)
+        return NULL;
+
+    ArgumentList *arg = node->data.func_call.arguments;
+    const Closure **args = ARENA_ALLOC_ARRAY(const Closure *, func->param_count + 1);
+    for (int i = 0; i < func->param_count; i++, arg = arg->next)
+    {
+        VarType context = value_context(func->params[i]->type);
+        if (!arg || !is_context_type(context))
+            return NULL;
+        args[i] = compile_expression(arg->expr, context);
+    }
+    if (arg)
+        return NULL;
+
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    c->function = func;
+    c->args = args;
+    return c;
+}
+
+static Closure *compile_expression(ASTNode *node, VarType context)
+{
+    if (!node || !is_context_type(context))
+        return fallback_expression(node, context);
+
+    Value value;
+    if (literal_value(node, context, &value))
+        return constant(node, context, value);
+
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+        if (typed_slot(node, context))
+        {
+            Closure *c = new_closure(node, CLOSURE_SLOT);
+            c->slot = node->slot;
+            switch (context)
+            {
+#define SLOT_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                      \
+        c->run.RUNNER = CT##_slot;                 \
+        break;
+                CLOSURE_RESULT_TYPES(SLOT_CASE, 0)
+#undef SLOT_CASE
+            default:
+                break;
+            }
+            return c;
+        }
+        break;
+    case NODE_OPERATION:
+        return compile_binary(node, context);
+    case NODE_UNARY_OPERATION:
+        return compile_unary(node, context);
+    case NODE_ARRAY_ACCESS:
+        return compile_element(node, context);
+    case NODE_FUNC_CALL:
+    {
+        Closure *c = compile_call(node);
+        if (!c)
+            break;
+        switch (context)
+        {
+#define CALL_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                      \
+        c->run.RUNNER = CT##_call;                 \
+        break;
+            CLOSURE_RESULT_TYPES(CALL_CASE, 0)
+#undef CALL_CASE
+        default:
+            break;
+        }
+        return c;
+    }
+    default:
+        break;
+    }
+    return fallback_expression(node, context);
+}
+
+/* An int closure computing evaluate_expression(node). */
+static Closure *compile_condition(ASTNode *node)
+{
+    if (!node->type_info.resolved)
+    {
+        Closure *c = new_closure(node, CLOSURE_CODE);
+        c->run.as_int = int_fallback;
+        return c;
+    }
+
+    // Same order of tests as evaluate_expression()
+    VarType context = node->type_info.has_short    ? VAR_SHORT
+                      : node->type_info.has_float  ? VAR_FLOAT
+                      : node->type_info.has_double ? VAR_DOUBLE
+                                                   : VAR_INT;
+    return convert(compile_expression(node, context), context, VAR_INT);
+}
+
+static Closure *compile_assignment(ASTNode *node)
+{
+    ASTNode *target = node->data.op.left;
+    ASTNode *value = node->data.op.right;
+    bool declaration = node->type == NODE_DECLARATION;
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    c->slot = target->slot;
+
+    if (target->type == NODE_ARRAY_ACCESS)
+    {
+        VarType element = target->var_type;
+        if (declaration || !target->type_info.resolved || target->slot < 0)
+            return NULL;
+        c->a = compile_expression(target->data.array.index, VAR_INT);
+        c->b = compile_expression(value, value_context(element));
+        switch (element)
+        {
+#define STORE_CASE(CT, FIELD, RUNNER, TAG, EVAL, _)                          \
+    case TAG:                                                               \
+        c->run.exec = target->in_bounds ? store_unchecked_##CT : store_##CT; \
+        return c;
+            CLOSURE_RESULT_TYPES(STORE_CASE, 0)
+#undef STORE_CASE
+        case VAR_CHAR:
+            c->run.exec = store_char;
+            return c;
+        default:
+            return NULL;
+        }
+    }
+
+    // Literal chars, booleans and shorts are stored by the tree-walker
+    if (target->slot < 0 || !value->type_info.resolved || value->type == NODE_CHAR ||
+        value->type == NODE_BOOLEAN || value->type == NODE_SHORT)
+        return NULL;
+
+    VarType type = node->var_type == VAR_FLOAT || value->type_info.has_float     ? VAR_FLOAT
+                   : node->var_type == VAR_DOUBLE || value->type_info.has_double ? VAR_DOUBLE
+                                                                                 : VAR_INT;
+    c->a = compile_expression(value, type);
+    switch (type)
+    {
+#define ASSIGN_CASE(CT, FIELD, RUNNER, TAG, EVAL, _)            \
+    case TAG:                                                   \
+        c->run.exec = declaration ? declare_##CT : assign_##CT; \
+        return c;
+        CLOSURE_TYPES(ASSIGN_CASE, 0)
+#undef ASSIGN_CASE
+    default:
+        return NULL;
+    }
+}
+
+static Closure *compile_return(ASTNode *node, VarType return_type)
+{
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    ASTNode *expr = node->data.op.left;
+    if (!expr)
+    {
+        c->run.exec = run_return;
+        return c;
+    }
+    c->a = compile_expression(expr, return_type);
+    switch (return_type)
+    {
+#define RETURN_CASE(CT, FIELD, RUNNER, TAG, EVAL, _) \
+    case TAG:                                        \
+        c->run.exec = return_##CT;                   \
+        return c;
+        CLOSURE_RESULT_TYPES(RETURN_CASE, 0)
+#undef RETURN_CASE
+    default:
+        return NULL;
+    }
+}
+
+static Closure *compile_list(ASTNode *node, VarType return_type)
+{
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    const Closure **tail = &c->a;
+    for (StatementList *item = node->data.statements; item; item = item->next)
+    {
+        Closure *statement = compile_statement(item->statement, return_type);
+        *tail = statement;
+        tail = &statement->next;
+    }
+    c->run.exec = run_list;
+    return c;
+}
+
+/* A statement closure, or NULL to run the node on the tree-walker. */
+static Closure *specialize_statement(ASTNode *node, VarType return_type)
+{
+    Closure *c = new_closure(node, CLOSURE_CODE);
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        return compile_list(node, return_type);
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+        return compile_assignment(node);
+    case NODE_OPERATION:
+    case NODE_UNARY_OPERATION:
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_IDENTIFIER:
+        c->a = compile_condition(node);
+        c->run.exec = run_expression;
+        return c;
+    case NODE_FUNC_CALL:
+        c = compile_call(node);
+        if (c)
+            c->run.exec = run_call;
+        return c;
+    case NODE_IF_STATEMENT:
+        c->a = compile_condition(node->data.if_stmt.condition);
+        c->b = compile_statement(node->data.if_stmt.then_branch, return_type);
+        if (node->data.if_stmt.else_branch)
+            c->c = compile_statement(node->data.if_stmt.else_branch, return_type);
+        c->run.exec = run_if;
+        return c;
+    case NODE_FOR_STATEMENT:
+        // An idiom or a vector kernel runs as one call in the tree-walker
+        if (node->data.for_stmt.idiom || node->data.for_stmt.vector)
+            return NULL;
+        if (node->data.for_stmt.init)
+            c->a = compile_statement(node->data.for_stmt.init, return_type);
+        if (node->data.for_stmt.cond)
+            c->b = compile_condition(node->data.for_stmt.cond);
+        if (node->data.for_stmt.incr)
+            c->c = compile_statement(node->data.for_stmt.incr, return_type);
+        c->d = compile_statement(node->data.for_stmt.body, return_type);
+        c->run.exec = run_for;
+        return c;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        c->a = compile_condition(node->data.while_stmt.cond);
+        c->b = compile_statement(node->data.while_stmt.body, return_type);
+        c->run.exec = node->type == NODE_WHILE_STATEMENT ? run_while : run_do_while;
+        return c;
+    case NODE_BREAK_STATEMENT:
+        c->run.exec = run_break;
+        return c;
+    case NODE_CONTINUE_STATEMENT:
+        c->run.exec = run_continue;
+        return c;
+    case NODE_RETURN:
+        return compile_return(node, return_type);
+    default:
+        return NULL;
+    }
+}
+
+static Closure *compile_statement(ASTNode *node, VarType return_type)
+{
+    Closure *c = node ? specialize_statement(node, return_type) : NULL;
+    if (!c)
+    {
+        c = new_closure(node, CLOSURE_CODE);
+        c->run.exec = run_fallback;
+    }
+    return c;
+}
+
+Closure *compile_closures(ASTNode *root)
+{
+    if (root && root->type == NODE_STATEMENT_LIST)
+    {
+        for (StatementList *item = root->data.statements; item; item = item->next)
+        {
+            ASTNode *def = item->statement;
+            if (def && def->type == NODE_FUNCTION_DEF)
+            {
+                Function *func = def->data.function_def.function;
+                func->closure = compile_statement(func->body, value_context(func->return_type));
+            }
+        }
+    }
+    // main returns an int
+    return compile_statement(root, VAR_INT);
+}
@@ -0,0 +1,28 @@
+/* closure.h */
+
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include "ast.h"
+
+/*
+ * Closure-compiled form of a resolved program.
+ *
+ * compile_closures() turns every statement and expression into a small
+ * record holding a pointer to a C function specialised for that node (an
+ * int addition of a slot and a constant, a for loop, a scalar assignment)
+ * plus the operands it needs, so running the program is a chain of direct
+ * calls with no dispatch on node type. Every closure keeps the node it was
+ * compiled from; a node the compiler has no specialisation for is run by
+ * the tree-walker itself, so both engines behave the same everywhere.
+ */
+
+typedef struct Closure Closure;
+
+/* Compiles the main program and the body of every function defined in it.
+ * Must run after resolve_program(). */
+Closure *compile_closures(ASTNode *root);
+
+ControlFlow execute_closure(const Closure *closure);
+
+#endif /* CLOSURE_H */
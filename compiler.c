@@ -0,0 +1,1988 @@
+/* compiler.c */
+
+#include "vm.h"
+#include <setjmp.h>
+
+/*
+ * Lowers the AST into register bytecode for vm.c.
+ *
+ * Every variable gets one register and one type for its whole lifetime, and
+ * every expression is compiled in the same typed context the tree-walker
+ * would evaluate it in (evaluate_expression_int/short/float/double/bool), so
+ * both engines print the same thing. When a program needs something the
+ * bytecode cannot express with the same observable behaviour (a variable
+ * that changes type, a name that only resolves at runtime, a construct the
+ * evaluator reports as an error) the compiler bails out and main() runs the
+ * tree-walker instead.
+ */
+
+extern void report_error(const char *s);
+
+typedef struct
+{
+    const char *name; /* NULL for hidden registers such as a switch value */
+    VarType type;
+    TypeModifiers modifiers;
+    int depth;
+    uint16_t reg;
+} Local;
+
+typedef struct Breakable
+{
+    int *exits;
+    int exit_count;
+    int exit_capacity;
+    bool is_loop;   /* switches take bruh but pass grind on */
+    int *continues; /* grind jumps, patched once the loop knows its target */
+    int continue_count;
+    int continue_capacity;
+    int *matches; /* where each case of a switch starts, or its compare jump */
+    struct Breakable *enclosing;
+} Breakable;
+
+typedef struct
+{
+    const char *name;
+    VarType return_type;
+    Parameter **parameters; /* declaration order */
+    int param_count;
+    ASTNode *body;
+} FunctionInfo;
+
+typedef struct
+{
+    BytecodeProgram *program;
+    FunctionInfo *functions; /* parallel to program->functions */
+    Scope *globals;
+    BytecodeFunction *function;
+    int function_index;
+    ASTNode *main_tail; /* last top-level statement of main */
+    Local *locals;
+    int local_count;
+    int local_capacity;
+    int depth;
+    int next_register;
+    Breakable *breakable;
+    unsigned fuse; /* FUSE_ flags of the superinstructions to use */
+    jmp_buf bail;
+    const char *reason;
+} Compiler;
+
+_Noreturn static void bail(Compiler *c, const char *reason)
+{
+    c->reason = reason;
+    longjmp(c->bail, 1);
+}
+
+/* Code emission */
+
+static int emit(Compiler *c, Opcode op, int a, int b, int cc)
+{
+    BytecodeFunction *function = c->function;
+    GROW_ARRAY(function->code, function->code_length, function->code_capacity);
+    Instruction *instruction = &function->code[function->code_length];
+    instruction->op = op;
+    instruction->a = a;
+    instruction->b = b;
+    instruction->c = cc;
+    return function->code_length++;
+}
+
+static int emit_sbx(Compiler *c, Opcode op, int a, int32_t sbx)
+{
+    int at = emit(c, op, a, 0, 0);
+    c->function->code[at].sbx = sbx;
+    return at;
+}
+
+static int here(Compiler *c)
+{
+    return c->function->code_length;
+}
+
+static void patch_jump_to(Compiler *c, int at, int target)
+{
+    Instruction *instruction = &c->function->code[at];
+    int offset = target - (at + 1);
+    if (instruction->op == BC_JMP || instruction->op == BC_JMPF || instruction->op == BC_JMPT)
+    {
+        instruction->sbx = offset;
+        return;
+    }
+    /* Fused branches keep their offset in c. */
+    if (offset < INT16_MIN || offset > INT16_MAX)
+        bail(c, "branch too far for a fused instruction");
+    instruction->c = (uint16_t)(int16_t)offset;
+}
+
+static void patch_jump(Compiler *c, int at)
+{
+    patch_jump_to(c, at, here(c));
+}
+
+static void emit_jump_to(Compiler *c, Opcode op, int a, int target)
+{
+    int at = emit_sbx(c, op, a, 0);
+    patch_jump_to(c, at, target);
+}
+
+/* Registers and locals */
+
+static int alloc_register(Compiler *c)
+{
+    if (c->next_register >= MAX_REGISTERS)
+        bail(c, "too many registers");
+    int reg = c->next_register++;
+    if (c->next_register > c->function->register_count)
+        c->function->register_count = c->next_register;
+    return reg;
+}
+
+static int locals_top(Compiler *c)
+{
+    return c->local_count ? c->locals[c->local_count - 1].reg + 1 : 0;
+}
+
+static void reset_temporaries(Compiler *c)
+{
+    c->next_register = locals_top(c);
+}
+
+static bool is_local_register(Compiler *c, int reg)
+{
+    return reg < locals_top(c);
+}
+
+static Local *find_local(Compiler *c, const char *name)
+{
+    for (int i = c->local_count - 1; i >= 0; i--)
+    {
+        if (c->locals[i].name && strcmp(c->locals[i].name, name) == 0)
+            return &c->locals[i];
+    }
+    return NULL;
+}
+
+/* Arrays only live in the global scope, which functions cannot see. */
+static Variable *find_array(Compiler *c, const char *name)
+{
+    if (c->function_index != 0)
+        return NULL;
+    Variable *var = hm_get(c->globals->variables, name, strlen(name));
+    return var && var->is_array ? var : NULL;
+}
+
+static Local *declare_local(Compiler *c, const char *name, VarType type, TypeModifiers mods)
+{
+    for (int i = c->local_count - 1; i >= 0 && c->locals[i].depth == c->depth; i--)
+    {
+        if (name && c->locals[i].name && strcmp(c->locals[i].name, name) == 0)
+            bail(c, "variable redeclared in the same scope");
+    }
+    if (name && c->depth == 0 && find_array(c, name))
+        bail(c, "variable redeclared in the same scope");
+
+    reset_temporaries(c);
+    int reg = alloc_register(c);
+    GROW_ARRAY(c->locals, c->local_count, c->local_capacity);
+    Local *local = &c->locals[c->local_count++];
+    local->name = name;
+    local->type = type;
+    local->modifiers = mods;
+    local->depth = c->depth;
+    local->reg = reg;
+    return local;
+}
+
+static Local *resolve_scalar(Compiler *c, const char *name)
+{
+    Local *local = find_local(c, name);
+    if (!local)
+        bail(c, find_array(c, name) ? "array used as a scalar" : "undefined variable");
+    return local;
+}
+
+static int resolve_array(Compiler *c, const char *name)
+{
+    if (find_local(c, name))
+        bail(c, "scalar used as an array");
+    Variable *var = find_array(c, name);
+    if (!var)
+        bail(c, "undefined array");
+
+    BytecodeProgram *program = c->program;
+    for (int i = 0; i < program->array_count; i++)
+    {
+        if (strcmp(program->arrays[i].name, name) == 0)
+            return i;
+    }
+    GROW_ARRAY(program->arrays, program->array_count, program->array_capacity);
+    ArrayBinding *binding = &program->arrays[program->array_count];
+    binding->name = (char *)name;
+    binding->type = var->var_type;
+    binding->data = var->value.array_data;
+    binding->length = var->array_length;
+    binding->modifiers = var->modifiers;
+    return program->array_count++;
+}
+
+static void begin_scope(Compiler *c)
+{
+    c->depth++;
+}
+
+static void end_scope(Compiler *c)
+{
+    while (c->local_count && c->locals[c->local_count - 1].depth == c->depth)
+        c->local_count--;
+    c->depth--;
+    reset_temporaries(c);
+}
+
+/* On the heap rather than the compiling function's stack, so that
+ * free_compiler() can still walk the chain after a bail. */
+static Breakable *push_breakable(Compiler *c, bool is_loop)
+{
+    Breakable *breakable = calloc(1, sizeof(Breakable));
+    if (!breakable)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    breakable->is_loop = is_loop;
+    breakable->enclosing = c->breakable;
+    c->breakable = breakable;
+    return breakable;
+}
+
+/* Points every grind of the loop at the next instruction. */
+static void patch_continues(Compiler *c, Breakable *loop)
+{
+    for (int i = 0; i < loop->continue_count; i++)
+        patch_jump(c, loop->continues[i]);
+    loop->continue_count = 0;
+}
+
+static void pop_breakable(Compiler *c, Breakable *breakable)
+{
+    for (int i = 0; i < breakable->exit_count; i++)
+        patch_jump(c, breakable->exits[i]);
+    free(breakable->exits);
+    free(breakable->continues);
+    free(breakable->matches);
+    c->breakable = breakable->enclosing;
+    free(breakable);
+}
+
+static int find_function(Compiler *c, const char *name)
+{
+    for (int i = 1; i < c->program->function_count; i++)
+    {
+        if (strcmp(c->functions[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Constants */
+
+static int add_constant(Compiler *c, Register value)
+{
+    BytecodeProgram *program = c->program;
+    for (int i = 0; i < program->constant_count; i++)
+    {
+        if (memcmp(&program->constants[i], &value, sizeof(Register)) == 0)
+            return i;
+    }
+    GROW_ARRAY(program->constants, program->constant_count, program->constant_capacity);
+    program->constants[program->constant_count] = value;
+    return program->constant_count++;
+}
+
+static int add_string(Compiler *c, char *string)
+{
+    BytecodeProgram *program = c->program;
+    GROW_ARRAY(program->strings, program->string_count, program->string_capacity);
+    program->strings[program->string_count] = string;
+    return program->string_count++;
+}
+
+static int target(Compiler *c, int dest)
+{
+    return dest >= 0 ? dest : alloc_register(c);
+}
+
+static int load_value(Compiler *c, VarType type, Register value, int dest)
+{
+    int reg = target(c, dest);
+    if (type == VAR_INT)
+        emit_sbx(c, BC_LOADI, reg, value.ivalue);
+    else
+        emit_sbx(c, BC_LOADK, reg, add_constant(c, value));
+    return reg;
+}
+
+static int load_number(Compiler *c, VarType type, double number, int dest)
+{
+    Register value;
+    memset(&value, 0, sizeof(value));
+    switch (type)
+    {
+    case VAR_INT:
+        value.ivalue = (int)number;
+        break;
+    case VAR_SHORT:
+        value.svalue = (short)number;
+        break;
+    case VAR_FLOAT:
+        value.fvalue = (float)number;
+        break;
+    case VAR_DOUBLE:
+        value.dvalue = number;
+        break;
+    case VAR_BOOL:
+        value.bvalue = number != 0;
+        break;
+    default:
+        break;
+    }
+    return load_value(c, type, value, dest);
+}
+
+/* Types */
+
+/* VAR_CHAR scalars are stored in int registers, like set_char_variable does. */
+static VarType register_type(VarType type)
+{
+    return type == VAR_CHAR ? VAR_INT : type;
+}
+
+static int type_slot(VarType type)
+{
+    switch (type)
+    {
+    case VAR_INT:
+        return 0;
+    case VAR_SHORT:
+        return 1;
+    case VAR_FLOAT:
+        return 2;
+    case VAR_DOUBLE:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+static const Opcode conversions[5][5] = {
+    /* to:  int      short    float    double   bool */
+    {BC_MOVE, BC_I2S, BC_I2F, BC_I2D, BC_I2B},  /* from int */
+    {BC_S2I, BC_MOVE, BC_S2F, BC_S2D, BC_S2B},  /* from short */
+    {BC_F2I, BC_F2S, BC_MOVE, BC_F2D, BC_F2B},  /* from float */
+    {BC_D2I, BC_D2S, BC_D2F, BC_MOVE, BC_D2B},  /* from double */
+    {BC_B2I, BC_B2S, BC_B2F, BC_B2D, BC_MOVE},  /* from bool */
+};
+
+static int convert(Compiler *c, int reg, VarType from, VarType to, int dest)
+{
+    from = register_type(from);
+    to = register_type(to);
+    if (from == to)
+    {
+        if (dest >= 0 && dest != reg)
+        {
+            emit(c, BC_MOVE, dest, reg, 0);
+            return dest;
+        }
+        return reg;
+    }
+    int result = target(c, dest);
+    emit(c, conversions[type_slot(from)][type_slot(to)], result, reg, 0);
+    return result;
+}
+
+static VarType identifier_type(Compiler *c, const char *name)
+{
+    Local *local = find_local(c, name);
+    if (local)
+        return local->type;
+    Variable *var = find_array(c, name);
+    if (var)
+        return var->var_type;
+    bail(c, "undefined variable");
+}
+
+static VarType call_return_type(Compiler *c, ASTNode *node)
+{
+    int index = find_function(c, node->data.func_call.function_name);
+    if (index < 0)
+        bail(c, "undefined function");
+    return c->functions[index].return_type;
+}
+
+/* Mirrors get_expression_type(). */
+static VarType expression_type(Compiler *c, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+    case NODE_SIZEOF:
+        return VAR_INT;
+    case NODE_SHORT:
+        return VAR_SHORT;
+    case NODE_FLOAT:
+        return VAR_FLOAT;
+    case NODE_DOUBLE:
+        return VAR_DOUBLE;
+    case NODE_BOOLEAN:
+        return VAR_BOOL;
+    case NODE_ARRAY_ACCESS:
+    {
+        int array = resolve_array(c, node->data.array.name);
+        VarType index_type = expression_type(c, node->data.array.index);
+        if (index_type != VAR_INT && index_type != VAR_SHORT)
+            bail(c, "array index must be an integer type");
+        return c->program->arrays[array].type;
+    }
+    case NODE_IDENTIFIER:
+        return identifier_type(c, node->data.name);
+    case NODE_OPERATION:
+    {
+        VarType left = expression_type(c, node->data.op.left);
+        VarType right = expression_type(c, node->data.op.right);
+        if (left == VAR_DOUBLE || right == VAR_DOUBLE)
+            return VAR_DOUBLE;
+        if (left == VAR_FLOAT || right == VAR_FLOAT)
+            return VAR_FLOAT;
+        return VAR_INT;
+    }
+    case NODE_UNARY_OPERATION:
+        return expression_type(c, node->data.unary.operand);
+    case NODE_FUNC_CALL:
+        return call_return_type(c, node);
+    default:
+        bail(c, "unsupported expression");
+    }
+}
+
+/* Mirrors is_short_expression(), is_float_expression() and
+ * is_double_expression(): literals of the type, variables of the type,
+ * calls returning the type, and operations with such an operand unless
+ * the type is short, which operations promote to int. */
+static bool is_typed_expression(Compiler *c, ASTNode *node, VarType type)
+{
+    switch (node->type)
+    {
+    case NODE_SHORT:
+        return type == VAR_SHORT;
+    case NODE_FLOAT:
+        return type == VAR_FLOAT;
+    case NODE_DOUBLE:
+        return type == VAR_DOUBLE;
+    case NODE_IDENTIFIER:
+        return identifier_type(c, node->data.name) == type;
+    case NODE_OPERATION:
+        return type != VAR_SHORT && (is_typed_expression(c, node->data.op.left, type) ||
+                                     is_typed_expression(c, node->data.op.right, type));
+    case NODE_FUNC_CALL:
+        return call_return_type(c, node) == type;
+    default:
+        return false;
+    }
+}
+
+static bool is_comparison(OperatorType op)
+{
+    return op >= OP_LT && op <= OP_NE;
+}
+
+static bool has_increment(ASTNode *node)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_OPERATION:
+        return has_increment(node->data.op.left) || has_increment(node->data.op.right);
+    case NODE_UNARY_OPERATION:
+        return node->data.unary.op != OP_NEG || has_increment(node->data.unary.operand);
+    case NODE_ARRAY_ACCESS:
+        return has_increment(node->data.array.index);
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (has_increment(arg->expr))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static bool contains_call(ASTNode *node)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_FUNC_CALL:
+        return true;
+    case NODE_OPERATION:
+        return contains_call(node->data.op.left) || contains_call(node->data.op.right);
+    case NODE_UNARY_OPERATION:
+        return contains_call(node->data.unary.operand);
+    case NODE_ARRAY_ACCESS:
+        return contains_call(node->data.array.index);
+    default:
+        return false;
+    }
+}
+
+static bool references_name(ASTNode *node, const char *name)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+        return strcmp(node->data.name, name) == 0;
+    case NODE_OPERATION:
+        return references_name(node->data.op.left, name) || references_name(node->data.op.right, name);
+    case NODE_UNARY_OPERATION:
+        return references_name(node->data.unary.operand, name);
+    case NODE_ARRAY_ACCESS:
+        return references_name(node->data.array.index, name);
+    case NODE_SIZEOF:
+        return references_name(node->data.sizeof_stmt.expr, name);
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (references_name(arg->expr, name))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static Opcode typed_opcode(Opcode int_opcode, VarType type)
+{
+    static const int stride = BC_ADD_S - BC_ADD_I;
+    return (Opcode)(int_opcode + stride * type_slot(type));
+}
+
+static Opcode element_opcode(Opcode int_opcode, VarType type)
+{
+    switch (type)
+    {
+    case VAR_SHORT:
+        return (Opcode)(int_opcode + 1);
+    case VAR_FLOAT:
+        return (Opcode)(int_opcode + 2);
+    case VAR_DOUBLE:
+        return (Opcode)(int_opcode + 3);
+    case VAR_BOOL:
+        return (Opcode)(int_opcode + 4);
+    case VAR_CHAR:
+        return (Opcode)(int_opcode + 5);
+    default:
+        return int_opcode;
+    }
+}
+
+/* Expressions */
+
+static int compile_expression(Compiler *c, ASTNode *node, VarType want, int dest);
+
+static int compile_literal(Compiler *c, ASTNode *node, VarType want, int dest)
+{
+    double number;
+    bool integral = true;
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        number = node->data.ivalue;
+        integral = node->type == NODE_INT;
+        break;
+    case NODE_SHORT:
+        number = node->data.svalue;
+        integral = false;
+        break;
+    case NODE_BOOLEAN:
+        number = node->data.bvalue;
+        integral = false;
+        break;
+    case NODE_FLOAT:
+        number = node->data.fvalue;
+        if (want == VAR_INT || want == VAR_SHORT)
+            bail(c, "floating-point literal in integer context");
+        return load_number(c, want, number, dest);
+    case NODE_DOUBLE:
+        number = node->data.dvalue;
+        if (want == VAR_INT || want == VAR_SHORT)
+            bail(c, "floating-point literal in integer context");
+        if (want == VAR_DOUBLE)
+            return load_number(c, want, number, dest);
+        return load_number(c, want, (float)number, dest);
+    default:
+        bail(c, "unsupported literal");
+    }
+    /* Only int literals convert to floating point; the others are reported
+     * as invalid float/double expressions by the evaluator. */
+    if ((want == VAR_FLOAT || want == VAR_DOUBLE) && !integral)
+        bail(c, "literal in floating-point context");
+    return load_number(c, want, number, dest);
+}
+
+static int sizeof_value(Compiler *c, ASTNode *node)
+{
+    ASTNode *expr = node->data.sizeof_stmt.expr;
+    if (expr->type == NODE_IDENTIFIER)
+    {
+        Local *local = find_local(c, expr->data.name);
+        Variable *array = local ? NULL : find_array(c, expr->data.name);
+        if (!local && !array)
+            bail(c, "undefined variable in sizeof");
+        VarType type = local ? local->type : array->var_type;
+        int count = local ? 1 : array->array_length;
+        switch (type)
+        {
+        case VAR_INT:
+            return sizeof(int) * count;
+        case VAR_SHORT:
+            return sizeof(short) * count;
+        case VAR_FLOAT:
+            return sizeof(float) * count;
+        case VAR_DOUBLE:
+            return sizeof(double) * count;
+        case VAR_BOOL:
+            return sizeof(bool) * count;
+        default:
+            bail(c, "undefined variable in sizeof");
+        }
+    }
+    switch (expression_type(c, expr))
+    {
+    case VAR_INT:
+        return sizeof(int);
+    case VAR_SHORT:
+        return sizeof(short);
+    case VAR_FLOAT:
+        return sizeof(float);
+    case VAR_DOUBLE:
+        return sizeof(double);
+    case VAR_BOOL:
+        return sizeof(bool);
+    case VAR_CHAR:
+        return sizeof(char);
+    default:
+        bail(c, "invalid type in sizeof");
+    }
+}
+
+/* A variable's own register may be handed out as an operand; copy it when
+ * the rest of the expression could still increment that variable. */
+static int protect_operand(Compiler *c, int reg, ASTNode *rest)
+{
+    if (is_local_register(c, reg) && has_increment(rest))
+    {
+        int copy = alloc_register(c);
+        emit(c, BC_MOVE, copy, reg, 0);
+        return copy;
+    }
+    return reg;
+}
+
+/* Operand evaluation of handle_binary_operation(). */
+static int compile_operand(Compiler *c, ASTNode *node, VarType type, VarType promoted)
+{
+    switch (promoted)
+    {
+    case VAR_FLOAT:
+        if (type == VAR_INT)
+            return convert(c, compile_expression(c, node, VAR_INT, -1), VAR_INT, VAR_FLOAT, -1);
+        return compile_expression(c, node, VAR_FLOAT, -1);
+    case VAR_DOUBLE:
+        if (type == VAR_INT || type == VAR_FLOAT)
+            return convert(c, compile_expression(c, node, type, -1), type, VAR_DOUBLE, -1);
+        return compile_expression(c, node, VAR_DOUBLE, -1);
+    default:
+        return compile_expression(c, node, promoted, -1);
+    }
+}
+
+/* The int literal `node`, negated if asked, when it fits an immediate. */
+static bool small_literal(ASTNode *node, bool negate, int16_t *value)
+{
+    if (node->type != NODE_INT)
+        return false;
+    long number = negate ? -(long)node->data.ivalue : node->data.ivalue;
+    if (number < INT16_MIN || number > INT16_MAX)
+        return false;
+    *value = (int16_t)number;
+    return true;
+}
+
+static int compile_binary(Compiler *c, ASTNode *node, VarType want, int dest)
+{
+    ASTNode *left = node->data.op.left;
+    ASTNode *right = node->data.op.right;
+    OperatorType op = node->data.op.op;
+
+    if (op == OP_AND || op == OP_OR)
+    {
+        if (want == VAR_FLOAT || want == VAR_DOUBLE)
+            bail(c, "logical operator in floating-point context");
+        int l = compile_expression(c, left, want, -1);
+        l = protect_operand(c, l, right);
+        int r = compile_expression(c, right, want, -1);
+        l = convert(c, l, want, VAR_INT, -1);
+        r = convert(c, r, want, VAR_INT, -1);
+        int result = want == VAR_INT ? target(c, dest) : alloc_register(c);
+        emit(c, op == OP_AND ? BC_AND_I : BC_OR_I, result, l, r);
+        return convert(c, result, VAR_INT, want, dest);
+    }
+
+    VarType left_type = expression_type(c, left);
+    VarType right_type = expression_type(c, right);
+    VarType promoted = VAR_INT; /* short operands included, as in C */
+    if (left_type == VAR_DOUBLE || right_type == VAR_DOUBLE)
+        promoted = VAR_DOUBLE;
+    else if (left_type == VAR_FLOAT || right_type == VAR_FLOAT)
+        promoted = VAR_FLOAT;
+
+    int l = compile_operand(c, left, left_type, promoted);
+    l = protect_operand(c, l, right);
+
+    /* x + k and x - k with a small literal k */
+    int16_t step;
+    if ((c->fuse & FUSE_INCREMENT) && promoted == VAR_INT && (op == OP_PLUS || op == OP_MINUS) &&
+        small_literal(right, op == OP_MINUS, &step))
+    {
+        int result = want == VAR_INT ? target(c, dest) : alloc_register(c);
+        emit(c, BC_ADDI_I, result, l, (uint16_t)step);
+        return convert(c, result, VAR_INT, want, dest);
+    }
+
+    int r = compile_operand(c, right, right_type, promoted);
+
+    Opcode opcode = typed_opcode((Opcode)(BC_ADD_I + (op - OP_PLUS)), promoted);
+    if (op == OP_MOD && promoted == VAR_INT && node->modifiers.is_unsigned)
+        opcode = BC_UMOD_I;
+
+    VarType result_type = is_comparison(op) ? VAR_INT : promoted;
+    int result = result_type == register_type(want) ? target(c, dest) : alloc_register(c);
+    emit(c, opcode, result, l, r);
+    return convert(c, result, result_type, want, dest);
+}
+
+static void emit_step(Compiler *c, Local *local, int delta)
+{
+    if (local->type == VAR_INT)
+    {
+        emit(c, BC_ADDI_I, local->reg, local->reg, (uint16_t)(int16_t)delta);
+        return;
+    }
+    int one = load_number(c, local->type, 1, -1);
+    Opcode opcode = typed_opcode(delta > 0 ? BC_ADD_I : BC_SUB_I, local->type);
+    emit(c, opcode, local->reg, local->reg, one);
+}
+
+static int compile_increment(Compiler *c, ASTNode *node, VarType want, int dest)
+{
+    ASTNode *operand = node->data.unary.operand;
+    OperatorType op = node->data.unary.op;
+    if (operand->type != NODE_IDENTIFIER)
+        bail(c, "increment of a non-variable");
+    if (want == VAR_BOOL)
+        bail(c, "increment in boolean context");
+    Local *local = resolve_scalar(c, operand->data.name);
+    if (local->type != want)
+        bail(c, "increment changes the variable type");
+
+    int delta = (op == OP_PRE_INC || op == OP_POST_INC) ? 1 : -1;
+    if (op == OP_PRE_INC || op == OP_PRE_DEC)
+    {
+        emit_step(c, local, delta);
+        return convert(c, local->reg, want, want, dest);
+    }
+    int old = alloc_register(c);
+    emit(c, BC_MOVE, old, local->reg, 0);
+    emit_step(c, local, delta);
+    return convert(c, old, want, want, dest);
+}
+
+static int compile_call(Compiler *c, ASTNode *node, int dest)
+{
+    int index = find_function(c, node->data.func_call.function_name);
+    if (index < 0)
+        bail(c, "undefined function");
+    FunctionInfo *info = &c->functions[index];
+    if (info->return_type == VAR_CHAR)
+        bail(c, "unsupported return type");
+
+    int count = 0;
+    for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        count++;
+    if (count != info->param_count)
+        bail(c, "mismatched number of arguments and parameters");
+
+    /* enter_function_scope() reverses the parameter list while it evaluates
+     * the arguments, so nested calls would see it back to front. */
+    if (count > 1)
+    {
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (contains_call(arg->expr))
+                bail(c, "call in the arguments of a multi-parameter call");
+        }
+    }
+
+    /* Arguments land in consecutive registers, which become the callee's
+     * parameter registers. */
+    int base = c->next_register;
+    for (int i = 0; i < count; i++)
+        alloc_register(c);
+    int i = 0;
+    for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next, i++)
+        compile_expression(c, arg->expr, register_type(info->parameters[i]->type), base + i);
+
+    int result = dest >= 0 ? dest : count ? base : alloc_register(c);
+    emit(c, BC_CALL, result, index, base);
+    return result;
+}
+
+static int compile_expression(Compiler *c, ASTNode *node, VarType want, int dest)
+{
+    want = register_type(want);
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_BOOLEAN:
+        return compile_literal(c, node, want, dest);
+    case NODE_SIZEOF:
+        if (want == VAR_BOOL)
+            bail(c, "sizeof in boolean context");
+        return load_number(c, want, sizeof_value(c, node), dest);
+    case NODE_IDENTIFIER:
+    {
+        Local *local = resolve_scalar(c, node->data.name);
+        return convert(c, local->reg, local->type, want, dest);
+    }
+    case NODE_OPERATION:
+        return compile_binary(c, node, want, dest);
+    case NODE_UNARY_OPERATION:
+    {
+        if (node->data.unary.op != OP_NEG)
+            return compile_increment(c, node, want, dest);
+        int operand = compile_expression(c, node->data.unary.operand, want, -1);
+        int result = target(c, dest);
+        emit(c, want == VAR_BOOL ? BC_NOT_B : typed_opcode(BC_NEG_I, want), result, operand, 0);
+        return result;
+    }
+    case NODE_ARRAY_ACCESS:
+    {
+        int array = resolve_array(c, node->data.array.name);
+        VarType element = c->program->arrays[array].type;
+        if (node->var_type != element)
+            bail(c, "array element type changed");
+        int index = compile_expression(c, node->data.array.index, VAR_INT, -1);
+        int result = register_type(element) == want ? target(c, dest) : alloc_register(c);
+        emit(c, element_opcode(BC_LOADA_I, element), result, array, index);
+        return convert(c, result, element, want, dest);
+    }
+    case NODE_FUNC_CALL:
+    {
+        VarType type = call_return_type(c, node);
+        int result = compile_call(c, node, register_type(type) == want ? dest : -1);
+        return convert(c, result, type, want, dest);
+    }
+    default:
+        bail(c, "unsupported expression");
+    }
+}
+
+/* Mirrors evaluate_expression(): the value converted to int. */
+static int compile_value(Compiler *c, ASTNode *node, int dest)
+{
+    /* A comparison is 0 or 1 whatever context it is evaluated in. */
+    if (node->type == NODE_OPERATION && is_comparison(node->data.op.op))
+        return compile_expression(c, node, VAR_INT, dest);
+
+    VarType context = VAR_INT;
+    if (is_typed_expression(c, node, VAR_SHORT))
+        context = VAR_SHORT;
+    else if (is_typed_expression(c, node, VAR_FLOAT))
+        context = VAR_FLOAT;
+    else if (is_typed_expression(c, node, VAR_DOUBLE))
+        context = VAR_DOUBLE;
+
+    if (context == VAR_INT)
+        return compile_expression(c, node, VAR_INT, dest);
+    return convert(c, compile_expression(c, node, context, -1), context, VAR_INT, dest);
+}
+
+/* Statements */
+
+static void compile_statement(Compiler *c, ASTNode *node);
+
+/* The type the tree-walker gives a variable when assigning this node. */
+static VarType assignment_type(Compiler *c, ASTNode *node)
+{
+    ASTNode *value = node->data.op.right;
+    if (value->type == NODE_CHAR)
+        return VAR_CHAR;
+    if (value->type == NODE_BOOLEAN)
+        return VAR_BOOL;
+    if (value->type == NODE_SHORT)
+        return VAR_SHORT;
+    if (node->var_type == VAR_FLOAT || is_typed_expression(c, value, VAR_FLOAT))
+        return VAR_FLOAT;
+    if (node->var_type == VAR_DOUBLE || is_typed_expression(c, value, VAR_DOUBLE))
+        return VAR_DOUBLE;
+    return VAR_INT;
+}
+
+static void compile_store(Compiler *c, ASTNode *value, VarType type, int reg)
+{
+    switch (type)
+    {
+    case VAR_CHAR:
+        load_number(c, VAR_INT, (char)value->data.ivalue, reg);
+        break;
+    case VAR_BOOL:
+    case VAR_SHORT:
+        compile_literal(c, value, type, reg);
+        break;
+    default:
+        compile_expression(c, value, type, reg);
+        break;
+    }
+}
+
+/* a[i] = a[i] + k on an int array, where neither i nor k can fail or
+ * change anything, so the load, addition and store may run as one. */
+static bool is_simple_int(Compiler *c, ASTNode *node)
+{
+    if (node->type == NODE_INT)
+        return true;
+    if (node->type != NODE_IDENTIFIER)
+        return false;
+    Local *local = find_local(c, node->data.name);
+    return local && local->type == VAR_INT;
+}
+
+static bool is_accumulation(Compiler *c, ASTNode *node)
+{
+    ASTNode *access = node->data.op.left;
+    ASTNode *value = node->data.op.right;
+    if (value->type != NODE_OPERATION || value->data.op.op != OP_PLUS)
+        return false;
+    ASTNode *load = value->data.op.left;
+    if (load->type != NODE_ARRAY_ACCESS || load->var_type != VAR_INT ||
+        strcmp(load->data.array.name, access->data.array.name) != 0)
+        return false;
+
+    ASTNode *index = access->data.array.index;
+    ASTNode *load_index = load->data.array.index;
+    if (!is_simple_int(c, index) || !is_simple_int(c, value->data.op.right) ||
+        index->type != load_index->type)
+        return false;
+    if (index->type == NODE_INT)
+        return index->data.ivalue == load_index->data.ivalue;
+    return strcmp(index->data.name, load_index->data.name) == 0;
+}
+
+static void compile_array_assignment(Compiler *c, ASTNode *node)
+{
+    ASTNode *access = node->data.op.left;
+    int array = resolve_array(c, access->data.array.name);
+    ArrayBinding *binding = &c->program->arrays[array];
+    if (binding->modifiers.is_const)
+    {
+        emit(c, BC_CONST_ERROR, 0, 0, 0);
+        return;
+    }
+    VarType element = binding->type;
+    if ((c->fuse & FUSE_ACCUMULATE) && element == VAR_INT && is_accumulation(c, node))
+    {
+        int index = compile_expression(c, access->data.array.index, VAR_INT, -1);
+        int value = compile_expression(c, node->data.op.right->data.op.right, VAR_INT, -1);
+        emit(c, BC_ADDA_I, array, index, value);
+        return;
+    }
+    int index = compile_expression(c, access->data.array.index, VAR_INT, -1);
+    index = protect_operand(c, index, node->data.op.right);
+    /* Char elements are computed as int and truncated by the store. */
+    int value = compile_expression(c, node->data.op.right, element == VAR_CHAR ? VAR_INT : element, -1);
+    emit(c, element_opcode(BC_STOREA_I, element), array, index, value);
+}
+
+static void compile_assignment(Compiler *c, ASTNode *node)
+{
+    if (node->data.op.left->type == NODE_ARRAY_ACCESS)
+    {
+        compile_array_assignment(c, node);
+        return;
+    }
+
+    const char *name = node->data.op.left->data.name;
+    Local *local = resolve_scalar(c, name);
+    if (local->modifiers.is_const)
+    {
+        emit(c, BC_CONST_ERROR, 0, 0, 0);
+        return;
+    }
+    if (node->modifiers.is_const)
+        bail(c, "assignment makes the variable const");
+    if (assignment_type(c, node) != local->type)
+        bail(c, "assignment changes the variable type");
+    compile_store(c, node->data.op.right, local->type, local->reg);
+    local->modifiers = node->modifiers;
+}
+
+static void compile_declaration(Compiler *c, ASTNode *node)
+{
+    const char *name = node->data.op.left->data.name;
+    ASTNode *value = node->data.op.right;
+    if (references_name(value, name))
+        bail(c, "variable used in its own initializer");
+    VarType type = assignment_type(c, node);
+    Local *local = declare_local(c, name, type, node->modifiers);
+    compile_store(c, value, type, local->reg);
+}
+
+static void compile_increment_statement(Compiler *c, ASTNode *node)
+{
+    ASTNode *operand = node->data.unary.operand;
+    if (operand->type != NODE_IDENTIFIER)
+        bail(c, "increment of a non-variable");
+    Local *local = resolve_scalar(c, operand->data.name);
+    if (local->type != VAR_INT)
+        bail(c, "increment changes the variable type");
+    OperatorType op = node->data.unary.op;
+    emit_step(c, local, (op == OP_PRE_INC || op == OP_POST_INC) ? 1 : -1);
+}
+
+static void add_segment(Compiler *c, FormatSegment **segments, int *count, int *capacity,
+                        FormatKind kind, char *text, int reg, int index)
+{
+    (void)c;
+    GROW_ARRAY(*segments, *count, *capacity);
+    FormatSegment *segment = &(*segments)[(*count)++];
+    segment->kind = kind;
+    segment->text = text;
+    segment->reg = reg;
+    segment->index = index;
+}
+
+static char *copy_text(const char *start, size_t length)
+{
+    char *text = malloc(length + 1);
+    if (!text)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    memcpy(text, start, length);
+    text[length] = '\0';
+    return text;
+}
+
+/* Precompiles a yapping/yappin format string the way execute_yapping_call()
+ * walks it at runtime. */
+static void compile_print(Compiler *c, ArgumentList *args, PrintTarget print_target)
+{
+    if (!args || args->expr->type != NODE_STRING_LITERAL)
+        bail(c, "format must be a string literal");
+
+    PrintFormat format = {print_target, NULL, 0, 0};
+    const char *cursor = args->expr->data.name;
+    const char *text = cursor;
+    ArgumentList *cur = args->next;
+
+    while (*cursor != '\0')
+    {
+        if (*cursor != '%' || cur == NULL)
+        {
+            cursor++;
+            continue;
+        }
+        if (cursor > text)
+            add_segment(c, &format.segments, &format.segment_count, &format.segment_capacity,
+                        FORMAT_TEXT, copy_text(text, cursor - text), 0, 0);
+
+        const char *start = cursor++;
+        while (*cursor != '\0' && strchr("diouxXfFeEgGaAcspnb%", *cursor) == NULL)
+            cursor++;
+        if (*cursor == '\0' || cursor - start + 1 >= 32)
+            bail(c, "invalid format specifier");
+
+        char conversion = *cursor;
+        char *specifier = copy_text(start, cursor - start + 1);
+        ASTNode *expr = cur->expr;
+        FormatKind kind;
+        int reg = 0;
+        int index = 0;
+
+        if (conversion == 'b')
+        {
+            kind = FORMAT_BOOL;
+            reg = compile_expression(c, expr, VAR_BOOL, alloc_register(c));
+        }
+        else if (strchr("diouxX", conversion))
+        {
+            kind = FORMAT_INT;
+            if (is_typed_expression(c, expr, VAR_SHORT))
+            {
+                kind = FORMAT_SHORT;
+                if (print_target == PRINT_YAPPING)
+                {
+                    /* Signedness comes from the variable's modifiers at
+                     * runtime, which assignments may change. */
+                    if (expr->type == NODE_IDENTIFIER &&
+                        resolve_scalar(c, expr->data.name)->modifiers.is_unsigned)
+                        bail(c, "unsigned smol printed as integer");
+                    if (expr->modifiers.is_unsigned)
+                        kind = FORMAT_USHORT;
+                }
+                reg = compile_expression(c, expr, VAR_SHORT, alloc_register(c));
+            }
+            else
+            {
+                reg = compile_expression(c, expr, VAR_INT, alloc_register(c));
+            }
+        }
+        else if (strchr("fFeEgGa", conversion))
+        {
+            if (print_target == PRINT_YAPPING && expr->type == NODE_ARRAY_ACCESS)
+            {
+                index = resolve_array(c, expr->data.array.name);
+                VarType element = c->program->arrays[index].type;
+                if (element != VAR_FLOAT && element != VAR_DOUBLE)
+                    bail(c, "floating-point format with a non floating-point array");
+                kind = element == VAR_FLOAT ? FORMAT_ARRAY_FLOAT : FORMAT_ARRAY_DOUBLE;
+                reg = compile_expression(c, expr->data.array.index, VAR_INT, alloc_register(c));
+            }
+            else if (is_typed_expression(c, expr, VAR_FLOAT))
+            {
+                kind = FORMAT_FLOAT;
+                reg = compile_expression(c, expr, VAR_FLOAT, alloc_register(c));
+            }
+            else if (is_typed_expression(c, expr, VAR_DOUBLE))
+            {
+                kind = FORMAT_DOUBLE;
+                reg = compile_expression(c, expr, VAR_DOUBLE, alloc_register(c));
+            }
+            else
+            {
+                bail(c, "invalid argument type for floating-point format specifier");
+            }
+        }
+        else if (conversion == 'c')
+        {
+            kind = FORMAT_INT;
+            reg = compile_expression(c, expr, VAR_INT, alloc_register(c));
+        }
+        else if (conversion == 's')
+        {
+            if (expr->type == NODE_IDENTIFIER && !find_local(c, expr->data.name) &&
+                find_array(c, expr->data.name))
+            {
+                kind = FORMAT_ARRAY_STRING;
+                index = resolve_array(c, expr->data.name);
+            }
+            else if (expr->type == NODE_STRING_LITERAL && !find_local(c, expr->data.name) &&
+                     !find_array(c, expr->data.name))
+            {
+                kind = FORMAT_STRING;
+                index = add_string(c, expr->data.name);
+            }
+            else
+            {
+                bail(c, "invalid argument type for %s");
+            }
+        }
+        else
+        {
+            bail(c, "unsupported format specifier");
+        }
+
+        add_segment(c, &format.segments, &format.segment_count, &format.segment_capacity,
+                    kind, specifier, reg, index);
+        /* The evaluator stops formatting after printing an array element. */
+        if (kind == FORMAT_ARRAY_FLOAT || kind == FORMAT_ARRAY_DOUBLE)
+        {
+            text = cursor;
+            break;
+        }
+        cur = cur->next;
+        text = ++cursor;
+    }
+    if (cursor > text)
+        add_segment(c, &format.segments, &format.segment_count, &format.segment_capacity,
+                    FORMAT_TEXT, copy_text(text, cursor - text), 0, 0);
+
+    BytecodeProgram *program = c->program;
+    GROW_ARRAY(program->formats, program->format_count, program->format_capacity);
+    program->formats[program->format_count] = format;
+    emit(c, BC_PRINT, program->format_count++, 0, 0);
+}
+
+static void compile_slorp(Compiler *c, ArgumentList *args)
+{
+    if (!args || args->expr->type != NODE_IDENTIFIER)
+        bail(c, "slorp requires a variable identifier");
+    const char *name = args->expr->data.name;
+    Local *local = find_local(c, name);
+    if (local)
+    {
+        switch (local->type)
+        {
+        case VAR_INT:
+            emit(c, BC_SLORP_I, local->reg, 0, 0);
+            return;
+        case VAR_SHORT:
+            emit(c, BC_SLORP_S, local->reg, 0, 0);
+            return;
+        case VAR_FLOAT:
+            emit(c, BC_SLORP_F, local->reg, 0, 0);
+            return;
+        case VAR_DOUBLE:
+            emit(c, BC_SLORP_D, local->reg, 0, 0);
+            return;
+        default:
+            bail(c, "unsupported type for slorp");
+        }
+    }
+    int array = resolve_array(c, name);
+    if (c->program->arrays[array].type != VAR_CHAR)
+        bail(c, "unsupported type for slorp");
+    emit(c, BC_SLORP_STR, array, 0, 0);
+}
+
+static void compile_call_statement(Compiler *c, ASTNode *node)
+{
+    ArgumentList *args = node->data.func_call.arguments;
+    Builtin builtin = node->data.func_call.builtin;
+    switch (builtin)
+    {
+    case BUILTIN_YAPPING:
+        compile_print(c, args, PRINT_YAPPING);
+        break;
+    case BUILTIN_YAPPIN:
+        compile_print(c, args, PRINT_YAPPIN);
+        break;
+    case BUILTIN_BAKA:
+        if (!args)
+            emit(c, BC_BAKA_STR, add_string(c, "\n"), 0, 0);
+        else if (args->expr->type != NODE_STRING_LITERAL || strchr(args->expr->data.name, '%'))
+            bail(c, "baka needs a plain string literal");
+        else
+            emit(c, BC_BAKA_STR, add_string(c, args->expr->data.name), 0, 0);
+        break;
+    case BUILTIN_RAGEQUIT:
+    case BUILTIN_CHILL:
+        if (!args || args->expr->type != NODE_INT)
+            bail(c, "builtin needs an integer literal");
+        emit_sbx(c, builtin == BUILTIN_RAGEQUIT ? BC_RAGEQUIT : BC_CHILL, 0, args->expr->data.ivalue);
+        break;
+    case BUILTIN_SLORP:
+        compile_slorp(c, args);
+        break;
+    case BUILTIN_NONE:
+        compile_call(c, node, -1);
+        break;
+    }
+}
+
+/* Branches that negate a comparison: < to >=, > to <=, == to != */
+static const Opcode negated_branch[] = {
+    [OP_LT - OP_LT] = BC_JGE_I, [OP_GT - OP_LT] = BC_JLE_I, [OP_LE - OP_LT] = BC_JGT_I,
+    [OP_GE - OP_LT] = BC_JLT_I, [OP_EQ - OP_LT] = BC_JNE_I, [OP_NE - OP_LT] = BC_JEQ_I,
+};
+
+/* x % k == 0 and x % k != 0 with a positive literal k */
+static ASTNode *modulo_test(Compiler *c, ASTNode *node, int16_t *divisor)
+{
+    ASTNode *left = node->data.op.left;
+    ASTNode *right = node->data.op.right;
+    OperatorType op = node->data.op.op;
+    if ((op != OP_EQ && op != OP_NE) || right->type != NODE_INT || right->data.ivalue != 0 ||
+        left->type != NODE_OPERATION || left->data.op.op != OP_MOD || left->modifiers.is_unsigned ||
+        !small_literal(left->data.op.right, false, divisor) || *divisor <= 0 ||
+        expression_type(c, left->data.op.left) != VAR_INT)
+        return NULL;
+    return left->data.op.left;
+}
+
+/*
+ * Emits a jump taken when `condition` is true (`when`) or false, to be
+ * patched by the caller. An int comparison becomes a single
+ * compare-and-branch; anything else is evaluated like evaluate_expression()
+ * and tested with JMPT/JMPF.
+ */
+static int compile_branch(Compiler *c, ASTNode *condition, bool when)
+{
+    if ((c->fuse & (FUSE_COMPARE | FUSE_MODULO)) && condition->type == NODE_OPERATION &&
+        is_comparison(condition->data.op.op))
+    {
+        ASTNode *left = condition->data.op.left;
+        ASTNode *right = condition->data.op.right;
+        OperatorType op = condition->data.op.op;
+        VarType left_type = expression_type(c, left);
+        VarType right_type = expression_type(c, right);
+        Opcode branch = negated_branch[op - OP_LT];
+        if (when)
+            branch = (Opcode)(BC_JLT_I + (op - OP_LT));
+        int16_t immediate;
+        ASTNode *dividend = (c->fuse & FUSE_MODULO) ? modulo_test(c, condition, &immediate) : NULL;
+
+        if (dividend)
+        {
+            int reg = compile_expression(c, dividend, VAR_INT, -1);
+            return emit(c, (op == OP_EQ) == when ? BC_JMODZ_IK : BC_JMODNZ_IK, reg,
+                        (uint16_t)immediate, 0);
+        }
+        if ((c->fuse & FUSE_COMPARE) && (left_type == VAR_INT || left_type == VAR_SHORT) &&
+            (right_type == VAR_INT || right_type == VAR_SHORT) &&
+            (left_type == VAR_INT || right_type == VAR_INT))
+        {
+            int l = compile_operand(c, left, left_type, VAR_INT);
+            l = protect_operand(c, l, right);
+            if (small_literal(right, false, &immediate))
+                return emit(c, (Opcode)(branch - BC_JLT_I + BC_JLT_IK), l, (uint16_t)immediate, 0);
+            int r = compile_operand(c, right, right_type, VAR_INT);
+            return emit(c, branch, l, r, 0);
+        }
+    }
+    int value = compile_value(c, condition, -1);
+    return emit_sbx(c, when ? BC_JMPT : BC_JMPF, value, 0);
+}
+
+static void compile_if(Compiler *c, ASTNode *node)
+{
+    begin_scope(c);
+    int else_jump = compile_branch(c, node->data.if_stmt.condition, false);
+    compile_statement(c, node->data.if_stmt.then_branch);
+    if (node->data.if_stmt.else_branch)
+    {
+        int end_jump = emit_sbx(c, BC_JMP, 0, 0);
+        patch_jump(c, else_jump);
+        compile_statement(c, node->data.if_stmt.else_branch);
+        patch_jump(c, end_jump);
+    }
+    else
+    {
+        patch_jump(c, else_jump);
+    }
+    end_scope(c);
+}
+
+static bool bind_kernel_scalar(Compiler *c, LoopKernel *kernel, const char *name)
+{
+    for (int i = 0; i < kernel->scalar_count; i++)
+    {
+        if (strcmp(kernel->scalars[i].name, name) == 0)
+            return true;
+    }
+    Local *local = find_local(c, name);
+    if (!local)
+        return false;
+    kernel->scalars[kernel->scalar_count++] = (KernelScalar){name, local->type, local->modifiers, local->reg};
+    return true;
+}
+
+/* A loop the idiom or vectorize pass gave a kernel hands the counter's
+ * range to it first, as a counted loop does in the tree-walker. A vector
+ * kernel only pays off on the thread pool; alone, the loop as bytecode
+ * (and machine code once the JIT has it) is faster. The bound has to be
+ * an int literal or variable the body leaves alone. */
+static void compile_kernel(Compiler *c, ASTNode *node)
+{
+    const LoopIdiom *idiom = node->data.for_stmt.idiom;
+    const VectorKernel *vector = node->data.for_stmt.parallel != LOOP_SEQUENTIAL ? node->data.for_stmt.vector : NULL;
+    if ((!idiom && !vector) || c->program->kernel_count > UINT16_MAX)
+        return;
+    ASTNode *bound = node->data.for_stmt.cond->data.op.right;
+    const char *counter_name = node->data.for_stmt.cond->data.op.left->data.name;
+    Local *counter = find_local(c, counter_name);
+    if (!counter || counter->type != VAR_INT || counter->modifiers.is_const || counter->modifiers.is_unsigned)
+        return;
+    Local *bound_local = bound->type == NODE_IDENTIFIER ? find_local(c, bound->data.name) : NULL;
+    if (bound->type != NODE_INT && (!bound_local || bound_local->type != VAR_INT))
+        return;
+
+    LoopKernel kernel = {.loop = node};
+    bind_kernel_scalar(c, &kernel, counter_name);
+    for (int step = 0; vector && step < vector->count; step++)
+    {
+        const ASTNode *scalar = vector->steps[step].node;
+        if (vector->steps[step].kind == VECTOR_SCALAR && scalar->type == NODE_IDENTIFIER &&
+            !bind_kernel_scalar(c, &kernel, scalar->data.name))
+            return;
+    }
+    if (idiom && (idiom->kind == IDIOM_SUM || idiom->kind == IDIOM_MIN || idiom->kind == IDIOM_MAX))
+    {
+        const char *target = idiom->target->data.name;
+        if (!bind_kernel_scalar(c, &kernel, target) || (bound_local && strcmp(bound->data.name, target) == 0))
+            return;
+    }
+
+    BytecodeProgram *program = c->program;
+    GROW_ARRAY(program->kernels, program->kernel_count, program->kernel_capacity);
+    program->kernels[program->kernel_count] = kernel;
+    emit(c, BC_KERNEL, program->kernel_count++, compile_expression(c, bound, VAR_INT, -1), 0);
+}
+
+static void compile_for(Compiler *c, ASTNode *node)
+{
+    begin_scope(c);
+    compile_statement(c, node->data.for_stmt.init);
+    compile_kernel(c, node);
+
+    int loop_start = here(c);
+    begin_scope(c);
+    reset_temporaries(c);
+    int exit_jump = compile_branch(c, node->data.for_stmt.cond, false);
+    Breakable *loop = push_breakable(c, true);
+    compile_statement(c, node->data.for_stmt.body);
+    patch_continues(c, loop);
+    compile_statement(c, node->data.for_stmt.incr);
+    end_scope(c);
+    emit_jump_to(c, BC_JMP, 0, loop_start);
+    patch_jump(c, exit_jump);
+    pop_breakable(c, loop);
+    end_scope(c);
+}
+
+static void compile_while(Compiler *c, ASTNode *node)
+{
+    begin_scope(c);
+    int loop_start = here(c);
+    int exit_jump = compile_branch(c, node->data.while_stmt.cond, false);
+    Breakable *loop = push_breakable(c, true);
+    begin_scope(c);
+    compile_statement(c, node->data.while_stmt.body);
+    end_scope(c);
+    patch_continues(c, loop);
+    emit_jump_to(c, BC_JMP, 0, loop_start);
+    patch_jump(c, exit_jump);
+    pop_breakable(c, loop);
+    end_scope(c);
+}
+
+static void compile_do_while(Compiler *c, ASTNode *node)
+{
+    begin_scope(c);
+    int loop_start = here(c);
+    Breakable *loop = push_breakable(c, true);
+    begin_scope(c);
+    compile_statement(c, node->data.while_stmt.body);
+    end_scope(c);
+    patch_continues(c, loop);
+    patch_jump_to(c, compile_branch(c, node->data.while_stmt.cond, true), loop_start);
+    pop_breakable(c, loop);
+    end_scope(c);
+}
+
+static int case_constant(Compiler *c, ASTNode *value)
+{
+    switch (value->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        return value->data.ivalue;
+    case NODE_SHORT:
+        return value->data.svalue;
+    case NODE_BOOLEAN:
+        return value->data.bvalue;
+    case NODE_FLOAT:
+        return (int)value->data.fvalue;
+    case NODE_DOUBLE:
+        return (int)value->data.dvalue;
+    default:
+        bail(c, "case value is not a literal");
+    }
+}
+
+/* A SWITCH through the case table of the switch when it has one;
+ * otherwise the cases are tested in order. Bodies are laid out
+ * in order so that a match falls through, and nothing after `based` is
+ * ever reached. */
+static void compile_switch(Compiler *c, ASTNode *node)
+{
+    TypeModifiers none = {false, false, false, false, false};
+    Local *value = declare_local(c, NULL, VAR_INT, none);
+    int value_reg = value->reg;
+    compile_value(c, node->data.switch_stmt.expression, value_reg);
+
+    int case_count = 0;
+    CaseNode *default_case = NULL;
+    for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+    {
+        case_count++;
+        if (!entry->value)
+        {
+            default_case = entry;
+            break;
+        }
+    }
+
+    if (!node->data.switch_stmt.table)
+        node->data.switch_stmt.table = build_case_table(node);
+    const CaseTable *cases = node->data.switch_stmt.table;
+    int table_index = -1;
+    /* The case jumps live on the switch's Breakable, so a bail frees them. */
+    Breakable *breakable = push_breakable(c, false);
+    int *matches = breakable->matches = calloc(case_count ? case_count : 1, sizeof(int));
+    int miss = -1;
+    if (cases && c->program->jump_table_count <= UINT16_MAX)
+    {
+        BytecodeProgram *program = c->program;
+        GROW_ARRAY(program->jump_tables, program->jump_table_count, program->jump_table_capacity);
+        table_index = program->jump_table_count++;
+        JumpTable *table = &program->jump_tables[table_index];
+        table->cases = cases;
+        table->targets = malloc(cases->count * sizeof(int));
+        table->miss = -1;
+        emit(c, BC_SWITCH, value_reg, table_index, 0);
+    }
+    else
+    {
+        int i = 0;
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry != default_case && i < case_count;
+             entry = entry->next, i++)
+        {
+            reset_temporaries(c);
+            int constant = alloc_register(c);
+            emit_sbx(c, BC_LOADI, constant, case_constant(c, entry->value));
+            emit(c, BC_EQ_I, constant, value_reg, constant);
+            matches[i] = emit_sbx(c, BC_JMPT, constant, 0);
+        }
+        miss = emit_sbx(c, BC_JMP, 0, 0);
+    }
+
+    int i = 0;
+    for (CaseNode *entry = node->data.switch_stmt.cases; i < case_count; entry = entry->next, i++)
+    {
+        if (table_index >= 0)
+            matches[i] = here(c);
+        else if (entry == default_case)
+            patch_jump(c, miss);
+        else
+            patch_jump(c, matches[i]);
+        compile_statement(c, entry->statements);
+    }
+    if (!default_case && table_index < 0)
+        patch_jump(c, miss);
+
+    if (table_index >= 0)
+    {
+        JumpTable *table = &c->program->jump_tables[table_index];
+        table->miss = here(c);
+        for (int slot = 0; slot < cases->count; slot++)
+            table->targets[slot] = -1;
+        i = 0;
+        for (CaseNode *entry = node->data.switch_stmt.cases; i < case_count; entry = entry->next, i++)
+        {
+            if (entry == default_case)
+                table->miss = matches[i];
+            for (int slot = 0; slot < cases->count; slot++)
+            {
+                if (cases->entries[slot] == entry)
+                    table->targets[slot] = matches[i];
+            }
+        }
+    }
+    pop_breakable(c, breakable);
+}
+
+static void compile_return(Compiler *c, ASTNode *node)
+{
+    ASTNode *expr = node->data.op.left;
+    if (c->function_index == 0)
+    {
+        /* handle_return_statement() pops every scope of main, so only a
+         * final `bussin <int>` behaves like a plain exit. */
+        bool literal = expr->type == NODE_INT ||
+                       (expr->type == NODE_SHORT && c->program->function_count == 1);
+        if (node != c->main_tail || !literal)
+            bail(c, "bussin in the middle of main");
+        emit(c, BC_HALT, 0, 0, 0);
+        return;
+    }
+    VarType type = c->functions[c->function_index].return_type;
+    emit(c, BC_RET, compile_expression(c, expr, type, -1), 0, 0);
+}
+
+static void compile_statement(Compiler *c, ASTNode *node)
+{
+    if (!node)
+        return;
+    reset_temporaries(c);
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            compile_statement(c, entry->statement);
+        break;
+    case NODE_DECLARATION:
+        compile_declaration(c, node);
+        break;
+    case NODE_ASSIGNMENT:
+        compile_assignment(c, node);
+        break;
+    case NODE_ARRAY_ACCESS:
+        /* Arrays are allocated by the parser. */
+        break;
+    case NODE_UNARY_OPERATION:
+        if (node->data.unary.op != OP_NEG)
+        {
+            compile_increment_statement(c, node);
+            break;
+        }
+        compile_value(c, node, -1);
+        break;
+    case NODE_OPERATION:
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_IDENTIFIER:
+        compile_value(c, node, -1);
+        break;
+    case NODE_FUNC_CALL:
+        compile_call_statement(c, node);
+        break;
+    case NODE_FOR_STATEMENT:
+        compile_for(c, node);
+        break;
+    case NODE_WHILE_STATEMENT:
+        compile_while(c, node);
+        break;
+    case NODE_DO_WHILE_STATEMENT:
+        compile_do_while(c, node);
+        break;
+    case NODE_IF_STATEMENT:
+        compile_if(c, node);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        compile_switch(c, node);
+        break;
+    case NODE_BREAK_STATEMENT:
+    {
+        if (!c->breakable)
+            bail(c, "bruh outside of a loop or switch");
+        int at = emit_sbx(c, BC_JMP, 0, 0);
+        Breakable *breakable = c->breakable;
+        GROW_ARRAY(breakable->exits, breakable->exit_count, breakable->exit_capacity);
+        breakable->exits[breakable->exit_count++] = at;
+        break;
+    }
+    case NODE_CONTINUE_STATEMENT:
+    {
+        Breakable *loop = c->breakable;
+        while (loop && !loop->is_loop)
+            loop = loop->enclosing;
+        if (!loop)
+            bail(c, "grind outside of a loop");
+        int at = emit_sbx(c, BC_JMP, 0, 0);
+        GROW_ARRAY(loop->continues, loop->continue_count, loop->continue_capacity);
+        loop->continues[loop->continue_count++] = at;
+        break;
+    }
+    case NODE_RETURN:
+        compile_return(c, node);
+        break;
+    case NODE_ERROR_STATEMENT:
+    {
+        ASTNode *expr = node->data.op.left;
+        if (expr->type == NODE_STRING_LITERAL)
+            emit(c, BC_BAKA_STR, add_string(c, expr->data.name), 1, 0);
+        else
+            emit(c, BC_BAKA_INT, compile_value(c, expr, -1), 0, 0);
+        break;
+    }
+    default:
+        bail(c, "unsupported statement");
+    }
+}
+
+static void compile_function(Compiler *c, int index)
+{
+    FunctionInfo *info = &c->functions[index];
+    c->function = &c->program->functions[index];
+    c->function->name = (char *)info->name;
+    c->function->return_type = info->return_type;
+    c->function->param_count = info->param_count;
+    c->function_index = index;
+    c->local_count = 0;
+    c->depth = 0;
+    c->next_register = 0;
+    c->breakable = NULL;
+
+    for (int i = 0; i < info->param_count; i++)
+    {
+        Parameter *param = info->parameters[i];
+        declare_local(c, param->name, register_type(param->type), param->modifiers);
+    }
+    compile_statement(c, info->body);
+    emit(c, index == 0 ? BC_HALT : BC_RET0, 0, 0, 0);
+}
+
+static void collect_functions(Compiler *c, ASTNode *root)
+{
+    int count = 1;
+    StatementList *entry = root->data.statements;
+    for (StatementList *it = entry; it; it = it->next)
+    {
+        if (it->statement && it->statement->type == NODE_FUNCTION_DEF)
+            count++;
+    }
+
+    c->program->functions = calloc(count, sizeof(BytecodeFunction));
+    c->functions = calloc(count, sizeof(FunctionInfo));
+    if (!c->program->functions || !c->functions)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    c->program->function_count = count;
+    c->functions[0].name = "main";
+    c->functions[0].return_type = VAR_INT;
+
+    int index = 1;
+    for (StatementList *it = entry; it; it = it->next)
+    {
+        ASTNode *statement = it->statement;
+        if (!statement || statement->type != NODE_FUNCTION_DEF)
+        {
+            /* The main body is appended last by the grammar. */
+            c->functions[0].body = statement;
+            continue;
+        }
+        FunctionInfo *info = &c->functions[index++];
+        info->name = statement->data.function_def.name;
+        info->return_type = statement->data.function_def.return_type;
+        info->body = statement->data.function_def.body;
+        if (find_function(c, info->name) != index - 1)
+            bail(c, "function defined twice");
+
+        /* The parser builds parameter lists back to front. */
+        for (Parameter *param = statement->data.function_def.parameters; param; param = param->next)
+            info->param_count++;
+        info->parameters = calloc(info->param_count ? info->param_count : 1, sizeof(Parameter *));
+        int i = info->param_count;
+        for (Parameter *param = statement->data.function_def.parameters; param; param = param->next)
+            info->parameters[--i] = param;
+    }
+
+    ASTNode *main_body = c->functions[0].body;
+    if (main_body && main_body->type == NODE_STATEMENT_LIST)
+    {
+        StatementList *last = main_body->data.statements;
+        while (last && last->next)
+            last = last->next;
+        c->main_tail = last ? last->statement : NULL;
+    }
+}
+
+static void mark_calls(Compiler *c, ASTNode *node, bool *called)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            mark_calls(c, entry->statement, called);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+    case NODE_OPERATION:
+        mark_calls(c, node->data.op.left, called);
+        mark_calls(c, node->data.op.right, called);
+        break;
+    case NODE_RETURN:
+    case NODE_ERROR_STATEMENT:
+        mark_calls(c, node->data.op.left, called);
+        break;
+    case NODE_UNARY_OPERATION:
+        mark_calls(c, node->data.unary.operand, called);
+        break;
+    case NODE_ARRAY_ACCESS:
+        mark_calls(c, node->data.array.index, called);
+        break;
+    case NODE_FUNC_CALL:
+    {
+        int index = find_function(c, node->data.func_call.function_name);
+        if (index > 0)
+            called[index] = true;
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+            mark_calls(c, arg->expr, called);
+        break;
+    }
+    case NODE_FOR_STATEMENT:
+        mark_calls(c, node->data.for_stmt.init, called);
+        mark_calls(c, node->data.for_stmt.cond, called);
+        mark_calls(c, node->data.for_stmt.incr, called);
+        mark_calls(c, node->data.for_stmt.body, called);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        mark_calls(c, node->data.while_stmt.cond, called);
+        mark_calls(c, node->data.while_stmt.body, called);
+        break;
+    case NODE_IF_STATEMENT:
+        mark_calls(c, node->data.if_stmt.condition, called);
+        mark_calls(c, node->data.if_stmt.then_branch, called);
+        mark_calls(c, node->data.if_stmt.else_branch, called);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        mark_calls(c, node->data.switch_stmt.expression, called);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            mark_calls(c, entry->value, called);
+            mark_calls(c, entry->statements, called);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * The tree-walker gives a declaration initialised from a call the type the
+ * callee returns rather than the declared one, so programs whose functions
+ * reach functions with another return type stay on the tree-walker.
+ */
+static void check_return_paths(Compiler *c)
+{
+    int count = c->program->function_count;
+    bool *reach = calloc((size_t)count * count, sizeof(bool));
+    if (!reach)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    for (int i = 1; i < count; i++)
+        mark_calls(c, c->functions[i].body, &reach[i * count]);
+    for (int k = 1; k < count; k++)
+    {
+        for (int i = 1; i < count; i++)
+        {
+            if (!reach[i * count + k])
+                continue;
+            for (int j = 1; j < count; j++)
+                reach[i * count + j] |= reach[k * count + j];
+        }
+    }
+
+    const char *problem = NULL;
+    for (int i = 1; i < count && !problem; i++)
+    {
+        for (int j = 1; j < count && !problem; j++)
+        {
+            if (reach[i * count + j] && c->functions[j].return_type != c->functions[i].return_type)
+                problem = "function calls a function with another return type";
+        }
+    }
+    free(reach);
+    if (problem)
+        bail(c, problem);
+}
+
+static void free_compiler(Compiler *c)
+{
+    if (c->functions)
+    {
+        for (int i = 0; i < c->program->function_count; i++)
+            free(c->functions[i].parameters);
+        free(c->functions);
+    }
+    free(c->locals);
+    /* Loops and switches being compiled when the compiler bailed out. */
+    while (c->breakable)
+    {
+        Breakable *breakable = c->breakable;
+        c->breakable = breakable->enclosing;
+        free(breakable->exits);
+        free(breakable->continues);
+        free(breakable->matches);
+        free(breakable);
+    }
+}
+
+bool parse_fuse_names(const char *names, unsigned *flags)
+{
+    static const struct
+    {
+        const char *name;
+        unsigned flag;
+    } shapes[] = {
+        {"increment", FUSE_INCREMENT},
+        {"compare", FUSE_COMPARE},
+        {"modulo", FUSE_MODULO},
+        {"accumulate", FUSE_ACCUMULATE},
+    };
+
+    *flags = 0;
+    while (*names)
+    {
+        size_t length = strcspn(names, ",");
+        size_t n = 0;
+        while (n < sizeof(shapes) / sizeof(shapes[0]) &&
+               (strlen(shapes[n].name) != length || strncmp(shapes[n].name, names, length) != 0))
+            n++;
+        if (n == sizeof(shapes) / sizeof(shapes[0]))
+            return false;
+        *flags |= shapes[n].flag;
+        names += length;
+        if (*names == ',')
+            names++;
+    }
+    return true;
+}
+
+BytecodeProgram *compile_to_bytecode(ASTNode *root, unsigned fuse, const char **reason)
+{
+    Compiler compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.fuse = fuse;
+    compiler.program = calloc(1, sizeof(BytecodeProgram));
+    compiler.globals = brainrot->current_scope;
+    if (!compiler.program)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+
+    if (setjmp(compiler.bail) != 0)
+    {
+        *reason = compiler.reason;
+        free_compiler(&compiler);
+        free_bytecode_program(compiler.program);
+        return NULL;
+    }
+
+    if (!root || root->type != NODE_STATEMENT_LIST)
+        bail(&compiler, "empty program");
+    collect_functions(&compiler, root);
+    check_return_paths(&compiler);
+    for (int i = 0; i < compiler.program->function_count; i++)
+        compile_function(&compiler, i);
+
+    free_compiler(&compiler);
+    *reason = NULL;
+    return compiler.program;
+}
@@ -0,0 +1,327 @@
+/* dce.c */
+
+#include "optimizer.h"
+
+/*
+ * Dead code elimination.
+ *
+ * Removes statements no run of the program can reach: whatever follows a
+ * bussin, bruh or grind in the same block, the branch of an edgy whose
+ * condition is a literal and loops whose condition is a literal false,
+ * then every function main cannot call, directly or through other
+ * functions. The pass counts the AST nodes it drops.
+ *
+ * An edgy opens a scope, so the branch it always takes replaces it only
+ * when that branch declares nothing at its top level; otherwise the edgy
+ * stays, and only its other branch goes.
+ */
+
+static void prune_list(int *removed, ASTNode *list);
+
+static bool is_literal_condition(const ASTNode *node, bool *value)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        *value = node->data.ivalue != 0;
+        return true;
+    case NODE_BOOLEAN:
+        *value = node->data.bvalue;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool ends_block(const ASTNode *node)
+{
+    return node && (node->type == NODE_RETURN || node->type == NODE_BREAK_STATEMENT ||
+                    node->type == NODE_CONTINUE_STATEMENT);
+}
+
+static bool declares(const ASTNode *list)
+{
+    if (!list || list->type != NODE_STATEMENT_LIST)
+        return list && list->type == NODE_DECLARATION;
+    for (StatementList *entry = list->data.statements; entry; entry = entry->next)
+    {
+        if (entry->statement && entry->statement->type == NODE_DECLARATION)
+            return true;
+    }
+    return false;
+}
+
+/* What to run in place of a branch that is always taken, or the edgy
+ * itself when the branch has to keep its scope. */
+static ASTNode *take_branch(int *removed, ASTNode *node, ASTNode *taken, ASTNode *dropped)
+{
+    *removed += count_nodes(node->data.if_stmt.condition) + count_nodes(dropped);
+    if (!declares(taken))
+    {
+        *removed += 1;
+        return taken;
+    }
+    node->data.if_stmt.condition = create_boolean_node(true);
+    node->data.if_stmt.then_branch = taken;
+    node->data.if_stmt.else_branch = NULL;
+    *removed -= 1;
+    return node;
+}
+
+/* Returns the statement to keep in place of `node`, NULL to drop it. */
+static ASTNode *prune_statement(int *removed, ASTNode *node)
+{
+    if (!node)
+        return NULL;
+    bool value;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        prune_list(removed, node);
+        break;
+    case NODE_IF_STATEMENT:
+    {
+        ASTNode *then_branch = prune_statement(removed, node->data.if_stmt.then_branch);
+        ASTNode *else_branch = prune_statement(removed, node->data.if_stmt.else_branch);
+        node->data.if_stmt.then_branch = then_branch;
+        node->data.if_stmt.else_branch = else_branch;
+        if (!is_literal_condition(node->data.if_stmt.condition, &value) ||
+            (value && node->data.if_stmt.condition->type == NODE_BOOLEAN && !else_branch &&
+             declares(then_branch)))
+            break;
+        ASTNode *taken = value ? then_branch : else_branch;
+        ASTNode *dropped = value ? else_branch : then_branch;
+        if (!taken)
+        {
+            *removed += count_nodes(node);
+            return NULL;
+        }
+        return take_branch(removed, node, taken, dropped);
+    }
+    case NODE_WHILE_STATEMENT:
+        if (is_literal_condition(node->data.while_stmt.cond, &value) && !value)
+        {
+            *removed += count_nodes(node);
+            return NULL;
+        }
+        node->data.while_stmt.body = prune_statement(removed, node->data.while_stmt.body);
+        break;
+    case NODE_DO_WHILE_STATEMENT:
+        node->data.while_stmt.body = prune_statement(removed, node->data.while_stmt.body);
+        break;
+    case NODE_FOR_STATEMENT:
+    {
+        ASTNode *init = node->data.for_stmt.init;
+        /* A declaration in the initializer belongs to the loop's scope */
+        if (is_literal_condition(node->data.for_stmt.cond, &value) && !value &&
+            (!init || init->type != NODE_DECLARATION))
+        {
+            *removed += count_nodes(node) - count_nodes(init);
+            return init;
+        }
+        node->data.for_stmt.body = prune_statement(removed, node->data.for_stmt.body);
+        break;
+    }
+    case NODE_SWITCH_STATEMENT:
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            entry->statements = prune_statement(removed, entry->statements);
+        break;
+    default:
+        break;
+    }
+    return node;
+}
+
+static void prune_list(int *removed, ASTNode *list)
+{
+    StatementList **link = &list->data.statements;
+    while (*link)
+    {
+        StatementList *entry = *link;
+        ASTNode *kept = prune_statement(removed, entry->statement);
+        if (!kept && entry->statement)
+        {
+            *link = entry->next;
+            continue;
+        }
+        if (kept && kept != entry->statement && kept->type == NODE_STATEMENT_LIST)
+        {
+            /* An inlined branch: its statements take the edgy's place */
+            StatementList *first = kept->data.statements;
+            if (!first)
+            {
+                *link = entry->next;
+                continue;
+            }
+            StatementList *last = first;
+            while (last->next)
+                last = last->next;
+            last->next = entry->next;
+            *link = first;
+            entry = last;
+        }
+        else
+        {
+            entry->statement = kept;
+        }
+        if (ends_block(entry->statement))
+        {
+            for (StatementList *rest = entry->next; rest; rest = rest->next)
+                *removed += count_nodes(rest->statement);
+            entry->next = NULL;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+typedef struct
+{
+    Function **reached;
+    int count;
+    int capacity;
+} CallGraph;
+
+static bool reached(const CallGraph *graph, const Function *func)
+{
+    for (int i = 0; i < graph->count; i++)
+    {
+        if (graph->reached[i] == func)
+            return true;
+    }
+    return false;
+}
+
+static void mark_called(CallGraph *graph, ASTNode *node);
+
+static void mark_function(CallGraph *graph, Function *func)
+{
+    if (!func || reached(graph, func))
+        return;
+    if (graph->count >= graph->capacity)
+    {
+        graph->capacity = graph->capacity ? graph->capacity * 2 : 8;
+        Function **grown = realloc(graph->reached, graph->capacity * sizeof(Function *));
+        if (!grown)
+        {
+            fprintf(brainrot->err, "Error: Memory allocation failed\n");
+            brainrot_exit(EXIT_FAILURE);
+        }
+        graph->reached = grown;
+    }
+    graph->reached[graph->count++] = func;
+    mark_called(graph, func->body);
+}
+
+/* Marks every function a call below `node` can reach. */
+static void mark_called(CallGraph *graph, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            mark_called(graph, entry->statement);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+    case NODE_OPERATION:
+        mark_called(graph, node->data.op.left);
+        mark_called(graph, node->data.op.right);
+        break;
+    case NODE_RETURN:
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        mark_called(graph, node->data.op.left);
+        break;
+    case NODE_UNARY_OPERATION:
+        mark_called(graph, node->data.unary.operand);
+        break;
+    case NODE_ARRAY_ACCESS:
+        mark_called(graph, node->data.array.index);
+        break;
+    case NODE_SIZEOF:
+        mark_called(graph, node->data.sizeof_stmt.expr);
+        break;
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+            mark_called(graph, arg->expr);
+        mark_function(graph, node->data.func_call.function);
+        break;
+    case NODE_FOR_STATEMENT:
+        mark_called(graph, node->data.for_stmt.init);
+        mark_called(graph, node->data.for_stmt.cond);
+        mark_called(graph, node->data.for_stmt.incr);
+        mark_called(graph, node->data.for_stmt.body);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        mark_called(graph, node->data.while_stmt.cond);
+        mark_called(graph, node->data.while_stmt.body);
+        break;
+    case NODE_IF_STATEMENT:
+        mark_called(graph, node->data.if_stmt.condition);
+        mark_called(graph, node->data.if_stmt.then_branch);
+        mark_called(graph, node->data.if_stmt.else_branch);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        mark_called(graph, node->data.switch_stmt.expression);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            mark_called(graph, entry->value);
+            mark_called(graph, entry->statements);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Drops the definitions of the functions main never reaches. */
+static int remove_uncalled_functions(ASTNode *root)
+{
+    CallGraph graph = {0};
+    for (StatementList *entry = root->data.statements; entry; entry = entry->next)
+    {
+        if (entry->statement && entry->statement->type != NODE_FUNCTION_DEF)
+            mark_called(&graph, entry->statement);
+    }
+
+    int removed = 0;
+    StatementList **link = &root->data.statements;
+    while (*link)
+    {
+        ASTNode *def = (*link)->statement;
+        if (def && def->type == NODE_FUNCTION_DEF && !reached(&graph, def->data.function_def.function))
+        {
+            removed += count_nodes(def);
+            remove_function(def->data.function_def.function);
+            *link = (*link)->next;
+            continue;
+        }
+        link = &(*link)->next;
+    }
+    free(graph.reached);
+    return removed;
+}
+
+int eliminate_dead_code(ASTNode *root)
+{
+    if (!root || root->type != NODE_STATEMENT_LIST)
+        return 0;
+
+    int removed = 0;
+    for (StatementList *entry = root->data.statements; entry; entry = entry->next)
+    {
+        ASTNode *statement = entry->statement;
+        if (statement && statement->type == NODE_FUNCTION_DEF)
+            prune_statement(&removed, statement->data.function_def.body);
+        else
+            prune_statement(&removed, statement);
+    }
+    return removed + remove_uncalled_functions(root);
+}
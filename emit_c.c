@@ -0,0 +1,756 @@
+/* emit_c.c */
+
+#include "vm.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Ahead-of-time translation of a bytecode program to C.
+ *
+ * Every bytecode function becomes a C function whose registers are local
+ * Register unions, every instruction becomes the statement the VM would
+ * run for it and jumps become gotos, so the translated program is typed
+ * exactly as the compiler typed it and prints byte for byte what the VM
+ * prints. Arrays become globals holding their parse-time contents and each
+ * yapping/yappin call becomes one printf-style call with the precompiled
+ * format. The output needs nothing but libc and libm.
+ */
+
+extern void report_error(const char *s);
+
+/* Statements for the instructions that map one to one onto C. @a, @b and
+ * @c name the operand registers, @i the immediate. */
+#define INT_ARITH_TEMPLATES(T, F, CT)                                                    \
+    [BC_ADD_##T] = "@a." #F " = (" #CT ")((unsigned)@b." #F " + (unsigned)@c." #F ");", \
+    [BC_SUB_##T] = "@a." #F " = (" #CT ")((unsigned)@b." #F " - (unsigned)@c." #F ");", \
+    [BC_MUL_##T] = "@a." #F " = (" #CT ")((unsigned)@b." #F " * (unsigned)@c." #F ");", \
+    [BC_DIV_##T] = "if (@c." #F " == 0) { yyerror(\"Division by zero\"); @a." #F " = 0; } " \
+                   "else @a." #F " = (" #CT ")(@b." #F " / @c." #F ");",                    \
+    [BC_NEG_##T] = "@a." #F " = (" #CT ")(0u - (unsigned)@b." #F ");",
+
+#define FLOAT_ARITH_TEMPLATES(T, F, CT, TINY, HUGE_VALUE)                                      \
+    [BC_ADD_##T] = "@a." #F " = @b." #F " + @c." #F ";",                                      \
+    [BC_SUB_##T] = "@a." #F " = @b." #F " - @c." #F ";",                                      \
+    [BC_MUL_##T] = "@a." #F " = @b." #F " * @c." #F ";",                                      \
+    [BC_DIV_##T] = "if (fabs(@c." #F ") < " #TINY ") @a." #F " = fabs(@b." #F ") < " #TINY     \
+                   " ? (" #CT ")0.0 / (" #CT ")0.0 : @b." #F " > 0 ? " #HUGE_VALUE " : -" #HUGE_VALUE \
+                   "; else @a." #F " = @b." #F " / @c." #F ";",                                \
+    [BC_MOD_##T] = "@a." #F " = (" #CT ")fmod(@b." #F ", @c." #F ");",                          \
+    [BC_NEG_##T] = "@a." #F " = -@b." #F ";",
+
+#define COMPARE_TEMPLATES(T, F)                              \
+    [BC_LT_##T] = "@a.ivalue = @b." #F " < @c." #F ";",     \
+    [BC_GT_##T] = "@a.ivalue = @b." #F " > @c." #F ";",     \
+    [BC_LE_##T] = "@a.ivalue = @b." #F " <= @c." #F ";",    \
+    [BC_GE_##T] = "@a.ivalue = @b." #F " >= @c." #F ";",    \
+    [BC_EQ_##T] = "@a.ivalue = @b." #F " == @c." #F ";",    \
+    [BC_NE_##T] = "@a.ivalue = @b." #F " != @c." #F ";",
+
+#define CONVERT_TEMPLATE(OP, TO, FROM, CT) [BC_##OP] = "@a." #TO " = (" #CT ")@b." #FROM ";",
+
+static const char *const templates[BC_OPCODE_COUNT] = {
+    [BC_MOVE] = "@a = @b;",
+    [BC_LOADI] = "@a.ivalue = @i;",
+    [BC_LOADK] = "@a = K[@i];",
+    CONVERT_TEMPLATE(I2S, svalue, ivalue, short)
+    CONVERT_TEMPLATE(I2F, fvalue, ivalue, float)
+    CONVERT_TEMPLATE(I2D, dvalue, ivalue, double)
+    CONVERT_TEMPLATE(I2B, bvalue, ivalue, bool)
+    CONVERT_TEMPLATE(S2I, ivalue, svalue, int)
+    CONVERT_TEMPLATE(S2F, fvalue, svalue, float)
+    CONVERT_TEMPLATE(S2D, dvalue, svalue, double)
+    CONVERT_TEMPLATE(S2B, bvalue, svalue, bool)
+    CONVERT_TEMPLATE(F2I, ivalue, fvalue, int)
+    CONVERT_TEMPLATE(F2S, svalue, fvalue, short)
+    CONVERT_TEMPLATE(F2D, dvalue, fvalue, double)
+    CONVERT_TEMPLATE(F2B, bvalue, fvalue, bool)
+    CONVERT_TEMPLATE(D2I, ivalue, dvalue, int)
+    CONVERT_TEMPLATE(D2S, svalue, dvalue, short)
+    CONVERT_TEMPLATE(D2F, fvalue, dvalue, float)
+    CONVERT_TEMPLATE(D2B, bvalue, dvalue, bool)
+    CONVERT_TEMPLATE(B2I, ivalue, bvalue, int)
+    CONVERT_TEMPLATE(B2S, svalue, bvalue, short)
+    CONVERT_TEMPLATE(B2F, fvalue, bvalue, float)
+    CONVERT_TEMPLATE(B2D, dvalue, bvalue, double)
+    INT_ARITH_TEMPLATES(I, ivalue, int)
+    INT_ARITH_TEMPLATES(S, svalue, short)
+    FLOAT_ARITH_TEMPLATES(F, fvalue, float, FLT_MIN, FLT_MAX)
+    FLOAT_ARITH_TEMPLATES(D, dvalue, double, DBL_MIN, DBL_MAX)
+    COMPARE_TEMPLATES(I, ivalue)
+    COMPARE_TEMPLATES(S, svalue)
+    COMPARE_TEMPLATES(F, fvalue)
+    COMPARE_TEMPLATES(D, dvalue)
+    [BC_MOD_I] = "if (@c.ivalue == 0) { yyerror(\"Modulo by zero\"); @a.ivalue = 0; } "
+                 "else @a.ivalue = @b.ivalue % @c.ivalue;",
+    [BC_UMOD_I] = "if (@c.ivalue == 0) { yyerror(\"Modulo by zero\"); @a.ivalue = 0; } "
+                  "else @a.ivalue = (int)((unsigned)@b.ivalue % (unsigned)@c.ivalue);",
+    [BC_MOD_S] = "@a.svalue = @b.svalue % @c.svalue;",
+    [BC_AND_I] = "@a.ivalue = @b.ivalue && @c.ivalue;",
+    [BC_OR_I] = "@a.ivalue = @b.ivalue || @c.ivalue;",
+    [BC_NOT_B] = "@a.bvalue = !@b.bvalue;",
+    [BC_BAKA_INT] = "fprintf(stderr, \"%d\\n\", @a.ivalue);",
+    [BC_SLORP_I] = "@a.ivalue = slorp_int();",
+    [BC_SLORP_S] = "@a.svalue = slorp_short();",
+    [BC_SLORP_F] = "@a.fvalue = slorp_float();",
+    [BC_SLORP_D] = "@a.dvalue = slorp_double();",
+    [BC_CHILL] = "sleep(@i);",
+    [BC_RAGEQUIT] = "exit(@i);",
+    [BC_CONST_ERROR] = "yylineno = yylineno - 2; yyerror(\"Cannot modify const variable\"); "
+                       "exit(EXIT_FAILURE);",
+};
+
+/* Field and C type of an array element as held in a register. */
+static const char *array_field(VarType type)
+{
+    switch (type)
+    {
+    case VAR_SHORT:
+        return "svalue";
+    case VAR_FLOAT:
+        return "fvalue";
+    case VAR_DOUBLE:
+        return "dvalue";
+    case VAR_BOOL:
+        return "bvalue";
+    default:
+        return "ivalue";
+    }
+}
+
+static const char *array_ctype(VarType type)
+{
+    switch (type)
+    {
+    case VAR_SHORT:
+        return "short";
+    case VAR_FLOAT:
+        return "float";
+    case VAR_DOUBLE:
+        return "double";
+    case VAR_BOOL:
+        return "bool";
+    case VAR_CHAR:
+        return "char";
+    default:
+        return "int";
+    }
+}
+
+/* Writes `text` as the body of a C string literal; `percent` doubles %
+ * signs for use inside a format string. */
+static void emit_string_body(FILE *out, const char *text, bool percent)
+{
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        switch (*p)
+        {
+        case '"':
+        case '\\':
+            fprintf(out, "\\%c", *p);
+            break;
+        case '\n':
+            fputs("\\n", out);
+            break;
+        case '\t':
+            fputs("\\t", out);
+            break;
+        case '%':
+            fputs(percent ? "%%" : "%", out);
+            break;
+        default:
+            if (*p < 0x20 || *p >= 0x7f)
+                fprintf(out, "\\%03o", *p);
+            else
+                fputc(*p, out);
+            break;
+        }
+    }
+}
+
+/* Writes a floating-point initializer that reads back exactly. */
+static void emit_floating(FILE *out, double value, bool is_float)
+{
+    if (isnan(value))
+        fputs("NAN", out);
+    else if (isinf(value))
+        fputs(value > 0 ? "INFINITY" : "-INFINITY", out);
+    else
+        fprintf(out, is_float ? "%af" : "%a", value);
+}
+
+static void emit_register(FILE *out, int reg)
+{
+    fprintf(out, "r%d", reg);
+}
+
+static void emit_template(FILE *out, const char *text, const Instruction *i)
+{
+    for (; *text; text++)
+    {
+        if (*text != '@')
+        {
+            fputc(*text, out);
+            continue;
+        }
+        switch (*++text)
+        {
+        case 'a':
+            emit_register(out, i->a);
+            break;
+        case 'b':
+            emit_register(out, i->b);
+            break;
+        case 'c':
+            emit_register(out, i->c);
+            break;
+        case 'i':
+            fprintf(out, "%d", i->sbx);
+            break;
+        }
+    }
+}
+
+static void emit_print(FILE *out, const BytecodeProgram *program, const PrintFormat *format)
+{
+    /* Array elements are bounds-checked before anything is formatted, as the
+     * VM reports the error without printing. */
+    bool checked = false;
+    for (int s = 0; s < format->segment_count; s++)
+    {
+        const FormatSegment *segment = &format->segments[s];
+        if (segment->kind != FORMAT_ARRAY_FLOAT && segment->kind != FORMAT_ARRAY_DOUBLE)
+            continue;
+        fprintf(out, "%s in_bounds(r%d.ivalue, %d)", checked ? " &&" : "if (",
+                segment->reg, program->arrays[segment->index].length);
+        checked = true;
+    }
+    if (checked)
+        fputs(") ", out);
+
+    fprintf(out, "print(%d, \"%s\", \"", format->target == PRINT_YAPPING,
+            format->target == PRINT_YAPPING ? "Buffer overflow in yapping call"
+                                            : "Buffer overflow in yappin call");
+    for (int s = 0; s < format->segment_count; s++)
+    {
+        const FormatSegment *segment = &format->segments[s];
+        if (segment->kind == FORMAT_TEXT)
+            emit_string_body(out, segment->text, true);
+        else if (segment->kind == FORMAT_BOOL)
+            fputs("%s", out);
+        else
+            emit_string_body(out, segment->text, false);
+    }
+    fputc('"', out);
+
+    for (int s = 0; s < format->segment_count; s++)
+    {
+        const FormatSegment *segment = &format->segments[s];
+        int reg = segment->reg;
+        switch (segment->kind)
+        {
+        case FORMAT_TEXT:
+            break;
+        case FORMAT_BOOL:
+            fprintf(out, ", r%d.bvalue ? \"W\" : \"L\"", reg);
+            break;
+        case FORMAT_INT:
+            fprintf(out, ", r%d.ivalue", reg);
+            break;
+        case FORMAT_SHORT:
+            fprintf(out, ", r%d.svalue", reg);
+            break;
+        case FORMAT_USHORT:
+            fprintf(out, ", (unsigned short)r%d.svalue", reg);
+            break;
+        case FORMAT_FLOAT:
+            fprintf(out, ", r%d.fvalue", reg);
+            break;
+        case FORMAT_DOUBLE:
+            fprintf(out, ", r%d.dvalue", reg);
+            break;
+        case FORMAT_STRING:
+            fputs(", \"", out);
+            emit_string_body(out, program->strings[segment->index], false);
+            fputc('"', out);
+            break;
+        case FORMAT_ARRAY_STRING:
+            fprintf(out, ", array%d", segment->index);
+            break;
+        case FORMAT_ARRAY_FLOAT:
+        case FORMAT_ARRAY_DOUBLE:
+            fprintf(out, ", array%d[r%d.ivalue]", segment->index, reg);
+            break;
+        }
+    }
+    fputs(");", out);
+}
+
+/* Operators of the fused branches, in opcode order */
+static const char *const comparisons[] = {"<", ">", "<=", ">=", "==", "!="};
+
+static void emit_instruction(FILE *out, const BytecodeProgram *program, const BytecodeFunction *function,
+                             int pc, bool is_main)
+{
+    const Instruction *i = &function->code[pc];
+    switch ((Opcode)i->op)
+    {
+    case BC_ADDI_I:
+        fprintf(out, "r%d.ivalue = (int)((unsigned)r%d.ivalue + (unsigned)%d);", i->a, i->b, (int16_t)i->c);
+        break;
+    case BC_LOADA_I:
+    case BC_LOADA_S:
+    case BC_LOADA_F:
+    case BC_LOADA_D:
+    case BC_LOADA_B:
+    case BC_LOADA_C:
+    {
+        const ArrayBinding *array = &program->arrays[i->b];
+        fprintf(out, "r%d.%s = in_bounds(r%d.ivalue, %d) ? array%d[r%d.ivalue] : 0;", i->a,
+                array_field(array->type), i->c, array->length, i->b, i->c);
+        break;
+    }
+    case BC_STOREA_I:
+    case BC_STOREA_S:
+    case BC_STOREA_F:
+    case BC_STOREA_D:
+    case BC_STOREA_B:
+    case BC_STOREA_C:
+    {
+        const ArrayBinding *array = &program->arrays[i->a];
+        fprintf(out, "if (in_bounds(r%d.ivalue, %d)) array%d[r%d.ivalue] = r%d.%s;", i->b,
+                array->length, i->a, i->b, i->c, array_field(array->type));
+        break;
+    }
+    case BC_JMP:
+        fprintf(out, "goto L%d;", jump_target(i, pc));
+        break;
+    case BC_JMPF:
+        fprintf(out, "if (!r%d.ivalue) goto L%d;", i->a, jump_target(i, pc));
+        break;
+    case BC_JMPT:
+        fprintf(out, "if (r%d.ivalue) goto L%d;", i->a, jump_target(i, pc));
+        break;
+    case BC_SWITCH:
+    {
+        const JumpTable *table = &program->jump_tables[i->b];
+        const CaseTable *cases = table->cases;
+        fprintf(out, "switch (r%d.ivalue) {", i->a);
+        for (int slot = 0; slot < cases->count; slot++)
+        {
+            if (table->targets[slot] >= 0)
+                fprintf(out, " case %d: goto L%d;", cases->keys ? cases->keys[slot] : cases->low + slot,
+                        table->targets[slot]);
+        }
+        fprintf(out, " default: goto L%d; }", table->miss);
+        break;
+    }
+    case BC_KERNEL:
+        // The loop that follows runs every iteration itself
+        fputs("/* array kernel */", out);
+        break;
+    case BC_JLT_I: case BC_JGT_I: case BC_JLE_I:
+    case BC_JGE_I: case BC_JEQ_I: case BC_JNE_I:
+        fprintf(out, "if (r%d.ivalue %s r%d.ivalue) goto L%d;", i->a, comparisons[i->op - BC_JLT_I],
+                i->b, jump_target(i, pc));
+        break;
+    case BC_JLT_IK: case BC_JGT_IK: case BC_JLE_IK:
+    case BC_JGE_IK: case BC_JEQ_IK: case BC_JNE_IK:
+        fprintf(out, "if (r%d.ivalue %s %d) goto L%d;", i->a, comparisons[i->op - BC_JLT_IK],
+                (int16_t)i->b, jump_target(i, pc));
+        break;
+    case BC_JMODZ_IK:
+    case BC_JMODNZ_IK:
+        fprintf(out, "if (r%d.ivalue %% %d %s 0) goto L%d;", i->a, (int16_t)i->b,
+                i->op == BC_JMODZ_IK ? "==" : "!=", jump_target(i, pc));
+        break;
+    case BC_ADDA_I:
+        fprintf(out, "if (in_bounds(r%d.ivalue, %d)) array%d[r%d.ivalue] = (int)((unsigned)array%d[r%d.ivalue] "
+                "+ (unsigned)r%d.ivalue);",
+                i->b, program->arrays[i->a].length, i->a, i->b, i->a, i->b, i->c);
+        break;
+    case BC_CALL:
+    {
+        const BytecodeFunction *callee = &program->functions[i->b];
+        fprintf(out, "r%d = function%d(", i->a, i->b);
+        for (int p = 0; p < callee->param_count; p++)
+            fprintf(out, "%sr%d", p ? ", " : "", i->c + p);
+        fputs(");", out);
+        break;
+    }
+    case BC_RET:
+        if (is_main)
+            fputs("return 0;", out);
+        else
+            fprintf(out, "return r%d;", i->a);
+        break;
+    case BC_RET0:
+        fputs(is_main ? "return 0;" : "return (Register){0};", out);
+        break;
+    case BC_HALT:
+        fputs("return 0;", out);
+        break;
+    case BC_PRINT:
+        emit_print(out, program, &program->formats[i->a]);
+        break;
+    case BC_BAKA_STR:
+        fputs(i->b ? "fprintf(stderr, \"%s\\n\", \"" : "fprintf(stderr, \"%s\", \"", out);
+        emit_string_body(out, program->strings[i->a], false);
+        fputs("\");", out);
+        break;
+    case BC_SLORP_STR:
+        fprintf(out, "slorp_string(array%d, %d);", i->a, program->arrays[i->a].length);
+        break;
+    default:
+        if (i->op < BC_OPCODE_COUNT && templates[i->op])
+            emit_template(out, templates[i->op], i);
+        break;
+    }
+}
+
+static void emit_signature(FILE *out, const BytecodeFunction *function, int index)
+{
+    fprintf(out, "static Register function%d(", index);
+    for (int p = 0; p < function->param_count; p++)
+        fprintf(out, "%sRegister r%d", p ? ", " : "", p);
+    fputs(function->param_count ? ")" : "void)", out);
+}
+
+static void emit_function(FILE *out, const BytecodeProgram *program, int index)
+{
+    const BytecodeFunction *function = &program->functions[index];
+    bool is_main = index == 0;
+
+    fprintf(out, "\n/* %s */\n", function->name);
+    if (is_main)
+        fputs("int main(void)", out);
+    else
+        emit_signature(out, function, index);
+    fputs("\n{\n", out);
+    for (int r = is_main ? 0 : function->param_count; r < function->register_count; r++)
+        fprintf(out, "    Register r%d = {0};\n", r);
+
+    bool *targets = calloc(function->code_length + 1, sizeof(bool));
+    if (!targets)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    for (int pc = 0; pc < function->code_length; pc++)
+    {
+        const Instruction *i = &function->code[pc];
+        int target = jump_target(i, pc);
+        if (target >= 0)
+            targets[target] = true;
+        if (i->op == BC_SWITCH)
+        {
+            const JumpTable *table = &program->jump_tables[i->b];
+            for (int slot = 0; slot < table->cases->count; slot++)
+            {
+                if (table->targets[slot] >= 0)
+                    targets[table->targets[slot]] = true;
+            }
+            targets[table->miss] = true;
+        }
+    }
+
+    for (int pc = 0; pc < function->code_length; pc++)
+    {
+        if (targets[pc])
+            fprintf(out, "L%d:\n", pc);
+        fputs("    ", out);
+        emit_instruction(out, program, function, pc, is_main);
+        fputc('\n', out);
+    }
+    if (targets[function->code_length])
+        fprintf(out, "L%d:;\n", function->code_length);
+    free(targets);
+    fputs("}\n", out);
+}
+
+static const char prelude[] =
+    "#include <float.h>\n"
+    "#include <math.h>\n"
+    "#include <stdarg.h>\n"
+    "#include <stdbool.h>\n"
+    "#include <stdint.h>\n"
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <string.h>\n"
+    "#include <unistd.h>\n"
+    "\n"
+    "typedef union\n"
+    "{\n"
+    "    int ivalue;\n"
+    "    short svalue;\n"
+    "    float fvalue;\n"
+    "    double dvalue;\n"
+    "    bool bvalue;\n"
+    "    uint64_t bits;\n"
+    "} Register;\n"
+    "\n"
+    "static void yyerror(const char *s)\n"
+    "{\n"
+    "    fprintf(stderr, \"Error: %s at line %d\\n\", s, yylineno - 1);\n"
+    "}\n"
+    "\n"
+    "static inline bool in_bounds(int index, int length)\n"
+    "{\n"
+    "    if (index < 0 || index >= length)\n"
+    "    {\n"
+    "        yyerror(\"Array index out of bounds!\");\n"
+    "        return false;\n"
+    "    }\n"
+    "    return true;\n"
+    "}\n";
+
+static const char print_runtime[] =
+    "\n"
+    "static void print(bool newline, const char *overflow, const char *format, ...)\n"
+    "{\n"
+    "    char buffer[1024];\n"
+    "    va_list args;\n"
+    "    va_start(args, format);\n"
+    "    int length = vsnprintf(buffer, sizeof(buffer), format, args);\n"
+    "    va_end(args);\n"
+    "    if (length >= (int)sizeof(buffer))\n"
+    "    {\n"
+    "        yyerror(overflow);\n"
+    "        exit(EXIT_FAILURE);\n"
+    "    }\n"
+    "    fputs(buffer, stdout);\n"
+    "    if (newline)\n"
+    "        putchar('\\n');\n"
+    "}\n";
+
+/* lib/input.c and the slorp functions of lang.y, reduced to what the
+ * bytecode can call. */
+static const char slorp_runtime[] =
+    "\n"
+    "#include <errno.h>\n"
+    "#include <limits.h>\n"
+    "\n"
+    "static void fail(const char *message)\n"
+    "{\n"
+    "    fputs(message, stderr);\n"
+    "    exit(EXIT_FAILURE);\n"
+    "}\n"
+    "\n"
+    "/* 0 on success, -3 if the line did not fit, -5 on a read error */\n"
+    "static int read_line(char *buffer, size_t size)\n"
+    "{\n"
+    "    if (fgets(buffer, (int)size, stdin) == NULL)\n"
+    "    {\n"
+    "        if (ferror(stdin))\n"
+    "            return -5;\n"
+    "        buffer[0] = '\\0';\n"
+    "        return 0;\n"
+    "    }\n"
+    "    size_t len = strnlen(buffer, size);\n"
+    "    if (len == size && buffer[len - 1] != '\\n')\n"
+    "    {\n"
+    "        int c;\n"
+    "        while ((c = getchar()) != '\\n' && c != EOF)\n"
+    "            ;\n"
+    "        return -3;\n"
+    "    }\n"
+    "    if (len > 0 && buffer[len - 1] == '\\n')\n"
+    "        buffer[len - 1] = '\\0';\n"
+    "    return 0;\n"
+    "}\n"
+    "\n"
+    "static long read_integer(const char *kind, const char *format_error)\n"
+    "{\n"
+    "    char buffer[32];\n"
+    "    int status = read_line(buffer, sizeof(buffer));\n"
+    "    if (status != 0)\n"
+    "    {\n"
+    "        fprintf(stderr, \"Error reading %s: %d\\n\", kind, status);\n"
+    "        exit(EXIT_FAILURE);\n"
+    "    }\n"
+    "    char *endptr;\n"
+    "    errno = 0;\n"
+    "    long result = strtol(buffer, &endptr, 10);\n"
+    "    if (endptr == buffer || *endptr != '\\0')\n"
+    "        fail(format_error);\n"
+    "    return errno == ERANGE ? LONG_MAX : result;\n"
+    "}\n"
+    "\n"
+    "static int slorp_int(void)\n"
+    "{\n"
+    "    long result = read_integer(\"integer\", \"Error: Invalid integer format.\\n\");\n"
+    "    if (result > INT_MAX || result < INT_MIN)\n"
+    "        fail(\"Error: Integer value out of range.\\n\");\n"
+    "    return (int)result;\n"
+    "}\n"
+    "\n"
+    "static short slorp_short(void)\n"
+    "{\n"
+    "    long result = read_integer(\"short\", \"Error: short integer format.\\n\");\n"
+    "    if (result > SHRT_MAX || result < SHRT_MIN)\n"
+    "        fail(\"Error: short value out of range.\\n\");\n"
+    "    return (short)result;\n"
+    "}\n"
+    "\n"
+    "static double read_floating(size_t size, const char *kind, const char *format_error)\n"
+    "{\n"
+    "    char buffer[64];\n"
+    "    int status = read_line(buffer, size);\n"
+    "    if (status != 0)\n"
+    "    {\n"
+    "        fprintf(stderr, \"Error reading %s: %d\\n\", kind, status);\n"
+    "        exit(EXIT_FAILURE);\n"
+    "    }\n"
+    "    char *endptr;\n"
+    "    errno = 0;\n"
+    "    double result = strtod(buffer, &endptr);\n"
+    "    if (endptr == buffer || *endptr != '\\0')\n"
+    "        fail(format_error);\n"
+    "    if (errno == ERANGE)\n"
+    "        fail(\"Error: Double value out of range.\\n\");\n"
+    "    return result;\n"
+    "}\n"
+    "\n"
+    "static float slorp_float(void)\n"
+    "{\n"
+    "    return read_floating(32, \"float\", \"Error: Invalid float format.\\n\");\n"
+    "}\n"
+    "\n"
+    "static double slorp_double(void)\n"
+    "{\n"
+    "    return read_floating(64, \"double\", \"Error: Invalid double format.\\n\");\n"
+    "}\n"
+    "\n"
+    "static void slorp_string(char *array, int length)\n"
+    "{\n"
+    "    char val[length];\n"
+    "    int status = read_line(val, sizeof(val));\n"
+    "    if (status == -3)\n"
+    "        fail(\"Error: Input exceeded buffer size.\\n\");\n"
+    "    if (status != 0)\n"
+    "    {\n"
+    "        fprintf(stderr, \"Error reading string: %d\\n\", status);\n"
+    "        exit(EXIT_FAILURE);\n"
+    "    }\n"
+    "    strncpy(array, val, length - 1);\n"
+    "    array[length - 1] = '\\0';\n"
+    "}\n";
+
+void emit_c_program(FILE *out, const BytecodeProgram *program)
+{
+    bool prints = false;
+    bool slorps = false;
+    for (int f = 0; f < program->function_count; f++)
+    {
+        const BytecodeFunction *function = &program->functions[f];
+        for (int pc = 0; pc < function->code_length; pc++)
+        {
+            Opcode op = function->code[pc].op;
+            prints |= op == BC_PRINT;
+            slorps |= op == BC_SLORP_I || op == BC_SLORP_S || op == BC_SLORP_F ||
+                      op == BC_SLORP_D || op == BC_SLORP_STR;
+        }
+    }
+
+    fputs("/* Generated by brainrot --emit-c */\n\n", out);
+    fprintf(out, "static int yylineno = %d;\n\n", brainrot->line);
+    fputs(prelude, out);
+    if (prints)
+        fputs(print_runtime, out);
+    if (slorps)
+        fputs(slorp_runtime, out);
+
+    if (program->constant_count)
+    {
+        fputs("\nstatic const Register K[] = {\n", out);
+        for (int k = 0; k < program->constant_count; k++)
+        {
+            uint64_t bits;
+            memcpy(&bits, &program->constants[k], sizeof(bits));
+            fprintf(out, "    {.bits = 0x%016llxULL},\n", (unsigned long long)bits);
+        }
+        fputs("};\n", out);
+    }
+
+    for (int a = 0; a < program->array_count; a++)
+    {
+        const ArrayBinding *array = &program->arrays[a];
+        fprintf(out, "\n/* %s */\nstatic %s array%d[%d] = {", array->name, array_ctype(array->type), a,
+                array->length);
+        for (int e = 0; e < array->length; e++)
+        {
+            fputs(e == 0 ? "\n    " : e % 8 ? ", " : ",\n    ", out);
+            switch (array->type)
+            {
+            case VAR_SHORT:
+                fprintf(out, "%d", ((short *)array->data)[e]);
+                break;
+            case VAR_FLOAT:
+                emit_floating(out, ((float *)array->data)[e], true);
+                break;
+            case VAR_DOUBLE:
+                emit_floating(out, ((double *)array->data)[e], false);
+                break;
+            case VAR_BOOL:
+                fprintf(out, "%d", ((bool *)array->data)[e]);
+                break;
+            case VAR_CHAR:
+                fprintf(out, "%d", ((char *)array->data)[e]);
+                break;
+            default:
+                fprintf(out, "%d", ((int *)array->data)[e]);
+                break;
+            }
+        }
+        fputs("\n};\n", out);
+    }
+
+    fputc('\n', out);
+    for (int f = 1; f < program->function_count; f++)
+    {
+        emit_signature(out, &program->functions[f], f);
+        fputs(";\n", out);
+    }
+    for (int f = 1; f < program->function_count; f++)
+        emit_function(out, program, f);
+    emit_function(out, program, 0);
+}
+
+bool build_native(const BytecodeProgram *program, const char *output)
+{
+    char path[] = "/tmp/brainrotXXXXXX.c";
+    int fd = mkstemps(path, 2);
+    FILE *source = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!source)
+    {
+        fprintf(brainrot->err, "Cannot create C source: %s\n", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    emit_c_program(source, program);
+    fclose(source);
+
+    const char *cc = getenv("CC");
+    if (!cc || !*cc)
+        cc = "cc";
+    int status = -1;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        /* The child cannot write to brainrot->err, which may be a buffer
+         * in the parent; 127 tells the parent the exec failed. */
+        execlp(cc, cc, "-O2", "-o", output, path, "-lm", (char *)NULL);
+        _exit(127);
+    }
+    if (pid > 0)
+        waitpid(pid, &status, 0);
+    else
+        fprintf(brainrot->err, "Cannot start C compiler: %s\n", strerror(errno));
+    if (pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 127)
+        fprintf(brainrot->err, "Cannot run C compiler '%s'\n", cc);
+    unlink(path);
+    return status == 0;
+}
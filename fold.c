@@ -0,0 +1,532 @@
+/* fold.c */
+
+#include "optimizer.h"
+#include <limits.h>
+#include <math.h>
+
+/*
+ * Constant folding and propagation.
+ *
+ * Operations, negations and maxxing() whose operands are all literals are
+ * evaluated once here, with the interpreter's own operator kernels and
+ * promotion rules, and the node is rewritten in place into the literal.
+ * Reads of a deadass scalar initialized with a literal, and never stepped
+ * with ++/-- or read into with slorp, become that literal.
+ *
+ * The tree-walker evaluates a node differently depending on who asks for
+ * its value, and a literal does not always behave like the expression it
+ * replaces: an int literal does everywhere, but a float result asked for
+ * as an int is an error for a literal and a silent conversion for an
+ * operation, and a variable read as another type goes through the
+ * variable's raw storage. Every rewrite is therefore only made where the
+ * value is used in a way that cannot tell the two apart. Anything the
+ * interpreter would report at runtime (division by zero, int overflow) is
+ * left for it to report.
+ */
+
+/* How the parent evaluates an expression */
+typedef enum
+{
+    USE_OPERAND, /* operand of an arithmetic or comparison operator: as its own type */
+    USE_VALUE,   /* value of a scalar assignment: as its own type or the variable's */
+    USE_INT,     /* array index, condition or case value: through evaluate_expression_int() */
+    USE_OTHER,   /* anywhere else */
+} Use;
+
+typedef struct
+{
+    const char *name;
+    ASTNode *declaration; /* NULL for parameters */
+    int depth;
+} Binding;
+
+typedef struct
+{
+    Binding *bindings;
+    int binding_count;
+    int binding_capacity;
+    int depth;
+    bool in_main;  /* global arrays are only visible in main */
+    bool scanning; /* first walk: only find the mutated deadass variables */
+    ASTNode **mutated;
+    int mutated_count;
+    int mutated_capacity;
+    int changes;
+} Folder;
+
+static void declare(Folder *f, const char *name, ASTNode *declaration)
+{
+    if (f->binding_count >= f->binding_capacity)
+    {
+        f->binding_capacity = f->binding_capacity ? f->binding_capacity * 2 : 16;
+        Binding *grown = realloc(f->bindings, f->binding_capacity * sizeof(Binding));
+        if (!grown)
+        {
+            fprintf(brainrot->err, "Error: Memory allocation failed\n");
+            brainrot_exit(EXIT_FAILURE);
+        }
+        f->bindings = grown;
+    }
+    f->bindings[f->binding_count++] = (Binding){name, declaration, f->depth};
+}
+
+static Binding *lookup(Folder *f, const char *name)
+{
+    for (int i = f->binding_count - 1; i >= 0; i--)
+    {
+        if (strcmp(f->bindings[i].name, name) == 0)
+            return &f->bindings[i];
+    }
+    return NULL;
+}
+
+static void begin_scope(Folder *f)
+{
+    f->depth++;
+}
+
+static void end_scope(Folder *f)
+{
+    while (f->binding_count && f->bindings[f->binding_count - 1].depth == f->depth)
+        f->binding_count--;
+    f->depth--;
+}
+
+static bool is_mutated(Folder *f, const ASTNode *declaration)
+{
+    for (int i = 0; i < f->mutated_count; i++)
+    {
+        if (f->mutated[i] == declaration)
+            return true;
+    }
+    return false;
+}
+
+static void mark_mutated(Folder *f, ASTNode *variable)
+{
+    Binding *binding = lookup(f, variable->data.name);
+    if (!binding || !binding->declaration || is_mutated(f, binding->declaration))
+        return;
+    if (f->mutated_count >= f->mutated_capacity)
+    {
+        f->mutated_capacity = f->mutated_capacity ? f->mutated_capacity * 2 : 8;
+        ASTNode **grown = realloc(f->mutated, f->mutated_capacity * sizeof(ASTNode *));
+        if (!grown)
+        {
+            fprintf(brainrot->err, "Error: Memory allocation failed\n");
+            brainrot_exit(EXIT_FAILURE);
+        }
+        f->mutated = grown;
+    }
+    f->mutated[f->mutated_count++] = binding->declaration;
+}
+
+static bool is_number(const ASTNode *node)
+{
+    return node->type == NODE_INT || node->type == NODE_CHAR || node->type == NODE_FLOAT ||
+           node->type == NODE_DOUBLE;
+}
+
+/* The literal a read of this variable can be replaced by, if any. */
+static ASTNode *constant_value(Folder *f, ASTNode *identifier)
+{
+    Binding *binding = lookup(f, identifier->data.name);
+    if (!binding || !binding->declaration)
+        return NULL;
+    ASTNode *declaration = binding->declaration;
+    ASTNode *value = declaration->data.op.right;
+    if (!declaration->modifiers.is_const || is_mutated(f, declaration))
+        return NULL;
+    /* The initializer must already have the variable's type, as an
+     * assignment would store it unconverted. */
+    if ((declaration->var_type == VAR_INT && value->type == NODE_INT) ||
+        (declaration->var_type == VAR_FLOAT && value->type == NODE_FLOAT) ||
+        (declaration->var_type == VAR_DOUBLE && value->type == NODE_DOUBLE))
+        return value;
+    return NULL;
+}
+
+/* Rewrites a node into a literal, keeping its modifiers, which an
+ * operation carries for unsigned printing and modulo. */
+static void become_int(Folder *f, ASTNode *node, int value)
+{
+    node->type = NODE_INT;
+    node->var_type = VAR_INT;
+    node->data.ivalue = value;
+    f->changes++;
+}
+
+static void become_float(Folder *f, ASTNode *node, float value)
+{
+    node->type = NODE_FLOAT;
+    node->var_type = VAR_FLOAT;
+    node->data.fvalue = value;
+    f->changes++;
+}
+
+static void become_double(Folder *f, ASTNode *node, double value)
+{
+    node->type = NODE_DOUBLE;
+    node->var_type = VAR_DOUBLE;
+    node->data.dvalue = value;
+    f->changes++;
+}
+
+/* Whether an int operation on these operands runs without the interpreter
+ * reporting an error or overflowing. */
+static bool int_operation_is_quiet(OperatorType op, int left, int right, bool is_unsigned)
+{
+    int ignored;
+    switch (op)
+    {
+    case OP_PLUS:
+        return !__builtin_add_overflow(left, right, &ignored);
+    case OP_MINUS:
+        return !__builtin_sub_overflow(left, right, &ignored);
+    case OP_TIMES:
+        return !__builtin_mul_overflow(left, right, &ignored);
+    case OP_DIVIDE:
+        return right != 0 && !(left == INT_MIN && right == -1);
+    case OP_MOD:
+        return right != 0 && (is_unsigned || !(left == INT_MIN && right == -1));
+    default:
+        return true;
+    }
+}
+
+static void fold_operation(Folder *f, ASTNode *node, Use use)
+{
+    ASTNode *left = node->data.op.left;
+    ASTNode *right = node->data.op.right;
+    OperatorType op = node->data.op.op;
+    if (!is_number(left) || !is_number(right))
+        return;
+
+    if (op == OP_AND || op == OP_OR)
+    {
+        /* Only an int evaluation takes both sides as ints; a float one
+         * reports the operator as unsupported. */
+        if ((use == USE_INT || use == USE_OPERAND) && left->type != NODE_FLOAT &&
+            left->type != NODE_DOUBLE && right->type != NODE_FLOAT && right->type != NODE_DOUBLE)
+            become_int(f, node, op == OP_AND ? left->data.ivalue && right->data.ivalue
+                                             : left->data.ivalue || right->data.ivalue);
+        return;
+    }
+
+    /* The promotion handle_binary_operation() applies */
+    VarType left_type = get_expression_type(left);
+    VarType right_type = get_expression_type(right);
+    bool is_unsigned = node->modifiers.is_unsigned;
+    if (left_type == VAR_DOUBLE || right_type == VAR_DOUBLE)
+    {
+        /* A float operand makes the expression count as float too, which
+         * no single literal does */
+        if ((use != USE_OPERAND && use != USE_VALUE) || left_type == VAR_FLOAT ||
+            right_type == VAR_FLOAT)
+            return;
+        double l = left_type == VAR_INT ? (double)left->data.ivalue : left->data.dvalue;
+        double r = right_type == VAR_INT ? (double)right->data.ivalue : right->data.dvalue;
+        if (op == OP_DIVIDE && fabs(r) < __DBL_MIN__)
+            return;
+        become_double(f, node, double_binary(op, l, r, is_unsigned));
+    }
+    else if (left_type == VAR_FLOAT || right_type == VAR_FLOAT)
+    {
+        if (use != USE_OPERAND && use != USE_VALUE)
+            return;
+        float l = left_type == VAR_INT ? (float)left->data.ivalue : left->data.fvalue;
+        float r = right_type == VAR_INT ? (float)right->data.ivalue : right->data.fvalue;
+        if (op == OP_DIVIDE && fabsf(r) < __FLT_MIN__)
+            return;
+        become_float(f, node, float_binary(op, l, r, is_unsigned));
+    }
+    else
+    {
+        int l = left->data.ivalue;
+        int r = right->data.ivalue;
+        if (int_operation_is_quiet(op, l, r, is_unsigned))
+            become_int(f, node, int_binary(op, l, r, is_unsigned));
+    }
+}
+
+static void fold_negation(Folder *f, ASTNode *node, Use use)
+{
+    ASTNode *operand = node->data.unary.operand;
+    /* Asked for as a bool, a negation is a logical not */
+    if (operand->type == NODE_INT && operand->data.ivalue != INT_MIN &&
+        (use == USE_OPERAND || use == USE_VALUE || use == USE_INT))
+        become_int(f, node, -operand->data.ivalue);
+    else if (operand->type == NODE_FLOAT && use == USE_OPERAND)
+        become_float(f, node, -operand->data.fvalue);
+    else if (operand->type == NODE_DOUBLE && use == USE_OPERAND)
+        become_double(f, node, -operand->data.dvalue);
+}
+
+/* Whether an expression is built from literals only, so that
+ * get_expression_type() needs no variables to type it. */
+static bool is_literal_tree(const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_BOOLEAN:
+    case NODE_SIZEOF:
+        return true;
+    case NODE_OPERATION:
+        return is_literal_tree(node->data.op.left) && is_literal_tree(node->data.op.right);
+    case NODE_UNARY_OPERATION:
+        return is_literal_tree(node->data.unary.operand);
+    default:
+        return false;
+    }
+}
+
+/* maxxing() of a literal expression, a deadass literal or a global array,
+ * computed as handle_sizeof() would. */
+static void fold_sizeof(Folder *f, ASTNode *node)
+{
+    ASTNode *expr = node->data.sizeof_stmt.expr;
+    if (expr->type == NODE_IDENTIFIER)
+    {
+        Binding *binding = lookup(f, expr->data.name);
+        if (binding)
+        {
+            ASTNode *value = constant_value(f, expr);
+            if (value)
+                become_int(f, node, value->type == NODE_DOUBLE ? sizeof(double) : sizeof(int));
+            return;
+        }
+        Variable *var = f->in_main ? get_variable(expr->data.name) : NULL;
+        if (var && var->is_array && var->var_type != VAR_CHAR)
+            become_int(f, node, get_type_size(expr));
+        return;
+    }
+    if (!is_literal_tree(expr))
+        return;
+    switch (get_expression_type(expr))
+    {
+    case VAR_INT:
+        become_int(f, node, sizeof(int));
+        break;
+    case VAR_FLOAT:
+        become_int(f, node, sizeof(float));
+        break;
+    case VAR_DOUBLE:
+        become_int(f, node, sizeof(double));
+        break;
+    case VAR_SHORT:
+        become_int(f, node, sizeof(short));
+        break;
+    case VAR_BOOL:
+        become_int(f, node, sizeof(bool));
+        break;
+    default:
+        break;
+    }
+}
+
+static void fold_expression(Folder *f, ASTNode *node, Use use);
+
+static void fold_arguments(Folder *f, ArgumentList *args)
+{
+    for (; args; args = args->next)
+        fold_expression(f, args->expr, USE_OTHER);
+}
+
+static void fold_expression(Folder *f, ASTNode *node, Use use)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+    {
+        if (f->scanning || (use != USE_OPERAND && use != USE_INT))
+            break;
+        ASTNode *value = constant_value(f, node);
+        /* Read as an int, a float variable gives its raw bits */
+        if (!value || (use == USE_INT && value->type != NODE_INT))
+            break;
+        if (value->type == NODE_INT)
+            become_int(f, node, value->data.ivalue);
+        else if (value->type == NODE_FLOAT)
+            become_float(f, node, value->data.fvalue);
+        else
+            become_double(f, node, value->data.dvalue);
+        break;
+    }
+    case NODE_OPERATION:
+    {
+        bool logical = node->data.op.op == OP_AND || node->data.op.op == OP_OR;
+        fold_expression(f, node->data.op.left, logical ? USE_OTHER : USE_OPERAND);
+        fold_expression(f, node->data.op.right, logical ? USE_OTHER : USE_OPERAND);
+        if (!f->scanning)
+            fold_operation(f, node, use);
+        break;
+    }
+    case NODE_UNARY_OPERATION:
+    {
+        ASTNode *operand = node->data.unary.operand;
+        if (node->data.unary.op != OP_NEG)
+        {
+            /* ++ and -- store into their variable */
+            if (f->scanning && operand->type == NODE_IDENTIFIER)
+                mark_mutated(f, operand);
+            fold_expression(f, operand->type == NODE_IDENTIFIER ? NULL : operand, USE_OTHER);
+            break;
+        }
+        /* The operand is asked for in the type the negation is */
+        fold_expression(f, operand, use == USE_OPERAND || use == USE_INT ? use : USE_OTHER);
+        if (!f->scanning)
+            fold_negation(f, node, use);
+        break;
+    }
+    case NODE_ARRAY_ACCESS:
+        fold_expression(f, node->data.array.index, USE_INT);
+        break;
+    case NODE_SIZEOF:
+        /* The operand is never evaluated, only typed */
+        if (!f->scanning)
+            fold_sizeof(f, node);
+        break;
+    case NODE_FUNC_CALL:
+        /* slorp() stores into its variable */
+        if (f->scanning && node->data.func_call.builtin == BUILTIN_SLORP &&
+            node->data.func_call.arguments &&
+            node->data.func_call.arguments->expr->type == NODE_IDENTIFIER)
+            mark_mutated(f, node->data.func_call.arguments->expr);
+        if (node->data.func_call.builtin != BUILTIN_SLORP)
+            fold_arguments(f, node->data.func_call.arguments);
+        break;
+    default:
+        break;
+    }
+}
+
+static void fold_statement(Folder *f, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            fold_statement(f, entry->statement);
+        break;
+    case NODE_DECLARATION:
+        /* The variable exists before its initializer is evaluated */
+        declare(f, node->data.op.left->data.name, node);
+        fold_expression(f, node->data.op.right, USE_VALUE);
+        break;
+    case NODE_ASSIGNMENT:
+    {
+        ASTNode *target = node->data.op.left;
+        if (target->type == NODE_ARRAY_ACCESS)
+        {
+            fold_expression(f, target, USE_OTHER);
+            fold_expression(f, node->data.op.right, USE_OTHER);
+        }
+        else
+        {
+            fold_expression(f, node->data.op.right, USE_VALUE);
+        }
+        break;
+    }
+    case NODE_OPERATION:
+    case NODE_UNARY_OPERATION:
+    case NODE_FUNC_CALL:
+        fold_expression(f, node, USE_OTHER);
+        break;
+    case NODE_FOR_STATEMENT:
+        begin_scope(f);
+        fold_statement(f, node->data.for_stmt.init);
+        begin_scope(f);
+        fold_expression(f, node->data.for_stmt.cond, USE_INT);
+        fold_statement(f, node->data.for_stmt.body);
+        fold_statement(f, node->data.for_stmt.incr);
+        end_scope(f);
+        end_scope(f);
+        break;
+    case NODE_WHILE_STATEMENT:
+        begin_scope(f);
+        fold_expression(f, node->data.while_stmt.cond, USE_INT);
+        begin_scope(f);
+        fold_statement(f, node->data.while_stmt.body);
+        end_scope(f);
+        end_scope(f);
+        break;
+    case NODE_DO_WHILE_STATEMENT:
+        begin_scope(f);
+        begin_scope(f);
+        fold_statement(f, node->data.while_stmt.body);
+        end_scope(f);
+        fold_expression(f, node->data.while_stmt.cond, USE_INT);
+        end_scope(f);
+        break;
+    case NODE_IF_STATEMENT:
+        begin_scope(f);
+        fold_expression(f, node->data.if_stmt.condition, USE_INT);
+        fold_statement(f, node->data.if_stmt.then_branch);
+        fold_statement(f, node->data.if_stmt.else_branch);
+        end_scope(f);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        fold_expression(f, node->data.switch_stmt.expression, USE_INT);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            fold_expression(f, entry->value, USE_INT);
+            fold_statement(f, entry->statements);
+        }
+        break;
+    case NODE_RETURN:
+    case NODE_ERROR_STATEMENT:
+    case NODE_PRINT_STATEMENT:
+        fold_expression(f, node->data.op.left, USE_OTHER);
+        break;
+    default:
+        break;
+    }
+}
+
+static void declare_parameters(Folder *f, Parameter *param)
+{
+    for (; param; param = param->next)
+        declare(f, param->name, NULL);
+}
+
+static void fold_program(Folder *f, ASTNode *root)
+{
+    for (StatementList *entry = root->data.statements; entry; entry = entry->next)
+    {
+        ASTNode *statement = entry->statement;
+        f->binding_count = 0;
+        f->depth = 0;
+        f->in_main = !statement || statement->type != NODE_FUNCTION_DEF;
+        if (f->in_main)
+        {
+            fold_statement(f, statement);
+            continue;
+        }
+        declare_parameters(f, statement->data.function_def.parameters);
+        fold_statement(f, statement->data.function_def.body);
+    }
+}
+
+int fold_constants(ASTNode *root)
+{
+    if (!root || root->type != NODE_STATEMENT_LIST)
+        return 0;
+
+    Folder folder = {.scanning = true};
+    fold_program(&folder, root);
+    folder.scanning = false;
+    fold_program(&folder, root);
+
+    free(folder.bindings);
+    free(folder.mutated);
+    return folder.changes;
+}
@@ -0,0 +1,559 @@
+/* idiom.c */
+
+#include "optimizer.h"
+#include "lib/pool.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Loop idiom recognition.
+ *
+ * Finds flex loops whose whole body is one array idiom: a copy, a fill
+ * with a literal, element-wise +, - or * of two arrays, or the sum,
+ * minimum or maximum of an array. The loop has to count up by one against
+ * `i < b` or `i <= b`, and every index be the counter plus or minus a
+ * literal. The pass attaches a LoopIdiom to the loop and counts the loops
+ * it recognized; the loop itself stays as written.
+ *
+ * When such a loop is counted (see execute_for_statement()), the
+ * tree-walker hands the counter's whole range to run_loop_idiom(), as the
+ * bytecode VM's KERNEL instruction does before the loop. The kernel
+ * checks the variables it finds at runtime - their types, and that every
+ * index stays in bounds - and otherwise leaves the loop to run element by
+ * element. The kernels give exactly the loop's results: copies and fills
+ * go through memmove() and memset(), int arithmetic wraps, and a gigachad
+ * sum, minimum or maximum is taken in order. A destination that overlaps
+ * a source behind it is written element by element, as the loop would.
+ */
+
+/* Pass */
+
+static bool is_literal(const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_BOOLEAN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* edgy (b[i] < x) x = b[i], or > for a maximum */
+static bool match_extremum(LoopIdiom *idiom, ASTNode *statement, const char *counter)
+{
+    ASTNode *test = statement->data.if_stmt.condition;
+    if (statement->data.if_stmt.else_branch || test->type != NODE_OPERATION ||
+        (test->data.op.op != OP_LT && test->data.op.op != OP_GT) ||
+        !counter_access(test->data.op.left, counter, &idiom->offsets[1]))
+        return false;
+    ASTNode *extremum = test->data.op.right;
+    ASTNode *store = single_statement(statement->data.if_stmt.then_branch);
+    int offset;
+    if (!extremum || extremum->type != NODE_IDENTIFIER || names_variable(extremum, counter) ||
+        !store || store->type != NODE_ASSIGNMENT ||
+        !names_variable(store->data.op.left, extremum->data.name) ||
+        !counter_access(store->data.op.right, counter, &offset) || offset != idiom->offsets[1] ||
+        strcmp(store->data.op.right->data.array.name, test->data.op.left->data.array.name) != 0)
+        return false;
+    idiom->kind = test->data.op.op == OP_LT ? IDIOM_MIN : IDIOM_MAX;
+    idiom->store = store;
+    idiom->test = test;
+    idiom->target = extremum;
+    idiom->left = test->data.op.left;
+    return true;
+}
+
+static bool match_body(LoopIdiom *idiom, ASTNode *body, const char *counter)
+{
+    ASTNode *statement = single_statement(body);
+    if (!statement)
+        return false;
+    if (statement->type == NODE_IF_STATEMENT)
+        return match_extremum(idiom, statement, counter);
+    if (statement->type != NODE_ASSIGNMENT)
+        return false;
+
+    ASTNode *target = statement->data.op.left;
+    ASTNode *value = statement->data.op.right;
+    idiom->store = statement;
+    idiom->target = target;
+    if (counter_access(target, counter, &idiom->offsets[0]))
+    {
+        if (counter_access(value, counter, &idiom->offsets[1]))
+        {
+            idiom->kind = IDIOM_COPY;
+            idiom->left = value;
+            return true;
+        }
+        if (is_literal(value))
+        {
+            idiom->kind = IDIOM_FILL;
+            return true;
+        }
+        if (value->type != NODE_OPERATION ||
+            (value->data.op.op != OP_PLUS && value->data.op.op != OP_MINUS && value->data.op.op != OP_TIMES) ||
+            !counter_access(value->data.op.left, counter, &idiom->offsets[1]) ||
+            !counter_access(value->data.op.right, counter, &idiom->offsets[2]))
+            return false;
+        idiom->kind = IDIOM_MAP;
+        idiom->op = value->data.op.op;
+        idiom->test = value;
+        idiom->left = value->data.op.left;
+        idiom->right = value->data.op.right;
+        return true;
+    }
+
+    // x = x + b[i] or x = b[i] + x
+    if (target->type != NODE_IDENTIFIER || names_variable(target, counter) ||
+        value->type != NODE_OPERATION || value->data.op.op != OP_PLUS)
+        return false;
+    ASTNode *element = names_variable(value->data.op.left, target->data.name)    ? value->data.op.right
+                       : names_variable(value->data.op.right, target->data.name) ? value->data.op.left
+                                                                                  : NULL;
+    if (!counter_access(element, counter, &idiom->offsets[1]))
+        return false;
+    idiom->kind = IDIOM_SUM;
+    idiom->test = value;
+    idiom->left = element;
+    return true;
+}
+
+static void recognize(int *found, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            recognize(found, entry->statement);
+        break;
+    case NODE_FUNCTION_DEF:
+        recognize(found, node->data.function_def.body);
+        break;
+    case NODE_IF_STATEMENT:
+        recognize(found, node->data.if_stmt.then_branch);
+        recognize(found, node->data.if_stmt.else_branch);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        recognize(found, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            recognize(found, entry->statements);
+        break;
+    case NODE_FOR_STATEMENT:
+    {
+        recognize(found, node->data.for_stmt.body);
+        const char *counter = unit_step_counter(node);
+        LoopIdiom idiom = {0};
+        if (!counter || !match_body(&idiom, node->data.for_stmt.body, counter))
+            break;
+        node->data.for_stmt.idiom = ARENA_ALLOC(LoopIdiom);
+        *node->data.for_stmt.idiom = idiom;
+        (*found)++;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int recognize_loop_idioms(ASTNode *root)
+{
+    int found = 0;
+    recognize(&found, root);
+    if (found && brainrot->translated)
+        opt_remark("C runs a recognized loop as written");
+    return found;
+}
+
+/* Kernels */
+
+static size_t element_size(VarType type)
+{
+    switch (type)
+    {
+    case VAR_INT:
+        return sizeof(int);
+    case VAR_SHORT:
+        return sizeof(short);
+    case VAR_FLOAT:
+        return sizeof(float);
+    case VAR_DOUBLE:
+        return sizeof(double);
+    case VAR_BOOL:
+        return sizeof(bool);
+    case VAR_CHAR:
+        return sizeof(char);
+    default:
+        return 0;
+    }
+}
+
+/* The array an access names, if it has an element for every counter value
+ * from first to last */
+static Variable *array_in_range(const ASTNode *access, int offset, int first, int last)
+{
+    Variable *var = lookup_variable((ASTNode *)access);
+    if (!var || !var->is_array || !element_size(var->var_type))
+        return NULL;
+    long long low = (long long)first + offset;
+    long long high = (long long)last + offset;
+    return low >= 0 && high < var->array_length ? var : NULL;
+}
+
+/* Whether int or gigachad arithmetic on these arrays behaves as the
+ * kernels assume */
+static bool plain_numbers(const Variable *var, VarType type)
+{
+    return var->var_type == type && !var->modifiers.is_unsigned;
+}
+
+static void fill(Variable *target, int offset, int first, int count)
+{
+    size_t size = element_size(target->var_type);
+    char *start = (char *)target->value.array_data + ((size_t)first + offset) * size;
+    size_t total = (size_t)count * size;
+    bool uniform = true;
+    for (size_t byte = 1; byte < size; byte++)
+        uniform &= start[byte] == start[0];
+    if (uniform)
+    {
+        memset(start + size, start[0], total - size);
+        return;
+    }
+    // Doubles the filled prefix on every copy
+    for (size_t filled = size; filled < total;)
+    {
+        size_t chunk = filled < total - filled ? filled : total - filled;
+        memcpy(start + filled, start, chunk);
+        filled += chunk;
+    }
+}
+
+static void map_ints(int *out, const int *a, const int *b, OperatorType op, int count, bool in_order)
+{
+    int k = 0;
+#ifdef __SSE2__
+    if (!in_order && op != OP_TIMES)
+    {
+        for (; k + 4 <= count; k += 4)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + k));
+            __m128i y = _mm_loadu_si128((const __m128i *)(b + k));
+            _mm_storeu_si128((__m128i *)(out + k), op == OP_PLUS ? _mm_add_epi32(x, y) : _mm_sub_epi32(x, y));
+        }
+    }
+#endif
+    for (; k < count; k++)
+    {
+        unsigned x = (unsigned)a[k], y = (unsigned)b[k];
+        out[k] = (int)(op == OP_PLUS ? x + y : op == OP_MINUS ? x - y : x * y);
+    }
+}
+
+static void map_doubles(double *out, const double *a, const double *b, OperatorType op, int count,
+                        bool in_order)
+{
+    int k = 0;
+#ifdef __SSE2__
+    if (!in_order)
+    {
+        for (; k + 2 <= count; k += 2)
+        {
+            __m128d x = _mm_loadu_pd(a + k);
+            __m128d y = _mm_loadu_pd(b + k);
+            _mm_storeu_pd(out + k, op == OP_PLUS    ? _mm_add_pd(x, y)
+                                   : op == OP_MINUS ? _mm_sub_pd(x, y)
+                                                    : _mm_mul_pd(x, y));
+        }
+    }
+#endif
+    for (; k < count; k++)
+        out[k] = op == OP_PLUS ? a[k] + b[k] : op == OP_MINUS ? a[k] - b[k] : a[k] * b[k];
+}
+
+static int sum_ints(const int *a, int count, int total)
+{
+    unsigned sum = (unsigned)total;
+    int k = 0;
+#ifdef __SSE2__
+    __m128i lanes = _mm_setzero_si128();
+    for (; k + 4 <= count; k += 4)
+        lanes = _mm_add_epi32(lanes, _mm_loadu_si128((const __m128i *)(a + k)));
+    unsigned partial[4];
+    _mm_storeu_si128((__m128i *)partial, lanes);
+    sum += partial[0] + partial[1] + partial[2] + partial[3];
+#endif
+    for (; k < count; k++)
+        sum += (unsigned)a[k];
+    return (int)sum;
+}
+
+static int extremum_of_ints(const int *a, int count, int extremum, bool minimum)
+{
+    int k = 0;
+#ifdef __SSE2__
+    if (count >= 4)
+    {
+        __m128i best = _mm_set1_epi32(extremum);
+        for (; k + 4 <= count; k += 4)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + k));
+            __m128i better = minimum ? _mm_cmplt_epi32(x, best) : _mm_cmpgt_epi32(x, best);
+            best = _mm_or_si128(_mm_and_si128(better, x), _mm_andnot_si128(better, best));
+        }
+        int lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, best);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (minimum ? lanes[lane] < extremum : lanes[lane] > extremum)
+                extremum = lanes[lane];
+        }
+    }
+#endif
+    for (; k < count; k++)
+    {
+        if (minimum ? a[k] < extremum : a[k] > extremum)
+            extremum = a[k];
+    }
+    return extremum;
+}
+
+/* Reads of `source` overlap writes of `target` behind them, so they have to
+ * see the values the loop stored earlier */
+static bool reads_behind(const Variable *target, int target_offset, const Variable *source, int source_offset)
+{
+    return target->value.array_data == source->value.array_data && source_offset < target_offset;
+}
+
+/* Whether `source` reads elements of `target` that other iterations store */
+static bool shares_elements(const Variable *target, int target_offset, const Variable *source, int source_offset)
+{
+    return target->value.array_data == source->value.array_data && source_offset != target_offset;
+}
+
+/* An element-wise map, split into chunks for the thread pool */
+typedef struct
+{
+    OperatorType op;
+    char *out;
+    const char *a;
+    const char *b;
+    int count;
+    bool is_double;
+} Map;
+
+static void map_chunk(void *context, int chunk)
+{
+    const Map *map = context;
+    int start = chunk * PARALLEL_CHUNK;
+    int count = map->count - start < PARALLEL_CHUNK ? map->count - start : PARALLEL_CHUNK;
+    if (map->is_double)
+        map_doubles((double *)map->out + start, (const double *)map->a + start, (const double *)map->b + start,
+                    map->op, count, false);
+    else
+        map_ints((int *)map->out + start, (const int *)map->a + start, (const int *)map->b + start, map->op, count,
+                 false);
+}
+
+static bool run_store(const LoopIdiom *idiom, int first, int last, LoopParallelism parallel)
+{
+    int count = last - first + 1;
+    Variable *target = array_in_range(idiom->target, idiom->offsets[0], first, last);
+    if (!target || target->modifiers.is_const)
+        return false;
+    size_t size = element_size(target->var_type);
+    char *out = (char *)target->value.array_data + ((size_t)first + idiom->offsets[0]) * size;
+
+    if (idiom->kind == IDIOM_FILL)
+    {
+        // The first element is stored as written; the rest repeat its bytes
+        Variable *counter = lookup_variable(idiom->target->data.array.index->type == NODE_IDENTIFIER
+                                                ? idiom->target->data.array.index
+                                                : idiom->target->data.array.index->data.op.left);
+        if (!counter || counter->var_type != VAR_INT)
+            return false;
+        counter->value.ivalue = first;
+        execute_statement(idiom->store);
+        fill(target, idiom->offsets[0], first, count);
+        return true;
+    }
+
+    Variable *left = array_in_range(idiom->left, idiom->offsets[1], first, last);
+    if (!left)
+        return false;
+    const char *a = (const char *)left->value.array_data + ((size_t)first + idiom->offsets[1]) * size;
+    if (idiom->kind == IDIOM_COPY)
+    {
+        if (left->var_type != target->var_type)
+            return false;
+        if (!reads_behind(target, idiom->offsets[0], left, idiom->offsets[1]))
+        {
+            memmove(out, a, (size_t)count * size);
+            return true;
+        }
+        for (int k = 0; k < count; k++)
+            memcpy(out + (size_t)k * size, a + (size_t)k * size, size);
+        return true;
+    }
+
+    Variable *right = array_in_range(idiom->right, idiom->offsets[2], first, last);
+    if (!right || idiom->test->modifiers.is_unsigned)
+        return false;
+    const char *b = (const char *)right->value.array_data + ((size_t)first + idiom->offsets[2]) * size;
+    bool in_order = reads_behind(target, idiom->offsets[0], left, idiom->offsets[1]) ||
+                    reads_behind(target, idiom->offsets[0], right, idiom->offsets[2]);
+    Map map = {idiom->op, out, a, b, count, plain_numbers(target, VAR_DOUBLE)};
+    if (map.is_double ? !plain_numbers(left, VAR_DOUBLE) || !plain_numbers(right, VAR_DOUBLE)
+                      : !plain_numbers(target, VAR_INT) || !plain_numbers(left, VAR_INT) ||
+                            !plain_numbers(right, VAR_INT))
+        return false;
+    if (parallel != LOOP_SEQUENTIAL && count >= 2 * PARALLEL_CHUNK &&
+        !shares_elements(target, idiom->offsets[0], left, idiom->offsets[1]) &&
+        !shares_elements(target, idiom->offsets[0], right, idiom->offsets[2]))
+        pool_run((count + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, map_chunk, &map);
+    else if (map.is_double)
+        map_doubles((double *)out, (const double *)a, (const double *)b, idiom->op, count, in_order);
+    else
+        map_ints((int *)out, (const int *)a, (const int *)b, idiom->op, count, in_order);
+    return true;
+}
+
+static double reduce_doubles(IdiomKind kind, const double *a, int count, double value)
+{
+    // In order: the rounding of a sum, and which of equal values wins,
+    // depend on it
+    bool minimum = kind == IDIOM_MIN;
+    for (int k = 0; k < count; k++)
+    {
+        if (kind == IDIOM_SUM)
+            value = value + a[k];
+        else if (minimum ? a[k] < value : a[k] > value)
+            value = a[k];
+    }
+    return value;
+}
+
+static int reduce_ints(IdiomKind kind, const int *a, int count, int value)
+{
+    if (kind == IDIOM_SUM)
+        return sum_ints(a, count, value);
+    return extremum_of_ints(a, count, value, kind == IDIOM_MIN);
+}
+
+/* A reduction split into chunks for the thread pool. Each chunk starts
+ * from the variable's value, or a sum's later chunks from zero, and the
+ * results are combined in chunk order. */
+typedef struct
+{
+    IdiomKind kind;
+    const void *source; /* the element for the first counter value */
+    int count;
+    bool is_double;
+    Value start;
+    Value *results; /* one per chunk */
+} Reduction;
+
+static void reduce_chunk(void *context, int chunk)
+{
+    const Reduction *r = context;
+    int start = chunk * PARALLEL_CHUNK;
+    int count = r->count - start < PARALLEL_CHUNK ? r->count - start : PARALLEL_CHUNK;
+    bool from_zero = r->kind == IDIOM_SUM && chunk > 0;
+    // -0.0 leaves every sum as it is, including -0.0
+    if (r->is_double)
+        r->results[chunk].dvalue =
+            reduce_doubles(r->kind, (const double *)r->source + start, count, from_zero ? -0.0 : r->start.dvalue);
+    else
+        r->results[chunk].ivalue =
+            reduce_ints(r->kind, (const int *)r->source + start, count, from_zero ? 0 : r->start.ivalue);
+}
+
+/* The reduction over chunks run on the thread pool */
+static Value reduce_in_parallel(IdiomKind kind, const void *source, int count, bool is_double, Value start)
+{
+    int chunks = (count + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+    Reduction r = {kind, source, count, is_double, start, SAFE_MALLOC_ARRAY(Value, chunks)};
+    pool_run(chunks, reduce_chunk, &r);
+    Value value = r.results[0];
+    for (int chunk = 1; chunk < chunks; chunk++)
+    {
+        Value result = r.results[chunk];
+        if (is_double)
+            value.dvalue = reduce_doubles(kind, &result.dvalue, 1, value.dvalue);
+        else
+            value.ivalue = kind == IDIOM_SUM ? (int)((unsigned)value.ivalue + (unsigned)result.ivalue)
+                                             : reduce_ints(kind, &result.ivalue, 1, value.ivalue);
+    }
+    SAFE_FREE(r.results);
+    return value;
+}
+
+/* A sum, minimum or maximum into a rizz or gigachad variable */
+static bool run_reduction(const LoopIdiom *idiom, int first, int last, LoopParallelism parallel)
+{
+    int count = last - first + 1;
+    Variable *var = lookup_variable(idiom->target);
+    Variable *source = array_in_range(idiom->left, idiom->offsets[1], first, last);
+    if (!var || var->is_array || var->modifiers.is_const || var->modifiers.is_unsigned || !source ||
+        idiom->store->modifiers.is_unsigned || idiom->test->modifiers.is_unsigned)
+        return false;
+    bool is_double = plain_numbers(var, VAR_DOUBLE) && plain_numbers(source, VAR_DOUBLE);
+    if (!is_double && !(plain_numbers(var, VAR_INT) && plain_numbers(source, VAR_INT)))
+        return false;
+
+    Value before = is_double ? (Value){.type = VAR_DOUBLE, .dvalue = var->value.dvalue}
+                             : (Value){.type = VAR_INT, .ivalue = var->value.ivalue};
+    Value after = before;
+    const void *elements = is_double ? (const void *)((const double *)source->value.array_data + first +
+                                                      idiom->offsets[1])
+                                     : (const void *)((const int *)source->value.array_data + first +
+                                                      idiom->offsets[1]);
+    // Regrouping a gigachad sum changes its rounding, which --relaxed-fp allows
+    if (parallel != LOOP_SEQUENTIAL && count >= 2 * PARALLEL_CHUNK &&
+        (!is_double || idiom->kind != IDIOM_SUM || brainrot->relaxed_fp))
+        after = reduce_in_parallel(idiom->kind, elements, count, is_double, before);
+    else if (is_double)
+        after.dvalue = reduce_doubles(idiom->kind, elements, count, before.dvalue);
+    else
+        after.ivalue = reduce_ints(idiom->kind, elements, count, before.ivalue);
+    if (is_double)
+        var->value.dvalue = after.dvalue;
+    else
+        var->value.ivalue = after.ivalue;
+
+    // The assignment's modifiers, as set_variable() stores them. A minimum
+    // or maximum stores only a value that compares beyond the one it has
+    bool stored = idiom->kind == IDIOM_SUM ||
+                  (is_double ? memcmp(&after.dvalue, &before.dvalue, sizeof(double)) != 0
+                             : after.ivalue != before.ivalue);
+    if (stored)
+        var->modifiers = idiom->store->modifiers;
+    return true;
+}
+
+/* Runs the loop body for every counter value from first to last (first <=
+ * last); false, having done nothing, if the variables it finds are not
+ * what the kernels handle. */
+bool run_loop_idiom(const LoopIdiom *idiom, int first, int last, LoopParallelism parallel)
+{
+    switch (idiom->kind)
+    {
+    case IDIOM_COPY:
+    case IDIOM_FILL:
+    case IDIOM_MAP:
+        return run_store(idiom, first, last, parallel);
+    default:
+        return run_reduction(idiom, first, last, parallel);
+    }
+}
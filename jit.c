@@ -0,0 +1,877 @@
+/* jit.c */
+
+#include "vm.h"
+#include <math.h>
+#include <stddef.h>
+
+/*
+ * Template JIT for the register VM on x86-64.
+ *
+ * Every bytecode instruction is translated on its own into a short
+ * machine-code sequence that reads and writes the VM registers in memory,
+ * so native code and the interpreter share all state and either can pick up
+ * where the other stopped. Jumps between instructions become native jumps;
+ * CALL goes through vm_call_from_native(). Instructions with side effects
+ * outside the register file (returns, prints, slorp, chill, ragequit, const
+ * errors) are side exits: native code returns their index and the VM runs
+ * them. Runtime errors call the same report_error() messages the VM uses.
+ *
+ * While it runs, native code keeps the register file in rbx and the VM
+ * state in r12; rax, rcx, rdx, xmm0 and xmm1 are scratch.
+ */
+
+extern void report_error(const char *s);
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+
+#include <sys/mman.h>
+
+typedef int (*NativeEntry)(Register *R, struct VMState *vm, const uint8_t *target);
+
+struct NativeFunction
+{
+    uint8_t *code;
+    size_t size;       /* mapped bytes */
+    uint32_t *offsets; /* native offset of every instruction */
+    NativeEntry entry;
+};
+
+typedef struct
+{
+    uint8_t *bytes;
+    int length;
+    int capacity;
+} CodeBuffer;
+
+/* A rel32 to patch once every instruction has an offset; target -1 is
+ * the exit sequence. */
+typedef struct
+{
+    int at;
+    int target;
+} Fixup;
+
+typedef struct
+{
+    CodeBuffer code;
+    Fixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    const uint32_t *offsets; /* filled in while the function is emitted */
+} Assembler;
+
+/* Scratch registers, by their x86 encoding */
+enum
+{
+    EAX = 0,
+    ECX = 1,
+    EDX = 2,
+    XMM0 = 0,
+    XMM1 = 1,
+};
+
+static void emit_bytes(CodeBuffer *b, const uint8_t *bytes, size_t count)
+{
+    for (size_t n = 0; n < count; n++)
+    {
+        GROW_ARRAY(b->bytes, b->length, b->capacity);
+        b->bytes[b->length++] = bytes[n];
+    }
+}
+
+static void emit_u32(CodeBuffer *b, uint32_t value)
+{
+    uint8_t bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    emit_bytes(b, bytes, sizeof(bytes));
+}
+
+static void emit_u64(CodeBuffer *b, uint64_t value)
+{
+    uint8_t bytes[8];
+    memcpy(bytes, &value, sizeof(bytes));
+    emit_bytes(b, bytes, sizeof(bytes));
+}
+
+#define EMIT(b, ...) \
+    emit_bytes((b), (const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}))
+
+/* Opcode bytes followed by a ModRM addressing VM register r: [rbx + disp32]. */
+static void emit_mem(CodeBuffer *b, const uint8_t *opcode, size_t count, int reg, uint16_t r)
+{
+    emit_bytes(b, opcode, count);
+    EMIT(b, (uint8_t)(0x80 | (reg << 3) | 3));
+    emit_u32(b, (uint32_t)(r * sizeof(Register)));
+}
+
+#define MEM(b, reg, r, ...) \
+    emit_mem((b), (const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}), (reg), (r))
+
+/* Loads and stores of one VM register member */
+#define LOAD32(b, reg, r) MEM(b, reg, r, 0x8B)
+#define LOAD64(b, reg, r) MEM(b, reg, r, 0x48, 0x8B)
+#define LOADSX16(b, reg, r) MEM(b, reg, r, 0x0F, 0xBF)
+#define LOADZX8(b, reg, r) MEM(b, reg, r, 0x0F, 0xB6)
+#define STORE8(b, reg, r) MEM(b, reg, r, 0x88)
+#define STORE16(b, reg, r) MEM(b, reg, r, 0x66, 0x89)
+#define STORE32(b, reg, r) MEM(b, reg, r, 0x89)
+#define STORE64(b, reg, r) MEM(b, reg, r, 0x48, 0x89)
+#define MOVSS_LOAD(b, reg, r) MEM(b, reg, r, 0xF3, 0x0F, 0x10)
+#define MOVSS_STORE(b, reg, r) MEM(b, reg, r, 0xF3, 0x0F, 0x11)
+#define MOVSD_LOAD(b, reg, r) MEM(b, reg, r, 0xF2, 0x0F, 0x10)
+#define MOVSD_STORE(b, reg, r) MEM(b, reg, r, 0xF2, 0x0F, 0x11)
+
+/* cmp dword/word/byte [r], 0 */
+#define CMP32_ZERO(b, r) (MEM(b, 7, r, 0x83), EMIT(b, 0x00))
+#define CMP16_ZERO(b, r) (MEM(b, 7, r, 0x66, 0x83), EMIT(b, 0x00))
+#define CMP8_ZERO(b, r) (MEM(b, 7, r, 0x80), EMIT(b, 0x00))
+
+/* setcc al; movzx eax, al */
+#define SETCC_EAX(b, cc) EMIT(b, 0x0F, (cc), 0xC0, 0x0F, 0xB6, 0xC0)
+
+enum
+{
+    CC_E = 0x94,
+    CC_NE = 0x95,
+    CC_L = 0x9C,
+    CC_GE = 0x9D,
+    CC_LE = 0x9E,
+    CC_G = 0x9F,
+    CC_A = 0x97,
+    CC_AE = 0x93,
+    CC_P = 0x9A,
+    CC_NP = 0x9B,
+};
+
+/* A short forward jump whose rel8 is filled in by land(). */
+static int jump8(CodeBuffer *b, uint8_t opcode)
+{
+    EMIT(b, opcode, 0x00);
+    return b->length - 1;
+}
+
+static void land(CodeBuffer *b, int at)
+{
+    b->bytes[at] = (uint8_t)(b->length - (at + 1));
+}
+
+/* A rel32 jump to a bytecode instruction, or to the exit sequence. */
+static void jump32(Assembler *as, const uint8_t *opcode, size_t count, int target)
+{
+    emit_bytes(&as->code, opcode, count);
+    GROW_ARRAY(as->fixups, as->fixup_count, as->fixup_capacity);
+    as->fixups[as->fixup_count++] = (Fixup){as->code.length, target};
+    emit_u32(&as->code, 0);
+}
+
+#define JUMP(as, target, ...) \
+    jump32((as), (const uint8_t[]){__VA_ARGS__}, sizeof((const uint8_t[]){__VA_ARGS__}), (target))
+
+/* movabs rax, fn; call rax. The stack is 16-byte aligned in native code. */
+static void emit_call(CodeBuffer *b, uintptr_t fn)
+{
+    EMIT(b, 0x48, 0xB8);
+    emit_u64(b, fn);
+    EMIT(b, 0xFF, 0xD0);
+}
+
+#define CALL(b, fn) emit_call((b), (uintptr_t)(fn))
+
+/* Runtime helpers */
+
+static void division_by_zero(void)
+{
+    report_error("Division by zero");
+}
+
+static void modulo_by_zero(void)
+{
+    report_error("Modulo by zero");
+}
+
+static void index_out_of_bounds(void)
+{
+    report_error("Array index out of bounds!");
+}
+
+static float divide_float(float left, float right)
+{
+    if (fabs(right) < __FLT_MIN__)
+        return fabs(left) < __FLT_MIN__ ? 0.0f / 0.0f : left > 0 ? __FLT_MAX__ : -__FLT_MAX__;
+    return left / right;
+}
+
+static double divide_double(double left, double right)
+{
+    if (fabs(right) < __DBL_MIN__)
+        return fabs(left) < __DBL_MIN__ ? 0.0 / 0.0 : left > 0 ? __DBL_MAX__ : -__DBL_MAX__;
+    return left / right;
+}
+
+static float modulo_float(float left, float right)
+{
+    return (float)fmod(left, right);
+}
+
+static double modulo_double(double left, double right)
+{
+    return fmod(left, right);
+}
+
+/* Instruction templates */
+
+typedef enum
+{
+    WIDTH_BOOL,
+    WIDTH_SHORT,
+    WIDTH_INT,
+} IntWidth;
+
+/* Loads an int, short or bool register sign- or zero-extended into reg. */
+static void load_int(CodeBuffer *b, int reg, uint16_t r, IntWidth width)
+{
+    if (width == WIDTH_INT)
+        LOAD32(b, reg, r);
+    else if (width == WIDTH_SHORT)
+        LOADSX16(b, reg, r);
+    else
+        LOADZX8(b, reg, r);
+}
+
+static void store_int(CodeBuffer *b, int reg, uint16_t r, IntWidth width)
+{
+    if (width == WIDTH_INT)
+        STORE32(b, reg, r);
+    else if (width == WIDTH_SHORT)
+        STORE16(b, reg, r);
+    else
+        STORE8(b, reg, r);
+}
+
+/* Integer division and modulo: yyerror and 0 when dividing by zero,
+ * unless `trap` leaves the zero to the hardware like the VM does. */
+static void emit_divide(CodeBuffer *b, const Instruction *i, IntWidth width, bool modulo,
+                        bool is_unsigned, bool trap)
+{
+    load_int(b, EAX, i->b, width);
+    load_int(b, ECX, i->c, width);
+    int done = -1;
+    if (!trap)
+    {
+        EMIT(b, 0x85, 0xC9); // test ecx, ecx
+        int nonzero = jump8(b, 0x75);
+        CALL(b, modulo ? modulo_by_zero : division_by_zero);
+        EMIT(b, 0x31, 0xC0, 0x31, 0xD2); // xor eax, eax; xor edx, edx
+        done = jump8(b, 0xEB);
+        land(b, nonzero);
+    }
+    if (is_unsigned)
+        EMIT(b, 0x31, 0xD2, 0xF7, 0xF1); // xor edx, edx; div ecx
+    else
+        EMIT(b, 0x99, 0xF7, 0xF9); // cdq; idiv ecx
+    if (done >= 0)
+        land(b, done);
+    store_int(b, modulo ? EDX : EAX, i->a, width);
+}
+
+static void emit_int_arith(CodeBuffer *b, const Instruction *i, IntWidth width, uint8_t op)
+{
+    load_int(b, EAX, i->b, width);
+    load_int(b, ECX, i->c, width);
+    if (op == 0xAF)
+        EMIT(b, 0x0F, 0xAF, 0xC1); // imul eax, ecx
+    else
+        EMIT(b, op, 0xC8); // add/sub eax, ecx
+    store_int(b, EAX, i->a, width);
+}
+
+static void emit_int_compare(CodeBuffer *b, const Instruction *i, IntWidth width, uint8_t cc)
+{
+    load_int(b, EAX, i->b, width);
+    load_int(b, ECX, i->c, width);
+    EMIT(b, 0x39, 0xC8); // cmp eax, ecx
+    SETCC_EAX(b, cc);
+    STORE32(b, EAX, i->a);
+}
+
+/* Float arithmetic: F3 prefix for float, F2 for double */
+static void emit_float_arith(CodeBuffer *b, const Instruction *i, uint8_t prefix, uint8_t op)
+{
+    MEM(b, XMM0, i->b, prefix, 0x0F, 0x10);
+    MEM(b, XMM0, i->c, prefix, 0x0F, op);
+    MEM(b, XMM0, i->a, prefix, 0x0F, 0x11);
+}
+
+static void emit_float_call(CodeBuffer *b, const Instruction *i, uint8_t prefix, uintptr_t fn)
+{
+    MEM(b, XMM0, i->b, prefix, 0x0F, 0x10);
+    MEM(b, XMM1, i->c, prefix, 0x0F, 0x10);
+    emit_call(b, fn);
+    MEM(b, XMM0, i->a, prefix, 0x0F, 0x11);
+}
+
+/* Ordered comparisons false on NaN, like C: a < b is b above a. */
+static void emit_float_compare(CodeBuffer *b, const Instruction *i, bool is_double, Opcode kind)
+{
+    uint8_t prefix = is_double ? 0xF2 : 0xF3;
+    bool swap = kind == BC_LT_F || kind == BC_LE_F;
+    MEM(b, XMM0, swap ? i->c : i->b, prefix, 0x0F, 0x10);
+    if (is_double)
+        MEM(b, XMM0, swap ? i->b : i->c, 0x66, 0x0F, 0x2E); // ucomisd
+    else
+        MEM(b, XMM0, swap ? i->b : i->c, 0x0F, 0x2E); // ucomiss
+    switch (kind)
+    {
+    case BC_LT_F:
+    case BC_GT_F:
+        SETCC_EAX(b, CC_A);
+        break;
+    case BC_LE_F:
+    case BC_GE_F:
+        SETCC_EAX(b, CC_AE);
+        break;
+    case BC_EQ_F:
+        EMIT(b, 0x0F, CC_E, 0xC0, 0x0F, CC_NP, 0xC1, 0x20, 0xC8, 0x0F, 0xB6, 0xC0);
+        break;
+    default:
+        EMIT(b, 0x0F, CC_NE, 0xC0, 0x0F, CC_P, 0xC1, 0x08, 0xC8, 0x0F, 0xB6, 0xC0);
+        break;
+    }
+    STORE32(b, EAX, i->a);
+}
+
+/* bool of a float or double: anything but zero, NaN included */
+static void emit_float_to_bool(CodeBuffer *b, const Instruction *i, bool is_double)
+{
+    if (is_double)
+        MOVSD_LOAD(b, XMM0, i->b);
+    else
+        MOVSS_LOAD(b, XMM0, i->b);
+    EMIT(b, 0x0F, 0x57, 0xC9); // xorps xmm1, xmm1
+    if (is_double)
+        EMIT(b, 0x66);
+    EMIT(b, 0x0F, 0x2E, 0xC1);                          // ucomis xmm0, xmm1
+    EMIT(b, 0x0F, CC_NE, 0xC0, 0x0F, CC_P, 0xC1, 0x08, 0xC8); // setne al; setp cl; or al, cl
+    STORE8(b, EAX, i->a);
+}
+
+static void emit_convert(CodeBuffer *b, const Instruction *i)
+{
+    switch ((Opcode)i->op)
+    {
+    case BC_I2S:
+        LOAD32(b, EAX, i->b);
+        STORE16(b, EAX, i->a);
+        break;
+    case BC_I2B:
+        CMP32_ZERO(b, i->b);
+        EMIT(b, 0x0F, CC_NE, 0xC0);
+        STORE8(b, EAX, i->a);
+        break;
+    case BC_S2B:
+        CMP16_ZERO(b, i->b);
+        EMIT(b, 0x0F, CC_NE, 0xC0);
+        STORE8(b, EAX, i->a);
+        break;
+    case BC_S2I:
+        LOADSX16(b, EAX, i->b);
+        STORE32(b, EAX, i->a);
+        break;
+    case BC_B2I:
+        LOADZX8(b, EAX, i->b);
+        STORE32(b, EAX, i->a);
+        break;
+    case BC_B2S:
+        LOADZX8(b, EAX, i->b);
+        STORE16(b, EAX, i->a);
+        break;
+    case BC_I2F:
+    case BC_S2F:
+    case BC_B2F:
+    case BC_I2D:
+    case BC_S2D:
+    case BC_B2D:
+    {
+        bool to_double = i->op == BC_I2D || i->op == BC_S2D || i->op == BC_B2D;
+        load_int(b, EAX, i->b,
+                 i->op == BC_I2F || i->op == BC_I2D   ? WIDTH_INT
+                 : i->op == BC_S2F || i->op == BC_S2D ? WIDTH_SHORT
+                                                      : WIDTH_BOOL);
+        EMIT(b, to_double ? 0xF2 : 0xF3, 0x0F, 0x2A, 0xC0); // cvtsi2ss/sd xmm0, eax
+        if (to_double)
+            MOVSD_STORE(b, XMM0, i->a);
+        else
+            MOVSS_STORE(b, XMM0, i->a);
+        break;
+    }
+    case BC_F2I:
+    case BC_F2S:
+    case BC_D2I:
+    case BC_D2S:
+        MEM(b, EAX, i->b, i->op == BC_F2I || i->op == BC_F2S ? 0xF3 : 0xF2, 0x0F, 0x2C); // cvttss/sd2si
+        store_int(b, EAX, i->a, i->op == BC_F2I || i->op == BC_D2I ? WIDTH_INT : WIDTH_SHORT);
+        break;
+    case BC_F2D:
+        MEM(b, XMM0, i->b, 0xF3, 0x0F, 0x5A); // cvtss2sd
+        MOVSD_STORE(b, XMM0, i->a);
+        break;
+    case BC_D2F:
+        MEM(b, XMM0, i->b, 0xF2, 0x0F, 0x5A); // cvtsd2ss
+        MOVSS_STORE(b, XMM0, i->a);
+        break;
+    case BC_F2B:
+        emit_float_to_bool(b, i, false);
+        break;
+    case BC_D2B:
+        emit_float_to_bool(b, i, true);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Array elements: the binding's storage and length are fixed, so both are
+ * immediates. An index out of bounds reports the error; a load then yields 0
+ * and a store does nothing. The element moves through ecx/rcx and lives at
+ * [rdx + rax * size]. */
+static void emit_array(CodeBuffer *b, const BytecodeProgram *program, const Instruction *i)
+{
+    bool store = i->op >= BC_STOREA_I;
+    const ArrayBinding *array = &program->arrays[store ? i->a : i->b];
+    uint16_t index = store ? i->b : i->c;
+    uint16_t value = store ? i->c : i->a;
+    Opcode kind = store ? (Opcode)(i->op - BC_STOREA_I + BC_LOADA_I) : (Opcode)i->op;
+
+    LOAD32(b, EAX, index);
+    EMIT(b, 0x3D); // cmp eax, length; unsigned, so negative indexes fail too
+    emit_u32(b, (uint32_t)array->length);
+    int in_bounds = jump8(b, 0x72);
+    CALL(b, index_out_of_bounds);
+    if (!store)
+        EMIT(b, 0x31, 0xC9); // xor ecx, ecx
+    int done = jump8(b, 0xEB);
+    land(b, in_bounds);
+    EMIT(b, 0x48, 0xBA); // movabs rdx, data
+    emit_u64(b, (uint64_t)(uintptr_t)array->data);
+
+    if (store)
+    {
+        switch (kind)
+        {
+        case BC_LOADA_I:
+        case BC_LOADA_F:
+            LOAD32(b, ECX, value);
+            EMIT(b, 0x89, 0x0C, 0x82); // mov [rdx+rax*4], ecx
+            break;
+        case BC_LOADA_S:
+            LOAD32(b, ECX, value);
+            EMIT(b, 0x66, 0x89, 0x0C, 0x42); // mov [rdx+rax*2], cx
+            break;
+        case BC_LOADA_D:
+            LOAD64(b, ECX, value);
+            EMIT(b, 0x48, 0x89, 0x0C, 0xC2); // mov [rdx+rax*8], rcx
+            break;
+        default:
+            LOAD32(b, ECX, value);
+            EMIT(b, 0x88, 0x0C, 0x02); // mov [rdx+rax], cl
+            break;
+        }
+        land(b, done);
+        return;
+    }
+
+    switch (kind)
+    {
+    case BC_LOADA_I:
+    case BC_LOADA_F:
+        EMIT(b, 0x8B, 0x0C, 0x82); // mov ecx, [rdx+rax*4]
+        land(b, done);
+        STORE32(b, ECX, value);
+        break;
+    case BC_LOADA_S:
+        EMIT(b, 0x0F, 0xBF, 0x0C, 0x42); // movsx ecx, word [rdx+rax*2]
+        land(b, done);
+        STORE16(b, ECX, value);
+        break;
+    case BC_LOADA_D:
+        EMIT(b, 0x48, 0x8B, 0x0C, 0xC2); // mov rcx, [rdx+rax*8]
+        land(b, done);
+        STORE64(b, ECX, value);
+        break;
+    case BC_LOADA_B:
+        EMIT(b, 0x0F, 0xB6, 0x0C, 0x02); // movzx ecx, byte [rdx+rax]
+        land(b, done);
+        STORE8(b, ECX, value);
+        break;
+    default:
+        EMIT(b, 0x0F, 0xBE, 0x0C, 0x02); // movsx ecx, byte [rdx+rax]
+        land(b, done);
+        STORE32(b, ECX, value);
+        break;
+    }
+}
+
+/* a[i] += k; a bad index is reported once, as execute_assignment() checks
+ * it before evaluating a[i] + k. */
+static void emit_accumulate(CodeBuffer *b, const BytecodeProgram *program, const Instruction *i)
+{
+    const ArrayBinding *array = &program->arrays[i->a];
+    LOAD32(b, EAX, i->b);
+    EMIT(b, 0x3D); // cmp eax, length
+    emit_u32(b, (uint32_t)array->length);
+    int in_bounds = jump8(b, 0x72);
+    CALL(b, index_out_of_bounds);
+    int done = jump8(b, 0xEB);
+    land(b, in_bounds);
+    EMIT(b, 0x48, 0xBA); // movabs rdx, data
+    emit_u64(b, (uint64_t)(uintptr_t)array->data);
+    LOAD32(b, ECX, i->c);
+    EMIT(b, 0x01, 0x0C, 0x82); // add [rdx+rax*4], ecx
+    land(b, done);
+}
+
+/* Compare-and-branch superinstructions; jl jg jle jge je jne in opcode order */
+static void emit_branch(Assembler *as, const Instruction *i, int pc)
+{
+    static const uint8_t jcc[] = {0x8C, 0x8F, 0x8E, 0x8D, 0x84, 0x85};
+    CodeBuffer *b = &as->code;
+    int target = jump_target(i, pc);
+    switch ((Opcode)i->op)
+    {
+    case BC_JMODZ_IK:
+    case BC_JMODNZ_IK:
+        LOAD32(b, EAX, i->a);
+        EMIT(b, 0xB9); // mov ecx, divisor
+        emit_u32(b, (uint32_t)(int32_t)(int16_t)i->b);
+        EMIT(b, 0x99, 0xF7, 0xF9, 0x85, 0xD2); // cdq; idiv ecx; test edx, edx
+        JUMP(as, target, 0x0F, i->op == BC_JMODZ_IK ? 0x84 : 0x85);
+        break;
+    case BC_JLT_IK: case BC_JGT_IK: case BC_JLE_IK:
+    case BC_JGE_IK: case BC_JEQ_IK: case BC_JNE_IK:
+        MEM(b, 7, i->a, 0x81); // cmp dword [a], imm32
+        emit_u32(b, (uint32_t)(int32_t)(int16_t)i->b);
+        JUMP(as, target, 0x0F, jcc[i->op - BC_JLT_IK]);
+        break;
+    default:
+        LOAD32(b, EAX, i->a);
+        MEM(b, EAX, i->b, 0x3B); // cmp eax, [b]
+        JUMP(as, target, 0x0F, jcc[i->op - BC_JLT_I]);
+        break;
+    }
+}
+
+/* Returns false for instructions that are side exits. */
+static bool emit_instruction(Assembler *as, const BytecodeProgram *program, const Instruction *i, int pc)
+{
+    CodeBuffer *b = &as->code;
+    switch ((Opcode)i->op)
+    {
+    case BC_MOVE:
+        LOAD64(b, EAX, i->b);
+        STORE64(b, EAX, i->a);
+        return true;
+    case BC_LOADI:
+        MEM(b, 0, i->a, 0xC7); // mov dword [a], imm32
+        emit_u32(b, (uint32_t)i->sbx);
+        return true;
+    case BC_LOADK:
+    {
+        uint64_t bits;
+        memcpy(&bits, &program->constants[i->sbx], sizeof(bits));
+        EMIT(b, 0x48, 0xB8); // movabs rax, constant
+        emit_u64(b, bits);
+        STORE64(b, EAX, i->a);
+        return true;
+    }
+
+    case BC_I2S: case BC_I2F: case BC_I2D: case BC_I2B:
+    case BC_S2I: case BC_S2F: case BC_S2D: case BC_S2B:
+    case BC_F2I: case BC_F2S: case BC_F2D: case BC_F2B:
+    case BC_D2I: case BC_D2S: case BC_D2F: case BC_D2B:
+    case BC_B2I: case BC_B2S: case BC_B2F: case BC_B2D:
+        emit_convert(b, i);
+        return true;
+
+#define INT_CASES(T, WIDTH)                                          \
+    case BC_ADD_##T:                                                 \
+        emit_int_arith(b, i, WIDTH, 0x01);                           \
+        return true;                                                 \
+    case BC_SUB_##T:                                                 \
+        emit_int_arith(b, i, WIDTH, 0x29);                           \
+        return true;                                                 \
+    case BC_MUL_##T:                                                 \
+        emit_int_arith(b, i, WIDTH, 0xAF);                           \
+        return true;                                                 \
+    case BC_DIV_##T:                                                 \
+        emit_divide(b, i, WIDTH, false, false, false);               \
+        return true;                                                 \
+    case BC_NEG_##T:                                                 \
+        load_int(b, EAX, i->b, WIDTH);                               \
+        EMIT(b, 0xF7, 0xD8); /* neg eax */                           \
+        store_int(b, EAX, i->a, WIDTH);                              \
+        return true;                                                 \
+    case BC_LT_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_L);                         \
+        return true;                                                 \
+    case BC_GT_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_G);                         \
+        return true;                                                 \
+    case BC_LE_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_LE);                        \
+        return true;                                                 \
+    case BC_GE_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_GE);                        \
+        return true;                                                 \
+    case BC_EQ_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_E);                         \
+        return true;                                                 \
+    case BC_NE_##T:                                                  \
+        emit_int_compare(b, i, WIDTH, CC_NE);                        \
+        return true;
+
+        INT_CASES(I, WIDTH_INT)
+        INT_CASES(S, WIDTH_SHORT)
+#undef INT_CASES
+
+    case BC_MOD_I:
+        emit_divide(b, i, WIDTH_INT, true, false, false);
+        return true;
+    case BC_UMOD_I:
+        emit_divide(b, i, WIDTH_INT, true, true, false);
+        return true;
+    case BC_MOD_S:
+        emit_divide(b, i, WIDTH_SHORT, true, false, true);
+        return true;
+
+#define FLOAT_CASES(T, PREFIX, CT)                                              \
+    case BC_ADD_##T:                                                            \
+        emit_float_arith(b, i, PREFIX, 0x58);                                   \
+        return true;                                                            \
+    case BC_SUB_##T:                                                            \
+        emit_float_arith(b, i, PREFIX, 0x5C);                                   \
+        return true;                                                            \
+    case BC_MUL_##T:                                                            \
+        emit_float_arith(b, i, PREFIX, 0x59);                                   \
+        return true;                                                            \
+    case BC_DIV_##T:                                                            \
+        emit_float_call(b, i, PREFIX, (uintptr_t)divide_##CT);                  \
+        return true;                                                            \
+    case BC_MOD_##T:                                                            \
+        emit_float_call(b, i, PREFIX, (uintptr_t)modulo_##CT);                  \
+        return true;                                                            \
+    case BC_LT_##T:                                                             \
+    case BC_GT_##T:                                                             \
+    case BC_LE_##T:                                                             \
+    case BC_GE_##T:                                                             \
+    case BC_EQ_##T:                                                             \
+    case BC_NE_##T:                                                             \
+        emit_float_compare(b, i, PREFIX == 0xF2,                                \
+                           (Opcode)(i->op - BC_LT_##T + BC_LT_F));              \
+        return true;
+
+        FLOAT_CASES(F, 0xF3, float)
+        FLOAT_CASES(D, 0xF2, double)
+#undef FLOAT_CASES
+
+    case BC_NEG_F:
+        LOAD32(b, EAX, i->b);
+        EMIT(b, 0x35, 0x00, 0x00, 0x00, 0x80); // xor eax, sign bit
+        STORE32(b, EAX, i->a);
+        return true;
+    case BC_NEG_D:
+        LOAD64(b, EAX, i->b);
+        EMIT(b, 0x48, 0x0F, 0xBA, 0xF8, 0x3F); // btc rax, 63
+        STORE64(b, EAX, i->a);
+        return true;
+    case BC_ADDI_I:
+        LOAD32(b, EAX, i->b);
+        EMIT(b, 0x05); // add eax, imm32
+        emit_u32(b, (uint32_t)(int32_t)(int16_t)i->c);
+        STORE32(b, EAX, i->a);
+        return true;
+    case BC_AND_I:
+    case BC_OR_I:
+        CMP32_ZERO(b, i->b);
+        EMIT(b, 0x0F, CC_NE, 0xC0); // setne al
+        CMP32_ZERO(b, i->c);
+        EMIT(b, 0x0F, CC_NE, 0xC1); // setne cl
+        EMIT(b, i->op == BC_AND_I ? 0x20 : 0x08, 0xC8, 0x0F, 0xB6, 0xC0); // and/or al, cl; movzx
+        STORE32(b, EAX, i->a);
+        return true;
+    case BC_NOT_B:
+        CMP8_ZERO(b, i->b);
+        EMIT(b, 0x0F, CC_E, 0xC0); // sete al
+        STORE8(b, EAX, i->a);
+        return true;
+
+    case BC_LOADA_I: case BC_LOADA_S: case BC_LOADA_F:
+    case BC_LOADA_D: case BC_LOADA_B: case BC_LOADA_C:
+    case BC_STOREA_I: case BC_STOREA_S: case BC_STOREA_F:
+    case BC_STOREA_D: case BC_STOREA_B: case BC_STOREA_C:
+        emit_array(b, program, i);
+        return true;
+
+    case BC_JMP:
+        JUMP(as, pc + 1 + i->sbx, 0xE9);
+        return true;
+    case BC_JMPF:
+    case BC_JMPT:
+        CMP32_ZERO(b, i->a);
+        JUMP(as, pc + 1 + i->sbx, 0x0F, i->op == BC_JMPF ? 0x84 : 0x85);
+        return true;
+    case BC_SWITCH:
+    {
+        // The jump goes through the native offset of the instruction the
+        // table picks, relative to the start of the code
+        EMIT(b, 0x48, 0xBF); // movabs rdi, table
+        emit_u64(b, (uint64_t)(uintptr_t)&program->jump_tables[i->b]);
+        LOAD32(b, 6, i->a); // mov esi, [a]
+        CALL(b, jump_table_target);
+        EMIT(b, 0x48, 0xB9); // movabs rcx, offsets
+        emit_u64(b, (uint64_t)(uintptr_t)as->offsets);
+        EMIT(b, 0x89, 0xC0); // mov eax, eax
+        EMIT(b, 0x8B, 0x04, 0x81); // mov eax, [rcx + rax*4]
+        EMIT(b, 0x48, 0x8D, 0x15); // lea rdx, [code]
+        emit_u32(b, (uint32_t)-(b->length + 4));
+        EMIT(b, 0x48, 0x01, 0xD0, 0xFF, 0xE0); // add rax, rdx; jmp rax
+        return true;
+    }
+    case BC_JLT_I: case BC_JGT_I: case BC_JLE_I:
+    case BC_JGE_I: case BC_JEQ_I: case BC_JNE_I:
+    case BC_JLT_IK: case BC_JGT_IK: case BC_JLE_IK:
+    case BC_JGE_IK: case BC_JEQ_IK: case BC_JNE_IK:
+    case BC_JMODZ_IK: case BC_JMODNZ_IK:
+        emit_branch(as, i, pc);
+        return true;
+    case BC_ADDA_I:
+        emit_accumulate(b, program, i);
+        return true;
+    case BC_CALL:
+        EMIT(b, 0x4C, 0x89, 0xE7, 0x48, 0x89, 0xDE); // mov rdi, r12; mov rsi, rbx
+        EMIT(b, 0x48, 0xBA);                         // movabs rdx, instruction
+        emit_u64(b, (uint64_t)(uintptr_t)i);
+        CALL(b, vm_call_from_native);
+        EMIT(b, 0x48, 0x89, 0xC3); // mov rbx, rax
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void free_assembler(Assembler *as)
+{
+    free(as->code.bytes);
+    free(as->fixups);
+}
+
+bool jit_compile(const BytecodeProgram *program, BytecodeFunction *function)
+{
+    function->jit_attempted = true;
+
+    Assembler as;
+    memset(&as, 0, sizeof(as));
+    CodeBuffer *b = &as.code;
+    uint32_t *offsets = malloc(((size_t)function->code_length + 1) * sizeof(uint32_t));
+    if (!offsets)
+        return false;
+    as.offsets = offsets;
+
+    // push rbx; push r12; push r13 (for alignment); mov rbx, rdi; mov r12, rsi; jmp rdx
+    EMIT(b, 0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0xFF, 0xE2);
+
+    for (int pc = 0; pc < function->code_length; pc++)
+    {
+        offsets[pc] = (uint32_t)b->length;
+        if (!emit_instruction(&as, program, &function->code[pc], pc))
+        {
+            EMIT(b, 0xB8); // mov eax, pc
+            emit_u32(b, (uint32_t)pc);
+            JUMP(&as, -1, 0xE9);
+        }
+    }
+
+    // Falling off the end cannot happen; the exit sequence follows anyway
+    int exit = b->length;
+    offsets[function->code_length] = (uint32_t)exit;
+    EMIT(b, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3); // pop r13; pop r12; pop rbx; ret
+
+    for (int n = 0; n < as.fixup_count; n++)
+    {
+        const Fixup *fixup = &as.fixups[n];
+        int target = fixup->target < 0 ? exit : (int)offsets[fixup->target];
+        int32_t rel = target - (fixup->at + 4);
+        memcpy(b->bytes + fixup->at, &rel, sizeof(rel));
+    }
+
+    size_t size = (size_t)b->length;
+    uint8_t *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+    {
+        free(offsets);
+        free_assembler(&as);
+        return false;
+    }
+    memcpy(code, b->bytes, size);
+    free_assembler(&as);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(code, size);
+        free(offsets);
+        return false;
+    }
+
+    NativeFunction *native = malloc(sizeof(NativeFunction));
+    if (!native)
+    {
+        munmap(code, size);
+        free(offsets);
+        return false;
+    }
+    native->code = code;
+    native->size = size;
+    native->offsets = offsets;
+    memcpy(&native->entry, &code, sizeof(native->entry));
+    function->native = native;
+    return true;
+}
+
+int jit_run(const NativeFunction *native, struct VMState *vm, Register *R, int pc)
+{
+    return native->entry(R, vm, native->code + native->offsets[pc]);
+}
+
+void jit_free(NativeFunction *native)
+{
+    if (!native)
+        return;
+    munmap(native->code, native->size);
+    free(native->offsets);
+    free(native);
+}
+
+#else
+
+/* No code generator for this platform: everything stays interpreted. */
+
+bool jit_compile(const BytecodeProgram *program, BytecodeFunction *function)
+{
+    (void)program;
+    function->jit_attempted = true;
+    return false;
+}
+
+int jit_run(const NativeFunction *native, struct VMState *vm, Register *R, int pc)
+{
+    (void)native;
+    (void)vm;
+    (void)R;
+    return pc;
+}
+
+void jit_free(NativeFunction *native)
+{
+    (void)native;
+}
+
+#endif
@@ -1,18 +1,61 @@
 %define parse.error verbose
+%define api.pure full
+%param {yyscan_t scanner}
+
+%code requires {
+#include "optimizer.h"
+
+/* The reentrant scanner's handle, as lex.yy.c declares it */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+}
+
+%code provides {
+typedef enum { ENGINE_VM, ENGINE_AST, ENGINE_CLOSURE } Engine;
+
+/* How brainrot_run() runs a program; the command line fills one in */
+typedef struct
+{
+    Engine engine;
+    OptimizerOptions optimizer;
+    unsigned fuse;             /* superinstruction shapes the compiler may use */
+    int jit_threshold;
+    bool dump_bytecode;
+    bool emit_c;               /* print the program as C instead of running it */
+    const char *native_output; /* build an executable here instead of running */
+    bool quicken_report;
+    bool stats_report;
+} RunOptions;
+
+/*
+ * Parses, optimizes and runs the program read from source in the context
+ * vm, which it makes current on the calling thread; its output goes to
+ * vm->out and its errors to vm->err. Separate contexts may run on separate
+ * threads at once. A runtime error or ragequit ends only this program.
+ * Returns the exit status; the caller still owns vm and destroys it.
+ */
+int brainrot_run(BrainrotVM *vm, FILE *source, const RunOptions *options);
+}
+
 %{
 #include "ast.h"
+#include "vm.h"
+#include "closure.h"
+#include "optimizer.h"
 #include "lib/mem.h"
 #include "lib/input.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <pthread.h>
 
-int yylex(void);
-int yylex_destroy(void);
-void yyerror(const char *s);
+void report_error(const char *s);
 void ragequit(int exit_code);
 void yapping(const char* format, ...);
 void yappin(const char* format, ...);
@@ -23,16 +66,7 @@ int slorp_int(int val);
 short slorp_short(short val);
 float slorp_float(float var);
 double slorp_double(double var);
-void cleanup();
-TypeModifiers get_variable_modifiers(const char* name);
-extern TypeModifiers current_modifiers;
-extern VarType current_var_type;
-
-extern int yylineno;
-extern FILE *yyin;
-
-/* Root of the AST */
-ASTNode *root = NULL;
+TypeModifiers get_variable_modifiers(ASTNode *node);
 %}
 
 %union {
@@ -49,8 +83,18 @@ ASTNode *root = NULL;
     Parameter *param;
 }
 
+%code {
+/* The reentrant scanner lex.yy.c defines */
+int yylex(YYSTYPE *yylval, yyscan_t scanner);
+int yylex_init_extra(BrainrotVM *vm, yyscan_t *scanner);
+void yyset_in(FILE *in, yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+
+void yyerror(yyscan_t scanner, const char *s);
+}
+
 /* Define token types */
-%token SKIBIDI RIZZ YAP BAKA MAIN BUSSIN FLEX CAP
+%token SKIBIDI RIZZ YAP BAKA MAIN BUSSIN FLEX SCHIZO_FLEX CAP
 %token PLUS MINUS TIMES DIVIDE MOD SEMICOLON COLON COMMA
 %token LPAREN RPAREN LBRACE RBRACE
 %token LT GT LE GE EQ NE EQUALS AND OR DEC INC
@@ -83,7 +127,7 @@ ASTNode *root = NULL;
 %type <node> return_statement
 %type <node> init_expr condition increment
 %type <node> if_statement
-%type <node> switch_statement break_statement
+%type <node> switch_statement break_statement continue_statement
 %type <case_node> case_list case_clause
 %type <node> binary_operation unary_operation parentheses
 %type <node> array_access
@@ -113,7 +157,7 @@ ASTNode *root = NULL;
 
 program
     : function_def_list skibidi_function
-        { root = create_statement_list($2, $1); }
+        { brainrot->root = create_statement_list($2, $1); }
     ;
 
 function_def_list
@@ -174,6 +218,8 @@ statement:
         { $$ = $1;  }
     | break_statement SEMICOLON
         { $$ = $1; }
+    | continue_statement SEMICOLON
+        { $$ = $1; }
     | expression SEMICOLON
         { $$ = $1; }
     ;
@@ -202,6 +248,11 @@ break_statement:
         { $$ = create_break_node(); }
     ;  
 
+continue_statement:
+    CONTINUE
+        { $$ = create_continue_node(); }
+    ;
+
 if_statement:
       IF LPAREN expression RPAREN LBRACE statements RBRACE %prec LOWER_THAN_ELSE
         { $$ = create_if_statement_node($3, $6, NULL); }
@@ -236,7 +287,7 @@ declaration:
             Variable *var = variable_new($3);
             add_variable_to_scope($3, var);
             if (!set_array_variable($3, $5, get_current_modifiers(), $2)) {
-                yyerror("Failed to create array");
+                report_error("Failed to create array");
                 SAFE_FREE($3);
                 YYABORT;
             }
@@ -292,15 +343,15 @@ optional_modifiers:
 
 modifier:
     VOLATILE
-        { current_modifiers.is_volatile = true; }
+        { brainrot->current_modifiers.is_volatile = true; }
     | SIGNED
-        { current_modifiers.is_signed = true; }
+        { brainrot->current_modifiers.is_signed = true; }
     | UNSIGNED 
-        { current_modifiers.is_unsigned = true; }
+        { brainrot->current_modifiers.is_unsigned = true; }
     | DEADASS
-        { current_modifiers.is_const = true; }
+        { brainrot->current_modifiers.is_const = true; }
     | CAP
-        { current_var_type = VAR_BOOL; } 
+        { brainrot->current_var_type = VAR_BOOL; } 
     ;
 
 for_statement:
@@ -308,6 +359,11 @@ for_statement:
         {
             $$ = create_for_statement_node($3, $5, $7, $10);
         }
+    | SCHIZO_FLEX LPAREN init_expr SEMICOLON condition SEMICOLON increment RPAREN LBRACE statements RBRACE
+        {
+            $$ = create_for_statement_node($3, $5, $7, $10);
+            $$->data.for_stmt.parallel = LOOP_SCHIZO;
+        }
     ;
 
 while_statement:
@@ -436,9 +492,9 @@ assignment:
             ASTNode *access = create_array_access_node($1, $3);
             ASTNode *node = ARENA_ALLOC(ASTNode);
             if (!node) {
-                yyerror("Memory allocation failed");
+                report_error("Memory allocation failed");
                 SAFE_FREE($1);
-                exit(EXIT_FAILURE);
+                brainrot_exit(EXIT_FAILURE);
             }
             node->type = NODE_ASSIGNMENT;
             node->data.op.left = access;
@@ -493,41 +549,249 @@ array_access:
 
 %%
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <sourcefile>\n", argv[0]);
-        return 1;
+int brainrot_run(BrainrotVM *vm, FILE *source, const RunOptions *options) {
+    brainrot = vm;
+    vm->bytecode = options->engine == ENGINE_VM || options->emit_c || options->native_output;
+    vm->translated = options->emit_c || options->native_output;
+
+    /* brainrot_exit() comes back here, so the process outlives the program */
+    BytecodeProgram *volatile program = NULL;
+    jmp_buf quit;
+    if (setjmp(quit)) {
+        free_bytecode_program(program);
+        vm->quit = NULL;
+        return vm->exit_status;
+    }
+    vm->quit = &quit;
+
+    yyscan_t scanner;
+    yylex_init_extra(vm, &scanner);
+    yyset_in(source, scanner);
+    int parsed = yyparse(scanner);
+    yylex_destroy(scanner);
+    ASTNode *root = vm->root;
+
+    if (parsed != 0) {
+        vm->quit = NULL;
+        return 0;
+    }
+    link_program(root);
+    optimize_program(root, &options->optimizer);
+
+    /* Run on the bytecode VM when the program compiles; anything the
+     * compiler cannot express falls back to the tree-walker. */
+    const char *reason = NULL;
+    if (vm->bytecode) {
+        program = compile_to_bytecode(root, options->fuse, &reason);
     }
+    if (options->dump_bytecode) {
+        if (program) {
+            dump_bytecode_program(vm->err, program);
+        } else if (reason) {
+            fprintf(vm->err, "bytecode: falling back to the tree-walker: %s\n", reason);
+        }
+    }
+    int status = 0;
+    if (options->emit_c || options->native_output) {
+        /* Translate instead of running; only bytecode can be translated. */
+        if (!program) {
+            fprintf(vm->err, "Cannot translate to C: %s\n", reason);
+            status = 1;
+        } else if (options->emit_c) {
+            emit_c_program(vm->out, program);
+        }
+        if (program && options->native_output && !build_native(program, options->native_output)) {
+            status = 1;
+        }
+    } else if (program) {
+        vm_execute(program, options->jit_threshold);
+        if (options->stats_report) {
+            fprintf(vm->err, "bounds checks: none eliminated; the bytecode VM checks every array access\n");
+        }
+    } else {
+        int frame_size = resolve_program(root);
+        execute_program(root, frame_size,
+                        options->engine == ENGINE_CLOSURE ? compile_closures(root) : NULL);
+        if (options->quicken_report) {
+            fprintf(vm->err, "quickening: %ld nodes specialized, %ld deoptimized\n",
+                    vm->quicken_stats.specialized, vm->quicken_stats.deoptimized);
+        }
+        if (options->stats_report) {
+            fprintf(vm->err, "bounds checks: %d of %d eliminated\n",
+                    vm->bounds_stats.unchecked, vm->bounds_stats.accesses);
+        }
+    }
+    free_bytecode_program(program);
+    vm->quit = NULL;
+    return status;
+}
 
-    FILE *source = fopen(argv[1], "r");
+/* One source file of the command line, run in a context of its own */
+typedef struct
+{
+    const char *path;
+    const RunOptions *options;
+    bool quicken;
+    bool relaxed_fp;
+    FILE *out;
+    FILE *err;
+    int status;
+} Job;
+
+static void *run_job(void *arg) {
+    Job *job = arg;
+    FILE *source = fopen(job->path, "r");
     if (!source) {
-        perror("Cannot open source file");
+        fprintf(job->err, "Cannot open source file: %s\n", strerror(errno));
+        job->status = 1;
+        return NULL;
+    }
+    BrainrotVM *vm = brainrot_create();
+    vm->quicken_enabled = job->quicken;
+    vm->relaxed_fp = job->relaxed_fp;
+    vm->out = job->out;
+    vm->err = job->err;
+    job->status = brainrot_run(vm, source, job->options);
+    fclose(source);
+    brainrot_destroy(vm);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    RunOptions options = {
+        .engine = ENGINE_VM,
+        .optimizer = {.level = OPT_DEFAULT_LEVEL},
+        .fuse = FUSE_ALL,
+        .jit_threshold = JIT_DEFAULT_THRESHOLD,
+    };
+    bool quicken = true;
+    bool relaxed_fp = false;
+    const char **paths = SAFE_MALLOC_ARRAY(const char *, argc);
+    int count = 0;
+    bool usage = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--engine=vm") == 0) {
+            options.engine = ENGINE_VM;
+        } else if (strcmp(argv[i], "--engine=ast") == 0) {
+            options.engine = ENGINE_AST;
+        } else if (strcmp(argv[i], "--engine=closure") == 0) {
+            options.engine = ENGINE_CLOSURE;
+        } else if (strcmp(argv[i], "--engine=jit") == 0) {
+            /* The VM with every function compiled to machine code on entry */
+            options.engine = ENGINE_VM;
+            options.jit_threshold = 0;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            options.jit_threshold = JIT_DISABLED;
+        } else if (strcmp(argv[i], "--no-superinstructions") == 0) {
+            options.fuse = 0;
+        } else if (strncmp(argv[i], "--no-superinstructions=", 23) == 0) {
+            /* Turns off only the listed shapes, for measuring them one by one */
+            unsigned disabled;
+            if (!parse_fuse_names(argv[i] + 23, &disabled)) {
+                fprintf(stderr, "Unknown superinstruction in %s\n", argv[i]);
+                SAFE_FREE(paths);
+                return 1;
+            }
+            options.fuse &= ~disabled;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' &&
+                   argv[i][2] <= '0' + OPT_MAX_LEVEL && argv[i][3] == '\0') {
+            options.optimizer.level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--opt-report") == 0) {
+            options.optimizer.report = true;
+        } else if (strncmp(argv[i], "--disable-pass=", 15) == 0) {
+            if (!disable_passes(argv[i] + 15, &options.optimizer.disabled)) {
+                fprintf(stderr, "Unknown pass in %s\n", argv[i]);
+                SAFE_FREE(paths);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-quicken") == 0) {
+            quicken = false;
+        } else if (strcmp(argv[i], "--quicken-stats") == 0) {
+            options.quicken_report = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats_report = true;
+        } else if (strcmp(argv[i], "--relaxed-fp") == 0) {
+            relaxed_fp = true;
+        } else if (strcmp(argv[i], "--dump-bytecode") == 0) {
+            options.dump_bytecode = true;
+        } else if (strcmp(argv[i], "--emit-c") == 0) {
+            options.emit_c = true;
+        } else if (strncmp(argv[i], "--native=", 9) == 0 && argv[i][9] != '\0') {
+            options.native_output = argv[i] + 9;
+        } else if (argv[i][0] != '-') {
+            paths[count++] = argv[i];
+        } else {
+            usage = true;
+            break;
+        }
+    }
+
+    /* A translation writes one program, so it takes one source file */
+    if (usage || count == 0 || (count > 1 && (options.emit_c || options.native_output))) {
+        fprintf(stderr, "Usage: %s [-O0|-O1|-O2] [--opt-report] [--disable-pass=<passes>] [--engine=vm|jit|ast|closure] [--no-jit] [--no-superinstructions[=<shapes>]] [--no-quicken] [--quicken-stats] [--stats] [--relaxed-fp] [--dump-bytecode] [--emit-c] [--native=<output>] <sourcefile>...\n", argv[0]);
+        SAFE_FREE(paths);
         return 1;
     }
 
-    yyin = source;
-    current_scope = create_scope(NULL);
+    Job *jobs = SAFE_CALLOC(count, Job);
+    for (int i = 0; i < count; i++) {
+        jobs[i] = (Job){paths[i], &options, quicken, relaxed_fp, stdout, stderr, 0};
+    }
+    if (count == 1) {
+        run_job(&jobs[0]);
+    } else {
+        /* Several programs run at once, each on its own thread; their
+         * output and errors are collected and printed in command-line
+         * order, followed by the status of each one that failed. */
+        pthread_t *threads = SAFE_MALLOC_ARRAY(pthread_t, count);
+        char **buffers = SAFE_CALLOC(2 * count, char *); // out, then err, of each job
+        size_t *sizes = SAFE_CALLOC(2 * count, size_t);
+        for (int i = 0; i < count; i++) {
+            jobs[i].out = open_memstream(&buffers[2 * i], &sizes[2 * i]);
+            jobs[i].err = open_memstream(&buffers[2 * i + 1], &sizes[2 * i + 1]);
+            pthread_create(&threads[i], NULL, run_job, &jobs[i]);
+        }
+        for (int i = 0; i < count; i++) {
+            pthread_join(threads[i], NULL);
+            fclose(jobs[i].out);
+            fclose(jobs[i].err);
+            fwrite(buffers[2 * i], 1, sizes[2 * i], stdout);
+            fflush(stdout);
+            fwrite(buffers[2 * i + 1], 1, sizes[2 * i + 1], stderr);
+            if (jobs[i].status != 0) {
+                fprintf(stderr, "%s: exited with status %d\n", jobs[i].path, jobs[i].status);
+            }
+            free(buffers[2 * i]);
+            free(buffers[2 * i + 1]);
+        }
+        SAFE_FREE(sizes);
+        SAFE_FREE(buffers);
+        SAFE_FREE(threads);
+    }
 
-    if (yyparse() == 0) {
-        execute_statement(root);
+    int status = 0;
+    for (int i = 0; i < count; i++) {
+        if (jobs[i].status != 0) {
+            status = jobs[i].status;
+        }
     }
+    SAFE_FREE(jobs);
+    SAFE_FREE(paths);
+    return status;
+}
 
-    fclose(source);
-    free_ast();
-    free_function_table();
-    free_scope(current_scope);
-    yylex_destroy();
-    
-    return 0;
+void yyerror(yyscan_t scanner, const char *s) {
+    (void)scanner;
+    report_error(s);
 }
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error: %s at line %d\n", s, yylineno - 1);
+void report_error(const char *s) {
+    fprintf(brainrot->err, "Error: %s at line %d\n", s, brainrot->line - 1);
 }
 
 void ragequit(int exit_code) {
-    cleanup();
-    exit(exit_code);
+    brainrot_exit(exit_code);
 }
 
 void chill(unsigned int seconds) {
@@ -537,22 +801,22 @@ void chill(unsigned int seconds) {
 void yapping(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    vfprintf(brainrot->out, format, args);
     va_end(args);
-    printf("\n");
+    fputc('\n', brainrot->out);
 }
 
 void yappin(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    vfprintf(brainrot->out, format, args);
     va_end(args);
 }
 
 void baka(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+    vfprintf(brainrot->err, format, args);
     va_end(args);
 }
 
@@ -566,13 +830,13 @@ char slorp_char(char chr) {
     }
     else if (status == INPUT_INVALID_LENGTH)
     {
-        fprintf(stderr, "Error: Invalid input length.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Invalid input length.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading char: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading char: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
 }
 
@@ -587,13 +851,13 @@ char *slorp_string(char *string, size_t size) {
     }
     else if (status == INPUT_BUFFER_OVERFLOW)
     {
-        fprintf(stderr, "Error: Input exceeded buffer size.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Input exceeded buffer size.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading string: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading string: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
 }
 
@@ -607,18 +871,18 @@ int slorp_int(int val) {
     }
     else if (status == INPUT_INTEGER_OVERFLOW)
     {
-        fprintf(stderr, "Error: Integer value out of range.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Integer value out of range.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else if (status == INPUT_CONVERSION_ERROR)
     {
-        fprintf(stderr, "Error: Invalid integer format.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Invalid integer format.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading integer: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading integer: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
     return 0;
 }
@@ -633,18 +897,18 @@ short slorp_short(short val) {
     }
     else if (status == INPUT_SHORT_OVERFLOW)
     {
-        fprintf(stderr, "Error: short value out of range.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: short value out of range.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else if (status == INPUT_CONVERSION_ERROR)
     {
-        fprintf(stderr, "Error: short integer format.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: short integer format.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading short: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading short: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
     return 0;
 }
@@ -659,18 +923,18 @@ float slorp_float(float var) {
     }
     else if (status == INPUT_FLOAT_OVERFLOW)
     {
-        fprintf(stderr, "Error: Double value out of range.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Double value out of range.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else if (status == INPUT_CONVERSION_ERROR)
     {
-        fprintf(stderr, "Error: Invalid float format.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Invalid float format.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading float: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading float: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
 }
 
@@ -684,39 +948,24 @@ double slorp_double(double var) {
     }
     else if (status == INPUT_DOUBLE_OVERFLOW)
     {
-        fprintf(stderr, "Error: Double value out of range.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Double value out of range.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else if (status == INPUT_CONVERSION_ERROR)
     {
-        fprintf(stderr, "Error: Invalid double format.\n");
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error: Invalid double format.\n");
+        brainrot_exit(EXIT_FAILURE);
     }
     else
     {
-        fprintf(stderr, "Error reading double: %d\n", status);
-        exit(EXIT_FAILURE);
+        fprintf(brainrot->err, "Error reading double: %d\n", status);
+        brainrot_exit(EXIT_FAILURE);
     }
 }
 
-void cleanup() {
-    // Free the AST
-    free_ast();
-    
-    // Free the scope
-    free_scope(current_scope);
-
-    free_function_table();
-
-    CLEAN_JUMP_BUFFER();
-    
-    // Clean up flex's internal state
-    yylex_destroy();
-}
-
-TypeModifiers get_variable_modifiers(const char* name) {
+TypeModifiers get_variable_modifiers(ASTNode *node) {
     TypeModifiers mods = {false, false, false, false, false};  // Default modifiers
-    Variable *var = get_variable(name); 
+    Variable *var = lookup_variable(node);
     if (var != NULL) {
         return var->modifiers;
     }
@@ -42,5 +42,22 @@ void *safe_calloc(size_t count, size_t size);
 #define SAFE_MALLOC_ARRAY(type, n) ((type *)safe_malloc_array((n), sizeof(type)))
 // Convenience macro for safer free usage
 #define SAFE_FREE(ptr) safe_free((void **)&(ptr), __FILE__, __LINE__, __func__)
+// Grows a malloc'd array so that ptr[count] can be written; the file
+// using it declares report_error()
+#define GROW_ARRAY(ptr, count, capacity)                                       \
+    do                                                                         \
+    {                                                                          \
+        if ((count) >= (capacity))                                             \
+        {                                                                      \
+            (capacity) = (capacity) ? (capacity) * 2 : 8;                      \
+            void *grown = realloc((ptr), (size_t)(capacity) * sizeof(*(ptr))); \
+            if (!grown)                                                        \
+            {                                                                  \
+                report_error("Memory allocation failed");                      \
+                exit(EXIT_FAILURE);                                            \
+            }                                                                  \
+            (ptr) = grown;                                                     \
+        }                                                                      \
+    } while (0)
 
 #endif
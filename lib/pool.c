@@ -0,0 +1,129 @@
+/**
+ * pool.c - A pool of worker threads for data-parallel loops
+ *
+ * The workers are started the first time a loop needs them and then wait
+ * for the next one. pool_run() queues its loop, runs its chunks one by
+ * one on the calling thread, and returns once every chunk is done; the
+ * workers meanwhile take chunks from the oldest queued loop. Programs on
+ * other threads that call pool_run() at the same time queue their loops
+ * behind it, and the workers move on to them as the earlier loops run out
+ * of chunks.
+ */
+
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* One pool_run() call, on its caller's stack until it returns */
+typedef struct Loop
+{
+    PoolTask task;
+    void *context;
+    int chunks;
+    int next;     /* first chunk nobody has taken */
+    int finished; /* chunks whose task has returned */
+    struct Loop *following;
+} Loop;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t start; /* a loop was queued */
+    pthread_cond_t done;  /* a loop finished its last chunk */
+    int threads;          /* workers plus the caller; 0 until started */
+    Loop *queue;          /* loops with chunks nobody has taken, oldest first */
+} Pool;
+
+static Pool pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .start = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+
+/**
+ * Takes the next chunk of loop and runs it, dropping the loop from the
+ * queue once its last chunk is taken.
+ * Called with the lock held; returns with it held.
+ */
+static void run_chunk(Loop *loop)
+{
+    int chunk = loop->next++;
+    if (loop->next == loop->chunks)
+    {
+        Loop **link = &pool.queue;
+        while (*link != loop)
+            link = &(*link)->following;
+        *link = loop->following;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    loop->task(loop->context, chunk);
+    pthread_mutex_lock(&pool.lock);
+    if (++loop->finished == loop->chunks)
+        pthread_cond_broadcast(&pool.done);
+}
+
+static void *worker(void *unused)
+{
+    (void)unused;
+    pthread_mutex_lock(&pool.lock);
+    for (;;)
+    {
+        while (!pool.queue)
+            pthread_cond_wait(&pool.start, &pool.lock);
+        run_chunk(pool.queue);
+    }
+    return NULL;
+}
+
+static void start_workers(void)
+{
+    const char *setting = getenv("BRAINROT_THREADS");
+    long threads = setting ? strtol(setting, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    if (threads > POOL_MAX_THREADS)
+        threads = POOL_MAX_THREADS;
+    pool.threads = 1;
+    for (long t = 1; t < threads; t++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+        pool.threads++;
+    }
+}
+
+/**
+ * @brief The threads pool_run() spreads chunks over, the caller included:
+ * BRAINROT_THREADS if set, otherwise one per online processor.
+ */
+int pool_threads(void)
+{
+    pthread_once(&started, start_workers);
+    return pool.threads;
+}
+
+/**
+ * @brief Runs task(context, chunk) for every chunk from 0 to chunks - 1,
+ * spread over the pool's threads, and waits for all of them.
+ * @param chunks The number of chunks.
+ * @param task Called once per chunk, possibly on several threads at once.
+ * @param context Passed to every call.
+ */
+void pool_run(int chunks, PoolTask task, void *context)
+{
+    if (chunks <= 0)
+        return;
+    pthread_once(&started, start_workers);
+    Loop loop = {task, context, chunks, 0, 0, NULL};
+    pthread_mutex_lock(&pool.lock);
+    Loop **link = &pool.queue;
+    while (*link)
+        link = &(*link)->following;
+    *link = &loop;
+    pthread_cond_broadcast(&pool.start);
+    while (loop.next < loop.chunks)
+        run_chunk(&loop);
+    while (loop.finished < loop.chunks)
+        pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,16 @@
+/* pool.h */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+
+/* Upper bound on the threads a pool runs, the caller included */
+#define POOL_MAX_THREADS 64
+
+typedef void (*PoolTask)(void *context, int chunk);
+
+int pool_threads(void);
+void pool_run(int chunks, PoolTask task, void *context);
+
+#endif
@@ -0,0 +1,840 @@
+/* licm.c */
+
+#include "optimizer.h"
+
+extern void report_error(const char *s);
+
+/*
+ * Loop-invariant code motion.
+ *
+ * An int expression inside a flex or goon loop whose variables the loop
+ * never writes is computed once, into a temporary declared just before
+ * the loop, and the loop reads the temporary instead, so `i < N - 1`
+ * subtracts once rather than on every test. Inner loops are done first,
+ * so what they hoist into an outer loop's body can be hoisted on out of
+ * that loop too.
+ *
+ * A variable counts as written if the loop (its init and step included)
+ * assigns or declares a variable of that name, steps one with ++/--, or
+ * reads one with slorp. Calls do not count: a function only sees its own
+ * variables.
+ *
+ * Only expressions the loop evaluates anyway are moved, so a temporary
+ * never computes what the program would not: those in the loop's test,
+ * which runs at least once, and those the body reaches on every
+ * iteration, outside branches and inner loop bodies and before anything
+ * that can end the iteration early. Unless the loop's literal bounds show
+ * the body runs, the pre-header only computes the body's temporaries
+ * under an edgy on the loop's first test, which must compare variables
+ * and literals, so it cannot fail either; the loop reads them only after
+ * passing that test. Of those expressions, only +, - and * of ints and /
+ * and % by a literal other than 0 and -1 are moved.
+ *
+ * A variable is an int if every declaration of its name in the function
+ * is a rizz and every value the function gives it is an int, since an
+ * assignment of a float or double retypes it. The temporary is a plain
+ * rizz, so it only replaces an expression where the parent takes the
+ * value as an int anyway: an operand next to another int, an array
+ * index, or the value stored into a rizz.
+ */
+
+/* How the parent takes an expression's value */
+typedef enum
+{
+    TAKE_INT,   /* as an int: next to another int operand, index or rizz value */
+    TAKE_OTHER, /* any other way */
+} Take;
+
+typedef struct
+{
+    const char *name;
+    bool is_int; /* a signed rizz scalar */
+} Binding;
+
+typedef struct
+{
+    Binding *bindings;
+    int binding_count;
+    int binding_capacity;
+    int loop_bindings; /* bindings visible before the loop being hoisted out of, -1 if none */
+    const char **written;
+    int written_count;
+    int written_capacity;
+    const char **ints; /* variables the function keeps int, by name */
+    int int_count;
+    int int_capacity;
+    bool runs;         /* what is being visited runs on every iteration of the loop hoisted out of */
+    StatementList *preheader; /* temporaries for the loop, in order */
+    StatementList *preheader_last;
+    StatementList *guarded;   /* assignments of the temporaries that need the loop's first test */
+    StatementList *guarded_last;
+    bool in_guard;            /* what is being visited runs only once the first test passed */
+    ASTNode *guard;           /* that test */
+    int temps;
+    int changes;
+} Hoister;
+
+static void declare(Hoister *h, const char *name, bool is_int)
+{
+    GROW_ARRAY(h->bindings, h->binding_count, h->binding_capacity);
+    h->bindings[h->binding_count++] = (Binding){name, is_int};
+}
+
+/* Index of the binding a name refers to, -1 if it has none */
+static int lookup(const Hoister *h, const char *name)
+{
+    for (int i = h->binding_count - 1; i >= 0; i--)
+    {
+        if (strcmp(h->bindings[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool is_int_declaration(const ASTNode *node)
+{
+    return node->var_type == VAR_INT && !node->modifiers.is_unsigned;
+}
+
+static int find_name(const char **names, int count, const char *name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool keeps_int(const Hoister *h, const char *name)
+{
+    return find_name(h->ints, h->int_count, name) >= 0;
+}
+
+static bool is_arithmetic(OperatorType op)
+{
+    return op == OP_PLUS || op == OP_MINUS || op == OP_TIMES || op == OP_DIVIDE || op == OP_MOD;
+}
+
+/* Whether the value is an int for certain, given the variables still
+ * believed to keep int */
+static bool is_int_value(const Hoister *h, const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_SIZEOF:
+        return true;
+    case NODE_IDENTIFIER:
+        return keeps_int(h, node->data.name);
+    case NODE_OPERATION:
+        return is_arithmetic(node->data.op.op) && !node->modifiers.is_unsigned &&
+               is_int_value(h, node->data.op.left) && is_int_value(h, node->data.op.right);
+    case NODE_UNARY_OPERATION:
+        return is_int_value(h, node->data.unary.operand);
+    default:
+        return false;
+    }
+}
+
+static void drop_int(Hoister *h, const char *name)
+{
+    int i = find_name(h->ints, h->int_count, name);
+    if (i >= 0)
+        h->ints[i] = h->ints[--h->int_count];
+}
+
+/* With `collect`, gathers the names declared as signed rizz scalars;
+ * otherwise drops those some declaration or assignment gives another type. */
+static void find_ints(Hoister *h, const ASTNode *node, bool collect)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            find_ints(h, entry->statement, collect);
+        break;
+    case NODE_DECLARATION:
+    {
+        const char *name = node->data.op.left->data.name;
+        if (collect && is_int_declaration(node) && !keeps_int(h, name))
+        {
+            GROW_ARRAY(h->ints, h->int_count, h->int_capacity);
+            h->ints[h->int_count++] = name;
+        }
+        else if (!collect && (!is_int_declaration(node) || !is_int_value(h, node->data.op.right)))
+            drop_int(h, name);
+        break;
+    }
+    case NODE_ARRAY_ACCESS:
+        if (!collect)
+            drop_int(h, node->data.array.name);
+        break;
+    case NODE_ASSIGNMENT:
+        if (!collect && node->data.op.left->type == NODE_IDENTIFIER &&
+            (node->var_type == VAR_FLOAT || node->var_type == VAR_DOUBLE || !is_int_value(h, node->data.op.right)))
+            drop_int(h, node->data.op.left->data.name);
+        break;
+    case NODE_FOR_STATEMENT:
+        find_ints(h, node->data.for_stmt.init, collect);
+        find_ints(h, node->data.for_stmt.incr, collect);
+        find_ints(h, node->data.for_stmt.body, collect);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        find_ints(h, node->data.while_stmt.body, collect);
+        break;
+    case NODE_IF_STATEMENT:
+        find_ints(h, node->data.if_stmt.then_branch, collect);
+        find_ints(h, node->data.if_stmt.else_branch, collect);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            find_ints(h, entry->statements, collect);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Whether the statement can leave the iteration it runs in, and so keep
+ * what follows it from running, when `loop` is false: a bussin, a call
+ * (which can ragequit), or a bruh or grind that is not inside an inner
+ * loop or, for bruh, an inner ohio. */
+static bool ends_iteration(const ASTNode *node, bool loop, bool in_switch)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_RETURN:
+        return true;
+    case NODE_BREAK_STATEMENT:
+        return !loop && !in_switch;
+    case NODE_CONTINUE_STATEMENT:
+        return !loop;
+    case NODE_FUNC_CALL:
+        if (node->data.func_call.builtin == BUILTIN_NONE || node->data.func_call.builtin == BUILTIN_RAGEQUIT)
+            return true;
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (ends_iteration(arg->expr, loop, in_switch))
+                return true;
+        }
+        return false;
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+        {
+            if (ends_iteration(entry->statement, loop, in_switch))
+                return true;
+        }
+        return false;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+    case NODE_OPERATION:
+        return ends_iteration(node->data.op.left, loop, in_switch) ||
+               ends_iteration(node->data.op.right, loop, in_switch);
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        return ends_iteration(node->data.op.left, loop, in_switch);
+    case NODE_UNARY_OPERATION:
+        return ends_iteration(node->data.unary.operand, loop, in_switch);
+    case NODE_ARRAY_ACCESS:
+        return ends_iteration(node->data.array.index, loop, in_switch);
+    case NODE_FOR_STATEMENT:
+        return ends_iteration(node->data.for_stmt.init, loop, in_switch) ||
+               ends_iteration(node->data.for_stmt.cond, loop, in_switch) ||
+               ends_iteration(node->data.for_stmt.incr, true, in_switch) ||
+               ends_iteration(node->data.for_stmt.body, true, in_switch);
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        return ends_iteration(node->data.while_stmt.cond, loop, in_switch) ||
+               ends_iteration(node->data.while_stmt.body, true, in_switch);
+    case NODE_IF_STATEMENT:
+        return ends_iteration(node->data.if_stmt.condition, loop, in_switch) ||
+               ends_iteration(node->data.if_stmt.then_branch, loop, in_switch) ||
+               ends_iteration(node->data.if_stmt.else_branch, loop, in_switch);
+    case NODE_SWITCH_STATEMENT:
+        if (ends_iteration(node->data.switch_stmt.expression, loop, in_switch))
+            return true;
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            if (ends_iteration(entry->statements, loop, true))
+                return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+static bool is_leaf(const ASTNode *node)
+{
+    return node->type == NODE_INT || node->type == NODE_IDENTIFIER;
+}
+
+static bool is_comparison(const ASTNode *node)
+{
+    if (node->type != NODE_OPERATION || node->modifiers.is_unsigned)
+        return false;
+    OperatorType op = node->data.op.op;
+    return op == OP_LT || op == OP_LE || op == OP_GT || op == OP_GE || op == OP_EQ || op == OP_NE;
+}
+
+static ASTNode *copy_leaf(const ASTNode *node)
+{
+    ASTNode *copy = ARENA_ALLOC(ASTNode);
+    *copy = *node;
+    return copy;
+}
+
+/* The loop's first test as an expression of its own, to run before the
+ * loop: a comparison of two variables or literals, with a flex counter
+ * replaced by its initial value. NULL if the test is not of that form. */
+static ASTNode *first_test(const ASTNode *node)
+{
+    const ASTNode *cond = node->type == NODE_FOR_STATEMENT ? node->data.for_stmt.cond : node->data.while_stmt.cond;
+    if (!cond || !is_comparison(cond) || !is_leaf(cond->data.op.left) || !is_leaf(cond->data.op.right))
+        return NULL;
+    const ASTNode *left = cond->data.op.left;
+    const ASTNode *right = cond->data.op.right;
+    if (node->type == NODE_FOR_STATEMENT)
+    {
+        const ASTNode *init = node->data.for_stmt.init;
+        if (!init || (init->type != NODE_DECLARATION && init->type != NODE_ASSIGNMENT) ||
+            init->data.op.left->type != NODE_IDENTIFIER || !is_leaf(init->data.op.right) ||
+            left->type != NODE_IDENTIFIER || strcmp(left->data.name, init->data.op.left->data.name) != 0 ||
+            (right->type == NODE_IDENTIFIER && strcmp(right->data.name, left->data.name) == 0))
+            return NULL;
+        left = init->data.op.right;
+    }
+    ASTNode *test = create_operation_node(cond->data.op.op, copy_leaf(left), copy_leaf(right));
+    test->modifiers = (TypeModifiers){0};
+    return test;
+}
+
+/* Whether the loop's literal bounds show it runs its body at least once */
+static bool enters_body(const ASTNode *node)
+{
+    if (node->type == NODE_WHILE_STATEMENT)
+    {
+        const ASTNode *cond = node->data.while_stmt.cond;
+        return cond && cond->type == NODE_INT && cond->data.ivalue != 0;
+    }
+
+    const ASTNode *init = node->data.for_stmt.init;
+    const ASTNode *cond = node->data.for_stmt.cond;
+    if (!init || (init->type != NODE_DECLARATION && init->type != NODE_ASSIGNMENT) ||
+        init->data.op.left->type != NODE_IDENTIFIER || init->data.op.right->type != NODE_INT ||
+        !cond || cond->type != NODE_OPERATION || cond->data.op.left->type != NODE_IDENTIFIER ||
+        cond->data.op.right->type != NODE_INT || cond->modifiers.is_unsigned ||
+        strcmp(cond->data.op.left->data.name, init->data.op.left->data.name) != 0)
+        return false;
+    int start = init->data.op.right->data.ivalue;
+    int bound = cond->data.op.right->data.ivalue;
+    switch (cond->data.op.op)
+    {
+    case OP_LT:
+        return start < bound;
+    case OP_LE:
+        return start <= bound;
+    case OP_GT:
+        return start > bound;
+    case OP_GE:
+        return start >= bound;
+    case OP_NE:
+        return start != bound;
+    default:
+        return false;
+    }
+}
+
+static bool is_written(const Hoister *h, const char *name)
+{
+    return find_name(h->written, h->written_count, name) >= 0;
+}
+
+static void mark_written(Hoister *h, const ASTNode *variable)
+{
+    if (!variable || (variable->type != NODE_IDENTIFIER && variable->type != NODE_ARRAY_ACCESS))
+        return;
+    const char *name = variable->type == NODE_IDENTIFIER ? variable->data.name : variable->data.array.name;
+    if (is_written(h, name))
+        return;
+    GROW_ARRAY(h->written, h->written_count, h->written_capacity);
+    h->written[h->written_count++] = name;
+}
+
+/* Collects the names of the variables anything under `node` writes. */
+static void find_writes(Hoister *h, const ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            find_writes(h, entry->statement);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+        mark_written(h, node->data.op.left);
+        find_writes(h, node->data.op.left);
+        find_writes(h, node->data.op.right);
+        break;
+    case NODE_OPERATION:
+        find_writes(h, node->data.op.left);
+        find_writes(h, node->data.op.right);
+        break;
+    case NODE_RETURN:
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        find_writes(h, node->data.op.left);
+        break;
+    case NODE_UNARY_OPERATION:
+        if (node->data.unary.op != OP_NEG)
+            mark_written(h, node->data.unary.operand);
+        find_writes(h, node->data.unary.operand);
+        break;
+    case NODE_ARRAY_ACCESS:
+        find_writes(h, node->data.array.index);
+        break;
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (node->data.func_call.builtin == BUILTIN_SLORP)
+                mark_written(h, arg->expr);
+            find_writes(h, arg->expr);
+        }
+        break;
+    case NODE_FOR_STATEMENT:
+        find_writes(h, node->data.for_stmt.init);
+        find_writes(h, node->data.for_stmt.cond);
+        find_writes(h, node->data.for_stmt.incr);
+        find_writes(h, node->data.for_stmt.body);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        find_writes(h, node->data.while_stmt.cond);
+        find_writes(h, node->data.while_stmt.body);
+        break;
+    case NODE_IF_STATEMENT:
+        find_writes(h, node->data.if_stmt.condition);
+        find_writes(h, node->data.if_stmt.then_branch);
+        find_writes(h, node->data.if_stmt.else_branch);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        find_writes(h, node->data.switch_stmt.expression);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            find_writes(h, entry->statements);
+        break;
+    default:
+        break;
+    }
+}
+
+static bool is_int_expression(const Hoister *h, const ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+        return true;
+    case NODE_IDENTIFIER:
+    {
+        int binding = lookup(h, node->data.name);
+        return binding >= 0 && h->bindings[binding].is_int;
+    }
+    case NODE_OPERATION:
+        return is_arithmetic(node->data.op.op) && !node->modifiers.is_unsigned &&
+               is_int_expression(h, node->data.op.left) && is_int_expression(h, node->data.op.right);
+    default:
+        return false;
+    }
+}
+
+/* True if the expression has the same value on every iteration, cannot
+ * fail, and reads at least one variable (literal trees are fold's). */
+static bool is_invariant(const Hoister *h, const ASTNode *node, bool *reads)
+{
+    switch (node->type)
+    {
+    case NODE_INT:
+        return true;
+    case NODE_IDENTIFIER:
+        *reads = true;
+        return lookup(h, node->data.name) < h->loop_bindings && !is_written(h, node->data.name);
+    case NODE_OPERATION:
+    {
+        const ASTNode *right = node->data.op.right;
+        if ((node->data.op.op == OP_DIVIDE || node->data.op.op == OP_MOD) &&
+            (right->type != NODE_INT || right->data.ivalue == 0 || right->data.ivalue == -1))
+            return false;
+        return is_invariant(h, node->data.op.left, reads) && is_invariant(h, right, reads);
+    }
+    default:
+        return false;
+    }
+}
+
+static bool same_expression(const ASTNode *a, const ASTNode *b)
+{
+    if (a->type != b->type)
+        return false;
+    switch (a->type)
+    {
+    case NODE_INT:
+        return a->data.ivalue == b->data.ivalue;
+    case NODE_IDENTIFIER:
+        return strcmp(a->data.name, b->data.name) == 0;
+    case NODE_OPERATION:
+        return a->data.op.op == b->data.op.op && same_expression(a->data.op.left, b->data.op.left) &&
+               same_expression(a->data.op.right, b->data.op.right);
+    default:
+        return false;
+    }
+}
+
+/* Moves the expression into a temporary of the loop's pre-header, or
+ * reuses the one an identical expression went into, and turns the node
+ * into a read of it. */
+static void append(StatementList **first, StatementList **last, ASTNode *statement)
+{
+    StatementList *entry = ARENA_ALLOC(StatementList);
+    entry->statement = statement;
+    entry->next = NULL;
+    if (*last)
+        (*last)->next = entry;
+    else
+        *first = entry;
+    *last = entry;
+}
+
+/* Name of the temporary an identical expression went into, NULL if none;
+ * a guarded one only serves what also runs after the first test. */
+static const char *find_temp(const Hoister *h, const ASTNode *node)
+{
+    for (StatementList *entry = h->preheader; entry; entry = entry->next)
+    {
+        if (same_expression(entry->statement->data.op.right, node))
+            return entry->statement->data.op.left->data.name;
+    }
+    for (StatementList *entry = h->in_guard ? h->guarded : NULL; entry; entry = entry->next)
+    {
+        if (same_expression(entry->statement->data.op.right, node))
+            return entry->statement->data.op.left->data.name;
+    }
+    return NULL;
+}
+
+static ASTNode *int_store(ASTNode *store)
+{
+    store->var_type = VAR_INT;
+    store->modifiers = (TypeModifiers){0};
+    store->data.op.left->modifiers = (TypeModifiers){0};
+    return store;
+}
+
+static void hoist(Hoister *h, ASTNode *node)
+{
+    const char *name = find_temp(h, node);
+    if (!name)
+    {
+        char temp[32];
+        snprintf(temp, sizeof(temp), "licm.%d", h->temps++);
+        ASTNode *value = ARENA_ALLOC(ASTNode);
+        *value = *node;
+        ASTNode *declaration;
+        if (h->in_guard)
+        {
+            ASTNode *zero = create_int_node(0);
+            zero->modifiers = (TypeModifiers){0};
+            declaration = int_store(create_declaration_node(temp, zero));
+            append(&h->guarded, &h->guarded_last, int_store(create_assignment_node(temp, value)));
+        }
+        else
+        {
+            declaration = int_store(create_declaration_node(temp, value));
+        }
+        append(&h->preheader, &h->preheader_last, declaration);
+        name = declaration->data.op.left->data.name;
+        GROW_ARRAY(h->ints, h->int_count, h->int_capacity);
+        h->ints[h->int_count++] = name;
+    }
+
+    ASTNode *read = create_identifier_node((char *)name);
+    read->modifiers = (TypeModifiers){0};
+    *node = *read;
+    h->changes++;
+}
+
+static void visit_expression(Hoister *h, ASTNode *node, Take take)
+{
+    if (!node)
+        return;
+    bool reads = false;
+    if (h->loop_bindings >= 0 && h->runs && take == TAKE_INT && node->type == NODE_OPERATION &&
+        is_int_expression(h, node) && is_invariant(h, node, &reads) && reads)
+    {
+        hoist(h, node);
+        return;
+    }
+
+    switch (node->type)
+    {
+    case NODE_OPERATION:
+    {
+        ASTNode *left = node->data.op.left;
+        ASTNode *right = node->data.op.right;
+        bool int_operands = node->data.op.op != OP_AND && node->data.op.op != OP_OR &&
+                            !node->modifiers.is_unsigned;
+        visit_expression(h, left, int_operands && is_int_expression(h, right) ? TAKE_INT : TAKE_OTHER);
+        visit_expression(h, right, int_operands && is_int_expression(h, left) ? TAKE_INT : TAKE_OTHER);
+        break;
+    }
+    case NODE_UNARY_OPERATION:
+        if (node->data.unary.op == OP_NEG)
+            visit_expression(h, node->data.unary.operand, TAKE_OTHER);
+        break;
+    case NODE_ARRAY_ACCESS:
+        visit_expression(h, node->data.array.index, TAKE_INT);
+        break;
+    case NODE_FUNC_CALL:
+        if (node->data.func_call.builtin == BUILTIN_SLORP)
+            break;
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+            visit_expression(h, arg->expr, TAKE_OTHER);
+        break;
+    default:
+        break;
+    }
+}
+
+static void visit_statement(Hoister *h, ASTNode *node);
+
+/* Whether the body of the loop, entered after its test, runs on every
+ * iteration of the loop hoisted out of: it must be that loop, behind its
+ * first test if need be, or an inner loop sure to run its body. */
+static void enter_body(Hoister *h, const ASTNode *node, bool inner)
+{
+    if (enters_body(node))
+        return;
+    if (inner || h->loop_bindings < 0)
+        h->runs = false;
+    else if ((h->guard = first_test(node)))
+        h->in_guard = true;
+    else
+        h->runs = false;
+}
+
+/* The scopes a loop opens, as the resolver opens them. */
+static void visit_loop(Hoister *h, ASTNode *node, bool with_init)
+{
+    int outer = h->binding_count;
+    bool runs = h->runs;
+    bool in_guard = h->in_guard;
+    if (node->type == NODE_FOR_STATEMENT)
+    {
+        /* The init runs once either way */
+        int loop_bindings = h->loop_bindings;
+        if (!with_init)
+            h->loop_bindings = -1;
+        visit_statement(h, node->data.for_stmt.init);
+        h->loop_bindings = loop_bindings;
+        int inner = h->binding_count;
+        visit_expression(h, node->data.for_stmt.cond, TAKE_OTHER);
+        enter_body(h, node, with_init);
+        visit_statement(h, node->data.for_stmt.body);
+        visit_statement(h, node->data.for_stmt.incr);
+        h->binding_count = inner;
+    }
+    else
+    {
+        visit_expression(h, node->data.while_stmt.cond, TAKE_OTHER);
+        int inner = h->binding_count;
+        enter_body(h, node, with_init);
+        visit_statement(h, node->data.while_stmt.body);
+        h->binding_count = inner;
+    }
+    h->binding_count = outer;
+    h->runs = runs;
+    h->in_guard = in_guard;
+}
+
+/* Hoists out of a loop what can be, after its inner loops; returns the
+ * temporaries to declare before it. */
+static StatementList *hoist_loop(Hoister *h, ASTNode *node)
+{
+    visit_loop(h, node, true);
+
+    h->written_count = 0;
+    find_writes(h, node);
+    h->loop_bindings = h->binding_count;
+    h->preheader = h->preheader_last = NULL;
+    h->guarded = h->guarded_last = NULL;
+    h->runs = true;
+    visit_loop(h, node, false);
+    h->loop_bindings = -1;
+
+    if (h->guarded)
+    {
+        ASTNode *assignments = create_statement_list(h->guarded->statement, NULL);
+        assignments->data.statements->next = h->guarded->next;
+        append(&h->preheader, &h->preheader_last, create_if_statement_node(h->guard, assignments, NULL));
+    }
+    return h->preheader;
+}
+
+static void visit_list(Hoister *h, ASTNode *list)
+{
+    StatementList **link = &list->data.statements;
+    while (*link)
+    {
+        StatementList *entry = *link;
+        ASTNode *node = entry->statement;
+        if (h->loop_bindings < 0 && node &&
+            (node->type == NODE_FOR_STATEMENT || node->type == NODE_WHILE_STATEMENT))
+        {
+            StatementList *preheader = hoist_loop(h, node);
+            for (; preheader; preheader = preheader->next)
+            {
+                if (preheader->statement->type == NODE_DECLARATION)
+                    declare(h, preheader->statement->data.op.left->data.name, true);
+                *link = preheader;
+                link = &preheader->next;
+            }
+            *link = entry;
+        }
+        else
+        {
+            bool runs = h->runs;
+            visit_statement(h, node);
+            h->runs = runs && !ends_iteration(node, false, false);
+        }
+        link = &entry->next;
+    }
+}
+
+static void visit_statement(Hoister *h, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        visit_list(h, node);
+        break;
+    case NODE_DECLARATION:
+    {
+        /* The variable exists before its initializer is evaluated */
+        bool is_int = is_int_declaration(node) && keeps_int(h, node->data.op.left->data.name);
+        declare(h, node->data.op.left->data.name, is_int);
+        visit_expression(h, node->data.op.right, is_int ? TAKE_INT : TAKE_OTHER);
+        break;
+    }
+    case NODE_ARRAY_ACCESS:
+        declare(h, node->data.array.name, false);
+        break;
+    case NODE_ASSIGNMENT:
+    {
+        ASTNode *target = node->data.op.left;
+        if (target->type == NODE_ARRAY_ACCESS)
+        {
+            visit_expression(h, target, TAKE_OTHER);
+            visit_expression(h, node->data.op.right, TAKE_OTHER);
+        }
+        else
+        {
+            visit_expression(h, node->data.op.right,
+                             is_int_expression(h, target) ? TAKE_INT : TAKE_OTHER);
+        }
+        break;
+    }
+    case NODE_OPERATION:
+    case NODE_UNARY_OPERATION:
+    case NODE_FUNC_CALL:
+        visit_expression(h, node, TAKE_OTHER);
+        break;
+    case NODE_RETURN:
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        visit_expression(h, node->data.op.left, TAKE_OTHER);
+        break;
+    case NODE_FOR_STATEMENT:
+    case NODE_WHILE_STATEMENT:
+        visit_loop(h, node, true);
+        break;
+    case NODE_DO_WHILE_STATEMENT:
+    {
+        /* The body runs at least once */
+        int outer = h->binding_count;
+        visit_statement(h, node->data.while_stmt.body);
+        h->binding_count = outer;
+        visit_expression(h, node->data.while_stmt.cond, TAKE_OTHER);
+        break;
+    }
+    case NODE_IF_STATEMENT:
+    {
+        int outer = h->binding_count;
+        visit_expression(h, node->data.if_stmt.condition, TAKE_OTHER);
+        h->runs = false;
+        visit_statement(h, node->data.if_stmt.then_branch);
+        visit_statement(h, node->data.if_stmt.else_branch);
+        h->binding_count = outer;
+        break;
+    }
+    case NODE_SWITCH_STATEMENT:
+        visit_expression(h, node->data.switch_stmt.expression, TAKE_OTHER);
+        h->runs = false;
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            visit_statement(h, entry->statements);
+        break;
+    default:
+        break;
+    }
+}
+
+int hoist_loop_invariants(ASTNode *root)
+{
+    if (!root || root->type != NODE_STATEMENT_LIST)
+        return 0;
+
+    Hoister hoister = {.loop_bindings = -1};
+    for (StatementList *entry = root->data.statements; entry; entry = entry->next)
+    {
+        ASTNode *statement = entry->statement;
+        hoister.binding_count = 0;
+        hoister.int_count = 0;
+        Parameter *params = NULL;
+        if (statement && statement->type == NODE_FUNCTION_DEF)
+        {
+            params = statement->data.function_def.parameters;
+            statement = statement->data.function_def.body;
+        }
+        for (Parameter *param = params; param; param = param->next)
+        {
+            if (param->type == VAR_INT && !param->modifiers.is_unsigned)
+            {
+                GROW_ARRAY(hoister.ints, hoister.int_count, hoister.int_capacity);
+                hoister.ints[hoister.int_count++] = param->name;
+            }
+        }
+        find_ints(&hoister, statement, true);
+        /* Dropping one variable can make another's value a non-int */
+        for (int count = -1; count != hoister.int_count;)
+        {
+            count = hoister.int_count;
+            find_ints(&hoister, statement, false);
+        }
+
+        for (Parameter *param = params; param; param = param->next)
+            declare(&hoister, param->name, keeps_int(&hoister, param->name));
+        visit_statement(&hoister, statement);
+    }
+
+    free(hoister.bindings);
+    free(hoister.written);
+    free(hoister.ints);
+    return hoister.changes;
+}
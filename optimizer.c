@@ -0,0 +1,251 @@
+/* optimizer.c */
+
+#include "optimizer.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <time.h>
+
+typedef struct
+{
+    const char *name;
+    int level;
+    int (*run)(ASTNode *root);
+    const char *changes; /* what run() counts, for the report */
+} Pass;
+
+#define PASS_ID(ID, NAME, LEVEL, RUN, CHANGES) ID,
+#define PASS_ENTRY(ID, NAME, LEVEL, RUN, CHANGES) {NAME, LEVEL, RUN, CHANGES},
+
+enum
+{
+    OPTIMIZATION_PASSES(PASS_ID) PASS_COUNT
+};
+
+/* Closed by an entry with no name, so the table is never empty */
+static const Pass passes[] = {OPTIMIZATION_PASSES(PASS_ENTRY){NULL, 0, NULL, NULL}};
+
+#undef PASS_ENTRY
+#undef PASS_ID
+
+bool disable_passes(const char *names, unsigned *disabled)
+{
+    while (*names)
+    {
+        size_t length = strcspn(names, ",");
+        int p = 0;
+        while (p < PASS_COUNT &&
+               (strlen(passes[p].name) != length || strncmp(passes[p].name, names, length) != 0))
+            p++;
+        if (p == PASS_COUNT)
+            return false;
+        *disabled |= 1u << p;
+        names += length;
+        if (*names == ',')
+            names++;
+    }
+    return true;
+}
+
+int count_nodes(const ASTNode *node)
+{
+    if (!node)
+        return 0;
+    int count = 1;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            count += count_nodes(entry->statement);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+    case NODE_OPERATION:
+        count += count_nodes(node->data.op.left) + count_nodes(node->data.op.right);
+        break;
+    case NODE_RETURN:
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        count += count_nodes(node->data.op.left);
+        break;
+    case NODE_UNARY_OPERATION:
+        count += count_nodes(node->data.unary.operand);
+        break;
+    case NODE_ARRAY_ACCESS:
+        count += count_nodes(node->data.array.index);
+        break;
+    case NODE_SIZEOF:
+        count += count_nodes(node->data.sizeof_stmt.expr);
+        break;
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+            count += count_nodes(arg->expr);
+        break;
+    case NODE_FOR_STATEMENT:
+        count += count_nodes(node->data.for_stmt.init) + count_nodes(node->data.for_stmt.cond) +
+                 count_nodes(node->data.for_stmt.incr) + count_nodes(node->data.for_stmt.body);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        count += count_nodes(node->data.while_stmt.cond) + count_nodes(node->data.while_stmt.body);
+        break;
+    case NODE_IF_STATEMENT:
+        count += count_nodes(node->data.if_stmt.condition) +
+                 count_nodes(node->data.if_stmt.then_branch) +
+                 count_nodes(node->data.if_stmt.else_branch);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        count += count_nodes(node->data.switch_stmt.expression);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            count += count_nodes(entry->value) + count_nodes(entry->statements);
+        break;
+    case NODE_FUNCTION_DEF:
+        count += count_nodes(node->data.function_def.body);
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+ASTNode *single_statement(ASTNode *body)
+{
+    while (body && body->type == NODE_STATEMENT_LIST)
+    {
+        StatementList *first = body->data.statements;
+        if (!first || first->next)
+            return NULL;
+        body = first->statement;
+    }
+    return body;
+}
+
+bool names_variable(const ASTNode *node, const char *name)
+{
+    return node && node->type == NODE_IDENTIFIER && strcmp(node->data.name, name) == 0;
+}
+
+/* i++, ++i or i = i + 1 */
+static bool steps_by_one(const ASTNode *incr, const char *counter)
+{
+    if (!incr)
+        return false;
+    if (incr->type == NODE_UNARY_OPERATION)
+        return (incr->data.unary.op == OP_PRE_INC || incr->data.unary.op == OP_POST_INC) &&
+               names_variable(incr->data.unary.operand, counter);
+    if (incr->type != NODE_ASSIGNMENT || !names_variable(incr->data.op.left, counter))
+        return false;
+    const ASTNode *value = incr->data.op.right;
+    return value->type == NODE_OPERATION && value->data.op.op == OP_PLUS &&
+           names_variable(value->data.op.left, counter) && value->data.op.right->type == NODE_INT &&
+           value->data.op.right->data.ivalue == 1;
+}
+
+const char *unit_step_counter(const ASTNode *loop)
+{
+    const ASTNode *cond = loop->data.for_stmt.cond;
+    if (!cond || cond->type != NODE_OPERATION || (cond->data.op.op != OP_LT && cond->data.op.op != OP_LE) ||
+        cond->data.op.left->type != NODE_IDENTIFIER)
+        return NULL;
+    const char *counter = cond->data.op.left->data.name;
+    return steps_by_one(loop->data.for_stmt.incr, counter) ? counter : NULL;
+}
+
+bool counter_access(const ASTNode *node, const char *counter, int *offset)
+{
+    if (!node || node->type != NODE_ARRAY_ACCESS || !node->data.array.index)
+        return false;
+    const ASTNode *index = node->data.array.index;
+    if (names_variable(index, counter))
+    {
+        *offset = 0;
+        return true;
+    }
+    if (index->type != NODE_OPERATION || (index->data.op.op != OP_PLUS && index->data.op.op != OP_MINUS) ||
+        !names_variable(index->data.op.left, counter) || index->data.op.right->type != NODE_INT ||
+        index->data.op.right->data.ivalue == INT_MIN)
+        return false;
+    int amount = index->data.op.right->data.ivalue;
+    *offset = index->data.op.op == OP_PLUS ? amount : -amount;
+    return true;
+}
+
+void opt_remark(const char *format, ...)
+{
+    FILE *remarks = brainrot->remarks;
+    if (!remarks)
+        return;
+    va_list args;
+    va_start(args, format);
+    fputs("    ", remarks);
+    vfprintf(remarks, format, args);
+    fputc('\n', remarks);
+    va_end(args);
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 + (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void optimize_program(ASTNode *root, const OptimizerOptions *options)
+{
+    if (options->report)
+        fprintf(brainrot->err, "optimizer: -O%d\n", options->level);
+
+    for (int p = 0; p < PASS_COUNT; p++)
+    {
+        const Pass *pass = &passes[p];
+        if (pass->level > options->level)
+        {
+            if (options->report)
+                fprintf(brainrot->err, "  %-12s needs -O%d\n", pass->name, pass->level);
+            continue;
+        }
+        if (options->disabled & (1u << p))
+        {
+            if (options->report)
+                fprintf(brainrot->err, "  %-12s disabled\n", pass->name);
+            continue;
+        }
+
+        // Printed after the pass's own line
+        char *lines = NULL;
+        size_t size = 0;
+        if (options->report)
+            brainrot->remarks = open_memstream(&lines, &size);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int changes = pass->run(root);
+        if (options->report)
+            fprintf(brainrot->err, "  %-12s %8.3f ms  %d %s\n", pass->name, elapsed_ms(&start), changes,
+                    pass->changes);
+        if (brainrot->remarks)
+        {
+            fclose(brainrot->remarks);
+            brainrot->remarks = NULL;
+            fputs(lines, brainrot->err);
+        }
+        free(lines);
+    }
+
+    // Whatever the level, a schizo flex body without a kernel runs in order
+    if (options->report)
+    {
+        char *lines = NULL;
+        size_t size = 0;
+        int threaded;
+        brainrot->remarks = open_memstream(&lines, &size);
+        int loops = schizo_flex_loops(root, &threaded);
+        fclose(brainrot->remarks);
+        brainrot->remarks = NULL;
+        if (loops)
+        {
+            fprintf(brainrot->err, "  %-12s %d of %d loops run on threads\n", "schizo flex", threaded, loops);
+            fputs(lines, brainrot->err);
+        }
+        free(lines);
+    }
+}
@@ -0,0 +1,81 @@
+/* optimizer.h */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+
+/*
+ * AST optimization passes, run between parsing and execution.
+ *
+ * optimize_program() takes the linked program and runs every pass the -O
+ * level selects, in the order listed below, before the tree is compiled to
+ * bytecode or resolved for the tree-walker, so every engine runs the
+ * optimized program. -O1 runs the cheap tree rewrites; -O2, the default,
+ * adds the loop analyses. A pass rewrites the tree in place and returns how many
+ * changes it made; --opt-report prints that count and the time each pass
+ * took, and --disable-pass turns single passes off to bisect a miscompile.
+ */
+
+#define OPT_DEFAULT_LEVEL 2
+#define OPT_MAX_LEVEL 2
+
+/* X(id, name for --disable-pass, lowest -O level, pass function, what the
+ * count it returns is) in the order the passes run. */
+#define OPTIMIZATION_PASSES(X)                                                           \
+    X(PASS_FOLD, "fold", 1, fold_constants, "expressions folded or reads propagated")    \
+    X(PASS_DCE, "dce", 1, eliminate_dead_code, "nodes removed")                          \
+    X(PASS_LICM, "licm", 1, hoist_loop_invariants, "loop-invariant expressions hoisted") \
+    X(PASS_IDIOM, "idiom", 2, recognize_loop_idioms, "loops recognized as array idioms") \
+    X(PASS_VECTORIZE, "vectorize", 2, vectorize_loops, "loops vectorized")               \
+    X(PASS_PARALLELIZE, "parallelize", 2, parallelize_loops, "loops parallelized")
+
+typedef struct
+{
+    int level;         /* -O level; 0 runs no pass */
+    unsigned disabled; /* bit per pass, set by disable_passes() */
+    bool report;       /* print what each pass did to stderr */
+} OptimizerOptions;
+
+/* Sets the bit of every comma-separated pass name in *disabled; false if
+ * a name is not a pass. */
+bool disable_passes(const char *names, unsigned *disabled);
+
+void optimize_program(ASTNode *root, const OptimizerOptions *options);
+
+/* Adds a line under the running pass to what --opt-report prints; does
+ * nothing without --opt-report */
+void opt_remark(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/* Nodes in the tree under `node`, itself included; 0 for NULL. */
+int count_nodes(const ASTNode *node);
+
+/* Loop shapes the loop passes look for */
+
+/* Whether `node` is the identifier `name` */
+bool names_variable(const ASTNode *node, const char *name);
+
+/* The statement a loop body consists of, or NULL if it has more than one */
+ASTNode *single_statement(ASTNode *body);
+
+/* The counter of a flex loop that runs while `i < b` or `i <= b` and adds
+ * one to i per iteration (`i++`, `++i` or `i = i + 1`), or NULL */
+const char *unit_step_counter(const ASTNode *loop);
+
+/* Whether `node` is an access `a[i]`, `a[i + c]` or `a[i - c]` of the
+ * counter i, with c an int literal; sets *offset to the index minus i */
+bool counter_access(const ASTNode *node, const char *counter, int *offset);
+
+/* Passes; each returns how many changes it made */
+int fold_constants(ASTNode *root);
+int eliminate_dead_code(ASTNode *root);
+int hoist_loop_invariants(ASTNode *root);
+int recognize_loop_idioms(ASTNode *root);
+int vectorize_loops(ASTNode *root);
+int parallelize_loops(ASTNode *root);
+
+/* Remarks on how each schizo flex loop runs; returns how many there are
+ * and sets *threaded to how many run their kernel on the thread pool */
+int schizo_flex_loops(ASTNode *root, int *threaded);
+
+#endif /* OPTIMIZER_H */
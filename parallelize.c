@@ -0,0 +1,489 @@
+/* parallelize.c */
+
+#include "optimizer.h"
+#include <limits.h>
+
+/*
+ * Automatic loop parallelization.
+ *
+ * Marks a flex loop LOOP_INDEPENDENT, as if it were a schizo flex, once it
+ * has proved that no iteration depends on another:
+ *
+ * - the body yaps, slorps or calls no function, and does not leave the
+ *   loop with bruh or bussin;
+ * - it assigns no variable declared outside it, other than the one an
+ *   idiom sums or takes the minimum or maximum into;
+ * - every access to an array the body stores to has an affine index
+ *   c * i + d, with i the counter and c and d int literals, and no two of
+ *   them reach the same element in different iterations. Equal
+ *   coefficients give the distance between the iterations directly;
+ *   otherwise the GCD test has to rule out an integer solution.
+ *
+ * Only the kernels of the idiom and vectorize passes run on the thread
+ * pool, so a loop without one stays sequential even when it is
+ * independent, as does every loop of a program translated to C and one
+ * whose literal bounds give it fewer than two chunks of iterations. The
+ * same holds for a schizo flex: the programmer's word replaces the proof,
+ * not the kernel. A gigachad sum stays in order too unless
+ * --relaxed-fp allows regrouping it. The kernels check the arrays they
+ * find at runtime again, so a parallelized loop otherwise gives exactly
+ * the results of the sequential one.
+ *
+ * --opt-report prints, for every flex loop in source order, whether it
+ * was parallelized and otherwise the first reason it was not. At every -O
+ * level it also lists each schizo flex loop and whether its kernel runs on
+ * threads; a body without a kernel runs one iteration at a time.
+ */
+
+#define MAX_ACCESSES 64
+#define MAX_LOCALS 16
+
+typedef struct
+{
+    bool known; /* the index is coefficient * counter + constant */
+    long long coefficient;
+    long long constant;
+} Affine;
+
+typedef struct
+{
+    const ASTNode *access;
+    Affine index;
+    bool store;
+} Access;
+
+typedef struct
+{
+    const char *counter;
+    const char *reduction; /* the variable an idiom reduces into, or NULL */
+    Access accesses[MAX_ACCESSES];
+    int access_count;
+    const char *locals[MAX_LOCALS]; /* declared in the body, new every iteration */
+    int local_count;
+    char reason[96]; /* the first obstacle found; empty while there is none */
+} Analysis;
+
+#define OBSTACLE(a, ...)                                              \
+    do                                                                \
+    {                                                                 \
+        if (!(a)->reason[0])                                          \
+            snprintf((a)->reason, sizeof((a)->reason), __VA_ARGS__); \
+    } while (0)
+
+/* Keeps coefficients and constants far enough from overflow to add and
+ * multiply them */
+static bool small(long long value)
+{
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+static Affine affine(const ASTNode *node, const char *counter)
+{
+    Affine unknown = {false, 0, 0};
+    if (!node)
+        return unknown;
+    switch (node->type)
+    {
+    case NODE_INT:
+        return (Affine){true, 0, node->data.ivalue};
+    case NODE_IDENTIFIER:
+        return names_variable(node, counter) ? (Affine){true, 1, 0} : unknown;
+    case NODE_UNARY_OPERATION:
+    {
+        Affine operand = affine(node->data.unary.operand, counter);
+        if (node->data.unary.op != OP_NEG || !operand.known)
+            return unknown;
+        return (Affine){true, -operand.coefficient, -operand.constant};
+    }
+    case NODE_OPERATION:
+    {
+        Affine left = affine(node->data.op.left, counter);
+        Affine right = affine(node->data.op.right, counter);
+        if (!left.known || !right.known)
+            return unknown;
+        Affine result = {true, 0, 0};
+        switch (node->data.op.op)
+        {
+        case OP_PLUS:
+            result = (Affine){true, left.coefficient + right.coefficient, left.constant + right.constant};
+            break;
+        case OP_MINUS:
+            result = (Affine){true, left.coefficient - right.coefficient, left.constant - right.constant};
+            break;
+        case OP_TIMES:
+            // One side has to be a literal to stay affine
+            if (left.coefficient && right.coefficient)
+                return unknown;
+            if (left.coefficient)
+                result = (Affine){true, left.coefficient * right.constant, left.constant * right.constant};
+            else
+                result = (Affine){true, right.coefficient * left.constant, right.constant * left.constant};
+            break;
+        default:
+            return unknown;
+        }
+        return small(result.coefficient) && small(result.constant) ? result : unknown;
+    }
+    default:
+        return unknown;
+    }
+}
+
+static bool is_local(const Analysis *a, const char *name)
+{
+    for (int k = 0; k < a->local_count; k++)
+    {
+        if (strcmp(a->locals[k], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void declare(Analysis *a, const char *name)
+{
+    if (a->local_count == MAX_LOCALS)
+        OBSTACLE(a, "declares more than %d variables", MAX_LOCALS);
+    else
+        a->locals[a->local_count++] = name;
+}
+
+static void record(Analysis *a, const ASTNode *access, bool store)
+{
+    if (a->access_count == MAX_ACCESSES)
+    {
+        OBSTACLE(a, "has more than %d array accesses", MAX_ACCESSES);
+        return;
+    }
+    a->accesses[a->access_count++] = (Access){access, affine(access->data.array.index, a->counter), store};
+}
+
+/* A write of the variable or element `target` */
+static void write_to(Analysis *a, const ASTNode *target)
+{
+    if (target->type == NODE_ARRAY_ACCESS)
+    {
+        record(a, target, true);
+        return;
+    }
+    if (target->type != NODE_IDENTIFIER)
+        return;
+    const char *name = target->data.name;
+    if (strcmp(name, a->counter) == 0)
+        OBSTACLE(a, "assigns the counter '%s' in the body", name);
+    else if (!is_local(a, name) && !(a->reduction && strcmp(name, a->reduction) == 0))
+        OBSTACLE(a, "carries '%s' from one iteration to the next", name);
+}
+
+static void scan(Analysis *a, const ASTNode *node)
+{
+    if (!node || a->reason[0])
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+        {
+            // An array declaration, as a statement
+            if (entry->statement && entry->statement->type == NODE_ARRAY_ACCESS)
+                declare(a, entry->statement->data.array.name);
+            else
+                scan(a, entry->statement);
+        }
+        break;
+    case NODE_DECLARATION:
+        scan(a, node->data.op.right);
+        declare(a, node->data.op.left->data.name);
+        break;
+    case NODE_ASSIGNMENT:
+        scan(a, node->data.op.right);
+        if (node->data.op.left->type == NODE_ARRAY_ACCESS)
+            scan(a, node->data.op.left->data.array.index);
+        write_to(a, node->data.op.left);
+        break;
+    case NODE_OPERATION:
+        scan(a, node->data.op.left);
+        scan(a, node->data.op.right);
+        break;
+    case NODE_UNARY_OPERATION:
+        scan(a, node->data.unary.operand);
+        if (node->data.unary.op != OP_NEG)
+            write_to(a, node->data.unary.operand);
+        break;
+    case NODE_ARRAY_ACCESS:
+        scan(a, node->data.array.index);
+        record(a, node, false);
+        break;
+    case NODE_SIZEOF:
+        scan(a, node->data.sizeof_stmt.expr);
+        break;
+    case NODE_PRINT_STATEMENT:
+        OBSTACLE(a, "yaps");
+        break;
+    case NODE_ERROR_STATEMENT:
+        OBSTACLE(a, "calls baka");
+        break;
+    case NODE_FUNC_CALL:
+        switch (node->data.func_call.builtin)
+        {
+        case BUILTIN_NONE:
+            OBSTACLE(a, "calls '%s'", node->data.func_call.function_name);
+            break;
+        case BUILTIN_SLORP:
+            OBSTACLE(a, "slorps input");
+            break;
+        case BUILTIN_YAPPING:
+        case BUILTIN_YAPPIN:
+            OBSTACLE(a, "yaps");
+            break;
+        default:
+            OBSTACLE(a, "calls %s", node->data.func_call.function_name);
+            break;
+        }
+        break;
+    case NODE_BREAK_STATEMENT:
+        OBSTACLE(a, "can leave the loop with bruh");
+        break;
+    case NODE_RETURN:
+        OBSTACLE(a, "can leave the loop with bussin");
+        break;
+    case NODE_FOR_STATEMENT:
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        OBSTACLE(a, "has a loop inside");
+        break;
+    case NODE_IF_STATEMENT:
+        scan(a, node->data.if_stmt.condition);
+        scan(a, node->data.if_stmt.then_branch);
+        scan(a, node->data.if_stmt.else_branch);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        // bruh in an ohio leaves the ohio, not the loop
+        OBSTACLE(a, "has an ohio inside");
+        break;
+    default:
+        break;
+    }
+}
+
+static long long gcd(long long x, long long y)
+{
+    x = x < 0 ? -x : x;
+    y = y < 0 ? -y : y;
+    while (y)
+    {
+        long long rest = x % y;
+        x = y;
+        y = rest;
+    }
+    return x;
+}
+
+/* Whether a store and another access of the same array can reach one
+ * element in two different iterations */
+static void check_pair(Analysis *a, const Access *store, const Access *other)
+{
+    const char *array = store->access->data.array.name;
+    if (!store->index.known || !other->index.known)
+    {
+        OBSTACLE(a, "indexes '%s' by something other than c * %s + d", array, a->counter);
+        return;
+    }
+    long long c1 = store->index.coefficient, c2 = other->index.coefficient;
+    long long difference = other->index.constant - store->index.constant;
+    if (c1 == c2)
+    {
+        if (c1 == 0)
+        {
+            if (difference == 0)
+                OBSTACLE(a, "stores '%s[%lld]' in every iteration", array, store->index.constant);
+        }
+        else if (difference != 0 && difference % c1 == 0)
+        {
+            long long distance = difference / c1;
+            OBSTACLE(a, "carries a dependence on '%s' at distance %lld", array, distance < 0 ? -distance : distance);
+        }
+        return;
+    }
+    // c1 * i - c2 * j = difference has integer solutions
+    long long divisor = gcd(c1, c2);
+    if (divisor == 0 || difference % divisor == 0)
+        OBSTACLE(a, "may reach an element of '%s' from two iterations", array);
+}
+
+static void check_arrays(Analysis *a)
+{
+    for (int s = 0; s < a->access_count; s++)
+    {
+        const Access *store = &a->accesses[s];
+        if (!store->store || is_local(a, store->access->data.array.name))
+            continue;
+        for (int o = 0; o < a->access_count; o++)
+        {
+            const Access *other = &a->accesses[o];
+            if ((o == s || strcmp(other->access->data.array.name, store->access->data.array.name) == 0) &&
+                !(o < s && other->store))
+                check_pair(a, store, other);
+        }
+    }
+}
+
+/* The literal start of the counter, as the loop's init sets it */
+static bool literal_start(const ASTNode *init, const char *counter, long long *start)
+{
+    if (!init || (init->type != NODE_DECLARATION && init->type != NODE_ASSIGNMENT) ||
+        !names_variable(init->data.op.left, counter) || init->data.op.right->type != NODE_INT)
+        return false;
+    *start = init->data.op.right->data.ivalue;
+    return true;
+}
+
+/* Whether an access names a gigachad array; arrays are in the global scope
+ * from parse time on */
+static bool gigachad_array(const ASTNode *access)
+{
+    Variable *var = get_variable(access->data.array.name);
+    return var && var->is_array && var->var_type == VAR_DOUBLE;
+}
+
+/* The bound of `i < b` or `i <= b`, as written */
+static const char *describe_bound(const ASTNode *bound, char *buffer, size_t size)
+{
+    if (bound->type == NODE_INT)
+        snprintf(buffer, size, "%d", bound->data.ivalue);
+    else if (bound->type == NODE_IDENTIFIER)
+        snprintf(buffer, size, "%s", bound->data.name);
+    else
+        snprintf(buffer, size, "...");
+    return buffer;
+}
+
+static bool parallelize(int *loops, ASTNode *node)
+{
+    int number = ++*loops;
+    const char *counter = unit_step_counter(node);
+    if (!counter)
+    {
+        opt_remark("loop %d: sequential: does not count up by one", number);
+        return false;
+    }
+    const ASTNode *cond = node->data.for_stmt.cond;
+    char bound[32];
+    describe_bound(cond->data.op.right, bound, sizeof(bound));
+    const char *op = cond->data.op.op == OP_LT ? "<" : "<=";
+    if (node->data.for_stmt.parallel == LOOP_SCHIZO)
+    {
+        opt_remark("loop %d (%s %s %s): schizo flex", number, counter, op, bound);
+        return false;
+    }
+
+    const LoopIdiom *idiom = node->data.for_stmt.idiom;
+    Analysis a = {.counter = counter};
+    if (idiom && (idiom->kind == IDIOM_SUM || idiom->kind == IDIOM_MIN || idiom->kind == IDIOM_MAX))
+        a.reduction = idiom->target->data.name;
+    scan(&a, node->data.for_stmt.body);
+    if (!a.reason[0])
+        check_arrays(&a);
+
+    long long start;
+    if (!a.reason[0] && !idiom && !node->data.for_stmt.vector)
+        OBSTACLE(&a, "independent, but only array kernels run on threads");
+    if (!a.reason[0] && idiom && idiom->kind == IDIOM_SUM && !brainrot->relaxed_fp && gigachad_array(idiom->left))
+        OBSTACLE(&a, "gigachad reduction on '%s' (strict FP order)", a.reduction);
+    if (!a.reason[0] && cond->data.op.right->type == NODE_INT &&
+        literal_start(node->data.for_stmt.init, counter, &start))
+    {
+        long long trips = (long long)cond->data.op.right->data.ivalue - start + (cond->data.op.op == OP_LE);
+        if (trips < 2 * PARALLEL_CHUNK)
+            OBSTACLE(&a, "%lld iterations, fewer than %d", trips < 0 ? 0 : trips, 2 * PARALLEL_CHUNK);
+    }
+    if (!a.reason[0] && brainrot->translated)
+        OBSTACLE(&a, "independent, but C runs every loop in order");
+    if (a.reason[0])
+    {
+        opt_remark("loop %d (%s %s %s): sequential: %s", number, counter, op, bound, a.reason);
+        return false;
+    }
+    node->data.for_stmt.parallel = LOOP_INDEPENDENT;
+    opt_remark("loop %d (%s %s %s): parallel", number, counter, op, bound);
+    return true;
+}
+
+/* Visits every flex loop in source order; `decide` returns whether it counts */
+static void visit(bool (*decide)(int *, ASTNode *), int *found, int *loops, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            visit(decide, found, loops, entry->statement);
+        break;
+    case NODE_FUNCTION_DEF:
+        visit(decide, found, loops, node->data.function_def.body);
+        break;
+    case NODE_IF_STATEMENT:
+        visit(decide, found, loops, node->data.if_stmt.then_branch);
+        visit(decide, found, loops, node->data.if_stmt.else_branch);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        visit(decide, found, loops, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            visit(decide, found, loops, entry->statements);
+        break;
+    case NODE_FOR_STATEMENT:
+        *found += decide(loops, node);
+        visit(decide, found, loops, node->data.for_stmt.body);
+        break;
+    default:
+        break;
+    }
+}
+
+int parallelize_loops(ASTNode *root)
+{
+    int found = 0;
+    int loops = 0;
+    visit(parallelize, &found, &loops, root);
+    return found;
+}
+
+/* Whether a schizo flex loop's kernel runs on the thread pool */
+static bool schizo(int *loops, ASTNode *node)
+{
+    if (node->data.for_stmt.parallel != LOOP_SCHIZO)
+        return false;
+    int number = ++*loops;
+    const char *counter = unit_step_counter(node);
+    char where[64] = "";
+    if (counter)
+    {
+        const ASTNode *cond = node->data.for_stmt.cond;
+        char bound[32];
+        snprintf(where, sizeof(where), " (%s %s %s)", counter, cond->data.op.op == OP_LT ? "<" : "<=",
+                 describe_bound(cond->data.op.right, bound, sizeof(bound)));
+    }
+    if (!node->data.for_stmt.idiom && !node->data.for_stmt.vector)
+    {
+        opt_remark("loop %d%s: one iteration at a time: no array kernel", number, where);
+        return false;
+    }
+    if (brainrot->translated)
+    {
+        opt_remark("loop %d%s: one iteration at a time: C runs every loop in order", number, where);
+        return false;
+    }
+    opt_remark("loop %d%s: on threads", number, where);
+    return true;
+}
+
+int schizo_flex_loops(ASTNode *root, int *threaded)
+{
+    int loops = 0;
+    *threaded = 0;
+    visit(schizo, threaded, &loops, root);
+    return loops;
+}
@@ -0,0 +1,845 @@
+/* resolver.c */
+
+#include "ast.h"
+#include <limits.h>
+
+/*
+ * Static analysis run once before the tree-walker executes a program.
+ *
+ * resolve_program() binds every identifier, array access and declaration
+ * to the declaration it refers to under the language's block scoping, and
+ * gives each declaration a slot in the frame of the enclosing function.
+ * Slots are handed out like a stack: a block's slots are released when it
+ * ends, so sibling blocks share storage and a frame is only as large as
+ * its deepest nesting of live variables. At runtime a variable access is
+ * then a single index into the running frame, and entering or leaving a
+ * block costs nothing.
+ *
+ * The pass also works out which variables keep a single type for their
+ * whole lifetime and stores in each expression node the type
+ * get_expression_type() and the is_*_expression() helpers would derive for
+ * it. Expressions that depend on a variable whose type changes while the
+ * program runs stay unresolved and keep being typed dynamically.
+ *
+ * Finally it bounds the values int variables can hold: the counter of a
+ * flex loop with a literal step, inside the loop's body, and a variable the
+ * rest of its block never writes after its declaration. An access to a
+ * global array whose index stays within those bounds and the array's
+ * length is marked in_bounds and skips its runtime check.
+ */
+
+extern void report_error(const char *s);
+
+typedef struct
+{
+    const char *name;
+    const void *key;  /* declaring node, parameter, or global array variable */
+    Variable *global; /* the global array, for bindings of one */
+    int depth;
+    int slot;
+} Binding;
+
+/* The values an int variable holds while the scope at `depth` is open */
+typedef struct
+{
+    const void *key;
+    int depth;
+    long long low;
+    long long high;
+} ValueRange;
+
+typedef struct
+{
+    Binding *bindings;
+    int binding_count;
+    int binding_capacity;
+    int depth;
+    int slot_count; /* slots live at this point in the current frame */
+    int frame_size; /* most slots live at once in the current frame */
+    HashMap *types; /* binding key -> VarType, NONE once the type varies */
+    bool changed;
+    ValueRange *ranges;
+    int range_count;
+    int range_capacity;
+} Resolver;
+
+static const TypeInfo unresolved = {false, false, false, false};
+
+/* hm_free() treats every value as a Variable, so the resolver's own tables
+ * are released here. */
+static void free_table(HashMap *table)
+{
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->nodes[i])
+        {
+            SAFE_FREE(table->nodes[i]->key);
+            SAFE_FREE(table->nodes[i]->value);
+            SAFE_FREE(table->nodes[i]);
+        }
+    }
+    SAFE_FREE(table->nodes);
+    SAFE_FREE(table);
+}
+
+/* Global arrays, in the order they take the first slots of main's frame. */
+static Variable *next_global_array(size_t *cursor)
+{
+    HashMap *globals = brainrot->current_scope->variables;
+    while (*cursor < globals->capacity)
+    {
+        HashMapNode *entry = globals->nodes[(*cursor)++];
+        if (entry && ((Variable *)entry->value)->is_array)
+            return entry->value;
+    }
+    return NULL;
+}
+
+/* Binds a name in the innermost scope and gives it the next frame slot. */
+static Binding *declare(Resolver *r, const char *name, const void *key)
+{
+    for (int i = r->binding_count - 1; i >= 0 && r->bindings[i].depth == r->depth; i--)
+    {
+        if (strcmp(r->bindings[i].name, name) == 0)
+        {
+            report_error("Variable already exists in current scope");
+            brainrot_exit(1);
+        }
+    }
+    if (r->binding_count >= r->binding_capacity)
+    {
+        r->binding_capacity = r->binding_capacity ? r->binding_capacity * 2 : 16;
+        Binding *grown = realloc(r->bindings, r->binding_capacity * sizeof(Binding));
+        if (!grown)
+        {
+            report_error("Memory allocation failed");
+            brainrot_exit(EXIT_FAILURE);
+        }
+        r->bindings = grown;
+    }
+    Binding *binding = &r->bindings[r->binding_count++];
+    *binding = (Binding){name, key, NULL, r->depth, r->slot_count++};
+    if (r->slot_count > r->frame_size)
+        r->frame_size = r->slot_count;
+    return binding;
+}
+
+static void begin_scope(Resolver *r)
+{
+    r->depth++;
+}
+
+/* Drops the block's bindings and hands their slots back. */
+static void end_scope(Resolver *r)
+{
+    while (r->binding_count && r->bindings[r->binding_count - 1].depth == r->depth)
+        r->slot_count = r->bindings[--r->binding_count].slot;
+    while (r->range_count && r->ranges[r->range_count - 1].depth == r->depth)
+        r->range_count--;
+    r->depth--;
+}
+
+/* Innermost declaration first. Global arrays are only bound in main. */
+static Binding *lookup(Resolver *r, const char *name)
+{
+    for (int i = r->binding_count - 1; i >= 0; i--)
+    {
+        if (strcmp(r->bindings[i].name, name) == 0)
+            return &r->bindings[i];
+    }
+    return NULL;
+}
+
+/* Records the slot of the variable a node names and returns its key. */
+static const void *bind(Resolver *r, ASTNode *node, const char *name)
+{
+    Binding *binding = lookup(r, name);
+    node->slot = binding ? binding->slot : -1;
+    return binding ? binding->key : NULL;
+}
+
+static bool binding_type(Resolver *r, const void *key, VarType *type)
+{
+    VarType *known = key ? hm_get(r->types, &key, sizeof(key)) : NULL;
+    if (!known || *known == NONE)
+        return false;
+    *type = *known;
+    return true;
+}
+
+/* Records that the variable can hold a value of this type. */
+static void record_type(Resolver *r, const void *key, VarType type)
+{
+    if (!key)
+        return;
+    VarType *known = hm_get(r->types, &key, sizeof(key));
+    if (known && (*known == type || *known == NONE))
+        return;
+    if (known)
+        type = NONE;
+    hm_put(r->types, &key, sizeof(key), &type, sizeof(type));
+    r->changed = true;
+}
+
+static TypeInfo type_info_for(VarType type)
+{
+    return (TypeInfo){true, type == VAR_SHORT, type == VAR_FLOAT, type == VAR_DOUBLE};
+}
+
+static void store(ASTNode *node, TypeInfo info, VarType type)
+{
+    node->type_info = info;
+    if (info.resolved)
+        node->var_type = type;
+}
+
+static bool is_int_variable(Resolver *r, const ASTNode *node)
+{
+    Binding *binding = node->type == NODE_IDENTIFIER ? lookup(r, node->data.name) : NULL;
+    VarType type;
+    return binding && !binding->global && node->slot >= 0 && binding_type(r, binding->key, &type) &&
+           type == VAR_INT;
+}
+
+/* Value ranges */
+
+static void push_range(Resolver *r, const void *key, long long low, long long high)
+{
+    GROW_ARRAY(r->ranges, r->range_count, r->range_capacity);
+    r->ranges[r->range_count++] = (ValueRange){key, r->depth, low, high};
+}
+
+static const ValueRange *find_range(Resolver *r, const char *name)
+{
+    Binding *binding = lookup(r, name);
+    for (int i = r->range_count - 1; binding && i >= 0; i--)
+    {
+        if (r->ranges[i].key == binding->key)
+            return &r->ranges[i];
+    }
+    return NULL;
+}
+
+/*
+ * Bounds of an int expression built from literals, variables with a range,
+ * +, - and *. Fails for anything else, and when an intermediate result
+ * could leave the int range, where the runtime would wrap it.
+ */
+static bool expression_range(Resolver *r, const ASTNode *node, long long *low, long long *high)
+{
+    if (!node)
+        return false;
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        *low = *high = node->data.ivalue;
+        return true;
+    case NODE_IDENTIFIER:
+    {
+        const ValueRange *range = find_range(r, node->data.name);
+        if (!range)
+            return false;
+        *low = range->low;
+        *high = range->high;
+        return true;
+    }
+    case NODE_OPERATION:
+    {
+        long long a_low, a_high, b_low, b_high;
+        if (!expression_range(r, node->data.op.left, &a_low, &a_high) ||
+            !expression_range(r, node->data.op.right, &b_low, &b_high))
+            return false;
+        switch (node->data.op.op)
+        {
+        case OP_PLUS:
+            *low = a_low + b_low;
+            *high = a_high + b_high;
+            break;
+        case OP_MINUS:
+            *low = a_low - b_high;
+            *high = a_high - b_low;
+            break;
+        case OP_TIMES:
+        {
+            long long products[] = {a_low * b_low, a_low * b_high, a_high * b_low, a_high * b_high};
+            *low = *high = products[0];
+            for (int i = 1; i < 4; i++)
+            {
+                if (products[i] < *low)
+                    *low = products[i];
+                if (products[i] > *high)
+                    *high = products[i];
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+        return *low >= INT_MIN && *high <= INT_MAX;
+    }
+    default:
+        return false;
+    }
+}
+
+/*
+ * Annotates an expression and returns its type information. `context` is
+ * the type the evaluator reads the expression as, or NONE when that is not
+ * known; it only matters for ++/--, which retype their variable to it.
+ */
+static TypeInfo resolve_expression(Resolver *r, ASTNode *node, VarType context)
+{
+    if (!node)
+        return unresolved;
+
+    TypeInfo info = unresolved;
+    VarType type = NONE;
+    switch (node->type)
+    {
+    case NODE_INT:
+    case NODE_CHAR:
+        type = VAR_INT;
+        info = type_info_for(VAR_INT);
+        break;
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_BOOLEAN:
+        type = node->var_type;
+        info = type_info_for(type);
+        break;
+    case NODE_SIZEOF:
+        resolve_expression(r, node->data.sizeof_stmt.expr, NONE);
+        type = VAR_INT;
+        info = (TypeInfo){true, false, false, false};
+        break;
+    case NODE_IDENTIFIER:
+        if (binding_type(r, bind(r, node, node->data.name), &type))
+            info = type_info_for(type);
+        break;
+    case NODE_ARRAY_ACCESS:
+    {
+        TypeInfo index = resolve_expression(r, node->data.array.index, VAR_INT);
+        const void *key = bind(r, node, node->data.array.name);
+        Binding *binding = lookup(r, node->data.array.name);
+        bool index_ok = index.resolved && (node->data.array.index->var_type == VAR_INT ||
+                                           node->data.array.index->var_type == VAR_SHORT);
+        if (binding && binding->global && index_ok && binding_type(r, key, &type) &&
+            type == node->var_type)
+            info = (TypeInfo){true, false, false, false};
+        long long low, high;
+        node->in_bounds = binding && binding->global &&
+                          expression_range(r, node->data.array.index, &low, &high) && low >= 0 &&
+                          high < binding->global->array_length;
+        brainrot->bounds_stats.accesses++;
+        brainrot->bounds_stats.unchecked += node->in_bounds;
+        break;
+    }
+    case NODE_OPERATION:
+    {
+        bool logical = node->data.op.op == OP_AND || node->data.op.op == OP_OR;
+        TypeInfo left = resolve_expression(r, node->data.op.left, logical ? context : NONE);
+        TypeInfo right = resolve_expression(r, node->data.op.right, logical ? context : NONE);
+        if (!left.resolved || !right.resolved)
+            break;
+        VarType left_type = node->data.op.left->var_type;
+        VarType right_type = node->data.op.right->var_type;
+        if (left_type == VAR_DOUBLE || right_type == VAR_DOUBLE)
+            type = VAR_DOUBLE;
+        else if (left_type == VAR_FLOAT || right_type == VAR_FLOAT)
+            type = VAR_FLOAT;
+        else
+            type = VAR_INT;
+        // Short operands are promoted to int, so the result is never short
+        info = (TypeInfo){true, false, left.has_float || right.has_float, left.has_double || right.has_double};
+        break;
+    }
+    case NODE_UNARY_OPERATION:
+    {
+        ASTNode *operand = node->data.unary.operand;
+        bool step = node->data.unary.op != OP_NEG;
+        TypeInfo inner = resolve_expression(r, operand, step ? NONE : context);
+        if (step && operand->type == NODE_IDENTIFIER)
+            record_type(r, bind(r, operand, operand->data.name), context);
+        if (inner.resolved)
+        {
+            type = operand->var_type;
+            info = (TypeInfo){true, false, false, false};
+        }
+        break;
+    }
+    case NODE_FUNC_CALL:
+    {
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+            resolve_expression(r, arg->expr, NONE);
+        Function *func = node->data.func_call.function;
+        if (func)
+        {
+            type = func->return_type;
+            info = type_info_for(type);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    store(node, info, type);
+    return info;
+}
+
+/* The context evaluate_expression() picks for a condition or statement. */
+static VarType generic_context(ASTNode *node)
+{
+    if (node->type == NODE_UNARY_OPERATION)
+        return VAR_INT;
+    return NONE;
+}
+
+/* The type execute_statement() gives the variable for this assignment. */
+static VarType assignment_type(ASTNode *node, TypeInfo value_info)
+{
+    ASTNode *value = node->data.op.right;
+    if (value->type == NODE_CHAR)
+        return VAR_CHAR;
+    if (value->type == NODE_BOOLEAN)
+        return VAR_BOOL;
+    if (value->type == NODE_SHORT)
+        return VAR_SHORT;
+    if (node->var_type == VAR_FLOAT)
+        return VAR_FLOAT;
+    if (!value_info.resolved)
+        return NONE;
+    if (value_info.has_float)
+        return VAR_FLOAT;
+    if (node->var_type == VAR_DOUBLE || value_info.has_double)
+        return VAR_DOUBLE;
+    return VAR_INT;
+}
+
+static void resolve_statement(Resolver *r, ASTNode *node);
+
+static void resolve_call_statement(Resolver *r, ASTNode *node)
+{
+    ArgumentList *args = node->data.func_call.arguments;
+    for (ArgumentList *arg = args; arg; arg = arg->next)
+        resolve_expression(r, arg->expr, NONE);
+
+    /* execute_slorp_call() stores a read char as an int, and writing into
+     * an array variable this way replaces it. */
+    if (node->data.func_call.builtin == BUILTIN_SLORP && args &&
+        args->expr->type == NODE_IDENTIFIER)
+    {
+        Binding *binding = lookup(r, args->expr->data.name);
+        const void *key = binding ? binding->key : NULL;
+        if (binding && binding->global)
+        {
+            if (binding->global->var_type != VAR_CHAR)
+                record_type(r, key, NONE);
+        }
+        else
+        {
+            VarType type;
+            if (!binding_type(r, key, &type) || type == VAR_CHAR)
+                record_type(r, key, VAR_INT);
+        }
+    }
+}
+
+/* Whether anything under `node` reads or writes a variable of this name;
+ * a declaration of the name counts as a write. */
+static void find_uses(const ASTNode *node, const char *name, bool *reads, bool *writes)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_IDENTIFIER:
+        *reads |= strcmp(node->data.name, name) == 0;
+        break;
+    case NODE_ARRAY_ACCESS:
+        *reads |= strcmp(node->data.array.name, name) == 0;
+        find_uses(node->data.array.index, name, reads, writes);
+        break;
+    case NODE_DECLARATION:
+    case NODE_ASSIGNMENT:
+        if (node->data.op.left->type == NODE_IDENTIFIER)
+            *writes |= strcmp(node->data.op.left->data.name, name) == 0;
+        else
+            find_uses(node->data.op.left, name, reads, writes);
+        find_uses(node->data.op.right, name, reads, writes);
+        break;
+    case NODE_OPERATION:
+        find_uses(node->data.op.left, name, reads, writes);
+        find_uses(node->data.op.right, name, reads, writes);
+        break;
+    case NODE_RETURN:
+    case NODE_PRINT_STATEMENT:
+    case NODE_ERROR_STATEMENT:
+        find_uses(node->data.op.left, name, reads, writes);
+        break;
+    case NODE_UNARY_OPERATION:
+        if (node->data.unary.op != OP_NEG && node->data.unary.operand->type == NODE_IDENTIFIER)
+            *writes |= strcmp(node->data.unary.operand->data.name, name) == 0;
+        find_uses(node->data.unary.operand, name, reads, writes);
+        break;
+    case NODE_SIZEOF:
+        find_uses(node->data.sizeof_stmt.expr, name, reads, writes);
+        break;
+    case NODE_FUNC_CALL:
+        for (ArgumentList *arg = node->data.func_call.arguments; arg; arg = arg->next)
+        {
+            if (node->data.func_call.builtin == BUILTIN_SLORP && arg->expr->type == NODE_IDENTIFIER)
+                *writes |= strcmp(arg->expr->data.name, name) == 0;
+            find_uses(arg->expr, name, reads, writes);
+        }
+        break;
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            find_uses(entry->statement, name, reads, writes);
+        break;
+    case NODE_FOR_STATEMENT:
+        find_uses(node->data.for_stmt.init, name, reads, writes);
+        find_uses(node->data.for_stmt.cond, name, reads, writes);
+        find_uses(node->data.for_stmt.incr, name, reads, writes);
+        find_uses(node->data.for_stmt.body, name, reads, writes);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        find_uses(node->data.while_stmt.cond, name, reads, writes);
+        find_uses(node->data.while_stmt.body, name, reads, writes);
+        break;
+    case NODE_IF_STATEMENT:
+        find_uses(node->data.if_stmt.condition, name, reads, writes);
+        find_uses(node->data.if_stmt.then_branch, name, reads, writes);
+        find_uses(node->data.if_stmt.else_branch, name, reads, writes);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        find_uses(node->data.switch_stmt.expression, name, reads, writes);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            find_uses(entry->statements, name, reads, writes);
+        break;
+    default:
+        break;
+    }
+}
+
+/* The step of `i++`, `i--`, `i = i + c` or `i = i - c` for a literal c. */
+static bool counter_step(const ASTNode *incr, const char *counter, int *step)
+{
+    if (!incr)
+        return false;
+    if (incr->type == NODE_UNARY_OPERATION)
+    {
+        const ASTNode *operand = incr->data.unary.operand;
+        if (incr->data.unary.op == OP_NEG || operand->type != NODE_IDENTIFIER ||
+            strcmp(operand->data.name, counter) != 0)
+            return false;
+        *step = incr->data.unary.op == OP_PRE_INC || incr->data.unary.op == OP_POST_INC ? 1 : -1;
+        return true;
+    }
+    if (incr->type != NODE_ASSIGNMENT || incr->data.op.left->type != NODE_IDENTIFIER ||
+        strcmp(incr->data.op.left->data.name, counter) != 0)
+        return false;
+    const ASTNode *value = incr->data.op.right;
+    if (value->type != NODE_OPERATION || (value->data.op.op != OP_PLUS && value->data.op.op != OP_MINUS) ||
+        value->data.op.left->type != NODE_IDENTIFIER ||
+        strcmp(value->data.op.left->data.name, counter) != 0 || value->data.op.right->type != NODE_INT)
+        return false;
+    unsigned amount = (unsigned)value->data.op.right->data.ivalue;
+    *step = (int)(value->data.op.op == OP_PLUS ? amount : 0u - amount);
+    return true;
+}
+
+/*
+ * Marks a flex loop of the form `flex (init; i < bound; i = i + c)` that
+ * execute_for_statement() can count natively: i is an int variable the
+ * body never writes, the bound an int literal or an int variable the body
+ * never writes, and the comparison <, <=, >, >= or !=.
+ */
+static void mark_counted_loop(Resolver *r, ASTNode *node)
+{
+    node->data.for_stmt.counted = false;
+    ASTNode *cond = node->data.for_stmt.cond;
+    if (!cond || cond->type != NODE_OPERATION)
+        return;
+    OperatorType op = cond->data.op.op;
+    ASTNode *counter = cond->data.op.left;
+    ASTNode *bound = cond->data.op.right;
+    if ((op != OP_LT && op != OP_LE && op != OP_GT && op != OP_GE && op != OP_NE) ||
+        !is_int_variable(r, counter) || (bound->type != NODE_INT && !is_int_variable(r, bound)) ||
+        !counter_step(node->data.for_stmt.incr, counter->data.name, &node->data.for_stmt.step))
+        return;
+
+    bool reads = false, writes = false;
+    find_uses(node->data.for_stmt.body, counter->data.name, &reads, &writes);
+    if (bound->type == NODE_IDENTIFIER)
+    {
+        bool bound_read = false;
+        find_uses(node->data.for_stmt.body, bound->data.name, &bound_read, &writes);
+        find_uses(node->data.for_stmt.incr, bound->data.name, &bound_read, &writes);
+    }
+    if (writes)
+        return;
+    node->data.for_stmt.counted = true;
+    node->data.for_stmt.reads_counter = reads;
+}
+
+/*
+ * Records the values the counter of `flex (i = a; i < b; i = i + c)` holds
+ * in the loop's body: i is an int variable the body never writes, c a
+ * literal and a and b have ranges. Loops counting down with > or >= work
+ * the same way.
+ */
+static void push_counter_range(Resolver *r, ASTNode *node)
+{
+    ASTNode *init = node->data.for_stmt.init;
+    ASTNode *cond = node->data.for_stmt.cond;
+    if (!init || (init->type != NODE_DECLARATION && init->type != NODE_ASSIGNMENT) ||
+        init->data.op.left->type != NODE_IDENTIFIER || !cond || cond->type != NODE_OPERATION)
+        return;
+    OperatorType op = cond->data.op.op;
+    ASTNode *counter = cond->data.op.left;
+    int step;
+    if (!is_int_variable(r, counter) || strcmp(init->data.op.left->data.name, counter->data.name) != 0 ||
+        !counter_step(node->data.for_stmt.incr, counter->data.name, &step))
+        return;
+    bool up = step > 0 && (op == OP_LT || op == OP_LE);
+    bool down = step < 0 && (op == OP_GT || op == OP_GE);
+    long long start_low, start_high, bound_low, bound_high;
+    if ((!up && !down) || !expression_range(r, init->data.op.right, &start_low, &start_high) ||
+        !expression_range(r, cond->data.op.right, &bound_low, &bound_high))
+        return;
+    bool reads = false, writes = false;
+    find_uses(node->data.for_stmt.body, counter->data.name, &reads, &writes);
+    if (writes)
+        return;
+
+    // The step after the last value must not wrap around either
+    const void *key = lookup(r, counter->data.name)->key;
+    if (up)
+    {
+        long long high = op == OP_LT ? bound_high - 1 : bound_high;
+        if (high + step <= INT_MAX)
+            push_range(r, key, start_low, high);
+    }
+    else
+    {
+        long long low = op == OP_GT ? bound_low + 1 : bound_low;
+        if (low + step >= INT_MIN)
+            push_range(r, key, low, start_high);
+    }
+}
+
+/* Records the range of a rizz declared with a ranged initializer that
+ * nothing after it in its block writes. */
+static void push_declared_range(Resolver *r, ASTNode *decl, StatementList *rest)
+{
+    ASTNode *target = decl->data.op.left;
+    long long low, high;
+    if (decl->var_type != VAR_INT || !is_int_variable(r, target) ||
+        !expression_range(r, decl->data.op.right, &low, &high))
+        return;
+    bool reads = false, writes = false;
+    for (; rest && !writes; rest = rest->next)
+        find_uses(rest->statement, target->data.name, &reads, &writes);
+    if (!writes)
+        push_range(r, lookup(r, target->data.name)->key, low, high);
+}
+
+static void resolve_statement(Resolver *r, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+        {
+            resolve_statement(r, entry->statement);
+            if (entry->statement && entry->statement->type == NODE_DECLARATION)
+                push_declared_range(r, entry->statement, entry->next);
+        }
+        break;
+    case NODE_DECLARATION:
+    {
+        /* The variable exists before its initializer is evaluated. */
+        node->slot = declare(r, node->data.op.left->data.name, node)->slot;
+        node->data.op.left->slot = node->slot;
+        TypeInfo value = resolve_expression(r, node->data.op.right, NONE);
+        record_type(r, node, assignment_type(node, value));
+        break;
+    }
+    case NODE_ASSIGNMENT:
+    {
+        ASTNode *target = node->data.op.left;
+        if (target->type == NODE_ARRAY_ACCESS)
+        {
+            resolve_expression(r, target, NONE);
+            resolve_expression(r, node->data.op.right, NONE);
+            break;
+        }
+        TypeInfo value = resolve_expression(r, node->data.op.right, NONE);
+        record_type(r, bind(r, target, target->data.name), assignment_type(node, value));
+        break;
+    }
+    case NODE_OPERATION:
+    case NODE_UNARY_OPERATION:
+    case NODE_INT:
+    case NODE_SHORT:
+    case NODE_FLOAT:
+    case NODE_DOUBLE:
+    case NODE_CHAR:
+    case NODE_IDENTIFIER:
+        resolve_expression(r, node, generic_context(node));
+        break;
+    case NODE_FUNC_CALL:
+        resolve_call_statement(r, node);
+        break;
+    case NODE_FOR_STATEMENT:
+        begin_scope(r);
+        resolve_statement(r, node->data.for_stmt.init);
+        begin_scope(r);
+        resolve_expression(r, node->data.for_stmt.cond, generic_context(node->data.for_stmt.cond));
+        push_counter_range(r, node);
+        resolve_statement(r, node->data.for_stmt.body);
+        resolve_statement(r, node->data.for_stmt.incr);
+        mark_counted_loop(r, node);
+        end_scope(r);
+        end_scope(r);
+        break;
+    case NODE_WHILE_STATEMENT:
+        begin_scope(r);
+        resolve_expression(r, node->data.while_stmt.cond, generic_context(node->data.while_stmt.cond));
+        begin_scope(r);
+        resolve_statement(r, node->data.while_stmt.body);
+        end_scope(r);
+        end_scope(r);
+        break;
+    case NODE_DO_WHILE_STATEMENT:
+        begin_scope(r);
+        begin_scope(r);
+        resolve_statement(r, node->data.while_stmt.body);
+        end_scope(r);
+        resolve_expression(r, node->data.while_stmt.cond, generic_context(node->data.while_stmt.cond));
+        end_scope(r);
+        break;
+    case NODE_IF_STATEMENT:
+        begin_scope(r);
+        resolve_expression(r, node->data.if_stmt.condition, generic_context(node->data.if_stmt.condition));
+        resolve_statement(r, node->data.if_stmt.then_branch);
+        resolve_statement(r, node->data.if_stmt.else_branch);
+        end_scope(r);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        if (!node->data.switch_stmt.table)
+            node->data.switch_stmt.table = build_case_table(node);
+        resolve_expression(r, node->data.switch_stmt.expression, NONE);
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+        {
+            resolve_expression(r, entry->value, NONE);
+            resolve_statement(r, entry->statements);
+        }
+        break;
+    case NODE_RETURN:
+    case NODE_ERROR_STATEMENT:
+    case NODE_PRINT_STATEMENT:
+        resolve_expression(r, node->data.op.left, NONE);
+        break;
+    default:
+        break;
+    }
+}
+
+static void begin_frame(Resolver *r)
+{
+    r->binding_count = 0;
+    r->depth = 0;
+    r->slot_count = 0;
+    r->frame_size = 0;
+    r->range_count = 0;
+}
+
+static void declare_parameters(Resolver *r, Parameter *param)
+{
+    /* The parser builds the list back to front; parameters take the first
+     * slots in declaration order. */
+    if (!param)
+        return;
+    declare_parameters(r, param->next);
+    declare(r, param->name, param);
+    record_type(r, param, param->type == VAR_CHAR ? VAR_INT : param->type);
+}
+
+static void resolve_function(Resolver *r, ASTNode *def)
+{
+    begin_frame(r);
+    declare_parameters(r, def->data.function_def.parameters);
+    resolve_statement(r, def->data.function_def.body);
+    def->data.function_def.frame_size = r->frame_size;
+}
+
+/* Returns the number of slots main's frame needs. */
+static int resolve_main(Resolver *r, ASTNode *body)
+{
+    begin_frame(r);
+    size_t cursor = 0;
+    for (Variable *var = next_global_array(&cursor); var; var = next_global_array(&cursor))
+    {
+        HashMapNode *entry = brainrot->current_scope->variables->nodes[cursor - 1];
+        char *name = arena_alloc(&brainrot->arena, entry->key_size + 1);
+        memcpy(name, entry->key, entry->key_size);
+        name[entry->key_size] = '\0';
+        declare(r, name, var)->global = var;
+    }
+    resolve_statement(r, body);
+    return r->frame_size;
+}
+
+/* Copies the global arrays into the slots resolve_main() gave them. The
+ * copies share their storage with the global scope, which owns it. */
+void bind_global_arrays(Frame *frame)
+{
+    size_t cursor = 0;
+    int slot = 0;
+    for (Variable *var = next_global_array(&cursor); var; var = next_global_array(&cursor))
+    {
+        frame->slots[slot] = *var;
+        frame->slots[slot].name = "";
+        slot++;
+    }
+}
+
+int resolve_program(ASTNode *root)
+{
+    if (!root || root->type != NODE_STATEMENT_LIST)
+        return 0;
+
+    Resolver resolver;
+    memset(&resolver, 0, sizeof(resolver));
+    resolver.types = hm_new();
+
+    /* Iterate until no variable changes its set of types. Types only move
+     * from unknown to a single type to NONE, so this terminates. Slots come
+     * out the same on every round. */
+    int main_frame_size = 0;
+    do
+    {
+        resolver.changed = false;
+        brainrot->bounds_stats = (BoundsStats){0, 0};
+        for (StatementList *entry = root->data.statements; entry; entry = entry->next)
+        {
+            ASTNode *statement = entry->statement;
+            if (statement && statement->type == NODE_FUNCTION_DEF)
+                resolve_function(&resolver, statement);
+            else
+                main_frame_size = resolve_main(&resolver, statement);
+        }
+    } while (resolver.changed);
+
+    free(resolver.bindings);
+    free(resolver.ranges);
+    free_table(resolver.types);
+    return main_frame_size;
+}
@@ -13,26 +13,30 @@ file_path = os.path.join(script_dir, "expected_results.json")
 with open(file_path, "r") as file:
     expected_results = json.load(file)
 
-@pytest.mark.parametrize("example,expected_output", expected_results.items())
-def test_brainrot_examples(example, expected_output):
-    brainrot_path = os.path.abspath(os.path.join(script_dir, "../brainrot"))
-    example_file_path = os.path.abspath(os.path.join(script_dir, f"../test_cases/{example}.brainrot"))
-
+def with_input(example, command):
+    """Pipes the input a slorp test case reads into the command."""
     if example.startswith("slorp_int"):
-        command = f"echo '42' | {brainrot_path} {example_file_path}"
+        return f"echo '42' | {command}"
     elif example.startswith("slorp_short"):
-        command = f"echo '69' | {brainrot_path} {example_file_path}"
+        return f"echo '69' | {command}"
     elif example.startswith("slorp_float"):
-        command = f"echo '3.14' | {brainrot_path} {example_file_path}"
+        return f"echo '3.14' | {command}"
     elif example.startswith("slorp_double"):
-        command = f"echo '3.141592' | {brainrot_path} {example_file_path}"
+        return f"echo '3.141592' | {command}"
     elif example.startswith("slorp_char"):
-        command = f"echo 'c' | {brainrot_path} {example_file_path}"
+        return f"echo 'c' | {command}"
     elif example.startswith("slorp_string"):
-        command = f"echo 'skibidi bop bop yes yes' | {brainrot_path} {example_file_path}"
-    else:
-        command = f"{brainrot_path} {example_file_path}"
+        return f"echo 'skibidi bop bop yes yes' | {command}"
+    return command
+
+@pytest.mark.parametrize("engine", ["vm", "jit", "ast", "closure"])
+@pytest.mark.parametrize("example,expected_output", expected_results.items())
+def test_brainrot_examples(example, expected_output, engine):
+    brainrot_path = os.path.abspath(os.path.join(script_dir, "../brainrot"))
+    brainrot_path = f"{brainrot_path} --engine={engine}"
+    example_file_path = os.path.abspath(os.path.join(script_dir, f"../test_cases/{example}.brainrot"))
 
+    command = with_input(example, f"{brainrot_path} {example_file_path}")
     result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, shell=True)
     actual_output = result.stdout.strip() if result.stdout.strip() else result.stderr.strip()
 
@@ -51,5 +55,84 @@ def test_brainrot_examples(example, expected_output):
             f"Stderr:\n{result.stderr}"
         )
 
+@pytest.mark.parametrize("engine", ["vm", "jit", "ast", "closure"])
+def test_programs_run_concurrently(engine):
+    """Programs given together run at once, each on its own thread and in
+    its own context, and print what they print when run alone. A runtime
+    error or ragequit ends only the program that hit it."""
+    brainrot_path = os.path.abspath(os.path.join(script_dir, "../brainrot"))
+    # Programs that read stdin would share it.
+    examples = [example for example in expected_results if with_input(example, "") == ""]
+    example_file_paths = [os.path.abspath(os.path.join(script_dir, f"../test_cases/{example}.brainrot"))
+                          for example in examples]
+
+    def run(*paths):
+        return subprocess.run([brainrot_path, f"--engine={engine}", *paths],
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+    alone = [(path, run(path)) for path in example_file_paths]
+    together = run(*example_file_paths)
+    assert together.stdout == "".join(result.stdout for _, result in alone)
+    assert together.stderr == "".join(
+        result.stderr + (f"{path}: exited with status {result.returncode}\n" if result.returncode else "")
+        for path, result in alone)
+    failed = [result.returncode for _, result in alone if result.returncode]
+    assert together.returncode == (failed[-1] if failed else 0)
+
+# Test cases --native cannot translate yet, because the bytecode compiler
+# bails on them. A new gap fails the test; a closed one must leave the list.
+NOT_TRANSLATED = {
+    "boolean",          # assignment changes the variable type
+    "fizz_buzz_short",  # increment changes the variable type
+    "licm_retype",      # assignment changes the variable type
+    "quickening",       # assignment changes the variable type
+    "short_promotion",  # assignment changes the variable type
+    "slorp_char",       # unsupported type for slorp
+}
+
+@pytest.mark.parametrize("example", expected_results.keys())
+def test_native_matches_interpreter(example, tmp_path):
+    """Programs built with --native print exactly what the interpreter prints."""
+    brainrot_path = os.path.abspath(os.path.join(script_dir, "../brainrot"))
+    example_file_path = os.path.abspath(os.path.join(script_dir, f"../test_cases/{example}.brainrot"))
+    executable = tmp_path / example
+
+    build = subprocess.run([brainrot_path, f"--native={executable}", example_file_path],
+                           stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    if example in NOT_TRANSLATED:
+        assert "Cannot translate to C" in build.stderr, f"{example} translates now; drop it from NOT_TRANSLATED"
+        pytest.xfail(build.stderr.strip())
+    assert "Cannot translate to C" not in build.stderr, build.stderr
+
+    interpreted = subprocess.run(with_input(example, f"{brainrot_path} {example_file_path}"),
+                                 stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+    if not executable.exists():
+        # Rejected before it runs, so the build reports the interpreter's error.
+        assert build.stderr.encode() == interpreted.stderr
+        return
+    native = subprocess.run(with_input(example, str(executable)),
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+    assert native.stdout == interpreted.stdout
+    assert native.stderr == interpreted.stderr
+    assert native.returncode == interpreted.returncode
+
+@pytest.mark.parametrize("engine", ["vm", "ast"])
+@pytest.mark.parametrize("example", expected_results.keys())
+def test_optimization_levels_agree(example, engine):
+    """Every -O level runs a program exactly as -O0 does."""
+    brainrot_path = os.path.abspath(os.path.join(script_dir, "../brainrot"))
+    example_file_path = os.path.abspath(os.path.join(script_dir, f"../test_cases/{example}.brainrot"))
+
+    def run(level):
+        command = with_input(example, f"{brainrot_path} -O{level} --engine={engine} {example_file_path}")
+        return subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, shell=True)
+
+    unoptimized = run(0)
+    for level in (1, 2):
+        optimized = run(level)
+        assert optimized.stdout == unoptimized.stdout, f"-O{level} changed stdout"
+        assert optimized.stderr == unoptimized.stderr, f"-O{level} changed stderr"
+        assert optimized.returncode == unoptimized.returncode, f"-O{level} changed the exit code"
+
 if __name__ == "__main__":
     pytest.main(["-v", os.path.abspath(__file__)])
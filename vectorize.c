@@ -0,0 +1,484 @@
+/* vectorize.c */
+
+#include "optimizer.h"
+#include "lib/pool.h"
+#include <limits.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Loop vectorization.
+ *
+ * Compiles flex loops whose whole body stores one element-wise expression
+ * into an array, such as `c[i] = a[i] * k + b[i]`, into a VectorKernel:
+ * the expression's steps in postfix order. The loop has to count up by one
+ * against `i < b` or `i <= b`, and every index be the counter plus or
+ * minus a literal. Loops the idiom pass recognized keep their idiom.
+ *
+ * The body writes nothing but the target element a[i + d], so only reads
+ * of `a` can depend on an earlier iteration. One at a[i + s] with s < d
+ * reads what the loop stored d - s iterations before; the kernel loads a
+ * whole block of lanes before it stores any of them, so it sees that store
+ * only if d - s >= VECTOR_LANES, and the pass leaves closer reads to the
+ * scalar loop. Reads at s >= d take elements no earlier iteration wrote.
+ *
+ * When the loop is counted (see execute_for_statement()), the tree-walker
+ * hands the counter's range to run_vector_kernel(), as the bytecode VM's
+ * KERNEL instruction does for a loop that may run on the thread pool. It
+ * checks the variables it finds - int or gigachad, every index in bounds,
+ * and the same distance for arrays that turn out to share storage - then
+ * runs whole blocks of VECTOR_LANES iterations with SSE2 and leaves the
+ * last few iterations to the scalar loop. Every lane does the operations the
+ * loop does, in the same order and types, so the results are identical:
+ * int arithmetic wraps, and a gigachad division by zero goes through
+ * double_binary().
+ */
+
+/* Pass */
+
+typedef struct
+{
+    VectorStep steps[VECTOR_MAX_STEPS];
+    int count;
+    const char *counter;
+    const ASTNode *target;
+    int offset; /* of the target */
+} Vectorizer;
+
+static bool emit(Vectorizer *v, VectorStepKind kind, ASTNode *node, int offset)
+{
+    if (v->count == VECTOR_MAX_STEPS)
+        return false;
+    v->steps[v->count++] = (VectorStep){kind, node, offset};
+    return true;
+}
+
+static bool compile_expression(Vectorizer *v, ASTNode *node)
+{
+    switch (node->type)
+    {
+    case NODE_ARRAY_ACCESS:
+    {
+        int offset;
+        if (!counter_access(node, v->counter, &offset))
+            return false;
+        // A read of the target's element from fewer than a block of
+        // iterations ago
+        if (strcmp(node->data.array.name, v->target->data.array.name) == 0 && offset < v->offset &&
+            (long long)v->offset - offset < VECTOR_LANES)
+            return false;
+        return emit(v, VECTOR_LOAD, node, offset);
+    }
+    case NODE_IDENTIFIER:
+        return emit(v, strcmp(node->data.name, v->counter) == 0 ? VECTOR_COUNTER : VECTOR_SCALAR, node, 0);
+    case NODE_INT:
+    case NODE_DOUBLE:
+        return emit(v, VECTOR_SCALAR, node, 0);
+    case NODE_UNARY_OPERATION:
+        return node->data.unary.op == OP_NEG && compile_expression(v, node->data.unary.operand) &&
+               emit(v, VECTOR_NEGATE, node, 0);
+    case NODE_OPERATION:
+        switch (node->data.op.op)
+        {
+        case OP_PLUS:
+        case OP_MINUS:
+        case OP_TIMES:
+        case OP_DIVIDE:
+            return compile_expression(v, node->data.op.left) && compile_expression(v, node->data.op.right) &&
+                   emit(v, VECTOR_BINARY, node, 0);
+        default:
+            return false;
+        }
+    default:
+        return false;
+    }
+}
+
+static VectorKernel *compile_loop(ASTNode *node)
+{
+    const char *counter = unit_step_counter(node);
+    ASTNode *store = single_statement(node->data.for_stmt.body);
+    if (!counter || !store || store->type != NODE_ASSIGNMENT)
+        return NULL;
+    Vectorizer v = {.counter = counter, .target = store->data.op.left};
+    if (!counter_access(v.target, counter, &v.offset) || !compile_expression(&v, store->data.op.right))
+        return NULL;
+
+    VectorKernel *kernel = ARENA_ALLOC(VectorKernel);
+    kernel->target = store->data.op.left;
+    kernel->offset = v.offset;
+    kernel->steps = ARENA_ALLOC_ARRAY(VectorStep, v.count);
+    memcpy(kernel->steps, v.steps, sizeof(VectorStep) * v.count);
+    kernel->count = v.count;
+    return kernel;
+}
+
+static void vectorize(int *found, ASTNode *node)
+{
+    if (!node)
+        return;
+    switch (node->type)
+    {
+    case NODE_STATEMENT_LIST:
+        for (StatementList *entry = node->data.statements; entry; entry = entry->next)
+            vectorize(found, entry->statement);
+        break;
+    case NODE_FUNCTION_DEF:
+        vectorize(found, node->data.function_def.body);
+        break;
+    case NODE_IF_STATEMENT:
+        vectorize(found, node->data.if_stmt.then_branch);
+        vectorize(found, node->data.if_stmt.else_branch);
+        break;
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        vectorize(found, node->data.while_stmt.body);
+        break;
+    case NODE_SWITCH_STATEMENT:
+        for (CaseNode *entry = node->data.switch_stmt.cases; entry; entry = entry->next)
+            vectorize(found, entry->statements);
+        break;
+    case NODE_FOR_STATEMENT:
+        vectorize(found, node->data.for_stmt.body);
+        if (!node->data.for_stmt.idiom)
+            node->data.for_stmt.vector = compile_loop(node);
+        *found += node->data.for_stmt.vector != NULL;
+        break;
+    default:
+        break;
+    }
+}
+
+int vectorize_loops(ASTNode *root)
+{
+    int found = 0;
+    vectorize(&found, root);
+    // The JIT's machine code outruns the kernel on a single thread
+    if (found && brainrot->translated)
+        opt_remark("C runs a vectorized loop element by element");
+    else if (found && brainrot->bytecode)
+        opt_remark("the bytecode VM runs a vectorized loop element by element unless it runs on threads");
+    return found;
+}
+
+/* Kernel */
+
+/* A step with the variables it reads looked up */
+typedef struct
+{
+    VectorStepKind kind;
+    OperatorType op;
+    bool is_double;       /* the type of the value the step leaves */
+    bool widen;           /* the value is then read as a double */
+    const void *elements; /* a load's element for the first counter value */
+    int ivalue;
+    double dvalue;
+} BoundStep;
+
+typedef union
+{
+    int ints[VECTOR_LANES];
+    double doubles[VECTOR_LANES];
+} Lanes;
+
+/* The array an access names, if it is int or gigachad and has an element
+ * for every counter value from first to last */
+static Variable *numeric_array(const ASTNode *access, int offset, int first, int last)
+{
+    Variable *var = lookup_variable((ASTNode *)access);
+    if (!var || !var->is_array || (var->var_type != VAR_INT && var->var_type != VAR_DOUBLE) ||
+        var->modifiers.is_unsigned)
+        return NULL;
+    long long low = (long long)first + offset;
+    long long high = (long long)last + offset;
+    return low >= 0 && high < var->array_length ? var : NULL;
+}
+
+static void *element_at(const Variable *var, long long index)
+{
+    if (var->var_type == VAR_DOUBLE)
+        return (double *)var->value.array_data + index;
+    return (int *)var->value.array_data + index;
+}
+
+/* Fills in `bound` for counter values first to last, and *shared if a read
+ * takes elements other iterations store; false if a variable is not what
+ * the kernel handles or a read depends on a store too close before it. */
+static bool bind_steps(const VectorKernel *kernel, const Variable *target, int first, int last, BoundStep *bound,
+                       bool *shared)
+{
+    *shared = false;
+    int stack[VECTOR_MAX_STEPS];
+    int top = 0;
+    for (int s = 0; s < kernel->count; s++)
+    {
+        const VectorStep *step = &kernel->steps[s];
+        ASTNode *node = step->node;
+        BoundStep *b = &bound[s];
+        *b = (BoundStep){.kind = step->kind};
+        switch (step->kind)
+        {
+        case VECTOR_LOAD:
+        {
+            Variable *var = numeric_array(node, step->offset, first, last);
+            if (!var || (var->value.array_data == target->value.array_data && step->offset < kernel->offset &&
+                         (long long)kernel->offset - step->offset < VECTOR_LANES))
+                return false;
+            *shared |= var->value.array_data == target->value.array_data && step->offset != kernel->offset;
+            b->is_double = var->var_type == VAR_DOUBLE;
+            b->elements = element_at(var, (long long)first + step->offset);
+            break;
+        }
+        case VECTOR_COUNTER:
+            break;
+        case VECTOR_SCALAR:
+            if (node->type == NODE_INT)
+                b->ivalue = node->data.ivalue;
+            else if (node->type == NODE_DOUBLE)
+            {
+                b->is_double = true;
+                b->dvalue = node->data.dvalue;
+            }
+            else
+            {
+                Variable *var = lookup_variable(node);
+                if (!var || var->is_array || (var->var_type != VAR_INT && var->var_type != VAR_DOUBLE))
+                    return false;
+                b->is_double = var->var_type == VAR_DOUBLE;
+                b->ivalue = var->value.ivalue;
+                b->dvalue = var->value.dvalue;
+            }
+            break;
+        case VECTOR_NEGATE:
+            b->is_double = bound[stack[top - 1]].is_double;
+            top--;
+            break;
+        case VECTOR_BINARY:
+        {
+            // handle_binary_operation(): an int operand next to a double
+            // one is evaluated as an int, then converted
+            BoundStep *left = &bound[stack[top - 2]];
+            BoundStep *right = &bound[stack[top - 1]];
+            b->op = node->data.op.op;
+            b->is_double = left->is_double || right->is_double;
+            if (node->modifiers.is_unsigned || (!b->is_double && b->op == OP_DIVIDE))
+                return false;
+            left->widen = !left->is_double && b->is_double;
+            right->widen = !right->is_double && b->is_double;
+            top -= 2;
+            break;
+        }
+        }
+        stack[top++] = s;
+    }
+
+    int root = stack[0];
+    if (target->var_type == VAR_INT)
+        return !bound[root].is_double;
+    if (bound[root].is_double)
+        return true;
+    // An int value stored into a gigachad array is evaluated as a double
+    // from the top: a negation negates the converted value
+    int value = root;
+    while (bound[value].kind == VECTOR_NEGATE)
+        value--;
+    // A variable evaluate_expression_double() reads with its own promotion
+    if (bound[value].kind == VECTOR_COUNTER ||
+        (bound[value].kind == VECTOR_SCALAR && kernel->steps[value].node->type == NODE_IDENTIFIER))
+        return false;
+    bound[value].widen = true;
+    for (int s = value + 1; s <= root; s++)
+        bound[s].is_double = true;
+    return true;
+}
+
+static void int_lanes(OperatorType op, int *x, const int *y)
+{
+#ifdef __SSE2__
+    for (int k = 0; k < VECTOR_LANES; k += 4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(x + k));
+        __m128i b = _mm_loadu_si128((const __m128i *)(y + k));
+        __m128i result;
+        if (op == OP_PLUS)
+            result = _mm_add_epi32(a, b);
+        else if (op == OP_MINUS)
+            result = _mm_sub_epi32(a, b);
+        else
+        {
+            // The low 32 bits of the even and the odd lanes' products
+            __m128i even = _mm_mul_epu32(a, b);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+            result = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+        _mm_storeu_si128((__m128i *)(x + k), result);
+    }
+#else
+    for (int k = 0; k < VECTOR_LANES; k++)
+    {
+        unsigned a = (unsigned)x[k], b = (unsigned)y[k];
+        x[k] = (int)(op == OP_PLUS ? a + b : op == OP_MINUS ? a - b : a * b);
+    }
+#endif
+}
+
+static void double_lanes(OperatorType op, double *x, const double *y)
+{
+    if (op == OP_DIVIDE)
+    {
+        for (int k = 0; k < VECTOR_LANES; k++)
+        {
+            // double_binary() replaces a division by zero or a denormal
+            if (fabs(y[k]) < __DBL_MIN__)
+            {
+                for (k = 0; k < VECTOR_LANES; k++)
+                    x[k] = double_binary(op, x[k], y[k], false);
+                return;
+            }
+        }
+    }
+#ifdef __SSE2__
+    for (int k = 0; k < VECTOR_LANES; k += 2)
+    {
+        __m128d a = _mm_loadu_pd(x + k);
+        __m128d b = _mm_loadu_pd(y + k);
+        __m128d result = op == OP_PLUS    ? _mm_add_pd(a, b)
+                         : op == OP_MINUS ? _mm_sub_pd(a, b)
+                         : op == OP_TIMES ? _mm_mul_pd(a, b)
+                                          : _mm_div_pd(a, b);
+        _mm_storeu_pd(x + k, result);
+    }
+#else
+    for (int k = 0; k < VECTOR_LANES; k++)
+        x[k] = op == OP_PLUS    ? x[k] + y[k]
+               : op == OP_MINUS ? x[k] - y[k]
+               : op == OP_TIMES ? x[k] * y[k]
+                                : x[k] / y[k];
+#endif
+}
+
+static void widen_lanes(Lanes *lanes)
+{
+    int ints[VECTOR_LANES];
+    memcpy(ints, lanes->ints, sizeof(ints));
+    for (int k = 0; k < VECTOR_LANES; k++)
+        lanes->doubles[k] = (double)ints[k];
+}
+
+/* Runs the steps for the block of iterations from counter value `start` */
+static void run_block(const BoundStep *bound, int count, Lanes *values, int start, int block)
+{
+    int top = 0;
+    for (int s = 0; s < count; s++)
+    {
+        const BoundStep *b = &bound[s];
+        Lanes *value = &values[top];
+        switch (b->kind)
+        {
+        case VECTOR_LOAD:
+            if (b->is_double)
+                memcpy(value->doubles, (const double *)b->elements + block, sizeof(value->doubles));
+            else
+                memcpy(value->ints, (const int *)b->elements + block, sizeof(value->ints));
+            top++;
+            break;
+        case VECTOR_COUNTER:
+            for (int k = 0; k < VECTOR_LANES; k++)
+                value->ints[k] = start + block + k;
+            top++;
+            break;
+        case VECTOR_SCALAR:
+            for (int k = 0; k < VECTOR_LANES; k++)
+            {
+                if (b->is_double)
+                    value->doubles[k] = b->dvalue;
+                else
+                    value->ints[k] = b->ivalue;
+            }
+            top++;
+            break;
+        case VECTOR_NEGATE:
+            value = &values[top - 1];
+            for (int k = 0; k < VECTOR_LANES; k++)
+            {
+                if (b->is_double)
+                    value->doubles[k] = -value->doubles[k];
+                else
+                    value->ints[k] = (int)(0u - (unsigned)value->ints[k]);
+            }
+            break;
+        case VECTOR_BINARY:
+            value = &values[top - 2];
+            if (b->is_double)
+                double_lanes(b->op, value->doubles, values[top - 1].doubles);
+            else
+                int_lanes(b->op, value->ints, values[top - 1].ints);
+            top--;
+            break;
+        }
+        if (b->widen)
+            widen_lanes(&values[top - 1]);
+    }
+}
+
+/* A kernel bound to its variables, run a range of blocks at a time */
+typedef struct
+{
+    const BoundStep *bound;
+    int steps;
+    int first;
+    char *out; /* the element stored for the first counter value */
+    bool to_double;
+    int count;
+} VectorRun;
+
+static void run_blocks(const VectorRun *run, int from, int to)
+{
+    Lanes values[VECTOR_MAX_STEPS];
+    size_t size = run->to_double ? sizeof(double) : sizeof(int);
+    for (int block = from; block < to; block += VECTOR_LANES)
+    {
+        run_block(run->bound, run->steps, values, run->first, block);
+        memcpy(run->out + (size_t)block * size, run->to_double ? (void *)values[0].doubles : (void *)values[0].ints,
+               size * VECTOR_LANES);
+    }
+}
+
+static void run_chunk(void *context, int chunk)
+{
+    const VectorRun *run = context;
+    int from = chunk * PARALLEL_CHUNK;
+    run_blocks(run, from, run->count - from < PARALLEL_CHUNK ? run->count : from + PARALLEL_CHUNK);
+}
+
+/* Runs the loop body for counter values from first on (first <= last), a
+ * whole number of blocks of VECTOR_LANES of them; returns how many it ran,
+ * 0 if the variables it finds are not what the kernel handles. A schizo
+ * flex loop whose iterations store and read disjoint elements runs its
+ * blocks on the thread pool. */
+int run_vector_kernel(const VectorKernel *kernel, int first, int last, LoopParallelism parallel)
+{
+    long long iterations = (long long)last - first + 1;
+    if (iterations < VECTOR_LANES || iterations > INT_MAX)
+        return 0;
+    int count = (int)(iterations / VECTOR_LANES * VECTOR_LANES);
+    last = first + count - 1;
+    Variable *target = numeric_array(kernel->target, kernel->offset, first, last);
+    if (!target || target->modifiers.is_const)
+        return 0;
+    BoundStep bound[VECTOR_MAX_STEPS];
+    bool shared;
+    if (!bind_steps(kernel, target, first, last, bound, &shared))
+        return 0;
+
+    VectorRun run = {bound, kernel->count, first, element_at(target, (long long)first + kernel->offset),
+                     target->var_type == VAR_DOUBLE, count};
+    if (parallel != LOOP_SEQUENTIAL && !shared && count >= 2 * PARALLEL_CHUNK)
+        pool_run((count + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK, run_chunk, &run);
+    else
+        run_blocks(&run, 0, count);
+    return count;
+}
@@ -0,0 +1,788 @@
+/* vm.c */
+
+#include "vm.h"
+#include <limits.h>
+#include <math.h>
+
+/* Include the runtime functions from lang.y */
+extern void report_error(const char *s);
+extern void ragequit(int exit_code);
+extern void chill(unsigned int seconds);
+extern void yapping(const char *format, ...);
+extern void yappin(const char *format, ...);
+extern void baka(const char *format, ...);
+extern char *slorp_string(char *string, size_t size);
+extern int slorp_int(int val);
+extern short slorp_short(short val);
+extern float slorp_float(float var);
+extern double slorp_double(double var);
+
+#define VM_MAX_CALL_DEPTH (1 << 20)
+#define PRINT_BUFFER_SIZE 1024
+
+/* Native code calls back into vm_run() on the C stack; past this many
+ * nested native activations calls are interpreted on the VM's own stack. */
+#define JIT_MAX_NATIVE_DEPTH 1024
+
+typedef struct
+{
+    BytecodeFunction *function;
+    const Instruction *pc; /* return address in the caller */
+    size_t base;           /* caller's first register */
+    uint16_t result;       /* caller register receiving the return value */
+} CallFrame;
+
+typedef struct VMState
+{
+    BytecodeProgram *program;
+    Register *stack;
+    size_t stack_capacity;
+    CallFrame *frames;
+    int frame_count;
+    int frame_capacity;
+    int jit_threshold; /* JIT_DISABLED to interpret everything */
+    int native_depth;  /* native activations on the C stack */
+} VMState;
+
+static const char *opcode_names[] = {
+#define BYTECODE_NAME(name) #name,
+    BYTECODE_OPS(BYTECODE_NAME)
+#undef BYTECODE_NAME
+};
+
+const char *opcode_name(Opcode op)
+{
+    return op < BC_OPCODE_COUNT ? opcode_names[op] : "?";
+}
+
+static void ensure_stack(VMState *vm, size_t needed)
+{
+    if (needed <= vm->stack_capacity)
+        return;
+    size_t capacity = vm->stack_capacity ? vm->stack_capacity : 256;
+    while (capacity < needed)
+        capacity *= 2;
+    Register *stack = realloc(vm->stack, capacity * sizeof(Register));
+    if (!stack)
+    {
+        report_error("Memory allocation failed");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    memset(stack + vm->stack_capacity, 0, (capacity - vm->stack_capacity) * sizeof(Register));
+    vm->stack = stack;
+    vm->stack_capacity = capacity;
+}
+
+static void free_vm_state(VMState *vm)
+{
+    free(vm->stack);
+    free(vm->frames);
+}
+
+/* Appends snprintf output to the print buffer; returns false on overflow. */
+#define APPEND_FORMAT(spec, value)                                                       \
+    (offset += snprintf(buffer + offset, sizeof(buffer) - offset, (spec), (value)),     \
+     offset < (int)sizeof(buffer))
+
+/* Formats one yapping/yappin call exactly like execute_yapping_call(). */
+static void execute_print(const BytecodeProgram *program, const PrintFormat *format, const Register *R)
+{
+    char buffer[PRINT_BUFFER_SIZE];
+    int offset = 0;
+    bool fits = true;
+
+    for (int i = 0; i < format->segment_count && fits; i++)
+    {
+        const FormatSegment *segment = &format->segments[i];
+        const Register *value = &R[segment->reg];
+        switch (segment->kind)
+        {
+        case FORMAT_TEXT:
+        {
+            size_t length = strlen(segment->text);
+            fits = offset + (int)length < (int)sizeof(buffer);
+            if (fits)
+            {
+                memcpy(buffer + offset, segment->text, length);
+                offset += length;
+            }
+            break;
+        }
+        case FORMAT_BOOL:
+            fits = APPEND_FORMAT("%s", value->bvalue ? "W" : "L");
+            break;
+        case FORMAT_INT:
+            fits = APPEND_FORMAT(segment->text, value->ivalue);
+            break;
+        case FORMAT_SHORT:
+            fits = APPEND_FORMAT(segment->text, value->svalue);
+            break;
+        case FORMAT_USHORT:
+            fits = APPEND_FORMAT(segment->text, (unsigned short)value->svalue);
+            break;
+        case FORMAT_FLOAT:
+            fits = APPEND_FORMAT(segment->text, value->fvalue);
+            break;
+        case FORMAT_DOUBLE:
+            fits = APPEND_FORMAT(segment->text, value->dvalue);
+            break;
+        case FORMAT_STRING:
+            fits = APPEND_FORMAT(segment->text, program->strings[segment->index]);
+            break;
+        case FORMAT_ARRAY_STRING:
+            fits = APPEND_FORMAT(segment->text, (char *)program->arrays[segment->index].data);
+            break;
+        case FORMAT_ARRAY_FLOAT:
+        case FORMAT_ARRAY_DOUBLE:
+        {
+            const ArrayBinding *array = &program->arrays[segment->index];
+            int index = value->ivalue;
+            if (index < 0 || index >= array->length)
+            {
+                report_error("Array index out of bounds!");
+                return;
+            }
+            if (segment->kind == FORMAT_ARRAY_FLOAT)
+                fits = APPEND_FORMAT(segment->text, ((float *)array->data)[index]);
+            else
+                fits = APPEND_FORMAT(segment->text, ((double *)array->data)[index]);
+            break;
+        }
+        }
+    }
+
+    if (!fits)
+    {
+        report_error(format->target == PRINT_YAPPING ? "Buffer overflow in yapping call"
+                                                : "Buffer overflow in yappin call");
+        brainrot_exit(EXIT_FAILURE);
+    }
+    buffer[offset] = '\0';
+    if (format->target == PRINT_YAPPING)
+        yapping("%s", buffer);
+    else
+        yappin("%s", buffer);
+}
+
+static bool check_index(const ArrayBinding *array, int index)
+{
+    if (index < 0 || index >= array->length)
+    {
+        report_error("Array index out of bounds!");
+        return false;
+    }
+    return true;
+}
+
+static void register_to_variable(Variable *var, Register value)
+{
+    switch (var->var_type)
+    {
+    case VAR_SHORT:
+        var->value.svalue = value.svalue;
+        break;
+    case VAR_FLOAT:
+        var->value.fvalue = value.fvalue;
+        break;
+    case VAR_DOUBLE:
+        var->value.dvalue = value.dvalue;
+        break;
+    case VAR_BOOL:
+        var->value.bvalue = value.bvalue;
+        break;
+    default:
+        var->value.ivalue = value.ivalue;
+        break;
+    }
+}
+
+static Register variable_to_register(const Variable *var)
+{
+    Register value;
+    switch (var->var_type)
+    {
+    case VAR_SHORT:
+        value.svalue = var->value.svalue;
+        break;
+    case VAR_FLOAT:
+        value.fvalue = var->value.fvalue;
+        break;
+    case VAR_DOUBLE:
+        value.dvalue = var->value.dvalue;
+        break;
+    case VAR_BOOL:
+        value.bvalue = var->value.bvalue;
+        break;
+    default:
+        value.ivalue = var->value.ivalue;
+        break;
+    }
+    return value;
+}
+
+/* KERNEL: binds the kernel's scalars by name in a scope of their own, the
+ * way the tree-walker's kernels look variables up before a frame exists,
+ * runs the kernel over the counter's range and copies back what it wrote.
+ * The counter moves past the iterations the kernel ran. */
+static void run_kernel(const LoopKernel *kernel, Register *R, int bound)
+{
+    const ASTNode *loop = kernel->loop;
+    int first = R[kernel->scalars[0].reg].ivalue;
+    long long last = loop->data.for_stmt.cond->data.op.op == OP_LT ? (long long)bound - 1 : bound;
+    if (first > last || last >= INT_MAX)
+        return;
+
+    Scope *scope = create_scope(brainrot->current_scope);
+    scope->is_function_scope = false;
+    for (int s = 0; s < kernel->scalar_count; s++)
+    {
+        const KernelScalar *scalar = &kernel->scalars[s];
+        Variable var = {.name = (char *)scalar->name, .var_type = scalar->type, .modifiers = scalar->modifiers};
+        register_to_variable(&var, R[scalar->reg]);
+        hm_put(scope->variables, scalar->name, strlen(scalar->name), &var, sizeof(var));
+    }
+    brainrot->current_scope = scope;
+    int done;
+    if (loop->data.for_stmt.idiom)
+        done = run_loop_idiom(loop->data.for_stmt.idiom, first, (int)last, loop->data.for_stmt.parallel)
+                   ? (int)(last - first + 1)
+                   : 0;
+    else
+        done = run_vector_kernel(loop->data.for_stmt.vector, first, (int)last, loop->data.for_stmt.parallel);
+    brainrot->current_scope = scope->parent;
+
+    if (done)
+    {
+        for (int s = 1; s < kernel->scalar_count; s++)
+        {
+            const KernelScalar *scalar = &kernel->scalars[s];
+            R[scalar->reg] = variable_to_register(hm_get(scope->variables, scalar->name, strlen(scalar->name)));
+        }
+        R[kernel->scalars[0].reg].ivalue = first + done;
+    }
+    scope->parent = NULL;
+    free_scope(scope);
+}
+
+#define INT_ARITH_CASES(T, F, CT)                                                        \
+    case BC_ADD_##T:                                                                     \
+        R[i->a].F = (CT)((unsigned)R[i->b].F + (unsigned)R[i->c].F);                     \
+        break;                                                                           \
+    case BC_SUB_##T:                                                                     \
+        R[i->a].F = (CT)((unsigned)R[i->b].F - (unsigned)R[i->c].F);                     \
+        break;                                                                           \
+    case BC_MUL_##T:                                                                     \
+        R[i->a].F = (CT)((unsigned)R[i->b].F * (unsigned)R[i->c].F);                     \
+        break;                                                                           \
+    case BC_DIV_##T:                                                                     \
+        if (R[i->c].F == 0)                                                              \
+        {                                                                                \
+            report_error("Division by zero");                                                 \
+            R[i->a].F = 0;                                                               \
+        }                                                                                \
+        else                                                                             \
+        {                                                                                \
+            R[i->a].F = (CT)(R[i->b].F / R[i->c].F);                                     \
+        }                                                                                \
+        break;                                                                           \
+    case BC_NEG_##T:                                                                     \
+        R[i->a].F = (CT)(0u - (unsigned)R[i->b].F);                                      \
+        break;
+
+#define FLOAT_ARITH_CASES(T, F, CT, TINY, HUGE_VALUE)                                    \
+    case BC_ADD_##T:                                                                     \
+        R[i->a].F = R[i->b].F + R[i->c].F;                                               \
+        break;                                                                           \
+    case BC_SUB_##T:                                                                     \
+        R[i->a].F = R[i->b].F - R[i->c].F;                                               \
+        break;                                                                           \
+    case BC_MUL_##T:                                                                     \
+        R[i->a].F = R[i->b].F * R[i->c].F;                                               \
+        break;                                                                           \
+    case BC_DIV_##T:                                                                     \
+    {                                                                                    \
+        CT left = R[i->b].F;                                                             \
+        CT right = R[i->c].F;                                                            \
+        if (fabs(right) < TINY)                                                          \
+            R[i->a].F = fabs(left) < TINY ? (CT)0.0 / (CT)0.0 : left > 0 ? HUGE_VALUE : -HUGE_VALUE; \
+        else                                                                             \
+            R[i->a].F = left / right;                                                    \
+        break;                                                                           \
+    }                                                                                    \
+    case BC_MOD_##T:                                                                     \
+        R[i->a].F = (CT)fmod(R[i->b].F, R[i->c].F);                                      \
+        break;                                                                           \
+    case BC_NEG_##T:                                                                     \
+        R[i->a].F = -R[i->b].F;                                                          \
+        break;
+
+#define COMPARE_CASES(T, F)                                                              \
+    case BC_LT_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F < R[i->c].F;                                          \
+        break;                                                                           \
+    case BC_GT_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F > R[i->c].F;                                          \
+        break;                                                                           \
+    case BC_LE_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F <= R[i->c].F;                                         \
+        break;                                                                           \
+    case BC_GE_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F >= R[i->c].F;                                         \
+        break;                                                                           \
+    case BC_EQ_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F == R[i->c].F;                                         \
+        break;                                                                           \
+    case BC_NE_##T:                                                                      \
+        R[i->a].ivalue = R[i->b].F != R[i->c].F;                                         \
+        break;
+
+#define CONVERT_CASE(OP, TO, FROM, CT) \
+    case BC_##OP:                      \
+        R[i->a].TO = (CT)R[i->b].FROM; \
+        break;
+
+#define LOAD_ARRAY_CASE(OP, TO, CT)                                    \
+    case BC_##OP:                                                      \
+    {                                                                  \
+        const ArrayBinding *array = &program->arrays[i->b];            \
+        int index = R[i->c].ivalue;                                    \
+        R[i->a].TO = check_index(array, index) ? ((CT *)array->data)[index] : 0; \
+        break;                                                         \
+    }
+
+#define STORE_ARRAY_CASE(OP, FROM, CT)                      \
+    case BC_##OP:                                           \
+    {                                                       \
+        const ArrayBinding *array = &program->arrays[i->a]; \
+        int index = R[i->b].ivalue;                         \
+        if (check_index(array, index))                      \
+            ((CT *)array->data)[index] = R[i->c].FROM;      \
+        break;                                              \
+    }
+
+/* Fused branches jump by the signed 16-bit c; backward ones count
+ * towards compiling the function. */
+#define TAKE_BRANCH                     \
+    do                                  \
+    {                                   \
+        int16_t offset = (int16_t)i->c; \
+        pc += offset;                   \
+        if (offset < 0)                 \
+            note_hot(vm, function);     \
+    } while (0)
+
+#define BRANCH_CASE(OP, CMP, RIGHT)         \
+    case BC_##OP:                           \
+        if (R[i->a].ivalue CMP (RIGHT))     \
+            TAKE_BRANCH;                    \
+        break;
+
+#define BRANCH_CASES(T, RIGHT)            \
+    BRANCH_CASE(JLT_##T, <, RIGHT)        \
+    BRANCH_CASE(JGT_##T, >, RIGHT)        \
+    BRANCH_CASE(JLE_##T, <=, RIGHT)       \
+    BRANCH_CASE(JGE_##T, >=, RIGHT)       \
+    BRANCH_CASE(JEQ_##T, ==, RIGHT)       \
+    BRANCH_CASE(JNE_##T, !=, RIGHT)
+
+/* Counts an entry or a backward jump and compiles the function once it is hot. */
+static void note_hot(VMState *vm, BytecodeFunction *function)
+{
+    if (vm->jit_threshold != JIT_DISABLED && !function->jit_attempted &&
+        ++function->hotness >= (uint32_t)vm->jit_threshold)
+        jit_compile(vm->program, function);
+}
+
+/*
+ * Runs `function` with its registers at `base` until it returns, and
+ * returns its result. Calls made by interpreted code stay in this loop on
+ * the VM's frame stack; native code calls come back in through
+ * vm_call_from_native().
+ */
+static Register vm_run(VMState *vm, BytecodeFunction *function, size_t base)
+{
+    BytecodeProgram *program = vm->program;
+    const Instruction *pc = function->code;
+    const Register *K = program->constants;
+    int entry_depth = vm->frame_count;
+    ensure_stack(vm, base + function->register_count);
+    Register *R = vm->stack + base;
+    note_hot(vm, function);
+
+    for (;;)
+    {
+        if (function->native && vm->native_depth < JIT_MAX_NATIVE_DEPTH)
+        {
+            vm->native_depth++;
+            int exit = jit_run(function->native, vm, R, pc - function->code);
+            vm->native_depth--;
+            R = vm->stack + base;
+            pc = function->code + exit;
+        }
+
+        const Instruction *i = pc++;
+        switch ((Opcode)i->op)
+        {
+        case BC_MOVE:
+            R[i->a] = R[i->b];
+            break;
+        case BC_LOADI:
+            R[i->a].ivalue = i->sbx;
+            break;
+        case BC_LOADK:
+            R[i->a] = K[i->sbx];
+            break;
+
+            CONVERT_CASE(I2S, svalue, ivalue, short)
+            CONVERT_CASE(I2F, fvalue, ivalue, float)
+            CONVERT_CASE(I2D, dvalue, ivalue, double)
+            CONVERT_CASE(I2B, bvalue, ivalue, bool)
+            CONVERT_CASE(S2I, ivalue, svalue, int)
+            CONVERT_CASE(S2F, fvalue, svalue, float)
+            CONVERT_CASE(S2D, dvalue, svalue, double)
+            CONVERT_CASE(S2B, bvalue, svalue, bool)
+            CONVERT_CASE(F2I, ivalue, fvalue, int)
+            CONVERT_CASE(F2S, svalue, fvalue, short)
+            CONVERT_CASE(F2D, dvalue, fvalue, double)
+            CONVERT_CASE(F2B, bvalue, fvalue, bool)
+            CONVERT_CASE(D2I, ivalue, dvalue, int)
+            CONVERT_CASE(D2S, svalue, dvalue, short)
+            CONVERT_CASE(D2F, fvalue, dvalue, float)
+            CONVERT_CASE(D2B, bvalue, dvalue, bool)
+            CONVERT_CASE(B2I, ivalue, bvalue, int)
+            CONVERT_CASE(B2S, svalue, bvalue, short)
+            CONVERT_CASE(B2F, fvalue, bvalue, float)
+            CONVERT_CASE(B2D, dvalue, bvalue, double)
+
+            INT_ARITH_CASES(I, ivalue, int)
+            INT_ARITH_CASES(S, svalue, short)
+            FLOAT_ARITH_CASES(F, fvalue, float, __FLT_MIN__, __FLT_MAX__)
+            FLOAT_ARITH_CASES(D, dvalue, double, __DBL_MIN__, __DBL_MAX__)
+            COMPARE_CASES(I, ivalue)
+            COMPARE_CASES(S, svalue)
+            COMPARE_CASES(F, fvalue)
+            COMPARE_CASES(D, dvalue)
+
+        case BC_MOD_I:
+            if (R[i->c].ivalue == 0)
+            {
+                report_error("Modulo by zero");
+                R[i->a].ivalue = 0;
+            }
+            else
+            {
+                R[i->a].ivalue = R[i->b].ivalue % R[i->c].ivalue;
+            }
+            break;
+        case BC_UMOD_I:
+            if (R[i->c].ivalue == 0)
+            {
+                report_error("Modulo by zero");
+                R[i->a].ivalue = 0;
+            }
+            else
+            {
+                R[i->a].ivalue = (int)((unsigned)R[i->b].ivalue % (unsigned)R[i->c].ivalue);
+            }
+            break;
+        case BC_MOD_S:
+            R[i->a].svalue = R[i->b].svalue % R[i->c].svalue;
+            break;
+        case BC_ADDI_I:
+            R[i->a].ivalue = (int)((unsigned)R[i->b].ivalue + (unsigned)(int16_t)i->c);
+            break;
+        case BC_AND_I:
+            R[i->a].ivalue = R[i->b].ivalue && R[i->c].ivalue;
+            break;
+        case BC_OR_I:
+            R[i->a].ivalue = R[i->b].ivalue || R[i->c].ivalue;
+            break;
+        case BC_NOT_B:
+            R[i->a].bvalue = !R[i->b].bvalue;
+            break;
+
+            LOAD_ARRAY_CASE(LOADA_I, ivalue, int)
+            LOAD_ARRAY_CASE(LOADA_S, svalue, short)
+            LOAD_ARRAY_CASE(LOADA_F, fvalue, float)
+            LOAD_ARRAY_CASE(LOADA_D, dvalue, double)
+            LOAD_ARRAY_CASE(LOADA_B, bvalue, bool)
+            LOAD_ARRAY_CASE(LOADA_C, ivalue, char)
+            STORE_ARRAY_CASE(STOREA_I, ivalue, int)
+            STORE_ARRAY_CASE(STOREA_S, svalue, short)
+            STORE_ARRAY_CASE(STOREA_F, fvalue, float)
+            STORE_ARRAY_CASE(STOREA_D, dvalue, double)
+            STORE_ARRAY_CASE(STOREA_B, bvalue, bool)
+            STORE_ARRAY_CASE(STOREA_C, ivalue, char)
+
+        case BC_JMP:
+            pc += i->sbx;
+            if (i->sbx < 0)
+                note_hot(vm, function);
+            break;
+        case BC_JMPF:
+            if (!R[i->a].ivalue)
+            {
+                pc += i->sbx;
+                if (i->sbx < 0)
+                    note_hot(vm, function);
+            }
+            break;
+        case BC_JMPT:
+            if (R[i->a].ivalue)
+            {
+                pc += i->sbx;
+                if (i->sbx < 0)
+                    note_hot(vm, function);
+            }
+            break;
+        case BC_SWITCH:
+            pc = function->code + jump_table_target(&program->jump_tables[i->b], R[i->a].ivalue);
+            break;
+        case BC_KERNEL:
+            run_kernel(&program->kernels[i->a], R, R[i->b].ivalue);
+            break;
+
+            BRANCH_CASES(I, R[i->b].ivalue)
+            BRANCH_CASES(IK, (int16_t)i->b)
+        case BC_JMODZ_IK:
+            if (R[i->a].ivalue % (int16_t)i->b == 0)
+                TAKE_BRANCH;
+            break;
+        case BC_JMODNZ_IK:
+            if (R[i->a].ivalue % (int16_t)i->b != 0)
+                TAKE_BRANCH;
+            break;
+        case BC_ADDA_I:
+        {
+            const ArrayBinding *array = &program->arrays[i->a];
+            int index = R[i->b].ivalue;
+            if (check_index(array, index))
+            {
+                int *element = (int *)array->data + index;
+                *element = (int)((unsigned)*element + (unsigned)R[i->c].ivalue);
+            }
+            break;
+        }
+
+        case BC_CALL:
+        {
+            if (vm->frame_count >= VM_MAX_CALL_DEPTH)
+            {
+                report_error("Stack overflow");
+                brainrot_exit(EXIT_FAILURE);
+            }
+            GROW_ARRAY(vm->frames, vm->frame_count, vm->frame_capacity);
+            CallFrame *frame = &vm->frames[vm->frame_count++];
+            frame->function = function;
+            frame->pc = pc;
+            frame->base = base;
+            frame->result = i->a;
+
+            /* The callee's registers start at the first argument. */
+            function = &program->functions[i->b];
+            base += i->c;
+            ensure_stack(vm, base + function->register_count);
+            R = vm->stack + base;
+            pc = function->code;
+            note_hot(vm, function);
+            break;
+        }
+        case BC_RET:
+        case BC_RET0:
+        {
+            Register value;
+            if (i->op == BC_RET)
+                value = R[i->a];
+            else
+                memset(&value, 0, sizeof(value));
+            if (vm->frame_count == entry_depth)
+                return value;
+            CallFrame *frame = &vm->frames[--vm->frame_count];
+            function = frame->function;
+            pc = frame->pc;
+            base = frame->base;
+            R = vm->stack + base;
+            R[frame->result] = value;
+            break;
+        }
+
+        case BC_PRINT:
+            execute_print(program, &program->formats[i->a], R);
+            break;
+        case BC_BAKA_STR:
+            baka(i->b ? "%s\n" : "%s", program->strings[i->a]);
+            break;
+        case BC_BAKA_INT:
+            baka("%d\n", R[i->a].ivalue);
+            break;
+        case BC_SLORP_I:
+            R[i->a].ivalue = slorp_int(0);
+            break;
+        case BC_SLORP_S:
+            R[i->a].svalue = slorp_short(0);
+            break;
+        case BC_SLORP_F:
+            R[i->a].fvalue = slorp_float(0.0f);
+            break;
+        case BC_SLORP_D:
+            R[i->a].dvalue = slorp_double(0.0);
+            break;
+        case BC_SLORP_STR:
+        {
+            const ArrayBinding *array = &program->arrays[i->a];
+            char val[array->length];
+            slorp_string(val, sizeof(val));
+            strncpy(array->data, val, array->length - 1);
+            ((char *)array->data)[array->length - 1] = '\0';
+            break;
+        }
+        case BC_CHILL:
+            chill(i->sbx);
+            break;
+        case BC_RAGEQUIT:
+        {
+            ragequit(i->sbx);
+            break;
+        }
+        case BC_CONST_ERROR:
+            brainrot->line -= 2;
+            report_error("Cannot modify const variable");
+            brainrot_exit(EXIT_FAILURE);
+        case BC_HALT:
+        {
+            Register value;
+            memset(&value, 0, sizeof(value));
+            return value;
+        }
+        case BC_OPCODE_COUNT:
+            break;
+        }
+    }
+}
+
+void vm_execute(BytecodeProgram *program, int jit_threshold)
+{
+    VMState vm;
+    memset(&vm, 0, sizeof(vm));
+    vm.program = program;
+    vm.jit_threshold = jit_threshold;
+    /* A program that ends early frees its registers and frames on the way
+     * out to the caller's quit point. */
+    jmp_buf quit;
+    jmp_buf *enclosing = brainrot->quit;
+    if (setjmp(quit))
+    {
+        free_vm_state(&vm);
+        brainrot->quit = enclosing;
+        brainrot_exit(brainrot->exit_status);
+    }
+    brainrot->quit = &quit;
+    vm_run(&vm, &program->functions[0], 0);
+    brainrot->quit = enclosing;
+    free_vm_state(&vm);
+}
+
+/* CALL from native code: runs the callee and returns the caller's
+ * registers, which move if the callee grew the stack. */
+Register *vm_call_from_native(VMState *vm, Register *R, const Instruction *call)
+{
+    size_t base = R - vm->stack;
+    Register value = vm_run(vm, &vm->program->functions[call->b], base + call->c);
+    R = vm->stack + base;
+    R[call->a] = value;
+    return R;
+}
+
+int jump_target(const Instruction *i, int pc)
+{
+    switch ((Opcode)i->op)
+    {
+    case BC_JMP:
+    case BC_JMPF:
+    case BC_JMPT:
+        return pc + 1 + i->sbx;
+    default:
+        if (i->op >= BC_JLT_I && i->op <= BC_JMODNZ_IK)
+            return pc + 1 + (int16_t)i->c;
+        return -1;
+    }
+}
+
+int jump_table_target(const JumpTable *table, int value)
+{
+    int slot = case_table_slot(table->cases, value);
+    return slot >= 0 ? table->targets[slot] : table->miss;
+}
+
+void free_bytecode_program(BytecodeProgram *program)
+{
+    if (!program)
+        return;
+    for (int i = 0; i < program->function_count; i++)
+    {
+        free(program->functions[i].code);
+        jit_free(program->functions[i].native);
+    }
+    free(program->functions);
+    for (int i = 0; i < program->format_count; i++)
+    {
+        for (int j = 0; j < program->formats[i].segment_count; j++)
+            free(program->formats[i].segments[j].text);
+        free(program->formats[i].segments);
+    }
+    free(program->formats);
+    free(program->constants);
+    free(program->arrays);
+    free(program->strings);
+    for (int i = 0; i < program->jump_table_count; i++)
+        free(program->jump_tables[i].targets);
+    free(program->jump_tables);
+    free(program->kernels);
+    free(program);
+}
+
+void dump_bytecode_program(FILE *out, const BytecodeProgram *program)
+{
+    for (int f = 0; f < program->function_count; f++)
+    {
+        const BytecodeFunction *function = &program->functions[f];
+        fprintf(out, "function %s (%d params, %d registers)\n",
+                function->name, function->param_count, function->register_count);
+        for (int pc = 0; pc < function->code_length; pc++)
+        {
+            const Instruction *i = &function->code[pc];
+            fprintf(out, "  %04d  %-10s", pc, opcode_name(i->op));
+            switch ((Opcode)i->op)
+            {
+            case BC_LOADI:
+            case BC_LOADK:
+            case BC_CHILL:
+            case BC_RAGEQUIT:
+                fprintf(out, " %d %d", i->a, i->sbx);
+                break;
+            case BC_JMP:
+            case BC_JMPF:
+            case BC_JMPT:
+                fprintf(out, " %d -> %04d", i->a, jump_target(i, pc));
+                break;
+            case BC_SWITCH:
+            {
+                const JumpTable *table = &program->jump_tables[i->b];
+                fprintf(out, " %d table %d (%d entries, else -> %04d)", i->a, i->b,
+                        table->cases->count, table->miss);
+                break;
+            }
+            default:
+                if (jump_target(i, pc) >= 0)
+                {
+                    fprintf(out, " %d %d -> %04d", i->a,
+                            i->op >= BC_JLT_IK ? (int16_t)i->b : i->b, jump_target(i, pc));
+                    break;
+                }
+                fprintf(out, " %d %d %d", i->a, i->b, i->c);
+                break;
+            }
+            fputc('\n', out);
+        }
+    }
+}
@@ -0,0 +1,297 @@
+/* vm.h */
+
+#ifndef VM_H
+#define VM_H
+
+#include "ast.h"
+#include <stdint.h>
+
+/*
+ * Register-based bytecode for the Brainrot VM.
+ *
+ * Every register has a single static type decided by the compiler, so a
+ * register is just an untagged union. Instructions are typed: the suffix
+ * names the operand type (_I int, _S short, _F float, _D double, _B bool,
+ * _C char for array elements).
+ */
+
+typedef union
+{
+    int ivalue;
+    short svalue;
+    float fvalue;
+    double dvalue;
+    bool bvalue;
+} Register;
+
+/* X(name) list of every opcode, used for the enum and the disassembler. */
+#define BYTECODE_ARITH_OPS(X, T) \
+    X(ADD_##T)                   \
+    X(SUB_##T)                   \
+    X(MUL_##T)                   \
+    X(DIV_##T)                   \
+    X(MOD_##T)                   \
+    X(LT_##T)                    \
+    X(GT_##T)                    \
+    X(LE_##T)                    \
+    X(GE_##T)                    \
+    X(EQ_##T)                    \
+    X(NE_##T)                    \
+    X(NEG_##T)
+
+#define BYTECODE_CONVERSION_OPS(X) \
+    X(I2S) X(I2F) X(I2D) X(I2B)        \
+    X(S2I) X(S2F) X(S2D) X(S2B)        \
+    X(F2I) X(F2S) X(F2D) X(F2B)        \
+    X(D2I) X(D2S) X(D2F) X(D2B)        \
+    X(B2I) X(B2S) X(B2F) X(B2D)
+
+#define BYTECODE_ARRAY_OPS(X) \
+    X(LOADA_I) X(LOADA_S) X(LOADA_F) X(LOADA_D) X(LOADA_B) X(LOADA_C) \
+    X(STOREA_I) X(STOREA_S) X(STOREA_F) X(STOREA_D) X(STOREA_B) X(STOREA_C)
+
+/* Superinstructions for common statement shapes. The branches jump when
+ * register a compares true against register b (_I) or against the signed
+ * 16-bit immediate b (_IK), by the signed 16-bit offset c. */
+#define BYTECODE_FUSED_OPS(X)                                      \
+    X(JLT_I) X(JGT_I) X(JLE_I) X(JGE_I) X(JEQ_I) X(JNE_I)          \
+    X(JLT_IK) X(JGT_IK) X(JLE_IK) X(JGE_IK) X(JEQ_IK) X(JNE_IK)    \
+    X(JMODZ_IK)  /* jump if R[a] % b == 0 */                       \
+    X(JMODNZ_IK) /* jump if R[a] % b != 0 */                       \
+    X(ADDA_I)    /* int array a: element R[b] += R[c] */
+
+#define BYTECODE_OPS(X)           \
+    X(MOVE)                       \
+    X(LOADI)                      \
+    X(LOADK)                      \
+    BYTECODE_CONVERSION_OPS(X)    \
+    BYTECODE_ARITH_OPS(X, I)      \
+    BYTECODE_ARITH_OPS(X, S)      \
+    BYTECODE_ARITH_OPS(X, F)      \
+    BYTECODE_ARITH_OPS(X, D)      \
+    X(UMOD_I)                     \
+    X(ADDI_I)                     \
+    X(AND_I)                      \
+    X(OR_I)                       \
+    X(NOT_B)                      \
+    BYTECODE_ARRAY_OPS(X)         \
+    X(JMP)                        \
+    X(JMPF)                       \
+    X(JMPT)                       \
+    X(SWITCH)                     \
+    X(KERNEL)                     \
+    BYTECODE_FUSED_OPS(X)         \
+    X(CALL)                       \
+    X(RET)                        \
+    X(RET0)                       \
+    X(PRINT)                      \
+    X(BAKA_STR)                   \
+    X(BAKA_INT)                   \
+    X(SLORP_I)                    \
+    X(SLORP_S)                    \
+    X(SLORP_F)                    \
+    X(SLORP_D)                    \
+    X(SLORP_STR)                  \
+    X(CHILL)                      \
+    X(RAGEQUIT)                   \
+    X(CONST_ERROR)                \
+    X(HALT)
+
+#define BYTECODE_ENUM(name) BC_##name,
+typedef enum
+{
+    BYTECODE_OPS(BYTECODE_ENUM)
+    BC_OPCODE_COUNT
+} Opcode;
+#undef BYTECODE_ENUM
+
+/*
+ * Instruction layout: `a` is usually the destination register, `b` and `c`
+ * the sources. Jumps and immediates use the signed 32-bit `sbx` instead of
+ * `b`/`c`; jump offsets are relative to the following instruction.
+ */
+typedef struct
+{
+    uint16_t op;
+    uint16_t a;
+    union
+    {
+        struct
+        {
+            uint16_t b;
+            uint16_t c;
+        };
+        int32_t sbx;
+    };
+} Instruction;
+
+#define MAX_REGISTERS UINT16_MAX
+
+/* One piece of a precompiled yapping/yappin format string. */
+typedef enum
+{
+    FORMAT_TEXT,         /* literal text copied as is */
+    FORMAT_BOOL,         /* %b, prints W or L */
+    FORMAT_INT,          /* %d %i %c ... with an int */
+    FORMAT_SHORT,        /* integer specifier with a short */
+    FORMAT_USHORT,       /* integer specifier with an unsigned short */
+    FORMAT_FLOAT,        /* floating specifier with a float */
+    FORMAT_DOUBLE,       /* floating specifier with a double */
+    FORMAT_STRING,       /* %s with a string literal */
+    FORMAT_ARRAY_STRING, /* %s with a char array */
+    FORMAT_ARRAY_FLOAT,  /* floating specifier with a float array element */
+    FORMAT_ARRAY_DOUBLE, /* floating specifier with a double array element */
+} FormatKind;
+
+typedef struct
+{
+    FormatKind kind;
+    char *text;     /* literal text or printf specifier */
+    uint16_t reg;   /* value register, or index register for array elements */
+    uint16_t index; /* array table index, or string table index for FORMAT_STRING */
+} FormatSegment;
+
+typedef enum
+{
+    PRINT_YAPPING, /* brainrot->out with trailing newline */
+    PRINT_YAPPIN,  /* brainrot->out */
+} PrintTarget;
+
+typedef struct
+{
+    PrintTarget target;
+    FormatSegment *segments;
+    int segment_count;
+    int segment_capacity;
+} PrintFormat;
+
+/* Arrays live in the global scope from parse time on, so the compiler binds
+ * their storage directly. */
+typedef struct
+{
+    char *name;
+    VarType type;
+    void *data;
+    int length;
+    TypeModifiers modifiers;
+} ArrayBinding;
+
+/* Where a SWITCH on R[a] goes: the switch's case table, borrowed from the
+ * AST, with the instruction each entry starts at. */
+typedef struct
+{
+    const CaseTable *cases;
+    int *targets; /* parallel to cases->entries; -1 in a gap */
+    int miss;     /* instruction for a value no case has */
+} JumpTable;
+
+/* A scalar a loop kernel reads or writes, bound by name from its register
+ * while the kernel runs */
+typedef struct
+{
+    const char *name;
+    VarType type;
+    TypeModifiers modifiers;
+    uint16_t reg;
+} KernelScalar;
+
+/* What KERNEL a b runs: loop kernels[a], up to the bound in R[b]. The
+ * kernel is the tree-walker's (see idiom.c and vectorize.c), given the
+ * counter's range at once; the loop compiled after KERNEL then finds
+ * itself done, or runs whatever the kernel left. scalars[0] is the
+ * counter. */
+typedef struct
+{
+    ASTNode *loop; /* borrowed from the AST */
+    KernelScalar scalars[VECTOR_MAX_STEPS + 1];
+    int scalar_count;
+} LoopKernel;
+
+typedef struct NativeFunction NativeFunction;
+
+typedef struct
+{
+    char *name;
+    VarType return_type;
+    int param_count;
+    int register_count;
+    Instruction *code;
+    int code_length;
+    int code_capacity;
+    uint32_t hotness;      /* entries plus backward jumps taken */
+    bool jit_attempted;    /* jit_compile() ran, whether or not it succeeded */
+    NativeFunction *native; /* machine code from jit.c, or NULL */
+} BytecodeFunction;
+
+typedef struct
+{
+    BytecodeFunction *functions; /* functions[0] is `skibidi main` */
+    int function_count;
+    Register *constants;
+    int constant_count;
+    int constant_capacity;
+    ArrayBinding *arrays;
+    int array_count;
+    int array_capacity;
+    PrintFormat *formats;
+    int format_count;
+    int format_capacity;
+    char **strings; /* borrowed from the AST */
+    int string_count;
+    int string_capacity;
+    JumpTable *jump_tables; /* indexed by SWITCH's b */
+    int jump_table_count;
+    int jump_table_capacity;
+    LoopKernel *kernels; /* indexed by KERNEL's a */
+    int kernel_count;
+    int kernel_capacity;
+} BytecodeProgram;
+
+/* compiler.c */
+
+/* Statement shapes compile_to_bytecode() may fuse into superinstructions */
+#define FUSE_INCREMENT (1u << 0)  /* x + k and x - k with a literal k: ADDI_I */
+#define FUSE_COMPARE (1u << 1)    /* int comparisons in conditions: J*_I, J*_IK */
+#define FUSE_MODULO (1u << 2)     /* x % k == 0 and x % k != 0: JMODZ_IK, JMODNZ_IK */
+#define FUSE_ACCUMULATE (1u << 3) /* a[i] = a[i] + k: ADDA_I */
+#define FUSE_ALL (FUSE_INCREMENT | FUSE_COMPARE | FUSE_MODULO | FUSE_ACCUMULATE)
+
+BytecodeProgram *compile_to_bytecode(ASTNode *root, unsigned fuse, const char **reason);
+/* Parses a comma-separated list of shape names (increment, compare, modulo,
+ * accumulate) into FUSE_ flags; false on an unknown name. */
+bool parse_fuse_names(const char *names, unsigned *flags);
+
+/* vm.c */
+#define JIT_DEFAULT_THRESHOLD 100 /* hotness at which a function is compiled */
+#define JIT_DISABLED -1
+
+struct VMState;
+
+void vm_execute(BytecodeProgram *program, int jit_threshold);
+Register *vm_call_from_native(struct VMState *vm, Register *R, const Instruction *call);
+void free_bytecode_program(BytecodeProgram *program);
+void dump_bytecode_program(FILE *out, const BytecodeProgram *program);
+const char *opcode_name(Opcode op);
+/* Index of the instruction a jump at `pc` may go to, or -1 for anything
+ * that is not a jump. */
+int jump_target(const Instruction *i, int pc);
+/* Index of the instruction a SWITCH on `value` goes to. */
+int jump_table_target(const JumpTable *table, int value);
+
+/*
+ * jit.c: x86-64 machine code for hot bytecode functions. Native code works
+ * on the VM's register file in memory and has an entry point for every
+ * instruction, so the VM can switch to it in the middle of a loop. It
+ * returns the index of the first instruction it cannot run itself (a
+ * return, a print, slorp, ...); the VM executes that one and carries on.
+ */
+bool jit_compile(const BytecodeProgram *program, BytecodeFunction *function);
+int jit_run(const NativeFunction *native, struct VMState *vm, Register *R, int pc);
+void jit_free(NativeFunction *native);
+
+/* emit_c.c: the program as a standalone C translation unit, and an
+ * executable built from it with the system C compiler ($CC, or cc). */
+void emit_c_program(FILE *out, const BytecodeProgram *program);
+bool build_native(const BytecodeProgram *program, const char *output);
+
+#endif /* VM_H */